@@ -1,12 +1,9 @@
 #pragma once
 
 #include <concepts>
-#include <map>
+#include <cstdint>
 #include <optional>
-#include <ranges>
-#include <set>
 #include <stdexcept>
-#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -14,14 +11,71 @@
 
 namespace target {
 
-struct FirstLastUse {
-    std::map<int, int> firstUse = {};
-    std::map<int, int> lastUse = {};
+// marks a virtual register that is never used
+const int no_register = -1;
+
+// what the allocator had to do to fit a frame into register_file
+struct AllocationStats {
+    // live intervals sent to a stack slot, and how many of those were split
+    int spilled = 0;
+    int split = 0;
+    // loads / stores of spill slots inserted around uses and definitions
+    int reloads = 0;
+    int stores = 0;
+    // uses of a spilled constant recomputed with a LoadI instead of a reload
+    int rematerialized = 0;
+    // register to register copies removed because both sides share a register
+    int coalesced = 0;
+};
+
+enum class RegisterAllocator {
+    // single pass over live intervals in program order, the default
+    LinearScan,
+    // iterated register coalescing over an interference graph, slower to
+    // run but coalesces moves into hardcoded registers and spills by cost
+    Graph,
+};
+
+// the live range of every virtual register as [start, end] instruction
+// indices, plus the index of every instruction that mentions it. Indexed by
+// virtual register id, which the lowering hands out densely.
+struct LiveIntervals {
+    // the range covers every block the register is live in or out of
+    std::vector<int> start = {};
+    std::vector<int> end = {};
+    // the widest size any mention gives the register, 0 when none does
+    std::vector<int> size = {};
+    // use positions of register v are usePositions[useOffset[v] ..
+    // useOffset[v + 1])
+    std::vector<int> useOffset = {};
+    std::vector<int> usePositions = {};
+    // the register is already live where its range starts, it flows in
+    // over a back edge rather than being defined there
+    std::vector<bool> liveOnEntry = {};
+    // hardcoded registers live after each instruction, bit i for
+    // register_file[i]
+    std::vector<std::uint32_t> fixedLive = {};
+};
+
+// a spilled interval keeps its register before spillAt and lives in a
+// stack slot from spillAt on
+struct SpillDecisions {
+    std::vector<int> spillAt = {};
+    int count = 0;
 };
 
-[[nodiscard]] auto getFirstUse(const Frame& frame) -> FirstLastUse;
-[[nodiscard]] auto remap(Frame& frame)
-    -> std::map<VirtualRegister, VirtualRegister>;
-[[nodiscard]] auto rewrite(const std::vector<Frame>& frames)
-    -> std::vector<Frame>;
+[[nodiscard]] auto virtualRegisterCount(const Frame& frame) -> int;
+[[nodiscard]] auto computeLiveIntervals(const Frame& frame) -> LiveIntervals;
+void insertSpillCode(Frame& frame, const LiveIntervals& intervals,
+                     const SpillDecisions& decisions, AllocationStats& stats);
+// allocates register_file by iterated register coalescing, rbp only when
+// the frame does not need it as frame pointer
+void colorGraph(Frame& frame, AllocationStats& stats, bool framePointer = true);
+// With omitFramePointer, frames that push no call arguments address their
+// slots from rsp and get rbp as one more general register.
+[[nodiscard]] auto rewrite(
+    std::vector<Frame> frames, AllocationStats& stats,
+    RegisterAllocator allocator = RegisterAllocator::LinearScan,
+    bool omitFramePointer = false) -> std::vector<Frame>;
+[[nodiscard]] auto rewrite(std::vector<Frame> frames) -> std::vector<Frame>;
 }  // namespace target
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "assem.hpp"
+#include "cfg.hpp"
+
+namespace qa_ir {
+
+// the analyses FrameAnalyses keeps
+enum class Analysis : std::uint8_t {
+    CFG = 1U << 0U,
+    Dominators = 1U << 1U,
+    DominanceFrontiers = 1U << 2U,
+    PostDominators = 1U << 3U,
+    Loops = 1U << 4U,
+};
+
+// The analyses a pass left valid. The CFG holds where every block starts
+// and ends, which any operation added or removed moves. The others only
+// name blocks by their index, so they outlive the CFG when a pass keeps the
+// blocks, their order and their edges. Frontiers and loops are derived from
+// the dominator tree and go with it.
+class PreservedAnalyses {
+   public:
+    [[nodiscard]] static PreservedAnalyses All();
+    [[nodiscard]] static PreservedAnalyses None();
+    // what a pass that keeps the blocks and edges but not the operations in
+    // them preserves, all but the CFG
+    [[nodiscard]] static PreservedAnalyses Blocks();
+
+    PreservedAnalyses& Preserve(Analysis analysis);
+    [[nodiscard]] bool Preserves(Analysis analysis) const;
+
+   private:
+    std::uint8_t bits = 0;
+};
+
+// Computes the analyses of one normalized frame on first request and keeps
+// them until Invalidate drops them. The frame is held by reference, so a
+// pass that changes it must say what it preserved.
+class FrameAnalyses {
+   public:
+    explicit FrameAnalyses(const Frame& frame) : frame(&frame) {}
+
+    [[nodiscard]] const ControlFlowGraph& CFG();
+    [[nodiscard]] const DominatorTree& Dominators();
+    [[nodiscard]] const std::vector<std::vector<int>>& Frontiers();
+    [[nodiscard]] const DominatorTree& PostDominators();
+    [[nodiscard]] const LoopForest& Loops();
+
+    void Invalidate(const PreservedAnalyses& preserved);
+    // how many analyses were computed so far, cached ones count once
+    [[nodiscard]] int Computations() const { return computations; }
+
+   private:
+    const Frame* frame;
+    int computations = 0;
+    std::optional<ControlFlowGraph> cfg = std::nullopt;
+    std::optional<DominatorTree> dominators = std::nullopt;
+    std::optional<std::vector<std::vector<int>>> frontiers = std::nullopt;
+    std::optional<DominatorTree> postDominators = std::nullopt;
+    std::optional<LoopForest> loops = std::nullopt;
+};
+}  // namespace qa_ir
\ No newline at end of file
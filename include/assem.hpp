@@ -60,4 +60,9 @@ CondJ GenerateConditionalIR(std::vector<Operation>& ins,
 [[nodiscard]] std::vector<Frame> Produce_IR(
     const std::vector<std::unique_ptr<ast::Node>>& nodes);
 
+// Produce_IR opens a frame with a MovR or DefineStackPushed per parameter
+[[nodiscard]] bool IsParameter(const Operation& op);
+// the parameters of a frame in the order calls pass them
+[[nodiscard]] std::vector<Variable> FrameParameters(const Frame& frame);
+
 }  // namespace qa_ir
\ No newline at end of file
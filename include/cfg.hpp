@@ -0,0 +1,130 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+class FrameAnalyses;
+
+// Hands out temps and labels that no operation of a frame uses yet.
+class FreshNames {
+   public:
+    explicit FreshNames(const Frame& frame);
+
+    [[nodiscard]] Temp NewTemp(int size);
+    [[nodiscard]] Label NewLabel();
+
+   private:
+    int nextTemp = 0;
+    int nextLabel = 0;
+};
+
+struct BasicBlock {
+    // name of the LabelDef that opens the block
+    std::string label;
+    // the block is frame.instructions[begin, end)
+    int begin;
+    int end;
+    std::vector<int> successors = {};
+    std::vector<int> predecessors = {};
+};
+
+struct ControlFlowGraph {
+    // blocks in instruction order, the entry block first
+    std::vector<BasicBlock> blocks = {};
+    std::map<std::string, int> blockOf = {};
+};
+
+// Gives every basic block an opening LabelDef and drops the blocks that no
+// path from the entry reaches, so that a ControlFlowGraph covers the frame.
+// Phis lose the arguments of blocks that no longer branch to them. Returns
+// whether a block was labelled or dropped, which moves the blocks of the
+// ControlFlowGraph.
+bool NormalizeBlocks(Frame& frame, FreshNames& names);
+// the frame must be normalized
+[[nodiscard]] ControlFlowGraph BuildCFG(const Frame& frame);
+// where operations added to the end of a block go, ahead of its terminator
+// and the Compare a conditional jump reads
+[[nodiscard]] int InsertionPoint(const Frame& frame, const BasicBlock& block);
+
+struct DominatorTree {
+    // immediate dominator of every block, the entry is its own
+    std::vector<int> idom = {};
+    std::vector<std::vector<int>> children = {};
+    // blocks in reverse postorder of a depth first walk from the entry
+    std::vector<int> reversePostorder = {};
+    // when a depth first walk of the tree enters and leaves each block, -1
+    // for blocks the entry does not reach
+    std::vector<int> enter = {};
+    std::vector<int> exit = {};
+};
+
+// Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder
+[[nodiscard]] DominatorTree ComputeDominators(const ControlFlowGraph& cfg);
+// The same over the reversed edges. The tree has one node more than cfg has
+// blocks, the exit every block without successors leads to, which is the
+// root. Blocks that never reach it, like those of an endless loop, have no
+// immediate post-dominator.
+[[nodiscard]] DominatorTree ComputePostDominators(const ControlFlowGraph& cfg);
+[[nodiscard]] std::vector<std::vector<int>> DominanceFrontiers(
+    const ControlFlowGraph& cfg, const DominatorTree& tree);
+// whether every path from the root of the tree to b passes a, in constant
+// time
+[[nodiscard]] bool Dominates(const DominatorTree& tree, int a, int b);
+
+// the natural loop of the back edges into one header
+struct Loop {
+    int header;
+    // every block of the loop, the header included, in instruction order
+    std::vector<int> blocks = {};
+    // the blocks branching back to the header
+    std::vector<int> latches = {};
+
+    [[nodiscard]] bool contains(int b) const;
+};
+
+// loops with fewer blocks first, so an inner loop comes before the loops
+// around it
+[[nodiscard]] std::vector<Loop> FindNaturalLoops(const ControlFlowGraph& cfg,
+                                                 const DominatorTree& tree);
+// the loops of a frame nested into each other
+struct LoopForest {
+    // as FindNaturalLoops returns them, inner loops first
+    std::vector<Loop> loops = {};
+    // the innermost loop around each loop, -1 for the outermost ones
+    std::vector<int> parent = {};
+    std::vector<std::vector<int>> children = {};
+    // the innermost loop of every block, -1 outside of all loops
+    std::vector<int> loopOf = {};
+    // how many loops contain each block
+    std::vector<int> depth = {};
+};
+
+[[nodiscard]] LoopForest BuildLoopForest(const ControlFlowGraph& cfg,
+                                         const DominatorTree& tree);
+// Returns the label of the block that every entry into the loop passes right
+// before the header. A lone predecessor outside the loop that only continues
+// at the header serves, otherwise a new block is put in front of the header
+// and takes over the entering branches and phi arguments. cfg no longer
+// describes the frame once a block was added.
+[[nodiscard]] std::string EnsurePreheader(Frame& frame, FreshNames& names,
+                                          const ControlFlowGraph& cfg,
+                                          const Loop& loop);
+
+// gets the index of a loop in analyses.Loops() and the label of its
+// preheader, returns whether it changed the frame
+using LoopVisitor = std::function<bool(int, const std::string&)>;
+// Visits every loop a normalized frame has on entry once, inner loops
+// before the loops around them, after giving it a preheader. The loops
+// are only found again when a preheader was added or visit changed the
+// frame, and those it added are left alone. The entry block has no
+// predecessor to put a preheader in, so a loop it heads is skipped.
+void ForEachLoop(Frame& frame, FreshNames& names, FrameAnalyses& analyses,
+                 const LoopVisitor& visit);
+}  // namespace qa_ir
\ No newline at end of file
@@ -5,5 +5,13 @@
 #include "assem.hpp"
 
 namespace codegen {
-[[nodiscard]] std::string Generate(const std::vector<target::Frame>& frames);
+
+struct FrameOptions {
+    // -fomit-frame-pointer: frames that push no call arguments address
+    // their slots from rsp and leave rbp to the register allocator
+    bool omitFramePointer = false;
+};
+
+[[nodiscard]] std::string Generate(const std::vector<target::Frame>& frames,
+                                   const FrameOptions& options = {});
 }
\ No newline at end of file
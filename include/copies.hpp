@@ -0,0 +1,20 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Replaces every temp defined by a Mov of another temp of the same size, or
+// by a phi whose arguments all agree, with what it copies and removes the
+// copy. The frame must be in SSA form. Returns the number of operations
+// removed.
+int PropagateCopies(Frame& frame);
+
+// Merges the two temps of a Mov whenever their live ranges don't overlap,
+// so the Mov becomes a copy of a temp to itself and is removed. Meant for
+// the copies DestructSSA leaves for phis. Live ranges are read off the CFG
+// in analyses. Returns the number of Movs removed.
+int CoalesceCopies(Frame& frame, FrameAnalyses& analyses);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Removes the blocks no path from the entry reaches (including whatever
+// follows a Ret or Jump in its block), stores to variables whose address is
+// never taken and that are never read, and the pure operations whose temps
+// nothing live reads. Calls are kept for their side effects even when their
+// result is unused. Only dropping blocks drops the analyses of the block
+// graph. Returns the number of operations removed.
+int EliminateDeadCode(Frame& frame, FrameAnalyses& analyses);
+
+// Removes Jumps to the label right after them and blocks that do nothing but
+// continue at another block, retargeting the branches into them. Blocks
+// continuing at a block with phis are kept. Conditional jumps left with one
+// target become a Jump and labels only reached by falling through are
+// dropped. Returns the number of operations removed.
+int SimplifyControlFlow(Frame& frame);
+}  // namespace qa_ir
\ No newline at end of file
@@ -1,3 +1,34 @@
 #pragma once
 
-[[nodiscard]] int runfile(const char* sourcefile, const std::string& outfile);
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "allocator.hpp"
+#include "inline.hpp"
+#include "pass_manager.hpp"
+#include "unroll.hpp"
+
+struct Options {
+    // print what the register allocator did for every compiled file
+    bool stats = false;
+    target::RegisterAllocator allocator =
+        target::RegisterAllocator::LinearScan;
+    // -funroll-loops and -unroll-count=N
+    qa_ir::UnrollOptions unroll = {};
+    // -finline-limit=N
+    qa_ir::InlineOptions inlining = {};
+    // -fomit-frame-pointer
+    bool omitFramePointer = false;
+    // -O0, -O1, -O2 or -Os
+    passes::OptLevel level = passes::OptLevel::O2;
+    // -passes=a,b,c runs these instead of the passes of the level
+    std::optional<std::vector<std::string>> pipeline = std::nullopt;
+    // -print-after=pass, once per pass to dump
+    std::vector<std::string> printAfter = {};
+    // -time-passes
+    bool timePasses = false;
+};
+
+[[nodiscard]] int runfile(const char* sourcefile, const std::string& outfile,
+                          const Options& options = {});
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Dominator based global value numbering over a frame in SSA form. Walking
+// the dominator tree, every arithmetic, comparison, Addr and load is hashed
+// by its opcode and the value numbers of its operands, and an operation
+// computing a value an earlier, dominating one already holds becomes a Mov of
+// that value. Loads through a pointer or from a variable left in memory are
+// only reused while no DerefStore, Call or store to such a variable can have
+// run in between. Replacements keep their place, so the analyses stay
+// valid. Returns the number of operations replaced.
+int NumberValues(Frame& frame, FrameAnalyses& analyses);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "cfg.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// constant plus the sum of coefficient * temp over terms, where none of the
+// temps changes in the loop
+struct Invariant {
+    int constant = 0;
+    // (coefficient, temp) ordered by temp id, no coefficient is 0
+    std::vector<std::pair<int, Temp>> terms = {};
+};
+
+// a header phi that starts at init and grows by step on every trip
+struct BasicInduction {
+    Temp phi;
+    Invariant init;
+    Invariant step;
+    // the value the latch hands back to the phi
+    Temp next;
+};
+
+// a temp that holds scale * basics[basic].phi + offset on every trip
+struct DerivedInduction {
+    Temp value;
+    int basic;
+    int scale;
+    Invariant offset;
+    // index of the operation defining it
+    int definition;
+};
+
+struct Inductions {
+    std::vector<BasicInduction> basics = {};
+    // in the order their definitions are reached
+    std::vector<DerivedInduction> derived = {};
+};
+
+// a + sign * b
+[[nodiscard]] Invariant AddInvariants(const Invariant& a, const Invariant& b,
+                                      int sign = 1);
+
+// k * a
+[[nodiscard]] Invariant ScaleInvariant(Invariant a, int k);
+
+// Appends the operations computing sum to code and returns where the result
+// is. Fails rather than spend more than a few Adds on a term.
+[[nodiscard]] std::optional<Value> MaterializeInvariant(
+    const Invariant& sum, int size, FreshNames& names,
+    std::vector<Operation>& code);
+
+// Finds the induction variables of a loop in SSA form with a single latch,
+// built from Add, Sub and Mov. preheader is the label EnsurePreheader gave.
+[[nodiscard]] Inductions FindInductionVariables(const Frame& frame,
+                                                const ControlFlowGraph& cfg,
+                                                const DominatorTree& tree,
+                                                const Loop& loop,
+                                                const std::string& preheader);
+
+struct HeaderPhi {
+    Temp phi;
+    Value entry;
+    // what the latch hands back
+    Value next;
+};
+
+// a loop that only leaves from its header, which ends by comparing a basic
+// induction variable with another value
+struct CountedLoop {
+    std::vector<HeaderPhi> phis = {};
+    // the header is its phis, [first, test), the Compare at test and a
+    // conditional jump
+    int first = 0;
+    int test = 0;
+    std::string body = {};
+    std::string exit = {};
+    std::string latch = {};
+    BasicInduction counter = {};
+    // the operand of the Compare the counter is, 0 for the left one
+    int side = 0;
+};
+
+[[nodiscard]] std::optional<CountedLoop> FindCountedLoop(
+    const Frame& frame, const ControlFlowGraph& cfg, const DominatorTree& tree,
+    const Loop& loop, const std::string& preheader);
+
+// How many times a counted loop runs its body, when that is a compile time
+// constant. Fails for a counter that would leave the int range first.
+[[nodiscard]] std::optional<int> ConstantTripCount(const Frame& frame,
+                                                   const CountedLoop& loop);
+
+// Strength reduction and linear function test replacement on the loops of a
+// frame in SSA form. A derived induction variable that adds a basic one to
+// itself becomes a phi of its own stepped by a single Add, and a basic
+// induction variable only kept for the exit test is dropped after the test
+// is rewritten on another one of the loop. Returns the number of induction
+// variables reduced or removed.
+int ReduceInductionVariables(Frame& frame, FrameAnalyses& analyses);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+struct InlineOptions {
+    // callees of at most this many operations are inlined at every call,
+    // 0 turns inlining off. -finline-limit=N
+    int limit = 16;
+};
+
+// Inlines calls between the frames of a program, callees first, so a frame
+// is inlined with the calls it makes already inlined. A callee is inlined
+// when it is no larger than options.limit or when only one call site in the
+// program calls it. Calls that recurse, directly or through other frames,
+// are kept. The callee's temps, labels and variables are renamed apart, its
+// parameters are assigned the arguments and every Ret becomes a jump to the
+// operations after the call. Frames other than main that nothing calls
+// anymore are dropped. Runs before ConstructSSA. Returns the number of calls
+// inlined.
+int InlineCalls(std::vector<Frame>& frames, const InlineOptions& options);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "lower_ir.hpp"
+#include "qa_ir.hpp"
+
+namespace target {
+
+// counts the reads and writes of every temp of frame into ctx.temp_reads
+// and ctx.temp_writes
+void CountTempUses(const qa_ir::Frame& frame, Ctx& ctx);
+
+// Tree-pattern instruction selection for Add, Sub and the Movs of their
+// results. The operation at ops[i] is a tree with its operands as leaves,
+// or, when ops[i] defines a temp only ops[i + 1] reads, the subtree of
+// ops[i + 1]. A table of tiles covers such trees with x86 forms at a cost
+// in instructions: inc and dec, immediates, lea, stack slots and pointers
+// as memory operands. The cheapest cover is emitted when it beats lowering
+// each operation by itself. Needs CountTempUses for the frame. Returns the
+// number of operations covered, 0 when ops[i] is left to LowerInstruction.
+[[nodiscard]] std::size_t SelectTiles(const std::vector<qa_ir::Operation>& ops,
+                                      std::size_t i, Ctx& ctx, Emitter& out);
+}  // namespace target
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+struct LayoutOptions {
+    // mark the top of every innermost loop to be aligned, which pads the
+    // code in front of it
+    bool alignLoops = true;
+};
+
+// Reorders the blocks of a frame out of SSA form so that the likely
+// successor of a block follows it and lowering leaves its branch out.
+// Without profiles, edges are weighed by static heuristics: a block in n
+// loops runs 8^n times as often, branches back to a loop header or staying
+// in the loop are taken, branches out of a loop or to a block that returns
+// while the other way goes on are not. Chains are grown along the heaviest
+// edges first, as Pettis and Hansen do, and laid out after the entry chain
+// by how strongly the placed blocks branch into them, chains that only
+// return last. With options.alignLoops, the first block of every innermost
+// loop is marked to be aligned.
+//
+// The frame is normalized first, which drops the analyses only when it
+// labels or removes a block. Returns the number of blocks that follow
+// another block than they did.
+int PlaceBlocks(Frame& frame, FrameAnalyses& analyses,
+                const LayoutOptions& options);
+}  // namespace qa_ir
\ No newline at end of file
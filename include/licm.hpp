@@ -0,0 +1,21 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Loop invariant code motion over the natural loops of a frame in SSA form,
+// inner loops first. Arithmetic, comparisons and Addr whose operands don't
+// change in the loop move to its preheader. So do loads of variables left in
+// memory that nothing in the loop may store to, and loads through a pointer
+// when the loop stores nowhere and they run on every trip through it.
+//
+// In a loop without calls or pointer accesses, a variable left in memory
+// whose address the loop doesn't take is kept in temps instead: it is loaded
+// once in the preheader, merged with the values of the latches by a phi in
+// the header and stored once on every edge leaving the loop. Returns the
+// number of operations moved out of loops.
+int HoistLoopInvariants(Frame& frame, FrameAnalyses& analyses);
+}  // namespace qa_ir
\ No newline at end of file
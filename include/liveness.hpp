@@ -0,0 +1,105 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "qa_x86.hpp"
+
+namespace target {
+
+// Dense set over [0, size). Liveness keeps one per basic block, so the
+// dataflow equations are word-wise and/or/not.
+class BitSet {
+   public:
+    BitSet() = default;
+    explicit BitSet(int size) : words((size + 63) / 64, 0) {}
+
+    [[nodiscard]] bool test(int i) const {
+        return (words[i / 64] >> (i % 64)) & 1U;
+    }
+    void set(int i) { words[i / 64] |= std::uint64_t{1} << (i % 64); }
+    void reset(int i) { words[i / 64] &= ~(std::uint64_t{1} << (i % 64)); }
+
+    // this |= other, returns whether a bit was added
+    bool unite(const BitSet& other) {
+        std::uint64_t added = 0;
+        for (std::size_t w = 0; w < words.size(); w++) {
+            added |= other.words[w] & ~words[w];
+            words[w] |= other.words[w];
+        }
+        return added != 0;
+    }
+
+    // this |= gen | (through & ~kill), returns whether a bit was added
+    bool uniteTransfer(const BitSet& gen, const BitSet& through,
+                       const BitSet& kill) {
+        std::uint64_t added = 0;
+        for (std::size_t w = 0; w < words.size(); w++) {
+            const auto next =
+                gen.words[w] | (through.words[w] & ~kill.words[w]);
+            added |= next & ~words[w];
+            words[w] |= next;
+        }
+        return added != 0;
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (std::size_t w = 0; w < words.size(); w++) {
+            for (auto bits = words[w]; bits != 0; bits &= bits - 1) {
+                f(static_cast<int>(w * 64) + std::countr_zero(bits));
+            }
+        }
+    }
+
+   private:
+    std::vector<std::uint64_t> words = {};
+};
+
+// Registers as dataflow nodes: node i < register_file_size is the hardcoded
+// register register_file[i], node register_file_size + v is virtual register
+// v.
+[[nodiscard]] int register_file_index(BaseRegister reg);
+[[nodiscard]] int node_of(const Register& reg);
+
+// the nodes an instruction reads and writes. clobbers are written without
+// being named by the instruction, so they never interfere with its own dst.
+struct Operands {
+    std::vector<int> uses = {};
+    std::vector<int> defs = {};
+    std::uint32_t clobbers = 0;
+};
+
+// the frame cut into basic blocks at labels and after jumps
+struct ControlFlowGraph {
+    // block b covers instructions [blockStart[b], blockStart[b + 1])
+    std::vector<int> blockStart = {};
+    std::vector<int> blockOf = {};
+    std::vector<std::vector<int>> successors = {};
+    // param registers written for the arguments of each Call and TailCall
+    std::vector<std::uint32_t> callArguments = {};
+    // number of backward jumps whose range covers each instruction
+    std::vector<int> loopDepth = {};
+
+    [[nodiscard]] int blocks() const {
+        return static_cast<int>(successors.size());
+    }
+};
+
+[[nodiscard]] auto buildControlFlowGraph(const Frame& frame)
+    -> ControlFlowGraph;
+void collectOperands(const Instruction& ins, std::uint32_t callArguments,
+                     Operands& operands);
+
+struct Liveness {
+    // nodes live on entry to / exit from every block
+    std::vector<BitSet> liveIn = {};
+    std::vector<BitSet> liveOut = {};
+};
+
+// backward dataflow over the blocks of cfg for every node of frame
+[[nodiscard]] auto computeLiveness(const Frame& frame,
+                                   const ControlFlowGraph& cfg, int nodes)
+    -> Liveness;
+}  // namespace target
\ No newline at end of file
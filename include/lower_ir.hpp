@@ -2,21 +2,42 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "assem.hpp"
 #include "qa_ir.hpp"
 #include "qa_x86.hpp"
 
 namespace target {
+
+// Sink that the LowerInstruction overloads append into. LowerIR reserves one
+// buffer per frame, so lowering an operation never builds a temporary vector.
+class Emitter {
+   public:
+    explicit Emitter(std::vector<Instruction>& buffer) : buffer(buffer) {}
+
+    template <typename T>
+    void emit(T&& instruction) {
+        buffer.emplace_back(std::forward<T>(instruction));
+    }
+
+   private:
+    std::vector<Instruction>& buffer;
+};
+
 struct Ctx {
    public:
     std::map<std::string, StackLocation> variable_offset = {};
     std::map<int, VirtualRegister> temp_register_mapping = {};
-    [[nodiscard]] Location AllocateNew(qa_ir::Value v);
+    // how often the frame being lowered reads and writes each temp, by id.
+    // Kept here so lowering a frame again reuses their storage.
+    std::vector<int> temp_reads = {};
+    std::vector<int> temp_writes = {};
+    [[nodiscard]] Location AllocateNew(const qa_ir::Value& v);
     [[nodiscard]] Register AllocateNewForTemp(qa_ir::Temp t);
     [[nodiscard]] VirtualRegister NewRegister(int size);
-    [[nodiscard]] std::vector<Instruction> toLocation(Location l,
-                                                      qa_ir::Value v);
+    void toLocation(Location l, const qa_ir::Value& v, Emitter& out);
     [[nodiscard]] int get_stack_offset() const;
 
     void define_stack_pushed_variable(const std::string& name);
@@ -26,9 +47,9 @@ struct Ctx {
     int stackOffset = 0;
     int stackPassedParameterOffset = 16;
 };
-[[nodiscard]] auto LowerInstruction(qa_ir::ConditionalJumpLess cj, Ctx& ctx)
-    -> std::vector<Instruction>;
-[[nodiscard]] auto LowerInstruction(qa_ir::LabelDef label, Ctx& ctx)
-    -> std::vector<Instruction>;
+void LowerInstruction(const qa_ir::ConditionalJumpLess& cj, Ctx& ctx,
+                      Emitter& out);
+void LowerInstruction(const qa_ir::LabelDef& label, Ctx& ctx, Emitter& out);
+void LowerFrame(const qa_ir::Frame& frame, Ctx& ctx, Emitter& out);
 [[nodiscard]] std::vector<Frame> LowerIR(const std::vector<qa_ir::Frame>& ops);
-}  // namespace target
\ No newline at end of file
+}  // namespace target
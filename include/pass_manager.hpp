@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <set>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "inline.hpp"
+#include "layout.hpp"
+#include "peephole.hpp"
+#include "unroll.hpp"
+
+namespace passes {
+
+enum class OptLevel { O0, O1, O2, Os };
+
+// what the passes read besides the frames
+struct PassOptions {
+    qa_ir::UnrollOptions unroll = {};
+    qa_ir::InlineOptions inlining = {};
+    qa_ir::LayoutOptions layout = {};
+};
+
+// The IR a pass runs on. SSA passes run between ConstructSSA and
+// DestructSSA, which the manager inserts where the form changes.
+enum class Form { Plain, SSA, Machine };
+
+struct PassContext {
+    const PassOptions& options;
+    // of the frame the pass runs on, unused by machine passes
+    qa_ir::FrameAnalyses* analyses;
+    target::PeepholeStats& peephole;
+};
+
+// every pass returns how much it changed, which -stats prints
+using ProgramPass = int (*)(std::vector<qa_ir::Frame>&, const PassOptions&);
+using FramePass = int (*)(qa_ir::Frame&, PassContext&);
+using MachinePass = int (*)(target::Frame&, PassContext&);
+
+struct Pass {
+    std::string_view name;
+    // what -stats prints after the count
+    std::string_view stat;
+    Form form;
+    std::variant<ProgramPass, FramePass, MachinePass> run;
+    // analyses of a frame that stay valid after the pass ran on it
+    qa_ir::PreservedAnalyses preserved;
+    // The pass may leave a temp assigned more than once. ConstructSSA only
+    // renames variables, so no SSA pass may run after it.
+    bool reassignsTemps = false;
+};
+
+// every pass -passes= may name
+[[nodiscard]] const std::vector<Pass>& Registry();
+// the pass names of an optimization level, in the order they run
+[[nodiscard]] std::vector<std::string> Preset(OptLevel level);
+// operations or instructions of all frames
+[[nodiscard]] long SizeOf(const std::vector<qa_ir::Frame>& frames);
+[[nodiscard]] long SizeOf(const std::vector<target::Frame>& frames);
+
+// what a pass, or a stage like lowering, cost over one compilation
+struct PassRecord {
+    std::string name;
+    int runs = 0;
+    // the counts the pass returned, summed over frames and runs
+    int changed = 0;
+    std::chrono::nanoseconds time{};
+    // size of all frames before and after, summed over the runs
+    long sizeBefore = 0;
+    long sizeAfter = 0;
+};
+
+// Runs a pipeline of named passes over the frames of a program: the IR
+// passes before lowering, the machine passes after register allocation.
+// Keeps the analyses of every frame between passes and drops what a pass
+// does not preserve.
+class PassManager {
+   public:
+    // throws std::invalid_argument for unknown names, for SSA passes after
+    // the frames left SSA form or after a pass that reassigns temps, and for
+    // IR passes after machine passes
+    PassManager(const std::vector<std::string>& pipeline, PassOptions options,
+                std::set<std::string, std::less<>> printAfter = {});
+
+    void RunIR(std::vector<qa_ir::Frame>& frames);
+    void RunMachine(std::vector<target::Frame>& frames);
+
+    // for the stages between the passes: lower, regalloc, codegen
+    void Record(std::string_view name, long sizeBefore, long sizeAfter,
+                std::chrono::nanoseconds time);
+    void PrintAfter(std::string_view name,
+                    const std::vector<qa_ir::Frame>& frames) const;
+    void PrintAfter(std::string_view name,
+                    const std::vector<target::Frame>& frames) const;
+    // the assembly codegen generated
+    void PrintAfter(std::string_view name, const std::string& code) const;
+
+    // "name: count stat" per IR pass, as -stats prints them
+    void PrintStats(std::ostream& os) const;
+    // runs, time and size change of every pass and stage, -time-passes
+    void PrintTimings(std::ostream& os) const;
+
+    [[nodiscard]] const std::vector<PassRecord>& Records() const {
+        return records;
+    }
+    [[nodiscard]] const target::PeepholeStats& Peephole() const {
+        return peephole;
+    }
+
+   private:
+    std::vector<const Pass*> pipeline = {};
+    PassOptions options;
+    std::set<std::string, std::less<>> printAfter;
+    std::vector<PassRecord> records = {};
+    target::PeepholeStats peephole = {};
+
+    PassRecord& record(std::string_view name);
+    void convert(std::vector<qa_ir::Frame>& frames, Form to);
+};
+}  // namespace passes
\ No newline at end of file
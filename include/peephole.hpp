@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+
+#include "assem.hpp"
+
+namespace target {
+
+// how often each rule of the peephole table fired, by rule name
+struct PeepholeStats {
+    std::map<std::string, int, std::less<>> fired = {};
+};
+
+// Rewrites short windows of consecutive instructions of an allocated frame
+// by a table of rules: jumps to the next label, code after an unconditional
+// jump, moves of a register to itself, a store followed by a load of the
+// same slot, and adds or subs of 0. The window slides over the frame until
+// no rule matches anywhere. Runs after rewrite. Returns the number of
+// windows rewritten.
+int Peephole(Frame& frame, PeepholeStats& stats);
+}  // namespace target
\ No newline at end of file
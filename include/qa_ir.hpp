@@ -3,7 +3,9 @@
 #include <concepts>
 #include <ostream>
 #include <string>
+#include <type_traits>
 #include <variant>
+#include <vector>
 
 #include "ast.hpp"
 #include "qa_x86.hpp"
@@ -121,6 +123,8 @@ std::ostream& operator<<(std::ostream& os, const Label& label);
 
 struct LabelDef {
     Label label;
+    // the top of a hot loop, which codegen aligns to 16 bytes
+    bool align = false;
 };
 
 struct DerefStore {
@@ -133,17 +137,91 @@ struct DefineStackPushed {
     int size;
 };
 
+struct PhiArgument {
+    // label of the predecessor block the value flows in from
+    Label predecessor;
+    Value value;
+};
+
+// only present while a frame is in SSA form, see ssa.hpp
+struct Phi {
+    Value dst;
+    std::vector<PhiArgument> args;
+};
+
 using Operation =
     std::variant<Mov, Ret, Add, Sub, MovR, Addr, DefineStackPushed, Deref,
                  Compare, Jump, Equal, ConditionalJumpEqual,
                  ConditionalJumpGreater, LabelDef, Call, DerefStore,
-                 GreaterThan, ConditionalJumpLess, NotEqual>;
+                 GreaterThan, ConditionalJumpLess, NotEqual, Phi>;
 
 using CondJ = std::variant<ConditionalJumpEqual, ConditionalJumpGreater>;
 
 Label get_true_label(const CondJ& condj);
 Label get_false_label(const CondJ& condj);
 
+// the value an operation writes, nullptr if it writes none
+[[nodiscard]] Value* defined_value(Operation& op);
+[[nodiscard]] const Value* defined_value(const Operation& op);
+
+// calls f on every value an operation reads. The variable an Addr takes the
+// address of is not read.
+template <typename Op, typename F>
+    requires std::same_as<std::remove_const_t<Op>, Operation>
+void for_each_used_value(Op& op, F&& f) {
+    std::visit(
+        [&f](auto& arg) {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, Mov> || std::is_same_v<T, Deref>) {
+                f(arg.src);
+            } else if constexpr (std::is_same_v<T, Ret>) {
+                f(arg.value);
+            } else if constexpr (std::is_same_v<T, Add> ||
+                                 std::is_same_v<T, Sub> ||
+                                 std::is_same_v<T, Compare> ||
+                                 std::is_same_v<T, Equal> ||
+                                 std::is_same_v<T, NotEqual> ||
+                                 std::is_same_v<T, GreaterThan>) {
+                f(arg.left);
+                f(arg.right);
+            } else if constexpr (std::is_same_v<T, DerefStore>) {
+                f(arg.dst);
+                f(arg.src);
+            } else if constexpr (std::is_same_v<T, Call>) {
+                for (auto& value : arg.args) {
+                    f(value);
+                }
+            } else if constexpr (std::is_same_v<T, Phi>) {
+                for (auto& incoming : arg.args) {
+                    f(incoming.value);
+                }
+            }
+        },
+        op);
+}
+
+// calls f on the values an operation reads that lowering can take an int
+// literal for, which is all of them except the pointers of Deref and
+// DerefStore
+template <typename F>
+void for_each_immediate_operand(Operation& op, F&& f) {
+    if (std::holds_alternative<Deref>(op)) {
+        return;
+    }
+    if (auto* store = std::get_if<DerefStore>(&op)) {
+        f(store->src);
+        return;
+    }
+    for_each_used_value(op, f);
+}
+
+// Jump, the conditional jumps and Ret end a basic block
+[[nodiscard]] bool is_terminator(const Operation& op);
+// labels a terminator can continue at, in the order true, false
+[[nodiscard]] std::vector<Label> successor_labels(const Operation& op);
+// points the labels of a terminator that name from at to instead
+void retarget(Operation& op, const std::string& from, const Label& to);
+
 std::ostream& operator<<(std::ostream& os, const Operation& ins);
 
 template <typename T>
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <concepts>
+#include <cstdint>
 #include <iostream>
 #include <optional>
 #include <string>
@@ -27,7 +29,9 @@ enum class BaseRegister {
     R12,
     R13,
     R14,
-    R15
+    R15,
+    // only allocated in frames that omit the frame pointer
+    BP
 };
 
 std::ostream& operator<<(std::ostream& os, BaseRegister reg);
@@ -36,11 +40,31 @@ std::ostream& operator<<(std::ostream& os, BaseRegister reg);
 inline const std::vector<BaseRegister> param_regs = {
     BaseRegister::DI, BaseRegister::SI, BaseRegister::DX,
     BaseRegister::CX, BaseRegister::R8, BaseRegister::R9};
-// general purpose registers
-// these are disjoint from the param_regs, so that calls don't clobber them
-inline const std::vector<BaseRegister> general_regs = {
-    BaseRegister::AX,  BaseRegister::BX,  BaseRegister::R10, BaseRegister::R11,
-    BaseRegister::R12, BaseRegister::R13, BaseRegister::R14, BaseRegister::R15};
+// System V registers a function restores before it returns, every other
+// register may be overwritten by a call
+inline const std::vector<BaseRegister> callee_saved_regs = {
+    BaseRegister::BX,  BaseRegister::R12, BaseRegister::R13,
+    BaseRegister::R14, BaseRegister::R15, BaseRegister::BP};
+// The registers the allocators hand out. Both prefer lower indices, so the
+// caller-saved registers come first and a value only takes a register the
+// frame has to save when it lives across a call. BP comes last.
+inline const std::vector<BaseRegister> register_file = {
+    BaseRegister::AX,  BaseRegister::R10, BaseRegister::R11, BaseRegister::DI,
+    BaseRegister::SI,  BaseRegister::DX,  BaseRegister::CX,  BaseRegister::R8,
+    BaseRegister::R9,  BaseRegister::BX,  BaseRegister::R12, BaseRegister::R13,
+    BaseRegister::R14, BaseRegister::R15, BaseRegister::BP};
+inline const int register_file_size = static_cast<int>(register_file.size());
+// bit i is set when a call may overwrite register_file[i]
+inline const std::uint32_t caller_saved = [] {
+    std::uint32_t mask = 0;
+    for (int i = 0; i < register_file_size; i++) {
+        if (std::ranges::find(callee_saved_regs, register_file[i]) ==
+            callee_saved_regs.end()) {
+            mask |= 1U << i;
+        }
+    }
+    return mask;
+}();
 
 [[nodiscard]] std::string to_asm(BaseRegister reg, int size);
 
@@ -110,6 +134,18 @@ struct JumpEq {
     std::string label;
 };
 
+struct JumpNotEq {
+    std::string label;
+};
+
+struct JumpGreaterEq {
+    std::string label;
+};
+
+struct JumpLessEq {
+    std::string label;
+};
+
 struct AddI {
     Register dst;
     int value;
@@ -117,24 +153,77 @@ struct AddI {
 
 struct AddMI {
     StackLocation dst;
+    int size;
     int value;
 };
 
 struct SubMI {
     StackLocation dst;
+    int size;
     int value;
 };
 
+struct IncM {
+    StackLocation dst;
+    int size;
+};
+
+struct DecM {
+    StackLocation dst;
+    int size;
+};
+
+// adds / subtracts a register to a stack slot in place
+struct AddM {
+    StackLocation dst;
+    Register src;
+};
+
+struct SubM {
+    StackLocation dst;
+    Register src;
+};
+
 struct SubI {
     Register dst;
     int value;
 };
 
+struct Inc {
+    Register dst;
+};
+
+struct Dec {
+    Register dst;
+};
+
 struct Add {
     Register dst;
     Register src;
 };
 
+// adds / subtracts a stack slot to a register
+struct AddRM {
+    Register dst;
+    StackLocation src;
+};
+
+struct SubRM {
+    Register dst;
+    StackLocation src;
+};
+
+// adds / subtracts what src points to
+struct AddIndirect {
+    Register dst;
+    Register src;
+};
+
+struct SubIndirect {
+    Register dst;
+    Register src;
+};
+
 struct Sub {
     Register dst;
     Register src;
@@ -152,6 +241,23 @@ struct CmpI {
     int value;
 };
 
+// test dst, dst, the flags of a compare of dst with 0
+struct Test {
+    Register dst;
+};
+
+// compares a register with a stack slot of the same size
+struct CmpM {
+    Register dst;
+    StackLocation src;
+};
+
+struct CmpMI {
+    StackLocation dst;
+    int size;
+    int value;
+};
+
 struct SetEAl {
     Register dst;
 };
@@ -166,6 +272,8 @@ struct SetNeAl {
 
 struct Label {
     std::string name;
+    // preceded by padding to a 16 byte boundary
+    bool align = false;
 };
 
 struct Call {
@@ -173,11 +281,23 @@ struct Call {
     Register dst;
 };
 
+// leaves the frame and jumps to name, which returns to our caller
+struct TailCall {
+    std::string name;
+};
+
 struct Lea {
     Register dst;
     StackLocation src;
 };
 
+// lea dst, [src + offset], an add that leaves src and the flags alone
+struct LeaOffset {
+    Register dst;
+    Register src;
+    int offset;
+};
+
 struct IndirectLoad {
     Register dst;
     Register src;
@@ -200,7 +320,9 @@ using Instruction =
     std::variant<Mov, LoadI, StoreI, Store, Load, Jump, AddI, Add, SubI, Sub,
                  AddMI, SubMI, Cmp, CmpI, SetEAl, SetGAl, Label, JumpEq, Call,
                  Lea, IndirectLoad, JumpGreater, IndirectStore, PushI, Push,
-                 JumpLess, SetNeAl>;
+                 JumpLess, SetNeAl, TailCall, JumpNotEq, JumpGreaterEq,
+                 JumpLessEq, Test, CmpM, CmpMI, Inc, Dec, IncM, DecM, AddM,
+                 SubM, AddRM, SubRM, AddIndirect, SubIndirect, LeaOffset>;
 
 std::optional<int> get_src_virtual_id_if_present(const Instruction& ins);
 std::optional<int> get_dest_virtual_id_if_present(const Instruction& ins);
@@ -208,6 +330,13 @@ std::optional<VirtualRegister> get_src_register(const Instruction& ins);
 std::optional<VirtualRegister> get_dest_register(const Instruction& ins);
 void set_src_register(Instruction& ins, Register reg);
 void set_dest_register(Instruction& ins, Register reg);
+// whether the register in the dst field is read / overwritten
+[[nodiscard]] bool reads_dest(const Instruction& ins);
+[[nodiscard]] bool writes_dest(const Instruction& ins);
+// the jumps and TailCall, which end a basic block
+[[nodiscard]] bool is_jump(const Instruction& ins);
+// the label a jump goes to, nullopt for every other instruction
+[[nodiscard]] std::optional<std::string> jump_label(const Instruction& ins);
 
 std::ostream& operator<<(std::ostream& os, const Instruction& ins);
 
@@ -227,4 +356,10 @@ struct Frame {
     int size = 0;
 };
 
+// arguments past the sixth are pushed before a call and never popped, so
+// such a frame keeps rbp to find its slots
+[[nodiscard]] bool pushes_arguments(const Frame& frame);
+// whether the frame calls a function that returns to it
+[[nodiscard]] bool makes_calls(const Frame& frame);
+
 }  // namespace target
\ No newline at end of file
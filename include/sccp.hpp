@@ -0,0 +1,18 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over a frame in
+// SSA form. Constants flow through temps and phis while only the branches
+// their conditions allow are followed, so a variable keeps its constant
+// along the paths that can run. Afterwards constant temps are replaced by
+// literals, branches with a known outcome become a Jump and the blocks no
+// executable edge reaches are removed, along with the phi arguments they
+// supplied. The CFG comes from analyses. Returns the number of operations
+// removed.
+int PropagateConstants(Frame& frame, FrameAnalyses& analyses);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "cfg.hpp"
+#include "induction.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// The add recurrence {c0, +, c1, +, c2 ...} of a loop: c0 on the first trip,
+// and on trip n the sum of ck * C(n, k), so every coefficient grows by the
+// next one on each trip.
+struct AddRecurrence {
+    std::vector<Invariant> coefficients = {};
+};
+
+// The add recurrences of the header phis of a counted loop in SSA form and
+// of the temps its header computes from them with Add, Sub and Mov, keyed by
+// temp id. A temp whose value the loop computes some other way is left out.
+[[nodiscard]] std::map<int, AddRecurrence> AnalyzeScalarEvolution(
+    const Frame& frame, const ControlFlowGraph& cfg, const Loop& loop,
+    const CountedLoop& counted);
+
+// The value of a recurrence on trip trips, where trips is a literal or an
+// Invariant of its own. Fails when it needs a multiplication by a temp.
+[[nodiscard]] std::optional<Invariant> EvaluateAt(
+    const AddRecurrence& recurrence, const Invariant& trips);
+
+// Deletes the counted loops of a frame in SSA form that have no effect but
+// the values they leave behind, when the recurrences of those values can be
+// evaluated at the trip count: any degree for a trip count known at compile
+// time, a linear one for a counter stepping by one towards a bound only known
+// at run time. The values are computed where the loop was. Returns the
+// number of loops deleted.
+int EvaluateLoopExitValues(Frame& frame, FrameAnalyses& analyses);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <optional>
+
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Folds operations on int literals with the wrap around of a 32 bit int,
+// applies identities such as x + 0, x - x and x == x, moves literals to the
+// right hand operand and turns Compare + conditional jump pairs with a known
+// outcome into a Jump. Temps holding a folded constant are substituted into
+// their readers and dropped.
+//
+// Every temp must be assigned once, as Produce_IR and ConstructSSA leave
+// them. Returns the number of operations removed.
+int Simplify(Frame& frame);
+
+// what an Add, Sub, Equal, NotEqual or GreaterThan computes from two literal
+// operands, nullopt for any other operation
+[[nodiscard]] std::optional<int> EvaluateBinary(const Operation& op, int left,
+                                                int right);
+// whether the conditional jump after Compare left, right is taken
+[[nodiscard]] bool EvaluateBranch(const Operation& jump, int left, int right);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "assem.hpp"
+#include "cfg.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// mem2reg: renames every local whose address is never taken into temps, one
+// per assignment, with Phi operations where definitions meet. Variables an
+// Addr reads and parameters passed on the stack stay in their slots.
+void ConstructSSA(Frame& frame);
+
+// Renames the given variables, with their sizes, into temps as ConstructSSA
+// does, on a normalized frame that may already be in SSA form. Phis only go
+// into the blocks whose labels region holds, so the variables may only be
+// read there and in blocks with a lone predecessor in it. Nothing may take
+// their addresses.
+void PromoteVariables(Frame& frame, FreshNames& names,
+                      const std::map<std::string, int>& variables,
+                      const std::set<std::string>& region);
+
+// Replaces every Phi with copies at the end of its predecessors, splitting
+// edges from blocks that branch elsewhere as well.
+void DestructSSA(Frame& frame);
+}  // namespace qa_ir
\ No newline at end of file
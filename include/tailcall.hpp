@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+// Replaces the calls a frame makes to itself and returns the result of
+// right away with assignments of the arguments to its parameters and a
+// jump back to its start, so tail recursion runs as a loop in one frame.
+// Runs before ConstructSSA, which gives the loop its phis. Returns the
+// number of calls replaced.
+int EliminateTailRecursion(Frame& frame);
+
+// whether operation i of frame is a Call whose result the next operation
+// returns
+[[nodiscard]] bool IsTailCall(const Frame& frame, std::size_t i);
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "assem.hpp"
+#include "qa_ir.hpp"
+
+namespace qa_ir {
+
+struct UnrollOptions {
+    // also unroll loops whose trip count is only known at run time
+    bool runtime = false;
+    // copies of the body per trip of such a loop, 0 picks one from the size
+    // of the body
+    int count = 0;
+};
+
+// Unrolls the loops of a frame in SSA form that only leave from a header
+// testing an induction variable against a loop invariant, as for loops do.
+// A loop with a trip count known at compile time is replaced by that many
+// copies of its body when they fit a size budget. With options.runtime, a
+// loop counting towards a bound only known at run time gets an unrolled
+// copy in front that runs several trips per test while enough of them are
+// left, and the original loop runs the rest. Returns the number of loops
+// unrolled.
+int UnrollLoops(Frame& frame, FrameAnalyses& analyses,
+                const UnrollOptions& options);
+}  // namespace qa_ir
\ No newline at end of file
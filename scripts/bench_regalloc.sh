@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Compiles every test source with both register allocators and reports
+# compile time, instruction count and run time of the generated binary.
+# Usage: scripts/bench_regalloc.sh [runs per binary]
+
+runs=${1:-1000}
+qac=./build/bin/qac
+
+mkdir -p tmp
+
+printf "%-40s %-7s %10s %8s %10s\n" "source" "alloc" "compile_ms" "instrs" \
+    "run_ms"
+for source in tests/sources/*.c; do
+    for allocator in linear graph; do
+        start=$(date +%s%N)
+        $qac "$source" -o tmp/bench.asm -regalloc=$allocator || exit 1
+        compiled=$(date +%s%N)
+        nasm -f elf64 -o tmp/bench.o tmp/bench.asm || exit 1
+        gcc -o tmp/bench.out tmp/bench.o -nostartfiles -lc || exit 1
+        instructions=$(grep -c "^	" tmp/bench.asm)
+        run_start=$(date +%s%N)
+        for ((i = 0; i < runs; i++)); do
+            ./tmp/bench.out
+        done
+        run_end=$(date +%s%N)
+        printf "%-40s %-7s %10.2f %8d %10.2f\n" "$(basename "$source")" \
+            "$allocator" "$(((compiled - start) / 10000))e-2" \
+            "$instructions" "$(((run_end - run_start) / 10000))e-2"
+    done
+done
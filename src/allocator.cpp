@@ -1,153 +1,529 @@
 #include "../include/allocator.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <climits>
 #include <concepts>
-#include <map>
+#include <cstdint>
 #include <optional>
 #include <ranges>
-#include <set>
 #include <stdexcept>
-#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "../include/liveness.hpp"
 #include "../include/qa_x86.hpp"
 
 namespace target {
 
+const std::uint32_t all_registers = (1U << register_file_size) - 1;
+
 struct AllocatorContext {
    public:
-    std::set<size_t> usedRegs = {};
-    std::map<Register, BaseRegister> mapping = {};
+    // bit i is set while register_file[i] is free
+    std::uint32_t freeRegs = all_registers;
+    std::uint32_t usable = all_registers;
+    // physical register index per virtual register id
+    std::vector<int> mapping = {};
 
-    [[nodiscard]] BaseRegister getReg() {
-        for (auto [idx, reg] : general_regs | std::views::enumerate) {
-            if (usedRegs.find(idx) == usedRegs.end()) {
-                usedRegs.insert(idx);
-                return reg;
-            }
-        }
-        throw std::runtime_error("No free registers");
-    }
+    AllocatorContext(int registerCount, std::uint32_t usable)
+        : usable(usable), mapping(registerCount, no_register) {}
 
-    void freeReg(BaseRegister freedReg) {
-        for (auto it = general_regs.begin(); it != general_regs.end(); ++it) {
-            if (*it == freedReg) {
-                auto index = std::distance(general_regs.begin(), it);
-                usedRegs.erase(index);
-                return;
-            }
+    [[nodiscard]] int getReg(std::uint32_t allowed) {
+        const auto candidates = freeRegs & allowed;
+        if (candidates == 0) {
+            return no_register;
         }
-        throw std::runtime_error("Register not found");
+        const auto idx = std::countr_zero(candidates);
+        freeRegs &= ~(1U << idx);
+        return idx;
     }
+
+    void freeReg(int idx) { freeRegs |= 1U << idx; }
 };
 
-auto getFirstUse(const Frame& frame) -> FirstLastUse {
-    std::map<int, int> firstUse = {};
-    std::map<int, int> lastUse = {};
-    for (auto [idx, instruction] : frame.instructions | std::views::enumerate) {
-        const auto srcId = get_src_virtual_id_if_present(instruction);
-        const auto dstId = get_dest_virtual_id_if_present(instruction);
-        for (const auto register_id : {srcId, dstId}) {
+auto virtualRegisterCount(const Frame& frame) -> int {
+    int count = 0;
+    for (const auto& instruction : frame.instructions) {
+        for (const auto register_id :
+             {get_src_virtual_id_if_present(instruction),
+              get_dest_virtual_id_if_present(instruction)}) {
             if (register_id.has_value()) {
-                if (firstUse.find(register_id.value()) == firstUse.end()) {
-                    firstUse[register_id.value()] = idx;
-                }
-                lastUse[register_id.value()] = idx;
+                count = std::max(count, register_id.value() + 1);
             }
         }
     }
-    return {firstUse, lastUse};
+    return count;
 }
 
-auto remap(Frame& frame) -> std::map<VirtualRegister, VirtualRegister> {
-    std::map<VirtualRegister, VirtualRegister> remappedRegisters = {};
-    std::map<VirtualRegister, int> newFirstUsed = {};
-    for (auto [idx, instruction] : frame.instructions | std::views::enumerate) {
-        std::optional<VirtualRegister> src;
-        auto register_src = get_src_register(instruction);
-        if (register_src.has_value()) {
-            src = *register_src;
-            if (newFirstUsed.find(*src) == newFirstUsed.end()) {
-                newFirstUsed[*src] = idx;
-            }
-        }
-        const auto register_dest = get_dest_register(instruction);
-        if (register_dest.has_value()) {
-            const auto dest = *register_dest;
-            if (!std::holds_alternative<Mov>(instruction)) {
-                continue;
+auto computeLiveIntervals(const Frame& frame) -> LiveIntervals {
+    const auto count = virtualRegisterCount(frame);
+    LiveIntervals intervals{.start = std::vector<int>(count, no_register),
+                            .end = std::vector<int>(count, no_register),
+                            .size = std::vector<int>(count, 0),
+                            .useOffset = std::vector<int>(count + 1, 0),
+                            .usePositions = {}};
+    auto for_each_register = [](const Instruction& ins, auto&& f) {
+        const auto src = get_src_register(ins);
+        const auto dst = get_dest_register(ins);
+        if (src.has_value()) {
+            f(src.value());
+        }
+        if (dst.has_value() && (!src.has_value() || src->id != dst->id)) {
+            f(dst.value());
+        }
+    };
+    for (auto [idx, ins] : frame.instructions | std::views::enumerate) {
+        for_each_register(ins, [&](VirtualRegister reg) {
+            if (intervals.start[reg.id] == no_register) {
+                intervals.start[reg.id] = idx;
             }
-            // if not found in newFirstused, (ie first used as a dest) then we
-            // need to remap
-            if (newFirstUsed.find(dest) == newFirstUsed.end()) {
-                if (src.has_value()) {
-                    // if src is in remapped registers, then we need to remap it
-                    if (remappedRegisters.find(*src) !=
-                        remappedRegisters.end()) {
-                        remappedRegisters[dest] = remappedRegisters[*src];
-                    } else {
-                        remappedRegisters[dest] = *src;
-                    }
+            intervals.end[reg.id] = idx;
+            intervals.size[reg.id] = std::max(intervals.size[reg.id], reg.size);
+            intervals.useOffset[reg.id + 1]++;
+        });
+    }
+    for (int v = 0; v < count; v++) {
+        intervals.useOffset[v + 1] += intervals.useOffset[v];
+    }
+    intervals.usePositions.resize(intervals.useOffset[count]);
+    std::vector<int> cursor(intervals.useOffset.begin(),
+                            intervals.useOffset.end() - 1);
+    for (auto [idx, ins] : frame.instructions | std::views::enumerate) {
+        for_each_register(ins, [&](VirtualRegister reg) {
+            intervals.usePositions[cursor[reg.id]++] = idx;
+        });
+    }
+
+    // values live across block boundaries, e.g. around a loop back edge,
+    // cover the whole block they flow through
+    const auto cfg = buildControlFlowGraph(frame);
+    const auto liveness =
+        computeLiveness(frame, cfg, register_file_size + count);
+    auto cover = [&](int n, int position) {
+        if (n < register_file_size) {
+            return;
+        }
+        const auto v = n - register_file_size;
+        intervals.start[v] = std::min(intervals.start[v], position);
+        intervals.end[v] = std::max(intervals.end[v], position);
+    };
+    for (int b = 0; b < cfg.blocks(); b++) {
+        liveness.liveIn[b].forEach(
+            [&](int n) { cover(n, cfg.blockStart[b]); });
+        liveness.liveOut[b].forEach(
+            [&](int n) { cover(n, cfg.blockStart[b + 1] - 1); });
+    }
+    // hardcoded registers after each instruction, walking every block
+    // backwards from the registers live out of it
+    intervals.fixedLive.assign(frame.instructions.size(), 0);
+    Operands operands;
+    for (int b = 0; b < cfg.blocks(); b++) {
+        std::uint32_t live = 0;
+        liveness.liveOut[b].forEach([&live](int n) {
+            if (n < register_file_size) {
+                live |= 1U << n;
+            }
+        });
+        for (int i = cfg.blockStart[b + 1] - 1; i >= cfg.blockStart[b];
+             i--) {
+            intervals.fixedLive[i] = live;
+            collectOperands(frame.instructions[i], cfg.callArguments[i],
+                            operands);
+            live &= ~operands.clobbers;
+            for (const auto d : operands.defs) {
+                if (d < register_file_size) {
+                    live &= ~(1U << d);
+                }
+            }
+            for (const auto u : operands.uses) {
+                if (u < register_file_size) {
+                    live |= 1U << u;
                 }
             }
         }
     }
-    return remappedRegisters;
+    intervals.liveOnEntry.assign(count, false);
+    for (int v = 0; v < count; v++) {
+        if (intervals.start[v] != no_register) {
+            intervals.liveOnEntry[v] =
+                liveness.liveIn[cfg.blockOf[intervals.start[v]]].test(
+                    register_file_size + v);
+        }
+    }
+    return intervals;
 }
 
-[[nodiscard]] Frame rewrite(const Frame& frame, AllocatorContext& ctx) {
-    Frame newFrame = frame;
-    auto [firstUse, lastUse] = getFirstUse(frame);
-    auto remappedRegisters = remap(newFrame);
-    for (const auto& entry : remappedRegisters) {
-        const auto prev = entry.first;
-        const auto newReg = entry.second;
-        firstUse[newReg.id] = std::min(firstUse[newReg.id], firstUse[prev.id]);
-        lastUse[newReg.id] = std::max(lastUse[newReg.id], lastUse[prev.id]);
+// the registers a frame may allocate, rbp only when it is no frame pointer
+[[nodiscard]] std::uint32_t usable_registers(bool framePointer) {
+    if (!framePointer) {
+        return all_registers;
     }
-    std::vector<Instruction> newInstructions = {};
-    for (auto [idx, instruction] : frame.instructions | std::views::enumerate) {
-        auto operation = instruction;
-        auto process_register =
-            [&ctx, &remappedRegisters, &firstUse, &lastUse,
-             &idx](VirtualRegister& reg) -> HardcodedRegister {
-            if (remappedRegisters.find(reg) != remappedRegisters.end()) {
-                reg = remappedRegisters[reg];
+    return all_registers & ~(1U << register_file_index(BaseRegister::BP));
+}
+
+// registers an instruction overwrites without naming them as a virtual
+// register
+[[nodiscard]] std::uint32_t clobbered_registers(const Instruction& ins) {
+    // callees restore callee_saved_regs before they return
+    if (std::holds_alternative<Call>(ins)) {
+        return caller_saved;
+    }
+    // setcc goes through al
+    if (std::holds_alternative<SetEAl>(ins) ||
+        std::holds_alternative<SetGAl>(ins) ||
+        std::holds_alternative<SetNeAl>(ins)) {
+        return 1U << register_file_index(BaseRegister::AX);
+    }
+    if (!writes_dest(ins)) {
+        return 0;
+    }
+    return std::visit(
+        [](auto&& arg) -> std::uint32_t {
+            if constexpr (HasRegisterDest<decltype(arg)>) {
+                const auto* hardcoded =
+                    std::get_if<HardcodedRegister>(&arg.dst);
+                if (hardcoded != nullptr) {
+                    return 1U << register_file_index(hardcoded->reg);
+                }
             }
+            return 0;
+        },
+        ins);
+}
+
+// per instruction facts the linear scan needs: which straight-line block it
+// belongs to and how often each register was clobbered before it
+struct FrameLayout {
+    std::vector<int> block = {};
+    // clobbers of register_file[r] at positions < p live at
+    // clobberPrefix[p * register_file_size + r]
+    std::vector<int> clobberPrefix = {};
+    // the same count for positions where register_file[r] holds a hardcoded
+    // value that is still to be read, e.g. an argument before its call
+    std::vector<int> fixedPrefix = {};
 
-            if (ctx.mapping.find(reg) == ctx.mapping.end() ||
-                firstUse[reg.id] == idx) {
-                ctx.mapping[reg] = ctx.getReg();
+    // registers clobbered strictly inside (start, end) or live as a
+    // hardcoded register somewhere in [start, end)
+    [[nodiscard]] std::uint32_t forbidden(int start, int end) const {
+        const auto regs = static_cast<std::size_t>(register_file_size);
+        std::uint32_t mask = 0;
+        for (std::size_t r = 0; r < regs; r++) {
+            const auto clobbered =
+                end - start >= 2 && clobberPrefix[end * regs + r] >
+                                        clobberPrefix[(start + 1) * regs + r];
+            const auto fixed =
+                fixedPrefix[end * regs + r] > fixedPrefix[start * regs + r];
+            if (clobbered || fixed) {
+                mask |= 1U << r;
             }
+        }
+        return mask;
+    }
+};
+
+[[nodiscard]] auto computeFrameLayout(const Frame& frame,
+                                      const LiveIntervals& intervals)
+    -> FrameLayout {
+    const auto regs = static_cast<std::size_t>(register_file_size);
+    const auto n = frame.instructions.size();
+    FrameLayout layout{.block = std::vector<int>(n, 0),
+                       .clobberPrefix = std::vector<int>((n + 1) * regs, 0),
+                       .fixedPrefix = std::vector<int>((n + 1) * regs, 0)};
+    int block = 0;
+    for (auto [idx, ins] : frame.instructions | std::views::enumerate) {
+        if (std::holds_alternative<Label>(ins)) {
+            block++;
+        }
+        layout.block[idx] = block;
+        if (is_jump(ins)) {
+            block++;
+        }
+        const auto clobbered = clobbered_registers(ins);
+        const auto fixed = intervals.fixedLive[idx];
+        for (std::size_t r = 0; r < regs; r++) {
+            layout.clobberPrefix[(idx + 1) * regs + r] =
+                layout.clobberPrefix[idx * regs + r] +
+                ((clobbered >> r) & 1U);
+            layout.fixedPrefix[(idx + 1) * regs + r] =
+                layout.fixedPrefix[idx * regs + r] + ((fixed >> r) & 1U);
+        }
+    }
+    return layout;
+}
+
+// Linear scan over intervals in order of their start. When no register is
+// allowed, the interval among the active ones (and the new one) whose next
+// use is furthest away is spilled. Intervals covering at most two adjacent
+// instructions are the reload / store intervals created by spilling and are
+// never picked.
+[[nodiscard]] auto linearScan(const LiveIntervals& intervals,
+                              const FrameLayout& layout,
+                              AllocatorContext& ctx) -> SpillDecisions {
+    const auto count = static_cast<int>(intervals.start.size());
+    SpillDecisions decisions{.spillAt = std::vector<int>(count, no_register),
+                             .count = 0};
+    std::vector<int> cursor(intervals.useOffset.begin(),
+                            intervals.useOffset.end() - 1);
+    auto nextUse = [&](int v, int position) {
+        while (cursor[v] < intervals.useOffset[v + 1] &&
+               intervals.usePositions[cursor[v]] < position) {
+            cursor[v]++;
+        }
+        if (cursor[v] == intervals.useOffset[v + 1]) {
+            return INT_MAX;
+        }
+        return intervals.usePositions[cursor[v]];
+    };
+    auto spillable = [&](int v) {
+        return intervals.end[v] - intervals.start[v] > 1;
+    };
+    auto spill = [&](int v, int position) {
+        // splitting is only safe while the part that keeps the register is
+        // straight-line code entered through the definition, otherwise the
+        // whole interval goes to memory
+        const auto start = intervals.start[v];
+        const auto straightLine =
+            layout.block[start] == layout.block[position] &&
+            !intervals.liveOnEntry[v];
+        decisions.spillAt[v] = straightLine ? position : start;
+        decisions.count++;
+    };
 
-            if (lastUse[reg.id] <= idx) {
-                ctx.freeReg(ctx.mapping[reg]);
+    // values live around a back edge start at the loop's label, before any
+    // instruction names them, so visit the intervals rather than the operands
+    std::vector<int> order;
+    order.reserve(count);
+    for (int v = 0; v < count; v++) {
+        if (intervals.start[v] != no_register) {
+            order.push_back(v);
+        }
+    }
+    std::ranges::stable_sort(order, [&intervals](int a, int b) {
+        return intervals.start[a] < intervals.start[b];
+    });
+
+    std::vector<int> active;
+    active.reserve(register_file_size);
+    for (const auto v : order) {
+        const auto position = intervals.start[v];
+        std::erase_if(active, [&](int a) {
+            const auto expired =
+                intervals.end[a] < position ||
+                (intervals.end[a] == position &&
+                 intervals.start[a] < position);
+            if (expired) {
+                ctx.freeReg(ctx.mapping[a]);
+            }
+            return expired;
+        });
+        const auto allowed =
+            ctx.usable &
+            ~layout.forbidden(intervals.start[v], intervals.end[v]);
+        if (const auto reg = ctx.getReg(allowed); reg != no_register) {
+            ctx.mapping[v] = reg;
+            active.push_back(v);
+            continue;
+        }
+        auto victim = v;
+        auto furthest = spillable(v) ? nextUse(v, position + 1) : -1;
+        for (const auto a : active) {
+            if ((allowed & (1U << ctx.mapping[a])) == 0 || !spillable(a)) {
+                continue;
             }
+            if (const auto next = nextUse(a, position); next > furthest) {
+                victim = a;
+                furthest = next;
+            }
+        }
+        if (victim == v) {
+            if (!spillable(v)) {
+                throw std::runtime_error("No free registers");
+            }
+            spill(v, intervals.start[v]);
+            continue;
+        }
+        spill(victim, position);
+        ctx.mapping[v] = ctx.mapping[victim];
+        ctx.mapping[victim] = no_register;
+        std::erase(active, victim);
+        active.push_back(v);
+    }
+    return decisions;
+}
+
+// Replaces every mention of a spilled register from its spill position on
+// with a fresh register that is loaded from / stored to the spill slot
+// around that one instruction. Registers with a single LoadI definition are
+// recomputed instead of reloaded.
+void insertSpillCode(Frame& frame, const LiveIntervals& intervals,
+                     const SpillDecisions& decisions, AllocationStats& stats) {
+    const auto count = static_cast<int>(intervals.start.size());
+    std::vector<int> definitions(count, 0);
+    std::vector<std::optional<int>> constant(count, std::nullopt);
+    for (const auto& ins : frame.instructions) {
+        const auto dest = get_dest_register(ins);
+        if (!dest.has_value() || !writes_dest(ins)) {
+            continue;
+        }
+        definitions[dest->id]++;
+        if (const auto* loadI = std::get_if<LoadI>(&ins)) {
+            constant[dest->id] = loadI->value;
+        }
+    }
+    auto rematerializable = [&](int v) {
+        return definitions[v] == 1 && constant[v].has_value();
+    };
+
+    // the frontend leaves the size out of some registers, a register never
+    // given one gets a full slot
+    auto slotSize = [&](int v) {
+        return intervals.size[v] > 0 ? intervals.size[v] : 8;
+    };
+    std::vector<int> slot(count, 0);
+    auto slotFor = [&](int v) {
+        if (slot[v] == 0) {
+            const auto size = slotSize(v);
+            frame.size = (frame.size + size - 1) / size * size + size;
+            slot[v] = frame.size;
+        }
+        return StackLocation{.offset = slot[v]};
+    };
+
+    // (position, register) of every split that needs a write back
+    std::vector<std::pair<int, int>> splits;
+    for (int v = 0; v < count; v++) {
+        if (decisions.spillAt[v] > intervals.start[v] && !rematerializable(v)) {
+            splits.emplace_back(decisions.spillAt[v], v);
+        }
+    }
+    std::ranges::sort(splits);
+    auto nextSplit = splits.begin();
 
-            return HardcodedRegister{ctx.mapping[reg], reg.size};
+    auto nextRegister = count;
+    std::vector<Instruction> instructions;
+    instructions.reserve(frame.instructions.size() + 4 * decisions.count);
+    for (auto [idx, ins] : frame.instructions | std::views::enumerate) {
+        const auto position = static_cast<int>(idx);
+        auto instruction = ins;
+        std::vector<Instruction> after;
+        auto spilledAt = [&](const std::optional<VirtualRegister>& reg) {
+            return reg.has_value() &&
+                   decisions.spillAt[reg->id] != no_register &&
+                   decisions.spillAt[reg->id] <= position;
         };
-        auto src_op = get_src_register(operation);
-        if (src_op.has_value()) {
-            auto src_reg = process_register(src_op.value());
-            set_src_register(operation, src_reg);
+        const auto src = get_src_register(instruction);
+        const auto dest = get_dest_register(instruction);
+        // the part before a split keeps its register, write it back once
+        for (; nextSplit != splits.end() && nextSplit->first == position;
+             ++nextSplit) {
+            const auto v = nextSplit->second;
+            instructions.emplace_back(
+                Store{.dst = slotFor(v),
+                      .src = VirtualRegister{.id = v, .size = slotSize(v)}});
+            stats.stores++;
         }
-        auto dest_op = get_dest_register(operation);
-        if (dest_op.has_value()) {
-            auto dest_reg = process_register(dest_op.value());
-            set_dest_register(operation, dest_reg);
+        // the single definition of a rematerialized register goes away
+        if (dest.has_value() && spilledAt(dest) &&
+            rematerializable(dest->id) &&
+            intervals.start[dest->id] == position && writes_dest(ins)) {
+            continue;
         }
-        newInstructions.push_back(operation);
+        auto reload = [&](int v, int size) {
+            const auto fresh =
+                VirtualRegister{.id = nextRegister++, .size = size};
+            if (rematerializable(v)) {
+                instructions.emplace_back(
+                    LoadI{.dst = fresh, .value = constant[v].value()});
+                stats.rematerialized++;
+            } else {
+                instructions.emplace_back(
+                    Load{.dst = fresh, .src = slotFor(v)});
+                stats.reloads++;
+            }
+            return fresh;
+        };
+        std::optional<VirtualRegister> replacedSrc;
+        if (spilledAt(src)) {
+            replacedSrc = reload(src->id, src->size);
+            set_src_register(instruction, replacedSrc.value());
+        }
+        if (spilledAt(dest)) {
+            const auto v = dest->id;
+            VirtualRegister fresh{.id = nextRegister, .size = dest->size};
+            if (src.has_value() && src->id == v) {
+                fresh = replacedSrc.value();
+            } else if (reads_dest(ins)) {
+                fresh = reload(v, dest->size);
+            } else {
+                nextRegister++;
+            }
+            set_dest_register(instruction, fresh);
+            if (writes_dest(ins)) {
+                after.emplace_back(Store{.dst = slotFor(v), .src = fresh});
+                stats.stores++;
+            }
+        }
+        instructions.push_back(instruction);
+        instructions.insert(instructions.end(), after.begin(), after.end());
+    }
+    frame.instructions = std::move(instructions);
+}
+
+void rewrite(Frame& frame, AllocationStats& stats, bool framePointer) {
+    while (true) {
+        const auto intervals = computeLiveIntervals(frame);
+        const auto layout = computeFrameLayout(frame, intervals);
+        AllocatorContext ctx(static_cast<int>(intervals.start.size()),
+                             usable_registers(framePointer));
+        const auto decisions = linearScan(intervals, layout, ctx);
+        if (decisions.count == 0) {
+            for (auto& instruction : frame.instructions) {
+                auto physical = [&ctx](VirtualRegister reg) {
+                    return HardcodedRegister{
+                        register_file[ctx.mapping[reg.id]], reg.size};
+                };
+                if (auto src = get_src_register(instruction)) {
+                    set_src_register(instruction, physical(src.value()));
+                }
+                if (auto dest = get_dest_register(instruction)) {
+                    set_dest_register(instruction, physical(dest.value()));
+                }
+            }
+            return;
+        }
+        for (int v = 0; v < static_cast<int>(decisions.spillAt.size()); v++) {
+            if (decisions.spillAt[v] == no_register) {
+                continue;
+            }
+            stats.spilled++;
+            if (decisions.spillAt[v] > intervals.start[v]) {
+                stats.split++;
+            }
+        }
+        insertSpillCode(frame, intervals, decisions, stats);
     }
-    newFrame.instructions = newInstructions;
-    return newFrame;
 }
 
-[[nodiscard]] std::vector<Frame> rewrite(const std::vector<Frame>& frames) {
-    std::vector<Frame> newFrames;
-    for (const auto& frame : frames) {
-        AllocatorContext ctx;
-        newFrames.push_back(rewrite(frame, ctx));
+[[nodiscard]] std::vector<Frame> rewrite(std::vector<Frame> frames,
+                                         AllocationStats& stats,
+                                         RegisterAllocator allocator,
+                                         bool omitFramePointer) {
+    for (auto& frame : frames) {
+        const auto framePointer =
+            !omitFramePointer || pushes_arguments(frame);
+        if (allocator == RegisterAllocator::Graph) {
+            colorGraph(frame, stats, framePointer);
+        } else {
+            rewrite(frame, stats, framePointer);
+        }
     }
-    return newFrames;
+    return frames;
+}
+
+[[nodiscard]] std::vector<Frame> rewrite(std::vector<Frame> frames) {
+    AllocationStats stats;
+    return rewrite(std::move(frames), stats);
 }
-}  // namespace target
+}  // namespace target
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "../include/analysis.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+[[nodiscard]] std::uint8_t bit(Analysis analysis) {
+    return static_cast<std::uint8_t>(analysis);
+}
+
+// computes the analysis into slot unless it is there already
+template <typename T, typename F>
+const T& cached(std::optional<T>& slot, int& computations, F&& compute) {
+    if (!slot.has_value()) {
+        slot.emplace(compute());
+        computations++;
+    }
+    return *slot;
+}
+}  // namespace
+
+PreservedAnalyses PreservedAnalyses::All() {
+    PreservedAnalyses all;
+    all.bits = 0xFF;
+    return all;
+}
+
+PreservedAnalyses PreservedAnalyses::None() { return PreservedAnalyses{}; }
+
+PreservedAnalyses PreservedAnalyses::Blocks() {
+    auto blocks = All();
+    blocks.bits &= static_cast<std::uint8_t>(~bit(Analysis::CFG));
+    return blocks;
+}
+
+PreservedAnalyses& PreservedAnalyses::Preserve(Analysis analysis) {
+    bits |= bit(analysis);
+    return *this;
+}
+
+bool PreservedAnalyses::Preserves(Analysis analysis) const {
+    return (bits & bit(analysis)) != 0;
+}
+
+const ControlFlowGraph& FrameAnalyses::CFG() {
+    return cached(cfg, computations, [this] { return BuildCFG(*frame); });
+}
+
+const DominatorTree& FrameAnalyses::Dominators() {
+    return cached(dominators, computations,
+                  [this] { return ComputeDominators(CFG()); });
+}
+
+const std::vector<std::vector<int>>& FrameAnalyses::Frontiers() {
+    return cached(frontiers, computations,
+                  [this] { return DominanceFrontiers(CFG(), Dominators()); });
+}
+
+const DominatorTree& FrameAnalyses::PostDominators() {
+    return cached(postDominators, computations,
+                  [this] { return ComputePostDominators(CFG()); });
+}
+
+const LoopForest& FrameAnalyses::Loops() {
+    return cached(loops, computations,
+                  [this] { return BuildLoopForest(CFG(), Dominators()); });
+}
+
+void FrameAnalyses::Invalidate(const PreservedAnalyses& preserved) {
+    const auto keepDominators = preserved.Preserves(Analysis::Dominators);
+    if (!preserved.Preserves(Analysis::CFG)) {
+        cfg.reset();
+    }
+    if (!keepDominators) {
+        dominators.reset();
+    }
+    if (!keepDominators ||
+        !preserved.Preserves(Analysis::DominanceFrontiers)) {
+        frontiers.reset();
+    }
+    if (!preserved.Preserves(Analysis::PostDominators)) {
+        postDominators.reset();
+    }
+    if (!keepDominators || !preserved.Preserves(Analysis::Loops)) {
+        loops.reset();
+    }
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <map>
+#include <optional>
 #include <stdexcept>
 
 namespace qa_ir {
@@ -81,7 +82,12 @@ Value GenerateIRForRhs(std::vector<Operation>& ins, const ast::Node* node,
             const auto varDataType = var->variableType;
             assert(varDataType.pointsTo != nullptr);
             const auto depth = node->derefDepth;
-            auto dst = ctx.newTemp(varDataType.pointsTo->size);
+            // **p loads what the pointer p points to points to
+            const auto* pointee = varDataType.pointsTo;
+            for (int i = 1; i < depth && pointee->pointsTo != nullptr; i++) {
+                pointee = pointee->pointsTo;
+            }
+            auto dst = ctx.newTemp(pointee->size);
             auto deref_instruction =
                 Deref{.dst = dst, .src = src, .depth = depth};
             ins.emplace_back(deref_instruction);
@@ -229,12 +235,22 @@ void GenerateIRForIf(std::vector<Operation>& ins,
     auto then_jump_instruction = LabelDef{.label = then_label};
     ins.emplace_back(then_jump_instruction);
     ins.insert(ins.end(), then_instructions.begin(), then_instructions.end());
+    // the then block continues past the else block, not into it
+    const auto end_label = else_instructions.size() > 0
+                               ? std::optional<Label>(ctx.newLabel())
+                               : std::nullopt;
+    if (end_label.has_value()) {
+        ins.emplace_back(Jump{.label = *end_label});
+    }
     auto else_jump_instruction = LabelDef{.label = else_label};
     ins.emplace_back(else_jump_instruction);
     if (else_instructions.size() > 0) {
         ins.insert(ins.end(), else_instructions.begin(),
                    else_instructions.end());
     }
+    if (end_label.has_value()) {
+        ins.emplace_back(LabelDef{.label = *end_label});
+    }
 }
 
 void MunchStmt(std::vector<Operation>& ins,
@@ -280,21 +296,23 @@ void MunchStmt(std::vector<Operation>& ins,
         }
         const auto name = node->functionName;
         std::vector<Operation> instructions;
+        // ctx.variables points at these, so they live as long as ctx
+        std::vector<std::unique_ptr<ast::Node>> params;
         for (auto [p, idx] =
                  std::tuple{node->params.begin(), static_cast<size_t>(0)};
              p != node->params.end(); ++p, ++idx) {
             if (idx >= target::param_regs.size()) {
-                auto var = ast::makeNewVar(p->name, p->type);
-                auto dst = ctx.AddVariable(var.get());
+                params.push_back(ast::makeNewVar(p->name, p->type));
+                ctx.AddVariable(params.back().get());
                 auto i =
                     DefineStackPushed{.name = p->name, .size = p->type.size};
                 instructions.emplace_back(i);
                 continue;
             }
             // create a variable node for the paramter
-            auto var = ast::makeNewVar(p->name, p->type);
+            params.push_back(ast::makeNewVar(p->name, p->type));
             // create a stack location for the variable
-            auto dst = ctx.AddVariable(var.get());
+            auto dst = ctx.AddVariable(params.back().get());
             const auto param_register = target::param_regs.at(idx);
             auto src = target::HardcodedRegister{.reg = param_register,
                                                  .size = p->type.size};
@@ -309,4 +327,23 @@ void MunchStmt(std::vector<Operation>& ins,
     }
     return frames;
 }
+
+bool IsParameter(const Operation& op) {
+    return std::holds_alternative<MovR>(op) ||
+           std::holds_alternative<DefineStackPushed>(op);
+}
+
+std::vector<Variable> FrameParameters(const Frame& frame) {
+    std::vector<Variable> parameters;
+    for (const auto& op : frame.instructions) {
+        if (const auto* mov = std::get_if<MovR>(&op)) {
+            parameters.push_back(std::get<Variable>(mov->dst));
+        } else if (const auto* pushed = std::get_if<DefineStackPushed>(&op)) {
+            parameters.push_back(Variable{pushed->name, 1, pushed->size});
+        } else {
+            break;
+        }
+    }
+    return parameters;
+}
 }  // namespace qa_ir
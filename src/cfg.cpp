@@ -0,0 +1,515 @@
+#include "../include/cfg.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <numeric>
+#include <ranges>
+#include <set>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/analysis.hpp"
+
+namespace qa_ir {
+
+FreshNames::FreshNames(const Frame& frame) {
+    auto see = [this](const Value& value) {
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            nextTemp = std::max(nextTemp, temp->id + 1);
+        }
+    };
+    for (const auto& op : frame.instructions) {
+        if (const auto* dst = defined_value(op)) {
+            see(*dst);
+        }
+        for_each_used_value(op, see);
+        const auto* label = std::get_if<LabelDef>(&op);
+        if (label == nullptr || !label->label.name.starts_with("L")) {
+            continue;
+        }
+        const auto digits = label->label.name.substr(1);
+        if (!digits.empty() && std::ranges::all_of(digits, [](char c) {
+                return c >= '0' && c <= '9';
+            })) {
+            nextLabel = std::max(nextLabel, std::stoi(digits) + 1);
+        }
+    }
+}
+
+Temp FreshNames::NewTemp(int size) { return Temp{nextTemp++, size}; }
+
+Label FreshNames::NewLabel() {
+    return Label{"L" + std::to_string(nextLabel++)};
+}
+
+bool NormalizeBlocks(Frame& frame, FreshNames& names) {
+    std::vector<Operation> labelled;
+    labelled.reserve(frame.instructions.size() + 1);
+    bool leader = true;
+    bool changed = false;
+    for (auto& op : frame.instructions) {
+        if (leader && !std::holds_alternative<LabelDef>(op)) {
+            labelled.emplace_back(LabelDef{.label = names.NewLabel()});
+            changed = true;
+        }
+        leader = is_terminator(op);
+        labelled.push_back(std::move(op));
+    }
+    frame.instructions = std::move(labelled);
+
+    auto cfg = BuildCFG(frame);
+    if (cfg.blocks.empty()) {
+        return changed;
+    }
+    std::vector<bool> reachable(cfg.blocks.size(), false);
+    std::vector<int> worklist = {0};
+    reachable[0] = true;
+    while (!worklist.empty()) {
+        const auto b = worklist.back();
+        worklist.pop_back();
+        for (const auto s : cfg.blocks[b].successors) {
+            if (!reachable[s]) {
+                reachable[s] = true;
+                worklist.push_back(s);
+            }
+        }
+    }
+    if (!std::ranges::all_of(reachable, [](bool r) { return r; })) {
+        std::vector<Operation> kept;
+        kept.reserve(frame.instructions.size());
+        for (const auto& [b, block] : cfg.blocks | std::views::enumerate) {
+            if (!reachable[b]) {
+                continue;
+            }
+            for (int i = block.begin; i < block.end; i++) {
+                kept.push_back(std::move(frame.instructions[i]));
+            }
+        }
+        frame.instructions = std::move(kept);
+        cfg = BuildCFG(frame);
+        changed = true;
+    }
+
+    // phis only keep the arguments of blocks that still branch to them
+    for (const auto& block : cfg.blocks) {
+        for (int i = block.begin + 1; i < block.end; i++) {
+            auto* phi = std::get_if<Phi>(&frame.instructions[i]);
+            if (phi == nullptr) {
+                break;
+            }
+            std::erase_if(phi->args, [&](const PhiArgument& incoming) {
+                const auto it = cfg.blockOf.find(incoming.predecessor.name);
+                return it == cfg.blockOf.end() ||
+                       std::ranges::find(block.predecessors, it->second) ==
+                           block.predecessors.end();
+            });
+        }
+    }
+    return changed;
+}
+
+ControlFlowGraph BuildCFG(const Frame& frame) {
+    ControlFlowGraph cfg;
+    const auto n = static_cast<int>(frame.instructions.size());
+    for (int i = 0; i < n; i++) {
+        const auto* label = std::get_if<LabelDef>(&frame.instructions[i]);
+        if (label == nullptr) {
+            continue;
+        }
+        if (!cfg.blocks.empty()) {
+            cfg.blocks.back().end = i;
+        }
+        cfg.blockOf[label->label.name] = static_cast<int>(cfg.blocks.size());
+        cfg.blocks.push_back(
+            BasicBlock{.label = label->label.name, .begin = i, .end = n});
+    }
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    for (int b = 0; b < blocks; b++) {
+        auto& block = cfg.blocks[b];
+        const auto& last = frame.instructions[block.end - 1];
+        if (!is_terminator(last)) {
+            if (b + 1 < blocks) {
+                block.successors.push_back(b + 1);
+            }
+        }
+        for (const auto& label : successor_labels(last)) {
+            const auto s = cfg.blockOf.at(label.name);
+            if (std::ranges::find(block.successors, s) ==
+                block.successors.end()) {
+                block.successors.push_back(s);
+            }
+        }
+        for (const auto s : block.successors) {
+            cfg.blocks[s].predecessors.push_back(b);
+        }
+    }
+    return cfg;
+}
+
+int InsertionPoint(const Frame& frame, const BasicBlock& block) {
+    const auto& ops = frame.instructions;
+    auto at = block.end;
+    if (!is_terminator(ops[at - 1])) {
+        return at;
+    }
+    at--;
+    if (successor_labels(ops[at]).size() == 2 && at - 1 > block.begin &&
+        std::holds_alternative<Compare>(ops[at - 1])) {
+        at--;
+    }
+    return at;
+}
+
+namespace {
+
+// Cooper, Harvey and Kennedy over nodes [0, nodes) and the edges the two
+// functions return for a node, from root
+template <typename Successors, typename Predecessors>
+[[nodiscard]] DominatorTree dominators_of(int nodes, int root,
+                                          Successors&& successors,
+                                          Predecessors&& predecessors) {
+    DominatorTree tree{.idom = std::vector<int>(nodes, -1),
+                       .children = std::vector<std::vector<int>>(nodes),
+                       .reversePostorder = {},
+                       .enter = std::vector<int>(nodes, -1),
+                       .exit = std::vector<int>(nodes, -1)};
+    if (nodes == 0) {
+        return tree;
+    }
+    // iterative depth first walk for the postorder
+    std::vector<int> postorder;
+    std::vector<bool> visited(nodes, false);
+    std::vector<std::pair<int, std::size_t>> stack = {{root, 0}};
+    visited[root] = true;
+    while (!stack.empty()) {
+        auto& [b, next] = stack.back();
+        const auto& out = successors(b);
+        if (next < out.size()) {
+            const auto s = out[next++];
+            if (!visited[s]) {
+                visited[s] = true;
+                stack.emplace_back(s, 0);
+            }
+            continue;
+        }
+        postorder.push_back(b);
+        stack.pop_back();
+    }
+    tree.reversePostorder.assign(postorder.rbegin(), postorder.rend());
+    std::vector<int> order(nodes, -1);
+    for (const auto& [i, b] : postorder | std::views::enumerate) {
+        order[b] = static_cast<int>(i);
+    }
+
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (order[a] < order[b]) {
+                a = tree.idom[a];
+            }
+            while (order[b] < order[a]) {
+                b = tree.idom[b];
+            }
+        }
+        return a;
+    };
+    tree.idom[root] = root;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto b : tree.reversePostorder) {
+            if (b == root) {
+                continue;
+            }
+            int idom = -1;
+            for (const auto p : predecessors(b)) {
+                if (tree.idom[p] == -1) {
+                    continue;
+                }
+                idom = idom == -1 ? p : intersect(p, idom);
+            }
+            if (idom != tree.idom[b]) {
+                tree.idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+    for (const auto b : tree.reversePostorder) {
+        if (b != root) {
+            tree.children[tree.idom[b]].push_back(b);
+        }
+    }
+
+    // number the tree so that dominance is a nesting of intervals
+    int clock = 0;
+    std::vector<std::pair<int, std::size_t>> walk = {{root, 0}};
+    tree.enter[root] = clock++;
+    while (!walk.empty()) {
+        auto& [b, next] = walk.back();
+        if (next < tree.children[b].size()) {
+            const auto c = tree.children[b][next++];
+            tree.enter[c] = clock++;
+            walk.emplace_back(c, 0);
+            continue;
+        }
+        tree.exit[b] = clock++;
+        walk.pop_back();
+    }
+    return tree;
+}
+}  // namespace
+
+DominatorTree ComputeDominators(const ControlFlowGraph& cfg) {
+    return dominators_of(
+        static_cast<int>(cfg.blocks.size()), 0,
+        [&cfg](int b) -> const std::vector<int>& {
+            return cfg.blocks[b].successors;
+        },
+        [&cfg](int b) -> const std::vector<int>& {
+            return cfg.blocks[b].predecessors;
+        });
+}
+
+DominatorTree ComputePostDominators(const ControlFlowGraph& cfg) {
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    const auto exit = blocks;
+    // the reversed edges, with the exit behind every block that leaves
+    std::vector<std::vector<int>> successors(blocks + 1);
+    std::vector<std::vector<int>> predecessors(blocks + 1);
+    for (int b = 0; b < blocks; b++) {
+        successors[b] = cfg.blocks[b].predecessors;
+        predecessors[b] = cfg.blocks[b].successors;
+        if (cfg.blocks[b].successors.empty()) {
+            successors[exit].push_back(b);
+            predecessors[b].push_back(exit);
+        }
+    }
+    return dominators_of(
+        blocks + 1, exit,
+        [&](int b) -> const std::vector<int>& { return successors[b]; },
+        [&](int b) -> const std::vector<int>& { return predecessors[b]; });
+}
+
+std::vector<std::vector<int>> DominanceFrontiers(const ControlFlowGraph& cfg,
+                                                 const DominatorTree& tree) {
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    std::vector<std::vector<int>> frontiers(blocks);
+    for (int b = 0; b < blocks; b++) {
+        const auto& predecessors = cfg.blocks[b].predecessors;
+        if (predecessors.size() < 2 || tree.idom[b] == -1) {
+            continue;
+        }
+        for (const auto p : predecessors) {
+            for (auto runner = p; runner != tree.idom[b];
+                 runner = tree.idom[runner]) {
+                auto& frontier = frontiers[runner];
+                if (frontier.empty() || frontier.back() != b) {
+                    frontier.push_back(b);
+                }
+            }
+        }
+    }
+    return frontiers;
+}
+
+bool Dominates(const DominatorTree& tree, int a, int b) {
+    if (a == b) {
+        return true;
+    }
+    if (tree.enter[a] == -1 || tree.enter[b] == -1) {
+        return false;
+    }
+    return tree.enter[a] < tree.enter[b] && tree.exit[b] < tree.exit[a];
+}
+
+bool Loop::contains(int b) const {
+    return std::ranges::binary_search(blocks, b);
+}
+
+std::vector<Loop> FindNaturalLoops(const ControlFlowGraph& cfg,
+                                   const DominatorTree& tree) {
+    std::map<int, Loop> byHeader;
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    for (int b = 0; b < blocks; b++) {
+        for (const auto h : cfg.blocks[b].successors) {
+            if (!Dominates(tree, h, b)) {
+                continue;
+            }
+            auto& loop =
+                byHeader.try_emplace(h, Loop{.header = h}).first->second;
+            loop.latches.push_back(b);
+            // everything reaching the latch without passing the header
+            std::set<int> body(loop.blocks.begin(), loop.blocks.end());
+            body.insert(h);
+            std::vector<int> worklist;
+            if (body.insert(b).second) {
+                worklist.push_back(b);
+            }
+            while (!worklist.empty()) {
+                const auto x = worklist.back();
+                worklist.pop_back();
+                for (const auto p : cfg.blocks[x].predecessors) {
+                    if (body.insert(p).second) {
+                        worklist.push_back(p);
+                    }
+                }
+            }
+            loop.blocks.assign(body.begin(), body.end());
+        }
+    }
+    std::vector<Loop> loops;
+    for (auto& [header, loop] : byHeader) {
+        loops.push_back(std::move(loop));
+    }
+    std::ranges::stable_sort(loops, {}, [](const Loop& loop) {
+        return loop.blocks.size();
+    });
+    return loops;
+}
+
+LoopForest BuildLoopForest(const ControlFlowGraph& cfg,
+                           const DominatorTree& tree) {
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    LoopForest forest{.loops = FindNaturalLoops(cfg, tree)};
+    const auto loops = static_cast<int>(forest.loops.size());
+    forest.parent.assign(loops, -1);
+    forest.children.assign(loops, {});
+    forest.loopOf.assign(blocks, -1);
+    forest.depth.assign(blocks, 0);
+    // Natural loops of different headers are disjoint or nested, and inner
+    // ones come first, so the first loop that meets a block is its
+    // innermost one. outermost[l] leads from a loop to the outermost loop
+    // around it found so far, shortened along the way.
+    std::vector<int> outermost(loops);
+    std::iota(outermost.begin(), outermost.end(), 0);
+    auto find = [&](int l) {
+        auto root = l;
+        while (outermost[root] != root) {
+            root = outermost[root];
+        }
+        while (outermost[l] != root) {
+            l = std::exchange(outermost[l], root);
+        }
+        return root;
+    };
+    for (int l = 0; l < loops; l++) {
+        for (const auto b : forest.loops[l].blocks) {
+            if (forest.loopOf[b] == -1) {
+                forest.loopOf[b] = l;
+                continue;
+            }
+            const auto inner = find(forest.loopOf[b]);
+            if (inner != l) {
+                forest.parent[inner] = l;
+                forest.children[l].push_back(inner);
+                outermost[inner] = l;
+            }
+        }
+    }
+    // a loop comes before the loops around it
+    std::vector<int> loopDepth(loops, 1);
+    for (int l = loops - 1; l >= 0; l--) {
+        if (forest.parent[l] != -1) {
+            loopDepth[l] = loopDepth[forest.parent[l]] + 1;
+        }
+    }
+    for (int b = 0; b < blocks; b++) {
+        if (forest.loopOf[b] != -1) {
+            forest.depth[b] = loopDepth[forest.loopOf[b]];
+        }
+    }
+    return forest;
+}
+
+std::string EnsurePreheader(Frame& frame, FreshNames& names,
+                            const ControlFlowGraph& cfg, const Loop& loop) {
+    const auto& header = cfg.blocks[loop.header];
+    std::vector<int> entering;
+    for (const auto p : header.predecessors) {
+        if (!loop.contains(p)) {
+            entering.push_back(p);
+        }
+    }
+    if (entering.size() == 1 &&
+        cfg.blocks[entering.front()].successors.size() == 1) {
+        return cfg.blocks[entering.front()].label;
+    }
+
+    auto& ops = frame.instructions;
+    const auto label = names.NewLabel();
+    std::vector<Operation> preheader = {LabelDef{.label = label}};
+    for (int i = header.begin + 1; i < header.end; i++) {
+        auto* phi = std::get_if<Phi>(&ops[i]);
+        if (phi == nullptr) {
+            break;
+        }
+        std::vector<PhiArgument> outside;
+        std::erase_if(phi->args, [&](const PhiArgument& incoming) {
+            if (loop.contains(cfg.blockOf.at(incoming.predecessor.name))) {
+                return false;
+            }
+            outside.push_back(incoming);
+            return true;
+        });
+        if (outside.size() == 1) {
+            phi->args.push_back(
+                PhiArgument{.predecessor = label, .value = outside[0].value});
+            continue;
+        }
+        const auto merged = names.NewTemp(SizeOf(phi->dst));
+        preheader.emplace_back(Phi{.dst = merged, .args = std::move(outside)});
+        phi->args.push_back(PhiArgument{.predecessor = label, .value = merged});
+    }
+    for (const auto p : entering) {
+        retarget(ops[cfg.blocks[p].end - 1], header.label, label);
+    }
+    // a loop block falling into the header has to jump over the preheader
+    if (loop.header > 0 && loop.contains(loop.header - 1) &&
+        !is_terminator(ops[header.begin - 1])) {
+        preheader.insert(preheader.begin(),
+                         Jump{.label = Label{header.label}});
+    }
+    ops.insert(ops.begin() + header.begin, preheader.begin(), preheader.end());
+    return label.name;
+}
+
+void ForEachLoop(Frame& frame, FreshNames& names, FrameAnalyses& analyses,
+                 const LoopVisitor& visit) {
+    // loops are told apart by the labels of their headers, which stay
+    std::set<std::string> pending;
+    for (const auto& loop : analyses.Loops().loops) {
+        if (loop.header != 0) {
+            pending.insert(analyses.CFG().blocks[loop.header].label);
+        }
+    }
+    auto find = [&analyses](const std::set<std::string>& headers) {
+        const auto& cfg = analyses.CFG();
+        const auto& loops = analyses.Loops().loops;
+        const auto it = std::ranges::find_if(loops, [&](const Loop& loop) {
+            return headers.contains(cfg.blocks[loop.header].label);
+        });
+        return static_cast<int>(it - loops.begin());
+    };
+    while (true) {
+        const auto next = find(pending);
+        const auto& loops = analyses.Loops().loops;
+        if (next == static_cast<int>(loops.size())) {
+            return;
+        }
+        const auto& cfg = analyses.CFG();
+        const auto header = cfg.blocks[loops[next].header].label;
+        pending.erase(header);
+        const auto preheader = EnsurePreheader(frame, names, cfg, loops[next]);
+        auto loop = next;
+        if (!cfg.blockOf.contains(preheader)) {
+            analyses.Invalidate(PreservedAnalyses::None());
+            loop = find({header});
+        }
+        if (visit(loop, preheader)) {
+            analyses.Invalidate(PreservedAnalyses::None());
+        }
+    }
+}
+}  // namespace qa_ir
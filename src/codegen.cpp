@@ -1,15 +1,58 @@
 #include "../include/codegen.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <ranges>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
 
 namespace codegen {
+
+// bytes below rsp that signal handlers leave alone, System V
+const int red_zone = 128;
+
+// How a frame reaches its slots. The prologue pushes the callee-saved
+// registers the frame uses, then rbp when it is the frame pointer, and
+// moves rsp down by adjust. Slot offsets count down from where rsp was
+// after the pushes: rbp with a frame pointer, adjust above rsp without.
+struct FrameLayout {
+    bool framePointer = true;
+    std::vector<target::BaseRegister> saved = {};
+    // bytes the prologue pushes
+    int pushed = 0;
+    int adjust = 0;
+};
+
 class Ctx {
    public:
     std::string Code;
+    FrameLayout layout;
 
     void AddInstructionNoIndent(const std::string& i) { Code += (i + "\n"); }
 
     void AddInstruction(const std::string& i) { Code += "\t" + i + "\n"; }
+
+    [[nodiscard]] std::string Slot(target::StackLocation sl) const {
+        const auto base = layout.framePointer ? "rbp" : "rsp";
+        auto displacement =
+            (layout.framePointer ? 0 : layout.adjust) - sl.offset;
+        if (sl.offset < 0) {
+            // incoming arguments start at offset -16, past the pushes and
+            // the return address
+            displacement += layout.pushed - target::address_size;
+        }
+        if (displacement == 0) {
+            return std::string("[") + base + "]";
+        }
+        if (displacement < 0) {
+            return std::string("[") + base + " - " +
+                   std::to_string(-displacement) + "]";
+        }
+        return std::string("[") + base + " + " + std::to_string(displacement) +
+               "]";
+    }
 };
 
 void MoveInstruction(const target::Mov mov, Ctx& ctx) {
@@ -19,11 +62,26 @@ void MoveInstruction(const target::Mov mov, Ctx& ctx) {
     ctx.AddInstruction("mov " + target::to_asm(mov));
 }
 
-std::string to_asm(target::StackLocation sl) {
-    if (sl.offset >= 0) {
-        return " [rbp - " + std::to_string(sl.offset) + "]";
-    }
-    return " [rbp + " + std::to_string(-sl.offset) + "]";
+std::string to_asm(target::StackLocation sl, const Ctx& ctx) {
+    return " " + ctx.Slot(sl);
+}
+
+std::string sizeString(int size) {
+    return size == 4 ? std::string("dword") : std::string("qword");
+}
+
+std::string to_asm(const target::Register& reg) {
+    const auto hardcoded = std::get<target::HardcodedRegister>(reg);
+    return target::to_asm(hardcoded.reg, hardcoded.size);
+}
+
+int sizeOf(const target::Register& reg) {
+    return std::get<target::HardcodedRegister>(reg).size;
+}
+
+// the register as an address, which is always 64 bits wide
+std::string addressOf(const target::Register& reg) {
+    return target::to_asm(std::get<target::HardcodedRegister>(reg).reg, 8);
 }
 
 void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
@@ -41,14 +99,14 @@ void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
     } else if (std::holds_alternative<target::StoreI>(is)) {
         const auto storeI = std::get<target::StoreI>(is);
         const auto sourcesizeString = std::string("dword");
-        ctx.AddInstruction("mov " + sourcesizeString + to_asm(storeI.dst) +
+        ctx.AddInstruction("mov " + sourcesizeString + to_asm(storeI.dst, ctx) +
                            ", " + std::to_string(storeI.value));
     } else if (std::holds_alternative<target::Store>(is)) {
         const auto store = std::get<target::Store>(is);
         const auto src = std::get<target::HardcodedRegister>(store.src);
         const auto sourcesizeString =
             src.size == 4 ? std::string("dword") : std::string("qword");
-        ctx.AddInstruction("mov " + sourcesizeString + to_asm(store.dst) +
+        ctx.AddInstruction("mov " + sourcesizeString + to_asm(store.dst, ctx) +
                            ", " + target::to_asm(src.reg, src.size));
     } else if (std::holds_alternative<target::Load>(is)) {
         const auto load = std::get<target::Load>(is);
@@ -56,7 +114,7 @@ void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
         const auto sourcesizeString =
             dst.size == 4 ? std::string("dword") : std::string("qword");
         ctx.AddInstruction("mov " + target::to_asm(dst.reg, dst.size) + ", " +
-                           sourcesizeString + to_asm(load.src));
+                           sourcesizeString + to_asm(load.src, ctx));
     } else if (std::holds_alternative<target::AddI>(is)) {
         const auto addI = std::get<target::AddI>(is);
         const auto dst = std::get<target::HardcodedRegister>(addI.dst);
@@ -101,6 +159,9 @@ void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
         ctx.AddInstruction("je ." + jump.label);
     } else if (std::holds_alternative<target::Label>(is)) {
         const auto label = std::get<target::Label>(is);
+        if (label.align) {
+            ctx.AddInstruction("align 16");
+        }
         ctx.AddInstructionNoIndent("." + label.name + ":");
     } else if (std::holds_alternative<target::Call>(is)) {
         const auto call = std::get<target::Call>(is);
@@ -109,8 +170,8 @@ void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
         const auto lea = std::get<target::Lea>(is);
         const auto dst = std::get<target::HardcodedRegister>(lea.dst);
         const auto dstsize = dst.size;
-        ctx.AddInstruction("lea " + target::to_asm(dst.reg, dstsize) +
-                           ", [rbp - " + std::to_string(lea.src.offset) + "]");
+        ctx.AddInstruction("lea " + target::to_asm(dst.reg, dstsize) + ", " +
+                           ctx.Slot(lea.src));
     } else if (std::holds_alternative<target::IndirectLoad>(is)) {
         const auto imao = std::get<target::IndirectLoad>(is);
         const auto dst = std::get<target::HardcodedRegister>(imao.dst);
@@ -145,21 +206,89 @@ void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
         ctx.AddInstruction("push " + target::to_asm(src.reg, 8));
     } else if (std::holds_alternative<target::AddMI>(is)) {
         const auto addMI = std::get<target::AddMI>(is);
-        const target::StackLocation dst = addMI.dst;
-        const auto v = addMI.value;
-        const auto sourceSizeString = std::string("dword");
-        ctx.AddInstruction("add " + sourceSizeString + to_asm(dst) + ", " +
-                           std::to_string(v));
+        ctx.AddInstruction("add " + sizeString(addMI.size) +
+                           to_asm(addMI.dst, ctx) + ", " +
+                           std::to_string(addMI.value));
     } else if (std::holds_alternative<target::SubMI>(is)) {
         const auto subMI = std::get<target::SubMI>(is);
-        const target::StackLocation dst = subMI.dst;
-        const auto v = subMI.value;
-        std::string sourceSizeString = std::string("dword");
-        ctx.AddInstruction("add " + sourceSizeString + to_asm(dst) + ", " +
-                           std::to_string(v));
+        ctx.AddInstruction("sub " + sizeString(subMI.size) +
+                           to_asm(subMI.dst, ctx) + ", " +
+                           std::to_string(subMI.value));
+    } else if (std::holds_alternative<target::IncM>(is)) {
+        const auto incM = std::get<target::IncM>(is);
+        ctx.AddInstruction("inc " + sizeString(incM.size) +
+                           to_asm(incM.dst, ctx));
+    } else if (std::holds_alternative<target::DecM>(is)) {
+        const auto decM = std::get<target::DecM>(is);
+        ctx.AddInstruction("dec " + sizeString(decM.size) +
+                           to_asm(decM.dst, ctx));
+    } else if (std::holds_alternative<target::AddM>(is)) {
+        const auto addM = std::get<target::AddM>(is);
+        ctx.AddInstruction("add " + sizeString(sizeOf(addM.src)) +
+                           to_asm(addM.dst, ctx) + ", " + to_asm(addM.src));
+    } else if (std::holds_alternative<target::SubM>(is)) {
+        const auto subM = std::get<target::SubM>(is);
+        ctx.AddInstruction("sub " + sizeString(sizeOf(subM.src)) +
+                           to_asm(subM.dst, ctx) + ", " + to_asm(subM.src));
+    } else if (std::holds_alternative<target::Inc>(is)) {
+        ctx.AddInstruction("inc " + to_asm(std::get<target::Inc>(is).dst));
+    } else if (std::holds_alternative<target::Dec>(is)) {
+        ctx.AddInstruction("dec " + to_asm(std::get<target::Dec>(is).dst));
+    } else if (std::holds_alternative<target::AddRM>(is)) {
+        const auto addRM = std::get<target::AddRM>(is);
+        ctx.AddInstruction("add " + to_asm(addRM.dst) + ", " +
+                           sizeString(sizeOf(addRM.dst)) +
+                           to_asm(addRM.src, ctx));
+    } else if (std::holds_alternative<target::SubRM>(is)) {
+        const auto subRM = std::get<target::SubRM>(is);
+        ctx.AddInstruction("sub " + to_asm(subRM.dst) + ", " +
+                           sizeString(sizeOf(subRM.dst)) +
+                           to_asm(subRM.src, ctx));
+    } else if (std::holds_alternative<target::AddIndirect>(is)) {
+        const auto add = std::get<target::AddIndirect>(is);
+        ctx.AddInstruction("add " + to_asm(add.dst) + ", [" +
+                           addressOf(add.src) + "]");
+    } else if (std::holds_alternative<target::SubIndirect>(is)) {
+        const auto sub = std::get<target::SubIndirect>(is);
+        ctx.AddInstruction("sub " + to_asm(sub.dst) + ", [" +
+                           addressOf(sub.src) + "]");
+    } else if (std::holds_alternative<target::LeaOffset>(is)) {
+        const auto lea = std::get<target::LeaOffset>(is);
+        const auto offset = lea.offset < 0
+                                ? " - " + std::to_string(-lea.offset)
+                                : " + " + std::to_string(lea.offset);
+        ctx.AddInstruction("lea " + to_asm(lea.dst) + ", [" +
+                           addressOf(lea.src) + offset + "]");
     } else if (std::holds_alternative<target::JumpLess>(is)) {
         const auto jump = std::get<target::JumpLess>(is);
         ctx.AddInstruction("jl ." + jump.label);
+    } else if (std::holds_alternative<target::JumpNotEq>(is)) {
+        const auto jump = std::get<target::JumpNotEq>(is);
+        ctx.AddInstruction("jne ." + jump.label);
+    } else if (std::holds_alternative<target::JumpGreaterEq>(is)) {
+        const auto jump = std::get<target::JumpGreaterEq>(is);
+        ctx.AddInstruction("jge ." + jump.label);
+    } else if (std::holds_alternative<target::JumpLessEq>(is)) {
+        const auto jump = std::get<target::JumpLessEq>(is);
+        ctx.AddInstruction("jle ." + jump.label);
+    } else if (std::holds_alternative<target::Test>(is)) {
+        const auto test = std::get<target::Test>(is);
+        const auto reg = std::get<target::HardcodedRegister>(test.dst);
+        const auto name = target::to_asm(reg.reg, reg.size);
+        ctx.AddInstruction("test " + name + ", " + name);
+    } else if (std::holds_alternative<target::CmpM>(is)) {
+        const auto cmpM = std::get<target::CmpM>(is);
+        const auto left = std::get<target::HardcodedRegister>(cmpM.dst);
+        const auto sourcesizeString =
+            left.size == 4 ? std::string("dword") : std::string("qword");
+        ctx.AddInstruction("cmp " + target::to_asm(left.reg, left.size) + ", " +
+                           sourcesizeString + to_asm(cmpM.src, ctx));
+    } else if (std::holds_alternative<target::CmpMI>(is)) {
+        const auto cmpMI = std::get<target::CmpMI>(is);
+        const auto sourcesizeString =
+            cmpMI.size == 4 ? std::string("dword") : std::string("qword");
+        ctx.AddInstruction("cmp " + sourcesizeString + to_asm(cmpMI.dst, ctx) +
+                           ", " + std::to_string(cmpMI.value));
     } else if (std::holds_alternative<target::SetNeAl>(is)) {
         const auto SetNeAl = std::get<target::SetNeAl>(is);
         ctx.AddInstruction("setne al");
@@ -172,17 +301,97 @@ void generateASMForInstruction(const target::Instruction& is, Ctx& ctx) {
     }
 }
 
-int sixteenByteAlign(int size) {
-    return size % 16 == 0 ? size : size + (16 - (size % 16));
+[[nodiscard]] bool mentions(const target::Frame& frame,
+                            target::BaseRegister reg) {
+    auto is_reg = [reg](const target::Register& r) {
+        const auto* hardcoded = std::get_if<target::HardcodedRegister>(&r);
+        return hardcoded != nullptr && hardcoded->reg == reg;
+    };
+    return std::ranges::any_of(frame.instructions, [&](const auto& is) {
+        return std::visit(
+            [&](const auto& ins) {
+                using T = std::decay_t<decltype(ins)>;
+                if constexpr (target::HasRegisterSrc<T>) {
+                    if (is_reg(ins.src)) {
+                        return true;
+                    }
+                }
+                if constexpr (target::HasRegisterDest<T>) {
+                    if (is_reg(ins.dst)) {
+                        return true;
+                    }
+                }
+                return false;
+            },
+            is);
+    });
 }
 
-void generateASMForFrame(const target::Frame& frame, Ctx& ctx) {
+// Leaf frames keep up to red_zone bytes of slots below rsp without moving
+// it. Otherwise rsp moves past the slots and on to where calls see it 16
+// byte aligned.
+[[nodiscard]] FrameLayout layoutOf(const target::Frame& frame,
+                                   const FrameOptions& options) {
+    const auto pushes = target::pushes_arguments(frame);
+    FrameLayout layout{.framePointer = !options.omitFramePointer || pushes};
+    for (const auto reg : target::callee_saved_regs) {
+        if (mentions(frame, reg)) {
+            layout.saved.push_back(reg);
+        }
+    }
+    const auto pushed = layout.saved.size() + (layout.framePointer ? 1 : 0);
+    layout.pushed = target::address_size * static_cast<int>(pushed);
+    if (!target::makes_calls(frame) && !pushes && frame.size <= red_zone) {
+        return layout;
+    }
+    // rsp is 8 below a 16 byte boundary on entry, the return address
+    layout.adjust = frame.size;
+    while ((layout.pushed + layout.adjust) % 16 != target::address_size) {
+        layout.adjust++;
+    }
+    return layout;
+}
+
+// restores rsp and the saved registers to what they were on entry
+void generateEpilogue(const target::Frame& frame, Ctx& ctx) {
+    if (!ctx.layout.framePointer) {
+        if (ctx.layout.adjust > 0) {
+            ctx.AddInstruction("add rsp, " +
+                               std::to_string(ctx.layout.adjust));
+        }
+    } else if (ctx.layout.adjust > 0 || target::pushes_arguments(frame)) {
+        // arguments pushed for a call are never popped, so rsp only matches
+        // rbp when the prologue did not move it and nothing was pushed
+        ctx.AddInstruction("leave");
+    } else {
+        ctx.AddInstruction("pop rbp");
+    }
+    for (const auto reg : ctx.layout.saved | std::views::reverse) {
+        ctx.AddInstruction("pop " + target::to_asm(reg, 8));
+    }
+}
+
+void generateASMForFrame(const target::Frame& frame,
+                         const FrameOptions& options, Ctx& ctx) {
+    ctx.layout = layoutOf(frame, options);
     ctx.AddInstructionNoIndent(frame.name + ":");
-    ctx.AddInstruction("push rbp");
-    ctx.AddInstruction("mov rbp, rsp");
-    ctx.AddInstruction("sub rsp, " +
-                       std::to_string(sixteenByteAlign(frame.size)));
+    for (const auto reg : ctx.layout.saved) {
+        ctx.AddInstruction("push " + target::to_asm(reg, 8));
+    }
+    if (ctx.layout.framePointer) {
+        ctx.AddInstruction("push rbp");
+        ctx.AddInstruction("mov rbp, rsp");
+    }
+    if (ctx.layout.adjust > 0) {
+        ctx.AddInstruction("sub rsp, " + std::to_string(ctx.layout.adjust));
+    }
     for (const auto& is : frame.instructions) {
+        if (const auto* tail = std::get_if<target::TailCall>(&is)) {
+            // the callee finds our return address on top of the stack
+            generateEpilogue(frame, ctx);
+            ctx.AddInstruction("jmp " + tail->name);
+            continue;
+        }
         try {
             generateASMForInstruction(is, ctx);
         } catch (const std::exception& e) {
@@ -192,20 +401,17 @@ void generateASMForFrame(const target::Frame& frame, Ctx& ctx) {
         }
     }
     ctx.AddInstructionNoIndent(".end:");
-    if (frame.size > 0) {
-        ctx.AddInstruction("leave");
-    } else {
-        ctx.AddInstruction("pop rbp");
-    }
+    generateEpilogue(frame, ctx);
     ctx.AddInstruction("ret");
 }
 
-[[nodiscard]] std::string Generate(const std::vector<target::Frame>& frames) {
+[[nodiscard]] std::string Generate(const std::vector<target::Frame>& frames,
+                                   const FrameOptions& options) {
     Ctx ctx;
     ctx.AddInstructionNoIndent("section .text");
     ctx.AddInstructionNoIndent("global _start");
     for (const auto& frame : frames) {
-        generateASMForFrame(frame, ctx);
+        generateASMForFrame(frame, options, ctx);
     }
     ctx.AddInstructionNoIndent("_start:");
     ctx.AddInstruction("call main");
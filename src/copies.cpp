@@ -0,0 +1,248 @@
+#include "../include/copies.hpp"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+#include "../include/liveness.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+[[nodiscard]] const Temp* temp_of(const Value* value) {
+    return value == nullptr ? nullptr : std::get_if<Temp>(value);
+}
+
+// the temp a Mov of one temp to another of the same size copies
+[[nodiscard]] std::optional<Temp> copied_temp(const Operation& op) {
+    const auto* move = std::get_if<Mov>(&op);
+    if (move == nullptr) {
+        return std::nullopt;
+    }
+    const auto* dst = temp_of(&move->dst);
+    const auto* src = temp_of(&move->src);
+    if (dst == nullptr || src == nullptr || dst->size != src->size) {
+        return std::nullopt;
+    }
+    return *src;
+}
+
+[[nodiscard]] int temp_count(const Frame& frame) {
+    int count = 0;
+    auto see = [&count](const Value& value) {
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            count = std::max(count, temp->id + 1);
+        }
+    };
+    for (const auto& op : frame.instructions) {
+        if (const auto* dst = defined_value(op)) {
+            see(*dst);
+        }
+        for_each_used_value(op, see);
+    }
+    return count;
+}
+
+struct Interference {
+    std::vector<std::set<int>> adjacent = {};
+    std::vector<int> leader = {};
+
+    explicit Interference(int temps) : adjacent(temps), leader(temps) {
+        std::iota(leader.begin(), leader.end(), 0);
+    }
+
+    [[nodiscard]] int find(int t) {
+        while (leader[t] != t) {
+            leader[t] = leader[leader[t]];
+            t = leader[t];
+        }
+        return t;
+    }
+
+    void add(int a, int b) {
+        adjacent[a].insert(b);
+        adjacent[b].insert(a);
+    }
+
+    // b's live range becomes part of a's
+    void merge(int a, int b) {
+        for (const auto n : adjacent[b]) {
+            adjacent[n].erase(b);
+            add(a, n);
+        }
+        adjacent[b].clear();
+        leader[b] = a;
+    }
+};
+
+[[nodiscard]] Interference build_interference(const Frame& frame,
+                                              const ControlFlowGraph& cfg,
+                                              int temps) {
+    const auto& ops = frame.instructions;
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    std::vector<target::BitSet> gen(blocks, target::BitSet(temps));
+    std::vector<target::BitSet> kill(blocks, target::BitSet(temps));
+    for (int b = 0; b < blocks; b++) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            for_each_used_value(ops[i], [&](const Value& value) {
+                if (const auto* temp = std::get_if<Temp>(&value);
+                    temp != nullptr && !kill[b].test(temp->id)) {
+                    gen[b].set(temp->id);
+                }
+            });
+            if (const auto* temp = temp_of(defined_value(ops[i]))) {
+                kill[b].set(temp->id);
+            }
+        }
+    }
+    std::vector<target::BitSet> liveIn(blocks, target::BitSet(temps));
+    std::vector<target::BitSet> liveOut(blocks, target::BitSet(temps));
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = blocks - 1; b >= 0; b--) {
+            for (const auto s : cfg.blocks[b].successors) {
+                liveOut[b].unite(liveIn[s]);
+            }
+            changed |= liveIn[b].uniteTransfer(gen[b], liveOut[b], kill[b]);
+        }
+    }
+
+    Interference graph(temps);
+    for (int b = 0; b < blocks; b++) {
+        auto live = liveOut[b];
+        for (int i = cfg.blocks[b].end - 1; i >= cfg.blocks[b].begin; i--) {
+            if (const auto* dst = temp_of(defined_value(ops[i]))) {
+                // a copy and its source may share a register
+                const auto copied = copied_temp(ops[i]);
+                live.forEach([&](int t) {
+                    if (t != dst->id && (!copied || t != copied->id)) {
+                        graph.add(dst->id, t);
+                    }
+                });
+                live.reset(dst->id);
+            }
+            for_each_used_value(ops[i], [&live](const Value& value) {
+                if (const auto* temp = std::get_if<Temp>(&value)) {
+                    live.set(temp->id);
+                }
+            });
+        }
+    }
+    return graph;
+}
+}  // namespace
+
+int PropagateCopies(Frame& frame) {
+    auto& ops = frame.instructions;
+    const auto before = ops.size();
+    std::map<int, Temp> copyOf;
+    auto resolve = [&copyOf](Temp temp) {
+        for (auto steps = copyOf.size(); steps > 0; steps--) {
+            const auto it = copyOf.find(temp.id);
+            if (it == copyOf.end()) {
+                break;
+            }
+            temp = it->second;
+        }
+        return temp;
+    };
+    // a phi becomes a copy once copies make its arguments agree
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto& op : ops) {
+            const auto* dst = temp_of(defined_value(op));
+            if (dst == nullptr || copyOf.contains(dst->id)) {
+                continue;
+            }
+            auto source = copied_temp(op);
+            if (const auto* phi = std::get_if<Phi>(&op)) {
+                for (const auto& incoming : phi->args) {
+                    const auto* temp = std::get_if<Temp>(&incoming.value);
+                    const auto arg =
+                        temp == nullptr ? std::nullopt
+                                        : std::optional{resolve(*temp)};
+                    if (arg.has_value() && arg->id == dst->id) {
+                        continue;
+                    }
+                    if (!arg.has_value() ||
+                        (source.has_value() && source->id != arg->id)) {
+                        source.reset();
+                        break;
+                    }
+                    source = arg;
+                }
+            }
+            if (!source.has_value() || source->size != dst->size) {
+                continue;
+            }
+            const auto resolved = resolve(*source);
+            if (resolved.id != dst->id) {
+                copyOf[dst->id] = resolved;
+                changed = true;
+            }
+        }
+    }
+
+    std::erase_if(ops, [&copyOf](const Operation& op) {
+        const auto* dst = temp_of(defined_value(op));
+        return dst != nullptr && copyOf.contains(dst->id);
+    });
+    for (auto& op : ops) {
+        for_each_used_value(op, [&resolve](Value& value) {
+            if (const auto* temp = std::get_if<Temp>(&value)) {
+                value = resolve(*temp);
+            }
+        });
+    }
+    return static_cast<int>(before - ops.size());
+}
+
+int CoalesceCopies(Frame& frame, FrameAnalyses& analyses) {
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    const auto& cfg = analyses.CFG();
+    const auto temps = temp_count(frame);
+    auto graph = build_interference(frame, cfg, temps);
+
+    auto& ops = frame.instructions;
+    for (const auto& op : ops) {
+        const auto src = copied_temp(op);
+        if (!src.has_value()) {
+            continue;
+        }
+        const auto a = graph.find(std::get<Temp>(std::get<Mov>(op).dst).id);
+        const auto b = graph.find(src->id);
+        if (a != b && !graph.adjacent[a].contains(b)) {
+            graph.merge(a, b);
+        }
+    }
+
+    auto rename = [&graph](Value& value) {
+        if (auto* temp = std::get_if<Temp>(&value)) {
+            temp->id = graph.find(temp->id);
+        }
+    };
+    for (auto& op : ops) {
+        if (auto* dst = defined_value(op)) {
+            rename(*dst);
+        }
+        for_each_used_value(op, rename);
+    }
+    const auto removed = std::erase_if(ops, [](const Operation& op) {
+        const auto src = copied_temp(op);
+        return src.has_value() &&
+               std::get<Temp>(std::get<Mov>(op).dst).id == src->id;
+    });
+    return static_cast<int>(removed);
+}
+}  // namespace qa_ir
\ No newline at end of file
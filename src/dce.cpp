@@ -0,0 +1,249 @@
+#include "../include/dce.hpp"
+
+#include <map>
+#include <ranges>
+#include <set>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// operations whose only effect is writing their dst
+[[nodiscard]] bool is_pure(const Operation& op) {
+    return std::holds_alternative<Mov>(op) || std::holds_alternative<Add>(op) ||
+           std::holds_alternative<Sub>(op) ||
+           std::holds_alternative<Equal>(op) ||
+           std::holds_alternative<NotEqual>(op) ||
+           std::holds_alternative<GreaterThan>(op) ||
+           std::holds_alternative<Addr>(op) ||
+           std::holds_alternative<Deref>(op) ||
+           std::holds_alternative<MovR>(op) || std::holds_alternative<Phi>(op);
+}
+
+void keep_if(std::vector<Operation>& ops, const std::vector<bool>& keep) {
+    std::vector<Operation> kept;
+    kept.reserve(ops.size());
+    for (auto&& [i, op] : ops | std::views::enumerate) {
+        if (keep[i]) {
+            kept.push_back(std::move(op));
+        }
+    }
+    ops = std::move(kept);
+}
+
+void remove_dead_stores(Frame& frame) {
+    // a variable whose address is taken may be read through a pointer
+    std::set<std::string> read;
+    for (const auto& op : frame.instructions) {
+        if (const auto* addr = std::get_if<Addr>(&op)) {
+            read.insert(std::get<Variable>(addr->src).name);
+        }
+        for_each_used_value(op, [&read](const Value& value) {
+            if (const auto* variable = std::get_if<Variable>(&value)) {
+                read.insert(variable->name);
+            }
+        });
+    }
+    std::erase_if(frame.instructions, [&read](const Operation& op) {
+        const auto* dst = defined_value(op);
+        const auto* variable =
+            dst == nullptr ? nullptr : std::get_if<Variable>(dst);
+        return variable != nullptr && is_pure(op) &&
+               !read.contains(variable->name);
+    });
+}
+
+// mark and sweep, so temps only reading each other around a loop go too
+void remove_unused_temps(Frame& frame) {
+    auto& ops = frame.instructions;
+    std::map<int, std::vector<int>> definitions;
+    std::vector<bool> live(ops.size(), false);
+    std::vector<int> worklist;
+    for (const auto& [i, op] : ops | std::views::enumerate) {
+        const auto* dst = defined_value(op);
+        const auto* temp = dst == nullptr ? nullptr : std::get_if<Temp>(dst);
+        if (temp != nullptr && is_pure(op)) {
+            definitions[temp->id].push_back(static_cast<int>(i));
+            continue;
+        }
+        live[i] = true;
+        worklist.push_back(static_cast<int>(i));
+    }
+    while (!worklist.empty()) {
+        const auto i = worklist.back();
+        worklist.pop_back();
+        for_each_used_value(ops[i], [&](const Value& value) {
+            const auto* temp = std::get_if<Temp>(&value);
+            if (temp == nullptr) {
+                return;
+            }
+            for (const auto d : definitions[temp->id]) {
+                if (!live[d]) {
+                    live[d] = true;
+                    worklist.push_back(d);
+                }
+            }
+        });
+    }
+    keep_if(ops, live);
+}
+
+bool remove_jumps_to_next(std::vector<Operation>& ops) {
+    std::vector<bool> keep(ops.size(), true);
+    bool changed = false;
+    for (std::size_t i = 0; i + 1 < ops.size(); i++) {
+        const auto* jump = std::get_if<Jump>(&ops[i]);
+        const auto* next = std::get_if<LabelDef>(&ops[i + 1]);
+        if (jump != nullptr && next != nullptr &&
+            jump->label.name == next->label.name) {
+            keep[i] = false;
+            changed = true;
+        }
+    }
+    keep_if(ops, keep);
+    return changed;
+}
+
+// branches into a block holding nothing but its label and possibly a Jump go
+// straight to where that block continues
+bool thread_empty_blocks(Frame& frame) {
+    auto& ops = frame.instructions;
+    const auto cfg = BuildCFG(frame);
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    auto hasPhis = [&](int b) {
+        const auto& block = cfg.blocks[b];
+        return block.begin + 1 < block.end &&
+               std::holds_alternative<Phi>(ops[block.begin + 1]);
+    };
+    std::map<std::string, std::string> forward;
+    for (int b = 1; b < blocks; b++) {
+        const auto& block = cfg.blocks[b];
+        const auto size = block.end - block.begin;
+        const auto* jump =
+            size == 2 ? std::get_if<Jump>(&ops[block.begin + 1]) : nullptr;
+        std::string target;
+        if (size == 1 && b + 1 < blocks) {
+            target = cfg.blocks[b + 1].label;
+        } else if (jump != nullptr) {
+            target = jump->label.name;
+        } else {
+            continue;
+        }
+        if (target != block.label && !hasPhis(cfg.blockOf.at(target))) {
+            forward[block.label] = target;
+        }
+    }
+    // follow chains of empty blocks, leaving out the ones that loop forever
+    std::map<std::string, std::string> resolved;
+    for (const auto& [label, first] : forward) {
+        auto target = first;
+        std::size_t steps = 0;
+        while (forward.contains(target) && steps <= forward.size()) {
+            target = forward.at(target);
+            steps++;
+        }
+        if (!forward.contains(target)) {
+            resolved[label] = target;
+        }
+    }
+    if (resolved.empty()) {
+        return false;
+    }
+
+    std::vector<bool> keep(ops.size(), true);
+    for (const auto& [label, target] : resolved) {
+        const auto& block = cfg.blocks[cfg.blockOf.at(label)];
+        keep[block.begin] = false;
+        // a block falling into this one keeps the Jump as its terminator
+        if (block.end - block.begin == 2 &&
+            is_terminator(ops[block.begin - 1])) {
+            keep[block.begin + 1] = false;
+        }
+    }
+    for (auto& op : ops) {
+        for (const auto& label : successor_labels(op)) {
+            if (const auto it = resolved.find(label.name);
+                it != resolved.end()) {
+                retarget(op, label.name, Label{it->second});
+            }
+        }
+    }
+    keep_if(ops, keep);
+    return true;
+}
+
+// a label only reached by falling into it joins its block to the previous one
+void remove_unused_labels(std::vector<Operation>& ops) {
+    std::set<std::string> targets;
+    for (const auto& op : ops) {
+        for (const auto& label : successor_labels(op)) {
+            targets.insert(label.name);
+        }
+        if (const auto* phi = std::get_if<Phi>(&op)) {
+            for (const auto& incoming : phi->args) {
+                targets.insert(incoming.predecessor.name);
+            }
+        }
+    }
+    std::vector<bool> keep(ops.size(), true);
+    for (std::size_t i = 1; i < ops.size(); i++) {
+        const auto* label = std::get_if<LabelDef>(&ops[i]);
+        keep[i] = label == nullptr || is_terminator(ops[i - 1]) ||
+                  targets.contains(label->label.name);
+    }
+    keep_if(ops, keep);
+}
+
+// a conditional jump whose targets agree no longer needs its Compare
+bool fold_same_target_branches(std::vector<Operation>& ops) {
+    std::vector<bool> keep(ops.size(), true);
+    bool changed = false;
+    for (std::size_t i = 0; i < ops.size(); i++) {
+        const auto labels = successor_labels(ops[i]);
+        if (labels.size() != 2 || labels[0].name != labels[1].name) {
+            continue;
+        }
+        ops[i] = Jump{.label = labels[0]};
+        if (i > 0 && std::holds_alternative<Compare>(ops[i - 1])) {
+            keep[i - 1] = false;
+        }
+        changed = true;
+    }
+    keep_if(ops, keep);
+    return changed;
+}
+}  // namespace
+
+int EliminateDeadCode(Frame& frame, FrameAnalyses& analyses) {
+    const auto before = frame.instructions.size();
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    remove_dead_stores(frame);
+    remove_unused_temps(frame);
+    return static_cast<int>(before) -
+           static_cast<int>(frame.instructions.size());
+}
+
+int SimplifyControlFlow(Frame& frame) {
+    const auto before = frame.instructions.size();
+    FreshNames names(frame);
+    NormalizeBlocks(frame, names);
+    auto changed = true;
+    while (changed) {
+        changed = remove_jumps_to_next(frame.instructions);
+        changed |= thread_empty_blocks(frame);
+        changed |= fold_same_target_branches(frame.instructions);
+    }
+    remove_unused_labels(frame.instructions);
+    return static_cast<int>(before) -
+           static_cast<int>(frame.instructions.size());
+}
+}  // namespace qa_ir
\ No newline at end of file
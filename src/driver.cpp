@@ -1,14 +1,21 @@
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
 #include "../include/allocator.hpp"
 #include "../include/assem.hpp"
 #include "../include/codegen.hpp"
+#include "../include/driver.hpp"
 #include "../include/lexer.hpp"
 #include "../include/lower_ir.hpp"
+#include "../include/pass_manager.hpp"
 #include "../include/parser.hpp"
+#include "../include/peephole.hpp"
 #include "../include/st.hpp"
 #include "../include/translate.hpp"
 
@@ -70,7 +77,37 @@ void write_to_file(const std::string& code, const std::string& outfile) {
     outFile.close();
 }
 
-int runfile(const char* sourcefile, const std::string& outfile) {
+void print_allocation_stats(const target::AllocationStats& stats) {
+    std::cerr << "regalloc: " << stats.spilled << " spilled (" << stats.split
+              << " split), " << stats.reloads << " reloads, " << stats.stores
+              << " stores, " << stats.rematerialized << " rematerialized, "
+              << stats.coalesced << " moves coalesced" << std::endl;
+}
+
+void print_peephole_stats(const target::PeepholeStats& stats, int rewritten) {
+    std::cerr << "peephole: " << rewritten << " windows rewritten";
+    auto separator = " (";
+    for (const auto& [rule, fired] : stats.fired) {
+        std::cerr << separator << rule << " " << fired;
+        separator = ", ";
+    }
+    std::cerr << (stats.fired.empty() ? "" : ")") << std::endl;
+}
+
+// runs a stage between the passes and records it with them
+template <typename F>
+auto run_stage(passes::PassManager& manager, std::string_view name,
+               long sizeBefore, F&& stage) {
+    const auto start = std::chrono::steady_clock::now();
+    auto result = stage();
+    manager.Record(name, sizeBefore, passes::SizeOf(result),
+                   std::chrono::steady_clock::now() - start);
+    manager.PrintAfter(name, result);
+    return result;
+}
+
+int runfile(const char* sourcefile, const std::string& outfile,
+            const Options& options) {
     const auto contents = readfile(sourcefile);
     const auto tokens = lexer::lex(contents);
     const auto st = parse(tokens);
@@ -82,18 +119,65 @@ int runfile(const char* sourcefile, const std::string& outfile) {
     if (DEBUG) print_ast(ast);
 
     auto frames = qa_ir::Produce_IR(ast);
+    auto manager = std::optional<passes::PassManager>{};
+    try {
+        manager.emplace(
+            options.pipeline.value_or(passes::Preset(options.level)),
+            passes::PassOptions{
+                .unroll = options.unroll,
+                .inlining = options.inlining,
+                // padding loop tops works against optimizing for size
+                .layout = {.alignLoops =
+                               options.level != passes::OptLevel::Os}},
+            std::set<std::string, std::less<>>(options.printAfter.begin(),
+                                               options.printAfter.end()));
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    manager->RunIR(frames);
+
+    if (options.stats) manager->PrintStats(std::cerr);
 
     if (DEBUG) print_ir(frames);
 
-    const auto lowered_frames = target::LowerIR(frames);
+    auto lowered_frames = run_stage(*manager, "lower", passes::SizeOf(frames),
+                                    [&] { return target::LowerIR(frames); });
 
     if (DEBUG) print_lower_ir(lowered_frames, "Lowered IR:");
 
-    auto rewritten = target::rewrite(lowered_frames);
+    auto stats = target::AllocationStats{};
+    auto rewritten = run_stage(
+        *manager, "regalloc", passes::SizeOf(lowered_frames), [&] {
+            return target::rewrite(std::move(lowered_frames), stats,
+                                   options.allocator,
+                                   options.omitFramePointer);
+        });
+
+    if (options.stats) print_allocation_stats(stats);
+
+    manager->RunMachine(rewritten);
+
+    const auto& records = manager->Records();
+    const auto peephole =
+        std::ranges::find(records, "peephole", &passes::PassRecord::name);
+    if (options.stats && peephole != records.end()) {
+        print_peephole_stats(manager->Peephole(), peephole->changed);
+    }
 
     if (DEBUG) print_lower_ir(rewritten, "Rewritten IR:");
 
-    auto code = codegen::Generate(rewritten);
+    const auto start = std::chrono::steady_clock::now();
+    auto code = codegen::Generate(
+        rewritten,
+        codegen::FrameOptions{.omitFramePointer = options.omitFramePointer});
+    manager->Record("codegen", passes::SizeOf(rewritten),
+                    std::ranges::count(code, '\n'),
+                    std::chrono::steady_clock::now() - start);
+    manager->PrintAfter("codegen", code);
+
+    if (options.timePasses) manager->PrintTimings(std::cerr);
+
     write_to_file(code, outfile);
 
     return 0;
@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ranges>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/allocator.hpp"
+#include "../include/liveness.hpp"
+#include "../include/qa_x86.hpp"
+
+namespace target {
+
+// Iterated register coalescing (George & Appel) over register_file, with
+// the nodes numbered as for liveness.
+
+// a set of nodes with constant time insert, erase and clear that can be
+// iterated without scanning every node
+struct SparseSet {
+    std::vector<int> members = {};
+    std::vector<int> index = {};
+
+    explicit SparseSet(int capacity) : index(capacity, -1) {}
+
+    [[nodiscard]] bool contains(int n) const { return index[n] != -1; }
+
+    void insert(int n) {
+        if (!contains(n)) {
+            index[n] = static_cast<int>(members.size());
+            members.push_back(n);
+        }
+    }
+
+    void erase(int n) {
+        if (!contains(n)) {
+            return;
+        }
+        const auto last = members.back();
+        members[index[n]] = last;
+        index[last] = index[n];
+        members.pop_back();
+        index[n] = -1;
+    }
+
+    void clear() {
+        for (const auto n : members) {
+            index[n] = -1;
+        }
+        members.clear();
+    }
+};
+
+enum class NodeState {
+    Precolored,
+    // virtual register ids that no instruction mentions
+    Absent,
+    Initial,
+    Simplify,
+    Freeze,
+    Spill,
+    Spilled,
+    Coalesced,
+    Colored,
+    OnStack,
+};
+
+enum class MoveState { Worklist, Active, Coalesced, Constrained, Frozen };
+
+struct Move {
+    int dst;
+    int src;
+    // index of the Mov in the frame
+    int position;
+};
+
+struct GraphColoring {
+    // one color per register of the register file
+    const int colors = register_file_size;
+    int nodes;
+    std::unordered_set<std::uint64_t> adjSet = {};
+    std::vector<std::vector<int>> adjList;
+    std::vector<int> degree;
+    std::vector<int> alias;
+    std::vector<int> color;
+    std::vector<NodeState> state;
+    // weighted uses per instruction the value spans, lower spills first
+    std::vector<double> spillCost;
+    std::vector<std::vector<int>> moveList;
+    std::vector<Move> moves = {};
+    std::vector<MoveState> moveState = {};
+
+    // worklists drop stale entries when popped, a node is only on the list
+    // its state names
+    std::vector<int> simplifyWorklist = {};
+    std::vector<int> freezeWorklist = {};
+    std::vector<int> spillWorklist = {};
+    std::vector<int> worklistMoves = {};
+    std::vector<int> selectStack = {};
+
+    // scratch marks for de-duplicating neighbour sets
+    std::vector<int> mark;
+    int epoch = 0;
+
+    explicit GraphColoring(int nodes)
+        : nodes(nodes),
+          adjList(nodes),
+          degree(nodes, 0),
+          alias(nodes),
+          color(nodes, no_register),
+          state(nodes, NodeState::Absent),
+          spillCost(nodes, 0),
+          moveList(nodes),
+          mark(nodes, 0) {
+        for (int n = 0; n < nodes; n++) {
+            alias[n] = n;
+        }
+        for (int p = 0; p < colors; p++) {
+            state[p] = NodeState::Precolored;
+            color[p] = p;
+            degree[p] = INT_MAX / 2;
+        }
+    }
+
+    [[nodiscard]] bool precolored(int n) const { return n < colors; }
+
+    [[nodiscard]] static std::uint64_t edge(int u, int v) {
+        const auto lo = static_cast<std::uint64_t>(std::min(u, v));
+        const auto hi = static_cast<std::uint64_t>(std::max(u, v));
+        return (lo << 32) | hi;
+    }
+
+    [[nodiscard]] bool adjacent(int u, int v) const {
+        return adjSet.contains(edge(u, v));
+    }
+
+    void addEdge(int u, int v) {
+        if (u == v || (precolored(u) && precolored(v)) ||
+            !adjSet.insert(edge(u, v)).second) {
+            return;
+        }
+        if (!precolored(u)) {
+            adjList[u].push_back(v);
+            degree[u]++;
+        }
+        if (!precolored(v)) {
+            adjList[v].push_back(u);
+            degree[v]++;
+        }
+    }
+
+    template <typename F>
+    void forEachAdjacent(int n, F&& f) const {
+        for (const auto m : adjList[n]) {
+            if (state[m] != NodeState::OnStack &&
+                state[m] != NodeState::Coalesced) {
+                f(m);
+            }
+        }
+    }
+
+    template <typename F>
+    void forEachNodeMove(int n, F&& f) const {
+        for (const auto m : moveList[n]) {
+            if (moveState[m] == MoveState::Active ||
+                moveState[m] == MoveState::Worklist) {
+                f(m);
+            }
+        }
+    }
+
+    [[nodiscard]] bool moveRelated(int n) const {
+        bool related = false;
+        forEachNodeMove(n, [&related](int) { related = true; });
+        return related;
+    }
+
+    void push(int n, NodeState to) {
+        state[n] = to;
+        if (to == NodeState::Simplify) {
+            simplifyWorklist.push_back(n);
+        } else if (to == NodeState::Freeze) {
+            freezeWorklist.push_back(n);
+        } else if (to == NodeState::Spill) {
+            spillWorklist.push_back(n);
+        }
+    }
+
+    void makeWorklist() {
+        for (int n = colors; n < nodes; n++) {
+            if (state[n] != NodeState::Initial) {
+                continue;
+            }
+            if (degree[n] >= colors) {
+                push(n, NodeState::Spill);
+            } else if (moveRelated(n)) {
+                push(n, NodeState::Freeze);
+            } else {
+                push(n, NodeState::Simplify);
+            }
+        }
+    }
+
+    void enableMoves(int n) {
+        forEachNodeMove(n, [this](int m) {
+            if (moveState[m] == MoveState::Active) {
+                moveState[m] = MoveState::Worklist;
+                worklistMoves.push_back(m);
+            }
+        });
+    }
+
+    void decrementDegree(int m) {
+        if (precolored(m)) {
+            return;
+        }
+        const auto d = degree[m]--;
+        if (d != colors) {
+            return;
+        }
+        enableMoves(m);
+        forEachAdjacent(m, [this](int n) { enableMoves(n); });
+        push(m, moveRelated(m) ? NodeState::Freeze : NodeState::Simplify);
+    }
+
+    void simplify() {
+        const auto n = simplifyWorklist.back();
+        simplifyWorklist.pop_back();
+        if (state[n] != NodeState::Simplify) {
+            return;
+        }
+        state[n] = NodeState::OnStack;
+        selectStack.push_back(n);
+        forEachAdjacent(n, [this](int m) { decrementDegree(m); });
+    }
+
+    [[nodiscard]] int getAlias(int n) const {
+        while (state[n] == NodeState::Coalesced) {
+            n = alias[n];
+        }
+        return n;
+    }
+
+    void addWorklist(int u) {
+        if (!precolored(u) && state[u] == NodeState::Freeze &&
+            !moveRelated(u) && degree[u] < colors) {
+            push(u, NodeState::Simplify);
+        }
+    }
+
+    // George: every neighbour of v is harmless for u
+    [[nodiscard]] bool george(int u, int v) const {
+        bool ok = true;
+        forEachAdjacent(v, [&](int t) {
+            ok = ok && (degree[t] < colors || precolored(t) || adjacent(t, u));
+        });
+        return ok;
+    }
+
+    // Briggs: the merged node has fewer than colors significant neighbours
+    [[nodiscard]] bool briggs(int u, int v) {
+        epoch++;
+        int significant = 0;
+        auto count = [&](int t) {
+            if (mark[t] != epoch) {
+                mark[t] = epoch;
+                significant += degree[t] >= colors ? 1 : 0;
+            }
+        };
+        forEachAdjacent(u, count);
+        forEachAdjacent(v, count);
+        return significant < colors;
+    }
+
+    void combine(int u, int v) {
+        state[v] = NodeState::Coalesced;
+        alias[v] = u;
+        moveList[u].insert(moveList[u].end(), moveList[v].begin(),
+                           moveList[v].end());
+        enableMoves(v);
+        forEachAdjacent(v, [&](int t) {
+            addEdge(t, u);
+            decrementDegree(t);
+        });
+        if (degree[u] >= colors && state[u] == NodeState::Freeze) {
+            push(u, NodeState::Spill);
+        }
+    }
+
+    void coalesce() {
+        const auto m = worklistMoves.back();
+        worklistMoves.pop_back();
+        if (moveState[m] != MoveState::Worklist) {
+            return;
+        }
+        auto u = getAlias(moves[m].dst);
+        auto v = getAlias(moves[m].src);
+        if (precolored(v)) {
+            std::swap(u, v);
+        }
+        if (u == v) {
+            moveState[m] = MoveState::Coalesced;
+            addWorklist(u);
+        } else if (precolored(v) || adjacent(u, v)) {
+            moveState[m] = MoveState::Constrained;
+            addWorklist(u);
+            addWorklist(v);
+        } else if (precolored(u) ? george(u, v) : briggs(u, v)) {
+            moveState[m] = MoveState::Coalesced;
+            combine(u, v);
+            addWorklist(u);
+        } else {
+            moveState[m] = MoveState::Active;
+        }
+    }
+
+    void freezeMoves(int u) {
+        forEachNodeMove(u, [&](int m) {
+            const auto x = getAlias(moves[m].src);
+            const auto y = getAlias(moves[m].dst);
+            const auto v = y == getAlias(u) ? x : y;
+            moveState[m] = MoveState::Frozen;
+            if (state[v] == NodeState::Freeze && !moveRelated(v) &&
+                degree[v] < colors) {
+                push(v, NodeState::Simplify);
+            }
+        });
+    }
+
+    void freeze() {
+        const auto u = freezeWorklist.back();
+        freezeWorklist.pop_back();
+        if (state[u] != NodeState::Freeze) {
+            return;
+        }
+        push(u, NodeState::Simplify);
+        freezeMoves(u);
+    }
+
+    void selectSpill() {
+        std::erase_if(spillWorklist, [this](int n) {
+            return state[n] != NodeState::Spill;
+        });
+        const auto cheapest = std::ranges::min_element(
+            spillWorklist, [this](int a, int b) {
+                return spillCost[a] / degree[a] < spillCost[b] / degree[b];
+            });
+        const auto m = *cheapest;
+        spillWorklist.erase(cheapest);
+        push(m, NodeState::Simplify);
+        freezeMoves(m);
+    }
+
+    // pops the select stack, returns the virtual registers that got no color
+    [[nodiscard]] std::vector<int> assignColors() {
+        std::vector<int> spilled;
+        while (!selectStack.empty()) {
+            const auto n = selectStack.back();
+            selectStack.pop_back();
+            auto available = (1U << colors) - 1;
+            for (const auto w : adjList[n]) {
+                const auto a = getAlias(w);
+                if (state[a] == NodeState::Colored ||
+                    state[a] == NodeState::Precolored) {
+                    available &= ~(1U << color[a]);
+                }
+            }
+            if (available == 0) {
+                state[n] = NodeState::Spilled;
+                spilled.push_back(n - colors);
+                continue;
+            }
+            state[n] = NodeState::Colored;
+            color[n] = std::countr_zero(available);
+        }
+        return spilled;
+    }
+};
+
+// interference edges and moves of the whole frame, walking every block
+// backwards from its live out set
+void build(const Frame& frame, const ControlFlowGraph& cfg,
+           GraphColoring& graph) {
+    const auto liveness = computeLiveness(frame, cfg, graph.nodes);
+    SparseSet live(graph.nodes);
+    Operands operands;
+    for (int b = 0; b < cfg.blocks(); b++) {
+        live.clear();
+        liveness.liveOut[b].forEach([&live](int n) { live.insert(n); });
+        for (int i = cfg.blockStart[b + 1] - 1; i >= cfg.blockStart[b];
+             i--) {
+            const auto& ins = frame.instructions[i];
+            collectOperands(ins, cfg.callArguments[i], operands);
+            if (std::holds_alternative<Mov>(ins)) {
+                // a copy does not make its two sides interfere
+                for (const auto u : operands.uses) {
+                    live.erase(u);
+                }
+                const auto m = static_cast<int>(graph.moves.size());
+                const auto dst = operands.defs.front();
+                const auto src = operands.uses.front();
+                graph.moves.push_back(
+                    Move{.dst = dst, .src = src, .position = i});
+                graph.moveState.push_back(MoveState::Worklist);
+                graph.worklistMoves.push_back(m);
+                graph.moveList[dst].push_back(m);
+                graph.moveList[src].push_back(m);
+            }
+            for (const auto d : operands.defs) {
+                for (const auto l : live.members) {
+                    graph.addEdge(d, l);
+                }
+            }
+            for (int p = 0; p < register_file_size; p++) {
+                if (((operands.clobbers >> p) & 1U) == 0) {
+                    continue;
+                }
+                for (const auto l : live.members) {
+                    if (std::ranges::find(operands.defs, l) ==
+                        operands.defs.end()) {
+                        graph.addEdge(p, l);
+                    }
+                }
+            }
+            for (const auto d : operands.defs) {
+                live.erase(d);
+            }
+            for (const auto u : operands.uses) {
+                live.insert(u);
+            }
+            const auto weight = std::pow(10.0, std::min(cfg.loopDepth[i], 6));
+            for (const auto& group : {operands.uses, operands.defs}) {
+                for (const auto n : group) {
+                    if (!graph.precolored(n)) {
+                        graph.state[n] = NodeState::Initial;
+                        graph.spillCost[n] += weight;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void colorGraph(Frame& frame, AllocationStats& stats, bool framePointer) {
+    while (true) {
+        const auto cfg = buildControlFlowGraph(frame);
+        const auto intervals = computeLiveIntervals(frame);
+        const auto count = static_cast<int>(intervals.start.size());
+        GraphColoring graph(register_file_size + count);
+        build(frame, cfg, graph);
+        if (framePointer) {
+            // rbp interferes with everything, so no virtual register gets it
+            const auto bp = register_file_index(BaseRegister::BP);
+            for (int v = 0; v < count; v++) {
+                if (graph.state[register_file_size + v] != NodeState::Absent) {
+                    graph.addEdge(bp, register_file_size + v);
+                }
+            }
+        }
+        for (int v = 0; v < count; v++) {
+            const auto n = register_file_size + v;
+            if (graph.state[n] == NodeState::Absent) {
+                continue;
+            }
+            // the registers created by spilling only span one or two
+            // instructions and must not be spilled again
+            const auto span = intervals.end[v] - intervals.start[v] + 1;
+            graph.spillCost[n] =
+                span <= 2 ? std::numeric_limits<double>::infinity()
+                          : graph.spillCost[n] / span;
+        }
+        graph.makeWorklist();
+        while (true) {
+            if (!graph.simplifyWorklist.empty()) {
+                graph.simplify();
+            } else if (!graph.worklistMoves.empty()) {
+                graph.coalesce();
+            } else if (!graph.freezeWorklist.empty()) {
+                graph.freeze();
+            } else if (std::ranges::any_of(graph.spillWorklist, [&](int n) {
+                           return graph.state[n] == NodeState::Spill;
+                       })) {
+                graph.selectSpill();
+            } else {
+                break;
+            }
+        }
+        const auto spilled = graph.assignColors();
+        if (spilled.empty()) {
+            for (auto& instruction : frame.instructions) {
+                auto physical = [&graph](VirtualRegister reg) {
+                    const auto n = graph.getAlias(register_file_size + reg.id);
+                    return HardcodedRegister{register_file[graph.color[n]],
+                                             reg.size};
+                };
+                if (auto src = get_src_register(instruction)) {
+                    set_src_register(instruction, physical(src.value()));
+                }
+                if (auto dest = get_dest_register(instruction)) {
+                    set_dest_register(instruction, physical(dest.value()));
+                }
+            }
+            const auto removed =
+                std::erase_if(frame.instructions, [](const Instruction& ins) {
+                    const auto* mov = std::get_if<Mov>(&ins);
+                    return mov != nullptr &&
+                           std::get<HardcodedRegister>(mov->dst) ==
+                               std::get<HardcodedRegister>(mov->src);
+                });
+            stats.coalesced += static_cast<int>(removed);
+            return;
+        }
+        SpillDecisions decisions{
+            .spillAt = std::vector<int>(count, no_register), .count = 0};
+        for (const auto v : spilled) {
+            if (std::isinf(graph.spillCost[register_file_size + v])) {
+                throw std::runtime_error("No free registers");
+            }
+            decisions.spillAt[v] = intervals.start[v];
+            decisions.count++;
+            stats.spilled++;
+        }
+        insertSpillCode(frame, intervals, decisions, stats);
+    }
+}
+}  // namespace target
\ No newline at end of file
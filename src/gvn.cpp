@@ -0,0 +1,192 @@
+#include "../include/gvn.hpp"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+struct Expression {
+    std::size_t opcode;
+    int size;
+    int depth;
+    std::vector<std::string> operands;
+    // generation of memory the operation reads, -1 if it reads none
+    int memory;
+
+    auto operator<=>(const Expression&) const = default;
+};
+
+[[nodiscard]] bool writes_memory(const Operation& op) {
+    if (std::holds_alternative<DerefStore>(op) ||
+        std::holds_alternative<Call>(op)) {
+        return true;
+    }
+    // after ConstructSSA the variables left are the ones whose address is
+    // taken, so a pointer may read what is stored to them
+    const auto* dst = defined_value(op);
+    return dst != nullptr && std::holds_alternative<Variable>(*dst);
+}
+
+struct ValueNumbering {
+    // value holding the same number as each temp, itself if it leads
+    std::map<int, Value> leaders = {};
+    std::map<Expression, Temp> available = {};
+    int memoryGenerations = 0;
+
+    [[nodiscard]] Value leader(const Value& value) const {
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            if (const auto it = leaders.find(temp->id); it != leaders.end()) {
+                return it->second;
+            }
+        }
+        return value;
+    }
+
+    // hardcoded registers are not numbered
+    [[nodiscard]] std::optional<std::string> number(const Value& value) const {
+        const auto lead = leader(value);
+        if (const auto* temp = std::get_if<Temp>(&lead)) {
+            return "t" + std::to_string(temp->id);
+        }
+        if (const auto* variable = std::get_if<Variable>(&lead)) {
+            return "v" + variable->name;
+        }
+        if (const auto* literal = std::get_if<int>(&lead)) {
+            return std::to_string(*literal);
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] std::optional<Expression> expression(const Operation& op,
+                                                       int memory) const {
+        const auto* dst = defined_value(op);
+        if (dst == nullptr || !std::holds_alternative<Temp>(*dst)) {
+            return std::nullopt;
+        }
+        auto key = Expression{.opcode = op.index(),
+                              .size = SizeOf(*dst),
+                              .depth = 0,
+                              .operands = {},
+                              .memory = -1};
+        auto add = [&](const Value& value) {
+            if (std::holds_alternative<Variable>(value)) {
+                key.memory = memory;
+            }
+            const auto operand = number(value);
+            key.operands.push_back(operand.value_or(""));
+            return operand.has_value();
+        };
+        return std::visit(
+            [&](const auto& arg) -> std::optional<Expression> {
+                using T = std::decay_t<decltype(arg)>;
+                if constexpr (std::is_same_v<T, Add> ||
+                              std::is_same_v<T, Sub> ||
+                              std::is_same_v<T, Equal> ||
+                              std::is_same_v<T, NotEqual> ||
+                              std::is_same_v<T, GreaterThan>) {
+                    if (!add(arg.left) || !add(arg.right)) {
+                        return std::nullopt;
+                    }
+                    if constexpr (std::is_same_v<T, Add> ||
+                                  std::is_same_v<T, Equal> ||
+                                  std::is_same_v<T, NotEqual>) {
+                        std::ranges::sort(key.operands);
+                    }
+                    return key;
+                } else if constexpr (std::is_same_v<T, Addr>) {
+                    // the address of a variable never changes
+                    key.operands.push_back(std::get<Variable>(arg.src).name);
+                    return key;
+                } else if constexpr (std::is_same_v<T, Deref>) {
+                    key.depth = arg.depth;
+                    key.memory = memory;
+                    return add(arg.src) ? std::optional{key} : std::nullopt;
+                } else if constexpr (std::is_same_v<T, Mov>) {
+                    if (!std::holds_alternative<Variable>(arg.src)) {
+                        return std::nullopt;
+                    }
+                    return add(arg.src) ? std::optional{key} : std::nullopt;
+                }
+                return std::nullopt;
+            },
+            op);
+    }
+};
+}  // namespace
+
+int NumberValues(Frame& frame, FrameAnalyses& analyses) {
+    const auto& cfg = analyses.CFG();
+    const auto& tree = analyses.Dominators();
+    ValueNumbering numbering;
+    int replaced = 0;
+
+    // a block sees the memory its dominator left only when it can be entered
+    // from nowhere else
+    std::vector<int> memoryAtExit(cfg.blocks.size(), 0);
+    std::vector<std::vector<Expression>> inserted(cfg.blocks.size());
+    std::vector<std::pair<int, bool>> walk = {{0, false}};
+    while (!walk.empty()) {
+        const auto [b, leaving] = walk.back();
+        walk.pop_back();
+        if (leaving) {
+            for (const auto& key : inserted[b]) {
+                numbering.available.erase(key);
+            }
+            continue;
+        }
+        walk.emplace_back(b, true);
+        const auto& block = cfg.blocks[b];
+        auto memory = b != 0 && block.predecessors.size() == 1
+                          ? memoryAtExit[tree.idom[b]]
+                          : numbering.memoryGenerations++;
+        for (int i = block.begin; i < block.end; i++) {
+            auto& op = frame.instructions[i];
+            if (writes_memory(op)) {
+                memory = numbering.memoryGenerations++;
+            }
+            const auto* dst = defined_value(op);
+            if (dst == nullptr || !std::holds_alternative<Temp>(*dst)) {
+                continue;
+            }
+            const auto temp = std::get<Temp>(*dst);
+            // copies share the number of what they copy, unless they truncate
+            if (const auto* move = std::get_if<Mov>(&op);
+                move != nullptr && std::holds_alternative<Temp>(move->src)) {
+                if (SizeOf(move->src) == temp.size) {
+                    numbering.leaders[temp.id] = numbering.leader(move->src);
+                }
+                continue;
+            }
+            const auto key = numbering.expression(op, memory);
+            if (!key.has_value()) {
+                continue;
+            }
+            const auto it = numbering.available.find(*key);
+            if (it == numbering.available.end()) {
+                numbering.available.emplace(*key, temp);
+                inserted[b].push_back(*key);
+                continue;
+            }
+            numbering.leaders[temp.id] = it->second;
+            op = Mov{.dst = temp, .src = it->second};
+            replaced++;
+        }
+        memoryAtExit[b] = memory;
+        for (auto it = tree.children[b].rbegin();
+             it != tree.children[b].rend(); ++it) {
+            walk.emplace_back(*it, false);
+        }
+    }
+    return replaced;
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,680 @@
+#include "../include/induction.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace qa_ir {
+
+namespace {
+
+// the most Adds materialize spends on a single term
+constexpr int kMaxCoefficient = 4;
+
+// the int the generated code ends up with, arithmetic wraps around
+[[nodiscard]] int wrapped(long long value) {
+    return static_cast<int>(static_cast<unsigned>(value));
+}
+
+[[nodiscard]] const Temp* temp_of(const Value* value) {
+    return value == nullptr ? nullptr : std::get_if<Temp>(value);
+}
+
+// temps defined in the loop and the operation defining them
+[[nodiscard]] std::map<int, int> definitions_in(const Frame& frame,
+                                                const ControlFlowGraph& cfg,
+                                                const Loop& loop) {
+    std::map<int, int> definitions;
+    for (const auto b : loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            const auto* temp = temp_of(defined_value(frame.instructions[i]));
+            if (temp != nullptr) {
+                definitions[temp->id] = i;
+            }
+        }
+    }
+    return definitions;
+}
+
+[[nodiscard]] std::optional<Invariant> invariant_of(
+    const Value& value, int size, const std::map<int, int>& definitions) {
+    if (const auto* literal = std::get_if<int>(&value)) {
+        return Invariant{.constant = *literal, .terms = {}};
+    }
+    const auto* temp = std::get_if<Temp>(&value);
+    if (temp == nullptr || temp->size != size ||
+        definitions.contains(temp->id)) {
+        return std::nullopt;
+    }
+    return Invariant{.constant = 0, .terms = {{1, *temp}}};
+}
+
+// scale * basics[basic].phi + offset, basic is -1 for a loop invariant
+struct Affine {
+    int basic = -1;
+    int scale = 0;
+    Invariant offset = {};
+};
+
+[[nodiscard]] std::optional<Affine> combine(const std::optional<Affine>& a,
+                                            const std::optional<Affine>& b,
+                                            int sign) {
+    if (!a.has_value() || !b.has_value() ||
+        (a->basic >= 0 && b->basic >= 0 && a->basic != b->basic)) {
+        return std::nullopt;
+    }
+    const auto scale = a->scale + sign * b->scale;
+    return Affine{.basic = scale == 0 ? -1 : std::max(a->basic, b->basic),
+                  .scale = scale,
+                  .offset = AddInvariants(a->offset, b->offset, sign)};
+}
+
+// which operations read each temp, once per operand
+[[nodiscard]] std::map<int, std::vector<int>> uses_of(const Frame& frame) {
+    std::map<int, std::vector<int>> uses;
+    const auto n = static_cast<int>(frame.instructions.size());
+    for (int i = 0; i < n; i++) {
+        for_each_used_value(frame.instructions[i], [&](const Value& value) {
+            if (const auto* temp = std::get_if<Temp>(&value)) {
+                uses[temp->id].push_back(i);
+            }
+        });
+    }
+    return uses;
+}
+
+// inserts each batch of operations in front of its index
+void insert_all(Frame& frame,
+                std::vector<std::pair<int, std::vector<Operation>>> batches) {
+    std::ranges::sort(batches, [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    auto& ops = frame.instructions;
+    for (auto& [at, code] : batches) {
+        ops.insert(ops.begin() + at, code.begin(), code.end());
+    }
+}
+
+// the CFG and loop are held by analyses, until the frame changes
+struct LoopInductions {
+    const ControlFlowGraph& cfg;
+    const Loop& loop;
+    Inductions inductions;
+};
+
+[[nodiscard]] std::optional<LoopInductions> analyze(const Frame& frame,
+                                              FrameAnalyses& analyses,
+                                              const std::string& header,
+                                              const std::string& preheader) {
+    const auto& cfg = analyses.CFG();
+    const auto& tree = analyses.Dominators();
+    for (const auto& loop : analyses.Loops().loops) {
+        if (cfg.blocks[loop.header].label != header) {
+            continue;
+        }
+        auto inductions =
+            FindInductionVariables(frame, cfg, tree, loop, preheader);
+        return LoopInductions{
+            .cfg = cfg, .loop = loop, .inductions = std::move(inductions)};
+    }
+    return std::nullopt;
+}
+
+// Gives the first derived induction variable that adds a basic one to
+// itself a phi of its own, stepped in the latch.
+bool reduce_strength(Frame& frame, FreshNames& names, FrameAnalyses& analyses,
+                     const std::string& header, const std::string& preheader) {
+    const auto analysis = analyze(frame, analyses, header, preheader);
+    if (!analysis.has_value()) {
+        return false;
+    }
+    const auto& [cfg, loop, inductions] = *analysis;
+    auto& ops = frame.instructions;
+    std::set<int> inductionDefinitions;
+    for (const auto& derived : inductions.derived) {
+        inductionDefinitions.insert(derived.definition);
+    }
+    const auto uses = uses_of(frame);
+    for (const auto& derived : inductions.derived) {
+        if (std::abs(derived.scale) < 2 || !uses.contains(derived.value.id)) {
+            continue;
+        }
+        // one that only feeds other induction variables goes away with them
+        if (std::ranges::all_of(uses.at(derived.value.id), [&](int use) {
+                return inductionDefinitions.contains(use);
+            })) {
+            continue;
+        }
+        const auto& basic = inductions.basics[derived.basic];
+        const auto size = derived.value.size;
+        std::vector<Operation> entry;
+        const auto init = MaterializeInvariant(
+            AddInvariants(ScaleInvariant(basic.init, derived.scale),
+                          derived.offset),
+            size, names, entry);
+        const auto step = MaterializeInvariant(
+            ScaleInvariant(basic.step, derived.scale), size, names, entry);
+        if (!init.has_value() || !step.has_value()) {
+            continue;
+        }
+
+        const auto phi = names.NewTemp(size);
+        const auto next = names.NewTemp(size);
+        for (const auto b : loop.blocks) {
+            for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                for_each_used_value(ops[i], [&](Value& value) {
+                    if (const auto* temp = std::get_if<Temp>(&value);
+                        temp != nullptr && temp->id == derived.value.id) {
+                        value = phi;
+                    }
+                });
+            }
+        }
+        // still defined where it was for the uses after the loop
+        ops[derived.definition] = Mov{.dst = derived.value, .src = phi};
+        const auto& latch = cfg.blocks[loop.latches.front()];
+        const auto stepped = Phi{
+            .dst = phi,
+            .args = {{.predecessor = {preheader}, .value = *init},
+                     {.predecessor = {latch.label}, .value = next}}};
+        insert_all(
+            frame,
+            {{InsertionPoint(frame, cfg.blocks[cfg.blockOf.at(preheader)]),
+              std::move(entry)},
+             {cfg.blocks[loop.header].begin + 1, {stepped}},
+             {InsertionPoint(frame, latch),
+              {Add{.dst = next, .left = phi, .right = *step}}}});
+        analyses.Invalidate(PreservedAnalyses::None());
+        return true;
+    }
+    return false;
+}
+
+// drops induction variables of the loop that nothing reads anymore
+bool remove_unused(Frame& frame, FrameAnalyses& analyses,
+                   const std::string& header, const std::string& preheader) {
+    auto removed = false;
+    while (true) {
+        const auto analysis = analyze(frame, analyses, header, preheader);
+        if (!analysis.has_value()) {
+            return removed;
+        }
+        const auto uses = uses_of(frame);
+        std::set<int> unused;
+        for (const auto& derived : analysis->inductions.derived) {
+            if (!uses.contains(derived.value.id)) {
+                unused.insert(derived.definition);
+            }
+        }
+        if (unused.empty()) {
+            return removed;
+        }
+        int i = 0;
+        std::erase_if(frame.instructions,
+                      [&](const Operation&) { return unused.contains(i++); });
+        analyses.Invalidate(PreservedAnalyses::None());
+        removed = true;
+    }
+}
+
+[[nodiscard]] bool is_comparison(const Operation& op) {
+    return std::holds_alternative<Compare>(op) ||
+           std::holds_alternative<Equal>(op) ||
+           std::holds_alternative<NotEqual>(op) ||
+           std::holds_alternative<GreaterThan>(op);
+}
+
+// Rewrites the one comparison a basic induction variable is kept for on
+// another induction variable of the loop, then removes it.
+bool replace_test(Frame& frame, FreshNames& names, FrameAnalyses& analyses,
+                  const std::string& header, const std::string& preheader) {
+    const auto analysis = analyze(frame, analyses, header, preheader);
+    if (!analysis.has_value()) {
+        return false;
+    }
+    const auto& [cfg, loop, inductions] = *analysis;
+    auto& ops = frame.instructions;
+    const auto uses = uses_of(frame);
+    const auto definitions = definitions_in(frame, cfg, loop);
+    for (const auto& basic : inductions.basics) {
+        if (!basic.step.terms.empty() || basic.step.constant == 0 ||
+            !uses.contains(basic.phi.id) || !uses.contains(basic.next.id)) {
+            continue;
+        }
+        const auto phi = definitions.at(basic.phi.id);
+        const auto next = definitions.at(basic.next.id);
+        const auto& phiUses = uses.at(basic.phi.id);
+        if (uses.at(basic.next.id) != std::vector<int>{phi} ||
+            phiUses.size() != 2 || std::ranges::count(phiUses, next) != 1) {
+            continue;
+        }
+        const auto test = phiUses[0] == next ? phiUses[1] : phiUses[0];
+        const auto inLoop = std::ranges::any_of(loop.blocks, [&](int b) {
+            return cfg.blocks[b].begin <= test && test < cfg.blocks[b].end;
+        });
+        if (!inLoop || !is_comparison(ops[test])) {
+            continue;
+        }
+        std::vector<Value*> operands;
+        for_each_used_value(ops[test],
+                            [&](Value& value) { operands.push_back(&value); });
+        const auto* left = temp_of(operands[0]);
+        auto* bound = left != nullptr && left->id == basic.phi.id
+                          ? operands[1]
+                          : operands[0];
+        const auto limit = invariant_of(*bound, basic.phi.size, definitions);
+        if (!limit.has_value()) {
+            continue;
+        }
+        for (const auto& other : inductions.basics) {
+            if (other.phi.id == basic.phi.id ||
+                other.phi.size != basic.phi.size || !other.step.terms.empty() ||
+                other.step.constant % basic.step.constant != 0 ||
+                other.step.constant / basic.step.constant <= 0) {
+                continue;
+            }
+            // other = ratio * basic + other.init - ratio * basic.init
+            const auto ratio = other.step.constant / basic.step.constant;
+            std::vector<Operation> entry;
+            const auto rewritten = MaterializeInvariant(
+                AddInvariants(
+                    ScaleInvariant(*limit, ratio),
+                    AddInvariants(other.init,
+                                  ScaleInvariant(basic.init, ratio), -1)),
+                basic.phi.size, names, entry);
+            if (!rewritten.has_value()) {
+                continue;
+            }
+            *bound = *rewritten;
+            for (auto* operand : operands) {
+                if (operand != bound) {
+                    *operand = other.phi;
+                }
+            }
+            const auto at =
+                InsertionPoint(frame, cfg.blocks[cfg.blockOf.at(preheader)]);
+            std::vector<Operation> out;
+            out.reserve(ops.size() + entry.size());
+            for (int i = 0; i < static_cast<int>(ops.size()); i++) {
+                if (i == at) {
+                    out.insert(out.end(), entry.begin(), entry.end());
+                }
+                if (i != phi && i != next) {
+                    out.push_back(std::move(ops[i]));
+                }
+            }
+            ops = std::move(out);
+            analyses.Invalidate(PreservedAnalyses::None());
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace
+
+Invariant AddInvariants(const Invariant& a, const Invariant& b, int sign) {
+    Invariant sum{
+        .constant = wrapped(a.constant + static_cast<long long>(sign) *
+                                             b.constant),
+        .terms = {}};
+    std::map<int, std::pair<int, Temp>> terms;
+    for (const auto& [coefficient, temp] : a.terms) {
+        terms.emplace(temp.id, std::pair{coefficient, temp});
+    }
+    for (const auto& [coefficient, temp] : b.terms) {
+        auto& term = terms.try_emplace(temp.id, 0, temp).first->second;
+        term.first = wrapped(term.first +
+                             static_cast<long long>(sign) * coefficient);
+    }
+    for (const auto& [id, term] : terms) {
+        if (term.first != 0) {
+            sum.terms.push_back(term);
+        }
+    }
+    return sum;
+}
+
+Invariant ScaleInvariant(Invariant a, int k) {
+    if (k == 0) {
+        return {};
+    }
+    a.constant = wrapped(static_cast<long long>(a.constant) * k);
+    for (auto& [coefficient, temp] : a.terms) {
+        coefficient = wrapped(static_cast<long long>(coefficient) * k);
+    }
+    std::erase_if(a.terms, [](const auto& term) { return term.first == 0; });
+    return a;
+}
+
+std::optional<Value> MaterializeInvariant(const Invariant& sum, int size,
+                                          FreshNames& names,
+                                          std::vector<Operation>& code) {
+    if (std::ranges::any_of(sum.terms, [](const auto& term) {
+            return term.first < -kMaxCoefficient ||
+                   term.first > kMaxCoefficient;
+        })) {
+        return std::nullopt;
+    }
+    std::optional<Value> result;
+    if (sum.constant != 0 || sum.terms.empty()) {
+        result = sum.constant;
+    }
+    for (const auto& [coefficient, temp] : sum.terms) {
+        for (int n = 0; n < std::abs(coefficient); n++) {
+            if (!result.has_value() && coefficient > 0) {
+                result = temp;
+                continue;
+            }
+            const auto dst = names.NewTemp(size);
+            if (!result.has_value()) {
+                code.emplace_back(Mov{.dst = dst, .src = 0});
+                result = dst;
+            }
+            if (coefficient > 0) {
+                code.emplace_back(
+                    Add{.dst = dst, .left = *result, .right = temp});
+            } else {
+                code.emplace_back(
+                    Sub{.dst = dst, .left = *result, .right = temp});
+            }
+            result = dst;
+        }
+    }
+    return result;
+}
+
+Inductions FindInductionVariables(const Frame& frame,
+                                  const ControlFlowGraph& cfg,
+                                  const DominatorTree& tree, const Loop& loop,
+                                  const std::string& preheader) {
+    Inductions found;
+    if (loop.latches.size() != 1) {
+        return found;
+    }
+    const auto& ops = frame.instructions;
+    const auto& latch = cfg.blocks[loop.latches.front()].label;
+    const auto definitions = definitions_in(frame, cfg, loop);
+    auto invariant = [&definitions](const Value& value, int size) {
+        return invariant_of(value, size, definitions);
+    };
+    // next = phi + step, step + phi or phi - step
+    auto step_of = [&](const Temp& phi, const Temp& next)
+        -> std::optional<Invariant> {
+        const auto it = definitions.find(next.id);
+        if (it == definitions.end() || next.size != phi.size) {
+            return std::nullopt;
+        }
+        auto is_phi = [&phi](const Value& value) {
+            const auto* temp = std::get_if<Temp>(&value);
+            return temp != nullptr && temp->id == phi.id;
+        };
+        if (const auto* add = std::get_if<Add>(&ops[it->second])) {
+            if (is_phi(add->left)) {
+                return invariant(add->right, phi.size);
+            }
+            if (is_phi(add->right)) {
+                return invariant(add->left, phi.size);
+            }
+        } else if (const auto* sub = std::get_if<Sub>(&ops[it->second]);
+                   sub != nullptr && is_phi(sub->left)) {
+            const auto step = invariant(sub->right, phi.size);
+            return step.has_value() ? std::optional{ScaleInvariant(*step, -1)}
+                                    : std::nullopt;
+        }
+        return std::nullopt;
+    };
+
+    const auto& header = cfg.blocks[loop.header];
+    for (int i = header.begin + 1; i < header.end; i++) {
+        const auto* phi = std::get_if<Phi>(&ops[i]);
+        if (phi == nullptr) {
+            break;
+        }
+        const auto* dst = temp_of(&phi->dst);
+        if (dst == nullptr || phi->args.size() != 2) {
+            continue;
+        }
+        std::optional<Invariant> init;
+        std::optional<Invariant> step;
+        const Temp* next = nullptr;
+        for (const auto& incoming : phi->args) {
+            if (incoming.predecessor.name == preheader) {
+                init = invariant(incoming.value, dst->size);
+            } else if (incoming.predecessor.name == latch) {
+                next = temp_of(&incoming.value);
+                step = next == nullptr ? std::nullopt : step_of(*dst, *next);
+            }
+        }
+        if (init.has_value() && step.has_value()) {
+            found.basics.push_back(BasicInduction{
+                .phi = *dst, .init = *init, .step = *step, .next = *next});
+        }
+    }
+
+    std::map<int, Affine> affine;
+    for (int b = 0; b < static_cast<int>(found.basics.size()); b++) {
+        affine[found.basics[b].phi.id] = Affine{.basic = b, .scale = 1};
+    }
+    auto operand = [&](const Value& value,
+                       int size) -> std::optional<Affine> {
+        const auto* temp = std::get_if<Temp>(&value);
+        if (temp != nullptr && affine.contains(temp->id)) {
+            return temp->size == size ? std::optional{affine.at(temp->id)}
+                                      : std::nullopt;
+        }
+        const auto offset = invariant(value, size);
+        return offset.has_value()
+                   ? std::optional{Affine{.basic = -1,
+                                          .scale = 0,
+                                          .offset = *offset}}
+                   : std::nullopt;
+    };
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto b : tree.reversePostorder) {
+            if (!loop.contains(b)) {
+                continue;
+            }
+            for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                const auto* dst = temp_of(defined_value(ops[i]));
+                if (dst == nullptr || affine.contains(dst->id)) {
+                    continue;
+                }
+                const auto value = std::visit(
+                    [&](const auto& arg) -> std::optional<Affine> {
+                        using T = std::decay_t<decltype(arg)>;
+                        if constexpr (std::is_same_v<T, Add>) {
+                            return combine(operand(arg.left, dst->size),
+                                           operand(arg.right, dst->size), 1);
+                        } else if constexpr (std::is_same_v<T, Sub>) {
+                            return combine(operand(arg.left, dst->size),
+                                           operand(arg.right, dst->size), -1);
+                        } else if constexpr (std::is_same_v<T, Mov>) {
+                            return operand(arg.src, dst->size);
+                        }
+                        return std::nullopt;
+                    },
+                    ops[i]);
+                if (!value.has_value() || value->basic < 0) {
+                    continue;
+                }
+                affine[dst->id] = *value;
+                found.derived.push_back(DerivedInduction{
+                    .value = *dst,
+                    .basic = value->basic,
+                    .scale = value->scale,
+                    .offset = value->offset,
+                    .definition = i});
+                changed = true;
+            }
+        }
+    }
+    return found;
+}
+
+std::optional<CountedLoop> FindCountedLoop(const Frame& frame,
+                                           const ControlFlowGraph& cfg,
+                                           const DominatorTree& tree,
+                                           const Loop& loop,
+                                           const std::string& preheader) {
+    const auto& ops = frame.instructions;
+    const auto& block = cfg.blocks[loop.header];
+    if (loop.latches.size() != 1 || block.end - block.begin < 3 ||
+        !std::holds_alternative<Compare>(ops[block.end - 2])) {
+        return std::nullopt;
+    }
+    const auto targets = successor_labels(ops[block.end - 1]);
+    if (targets.size() != 2) {
+        return std::nullopt;
+    }
+    CountedLoop counted{.test = block.end - 2,
+                        .latch = cfg.blocks[loop.latches.front()].label};
+    for (const auto& target : targets) {
+        if (loop.contains(cfg.blockOf.at(target.name))) {
+            counted.body = target.name;
+        } else {
+            counted.exit = target.name;
+        }
+    }
+    if (counted.body.empty() || counted.exit.empty()) {
+        return std::nullopt;
+    }
+    for (const auto b : loop.blocks) {
+        const auto leaves = std::ranges::any_of(
+            cfg.blocks[b].successors, [&](int s) { return !loop.contains(s); });
+        if (b != loop.header && leaves) {
+            return std::nullopt;
+        }
+    }
+    counted.first = block.begin + 1;
+    for (; counted.first < counted.test; counted.first++) {
+        const auto* phi = std::get_if<Phi>(&ops[counted.first]);
+        if (phi == nullptr) {
+            break;
+        }
+        const auto* dst = temp_of(&phi->dst);
+        if (dst == nullptr || phi->args.size() != 2) {
+            return std::nullopt;
+        }
+        HeaderPhi values{.phi = *dst, .entry = 0, .next = 0};
+        for (const auto& incoming : phi->args) {
+            if (incoming.predecessor.name == preheader) {
+                values.entry = incoming.value;
+            } else {
+                values.next = incoming.value;
+            }
+        }
+        counted.phis.push_back(values);
+    }
+
+    const auto inductions =
+        FindInductionVariables(frame, cfg, tree, loop, preheader);
+    const auto& compare = std::get<Compare>(ops[counted.test]);
+    const Value* operands[] = {&compare.left, &compare.right};
+    for (int side = 0; side < 2; side++) {
+        const auto* temp = temp_of(operands[side]);
+        if (temp == nullptr) {
+            continue;
+        }
+        for (const auto& basic : inductions.basics) {
+            if (basic.phi.id == temp->id) {
+                counted.counter = basic;
+                counted.side = side;
+                return counted;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<int> ConstantTripCount(const Frame& frame,
+                                     const CountedLoop& loop) {
+    const auto& ops = frame.instructions;
+    const auto& compare = std::get<Compare>(ops[loop.test]);
+    const auto* bound =
+        std::get_if<int>(loop.side == 0 ? &compare.right : &compare.left);
+    const auto& counter = loop.counter;
+    if (bound == nullptr || !counter.init.terms.empty() ||
+        !counter.step.terms.empty() || counter.step.constant == 0) {
+        return std::nullopt;
+    }
+    const auto& jump = ops[loop.test + 1];
+    const auto bodyOnTrue = successor_labels(jump)[0].name == loop.body;
+    const long long init = counter.init.constant;
+    const long long step = counter.step.constant;
+    auto continues = [&](long long trips) {
+        const auto value = init + trips * step;
+        const auto left = loop.side == 0 ? value : *bound;
+        const auto right = loop.side == 0 ? *bound : value;
+        auto holds = left == right;
+        if (std::holds_alternative<ConditionalJumpLess>(jump)) {
+            holds = left < right;
+        } else if (std::holds_alternative<ConditionalJumpGreater>(jump)) {
+            holds = left > right;
+        }
+        return holds == bodyOnTrue;
+    };
+    if (!continues(0)) {
+        return 0;
+    }
+    if (std::holds_alternative<ConditionalJumpEqual>(jump)) {
+        // the counter leaves the bound after a trip, or has to step onto it
+        if (bodyOnTrue) {
+            return 1;
+        }
+        const auto distance = *bound - init;
+        if (distance % step != 0 || distance / step <= 0 ||
+            distance / step > INT_MAX) {
+            return std::nullopt;
+        }
+        return static_cast<int>(distance / step);
+    }
+    // the counter crosses the bound once, before the most trips it stays an
+    // int for
+    auto done = step > 0 ? (INT_MAX - init) / step : (init - INT_MIN) / -step;
+    if (continues(done)) {
+        return std::nullopt;
+    }
+    long long running = 0;
+    while (done - running > 1) {
+        const auto middle = running + (done - running) / 2;
+        (continues(middle) ? running : done) = middle;
+    }
+    if (done > INT_MAX) {
+        return std::nullopt;
+    }
+    return static_cast<int>(done);
+}
+
+int ReduceInductionVariables(Frame& frame, FrameAnalyses& analyses) {
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    int reduced = 0;
+    const auto visit = [&](int loop, const std::string& preheader) {
+        const auto b = analyses.Loops().loops[loop].header;
+        const auto header = analyses.CFG().blocks[b].label;
+        const auto before = reduced;
+        while (reduce_strength(frame, names, analyses, header, preheader)) {
+            reduced++;
+        }
+        const auto removed = remove_unused(frame, analyses, header, preheader);
+        while (replace_test(frame, names, analyses, header, preheader)) {
+            reduced++;
+        }
+        return removed || reduced != before;
+    };
+    ForEachLoop(frame, names, analyses, visit);
+    return reduced;
+}
+}  // namespace qa_ir
\ No newline at end of file
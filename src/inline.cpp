@@ -0,0 +1,244 @@
+#include "../include/inline.hpp"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// the operations inlining a frame adds, labels and parameters aside
+[[nodiscard]] int size_of(const Frame& frame) {
+    int size = 0;
+    for (const auto& op : frame.instructions) {
+        if (!std::holds_alternative<LabelDef>(op) && !IsParameter(op)) {
+            size++;
+        }
+    }
+    return size;
+}
+
+// Copies of a callee's operations with its temps and labels replaced by
+// fresh ones of the caller and its variables prefixed with the call site.
+class Renamer {
+   public:
+    Renamer(const Frame& callee, FreshNames& names, std::string prefix)
+        : names_(names), prefix_(std::move(prefix)) {
+        for (const auto& op : callee.instructions) {
+            if (const auto* label = std::get_if<LabelDef>(&op)) {
+                labels_.emplace(label->label.name, names_.NewLabel());
+            }
+        }
+    }
+
+    [[nodiscard]] Variable variable(const Variable& variable) const {
+        return Variable{prefix_ + variable.name, variable.version,
+                        variable.size};
+    }
+
+    [[nodiscard]] Value value(const Value& value) {
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            const auto [it, added] = temps_.try_emplace(temp->id, Temp{});
+            if (added) {
+                it->second = names_.NewTemp(temp->size);
+            }
+            return it->second;
+        }
+        if (const auto* named = std::get_if<Variable>(&value)) {
+            return variable(*named);
+        }
+        return value;
+    }
+
+    [[nodiscard]] Operation operation(Operation op) {
+        if (auto* dst = defined_value(op)) {
+            *dst = value(*dst);
+        }
+        for_each_used_value(op, [this](Value& used) { used = value(used); });
+        std::visit(
+            [this](auto& arg) {
+                using T = std::decay_t<decltype(arg)>;
+                if constexpr (std::is_same_v<T, Addr>) {
+                    arg.src = value(arg.src);
+                } else if constexpr (std::is_same_v<T, Jump> ||
+                                     std::is_same_v<T, LabelDef>) {
+                    arg.label = labels_.at(arg.label.name);
+                } else if constexpr (requires { arg.trueLabel; }) {
+                    arg.trueLabel = labels_.at(arg.trueLabel.name);
+                    arg.falseLabel = labels_.at(arg.falseLabel.name);
+                }
+            },
+            op);
+        return op;
+    }
+
+   private:
+    FreshNames& names_;
+    std::string prefix_;
+    std::map<int, Temp> temps_ = {};
+    std::map<std::string, Label> labels_ = {};
+};
+
+// Appends callee's body to out in place of call. The result goes through a
+// variable of its own so that ConstructSSA merges the values of every Ret.
+void inline_call(const Call& call, const Frame& callee, FreshNames& names,
+                 int site, std::vector<Operation>& out) {
+    Renamer renamer(callee, names,
+                    callee.name + "." + std::to_string(site) + ".");
+    const auto result =
+        renamer.variable(Variable{"return", 1, SizeOf(call.dst)});
+    const auto continuation = names.NewLabel();
+    // a callee may end without returning a value
+    out.emplace_back(Mov{.dst = result, .src = 0});
+    const auto parameters = FrameParameters(callee);
+    for (std::size_t k = 0; k < parameters.size(); k++) {
+        out.emplace_back(
+            Mov{.dst = renamer.variable(parameters[k]), .src = call.args[k]});
+    }
+    for (const auto& op : callee.instructions) {
+        if (IsParameter(op)) {
+            continue;
+        }
+        if (const auto* ret = std::get_if<Ret>(&op)) {
+            out.emplace_back(
+                Mov{.dst = result, .src = renamer.value(ret->value)});
+            out.emplace_back(Jump{.label = continuation});
+            continue;
+        }
+        out.push_back(renamer.operation(op));
+    }
+    out.emplace_back(LabelDef{.label = continuation});
+    out.emplace_back(Mov{.dst = call.dst, .src = result});
+}
+
+// the frames each frame calls, by index
+[[nodiscard]] std::vector<std::vector<int>> call_graph(
+    const std::vector<Frame>& frames,
+    const std::map<std::string, int>& indexOf) {
+    std::vector<std::vector<int>> calls(frames.size());
+    for (std::size_t f = 0; f < frames.size(); f++) {
+        for (const auto& op : frames[f].instructions) {
+            const auto* call = std::get_if<Call>(&op);
+            const auto it =
+                call == nullptr ? indexOf.end() : indexOf.find(call->name);
+            if (it != indexOf.end()) {
+                calls[f].push_back(it->second);
+            }
+        }
+    }
+    return calls;
+}
+
+// reaches[f][g] when f calls g, directly or through other frames
+[[nodiscard]] std::vector<std::vector<bool>> transitive_calls(
+    const std::vector<std::vector<int>>& calls) {
+    const auto n = calls.size();
+    std::vector<std::vector<bool>> reaches(n, std::vector<bool>(n, false));
+    for (std::size_t f = 0; f < n; f++) {
+        std::vector<int> worklist(calls[f].begin(), calls[f].end());
+        while (!worklist.empty()) {
+            const auto g = worklist.back();
+            worklist.pop_back();
+            if (reaches[f][g]) {
+                continue;
+            }
+            reaches[f][g] = true;
+            worklist.insert(worklist.end(), calls[g].begin(), calls[g].end());
+        }
+    }
+    return reaches;
+}
+
+// Drops the frames main no longer reaches. Without a main every frame is
+// kept.
+void drop_uncalled_frames(std::vector<Frame>& frames) {
+    std::map<std::string, int> indexOf;
+    for (std::size_t f = 0; f < frames.size(); f++) {
+        indexOf.emplace(frames[f].name, static_cast<int>(f));
+    }
+    const auto main = indexOf.find("main");
+    if (main == indexOf.end()) {
+        return;
+    }
+    const auto reaches = transitive_calls(call_graph(frames, indexOf));
+    std::vector<Frame> kept;
+    for (std::size_t f = 0; f < frames.size(); f++) {
+        if (static_cast<int>(f) == main->second || reaches[main->second][f]) {
+            kept.push_back(std::move(frames[f]));
+        }
+    }
+    frames = std::move(kept);
+}
+}  // namespace
+
+int InlineCalls(std::vector<Frame>& frames, const InlineOptions& options) {
+    if (options.limit <= 0) {
+        return 0;
+    }
+    std::map<std::string, int> indexOf;
+    for (std::size_t f = 0; f < frames.size(); f++) {
+        indexOf.emplace(frames[f].name, static_cast<int>(f));
+    }
+    const auto calls = call_graph(frames, indexOf);
+    const auto reaches = transitive_calls(calls);
+    std::vector<int> sites(frames.size(), 0);
+    for (const auto& callees : calls) {
+        for (const auto g : callees) {
+            sites[g]++;
+        }
+    }
+
+    // callees before their callers
+    std::vector<int> order;
+    std::vector<bool> visited(frames.size(), false);
+    std::function<void(int)> visit = [&](int f) {
+        visited[f] = true;
+        for (const auto g : calls[f]) {
+            if (!visited[g]) {
+                visit(g);
+            }
+        }
+        order.push_back(f);
+    };
+    for (std::size_t f = 0; f < frames.size(); f++) {
+        if (!visited[f]) {
+            visit(static_cast<int>(f));
+        }
+    }
+
+    std::vector<int> sizes(frames.size(), 0);
+    int inlined = 0;
+    for (const auto f : order) {
+        auto& caller = frames[f];
+        FreshNames names(caller);
+        std::vector<Operation> out;
+        out.reserve(caller.instructions.size());
+        int site = 0;
+        for (auto& op : caller.instructions) {
+            const auto* call = std::get_if<Call>(&op);
+            const auto it =
+                call == nullptr ? indexOf.end() : indexOf.find(call->name);
+            const auto g = it == indexOf.end() ? -1 : it->second;
+            if (g == -1 || reaches[g][f] || reaches[g][g] ||
+                call->args.size() != FrameParameters(frames[g]).size() ||
+                (sizes[g] > options.limit && sites[g] != 1)) {
+                out.push_back(std::move(op));
+                continue;
+            }
+            inline_call(*call, frames[g], names, site++, out);
+            inlined++;
+        }
+        caller.instructions = std::move(out);
+        sizes[f] = size_of(caller);
+    }
+    drop_uncalled_frames(frames);
+    return inlined;
+}
+}  // namespace qa_ir
\ No newline at end of file
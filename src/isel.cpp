@@ -0,0 +1,380 @@
+#include "../include/isel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <optional>
+#include <string_view>
+#include <variant>
+
+namespace target {
+
+namespace {
+
+// An Add or Sub as a tree. dst is where the result goes, the Variable of
+// the Mov after it when that Mov is covered too. deref, when not null, is
+// the Deref whose temp right is.
+struct Tree {
+    const qa_ir::Value* dst;
+    const qa_ir::Value* left;
+    const qa_ir::Value* right;
+    bool add;
+    const qa_ir::Deref* deref = nullptr;
+};
+
+[[nodiscard]] std::optional<Tree> tree_of(const qa_ir::Operation& op) {
+    if (const auto* add = std::get_if<qa_ir::Add>(&op)) {
+        return Tree{&add->dst, &add->left, &add->right, true};
+    }
+    if (const auto* sub = std::get_if<qa_ir::Sub>(&op)) {
+        return Tree{&sub->dst, &sub->left, &sub->right, false};
+    }
+    return std::nullopt;
+}
+
+// the same Add with its operands the other way around
+[[nodiscard]] std::optional<Tree> commuted(const Tree& tree) {
+    if (!tree.add) {
+        return std::nullopt;
+    }
+    return Tree{tree.dst, tree.right, tree.left, true, tree.deref};
+}
+
+[[nodiscard]] const qa_ir::Temp* temp(const qa_ir::Value* value) {
+    return std::get_if<qa_ir::Temp>(value);
+}
+
+[[nodiscard]] const qa_ir::Variable* variable(const qa_ir::Value* value) {
+    return std::get_if<qa_ir::Variable>(value);
+}
+
+[[nodiscard]] bool same_temp(const qa_ir::Value* lhs, const qa_ir::Value* rhs) {
+    const auto* left = temp(lhs);
+    const auto* right = temp(rhs);
+    return left != nullptr && right != nullptr && left->id == right->id;
+}
+
+[[nodiscard]] bool same_variable(const qa_ir::Value* lhs,
+                                 const qa_ir::Value* rhs) {
+    const auto* left = variable(lhs);
+    const auto* right = variable(rhs);
+    return left != nullptr && right != nullptr && left->name == right->name;
+}
+
+// what right adds to left, nullopt when it isn't a constant or can't be
+// negated
+[[nodiscard]] std::optional<int> delta(const Tree& tree) {
+    const auto* value = std::get_if<int>(tree.right);
+    if (value == nullptr || *value == INT_MIN) {
+        return std::nullopt;
+    }
+    return tree.add ? *value : -*value;
+}
+
+[[nodiscard]] StackLocation slot(const qa_ir::Value* value, const Ctx& ctx) {
+    return ctx.variable_offset.at(variable(value)->name);
+}
+
+// A tile covers a tree at cost instructions, or returns nullopt when it
+// doesn't match it
+struct Tile {
+    std::string_view name;
+    std::optional<int> (*cost)(const Tree& tree);
+    void (*emit)(const Tree& tree, Ctx& ctx, Emitter& out);
+};
+
+constexpr auto tiles = std::array{
+    // inc reg / dec reg
+    Tile{"inc",
+         [](const Tree& tree) -> std::optional<int> {
+             const auto by = delta(tree);
+             if (tree.deref != nullptr || !same_temp(tree.dst, tree.left) ||
+                 !by.has_value() || (*by != 1 && *by != -1)) {
+                 return std::nullopt;
+             }
+             return 1;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             const auto reg = ctx.AllocateNewForTemp(*temp(tree.dst));
+             if (delta(tree) == 1) {
+                 out.emit(Inc{.dst = reg});
+             } else {
+                 out.emit(Dec{.dst = reg});
+             }
+         }},
+    // add reg, imm in place
+    Tile{"add-imm",
+         [](const Tree& tree) -> std::optional<int> {
+             if (tree.deref != nullptr || !same_temp(tree.dst, tree.left) ||
+                 !std::holds_alternative<int>(*tree.right)) {
+                 return std::nullopt;
+             }
+             return 1;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             const auto reg = ctx.AllocateNewForTemp(*temp(tree.dst));
+             const auto value = std::get<int>(*tree.right);
+             if (tree.add) {
+                 out.emit(AddI{.dst = reg, .value = value});
+             } else {
+                 out.emit(SubI{.dst = reg, .value = value});
+             }
+         }},
+    // add reg, reg in place
+    Tile{"add-reg",
+         [](const Tree& tree) -> std::optional<int> {
+             if (tree.deref != nullptr || !same_temp(tree.dst, tree.left) ||
+                 temp(tree.right) == nullptr) {
+                 return std::nullopt;
+             }
+             return 1;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             const auto reg = ctx.AllocateNewForTemp(*temp(tree.dst));
+             const auto src = ctx.AllocateNewForTemp(*temp(tree.right));
+             if (tree.add) {
+                 out.emit(Add{.dst = reg, .src = src});
+             } else {
+                 out.emit(Sub{.dst = reg, .src = src});
+             }
+         }},
+    // lea dst, [left + imm], when left lives on
+    Tile{"lea",
+         [](const Tree& tree) -> std::optional<int> {
+             const auto* dst = temp(tree.dst);
+             const auto* left = temp(tree.left);
+             if (tree.deref != nullptr || dst == nullptr || left == nullptr ||
+                 dst->id == left->id || dst->size != left->size ||
+                 !delta(tree).has_value()) {
+                 return std::nullopt;
+             }
+             return 1;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             out.emit(LeaOffset{
+                 .dst = ctx.AllocateNewForTemp(*temp(tree.dst)),
+                 .src = ctx.AllocateNewForTemp(*temp(tree.left)),
+                 .offset = delta(tree).value()});
+         }},
+    // add reg, [slot]
+    Tile{"add-slot",
+         [](const Tree& tree) -> std::optional<int> {
+             const auto* dst = temp(tree.dst);
+             const auto* right = variable(tree.right);
+             if (tree.deref != nullptr || dst == nullptr || right == nullptr ||
+                 right->size != dst->size) {
+                 return std::nullopt;
+             }
+             return same_temp(tree.dst, tree.left) ? 1 : 2;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             const auto reg = ctx.AllocateNewForTemp(*temp(tree.dst));
+             if (!same_temp(tree.dst, tree.left)) {
+                 ctx.toLocation(reg, *tree.left, out);
+             }
+             if (tree.add) {
+                 out.emit(AddRM{.dst = reg, .src = slot(tree.right, ctx)});
+             } else {
+                 out.emit(SubRM{.dst = reg, .src = slot(tree.right, ctx)});
+             }
+         }},
+    // inc [slot], add [slot], imm and add [slot], reg
+    Tile{"slot-in-place",
+         [](const Tree& tree) -> std::optional<int> {
+             if (tree.deref != nullptr || !same_variable(tree.dst, tree.left) ||
+                 (!delta(tree).has_value() && temp(tree.right) == nullptr)) {
+                 return std::nullopt;
+             }
+             return 1;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             const auto dst = slot(tree.dst, ctx);
+             const auto size = variable(tree.dst)->size;
+             if (const auto* right = temp(tree.right)) {
+                 const auto reg = ctx.AllocateNewForTemp(*right);
+                 if (tree.add) {
+                     out.emit(AddM{.dst = dst, .src = reg});
+                 } else {
+                     out.emit(SubM{.dst = dst, .src = reg});
+                 }
+                 return;
+             }
+             const auto by = delta(tree).value();
+             if (by == 1) {
+                 out.emit(IncM{.dst = dst, .size = size});
+             } else if (by == -1) {
+                 out.emit(DecM{.dst = dst, .size = size});
+             } else if (tree.add) {
+                 out.emit(AddMI{.dst = dst, .size = size, .value = by});
+             } else {
+                 out.emit(SubMI{.dst = dst, .size = size, .value = -by});
+             }
+         }},
+    // add reg, [ptr], with the pointer chain of a Deref followed first
+    Tile{"add-deref",
+         [](const Tree& tree) -> std::optional<int> {
+             const auto* dst = temp(tree.dst);
+             if (tree.deref == nullptr || dst == nullptr ||
+                 dst->size != qa_ir::SizeOf(tree.deref->dst) ||
+                 same_temp(tree.dst, &tree.deref->src)) {
+                 return std::nullopt;
+             }
+             const auto load = variable(&tree.deref->src) != nullptr ? 1 : 0;
+             const auto copy = same_temp(tree.dst, tree.left) ? 0 : 1;
+             return load + (tree.deref->depth - 1) + copy + 1;
+         },
+         [](const Tree& tree, Ctx& ctx, Emitter& out) {
+             const auto& deref = *tree.deref;
+             Register pointer = VirtualRegister{};
+             if (const auto* promoted = temp(&deref.src)) {
+                 pointer = ctx.AllocateNewForTemp(*promoted);
+             } else {
+                 pointer = ctx.NewRegister(8);
+                 out.emit(Load{.dst = pointer, .src = slot(&deref.src, ctx)});
+             }
+             for (int level = 1; level < deref.depth; level++) {
+                 const auto next = ctx.NewRegister(8);
+                 out.emit(IndirectLoad{.dst = next, .src = pointer});
+                 pointer = next;
+             }
+             const auto reg = ctx.AllocateNewForTemp(*temp(tree.dst));
+             if (!same_temp(tree.dst, tree.left)) {
+                 ctx.toLocation(reg, *tree.left, out);
+             }
+             if (tree.add) {
+                 out.emit(AddIndirect{.dst = reg, .src = pointer});
+             } else {
+                 out.emit(SubIndirect{.dst = reg, .src = pointer});
+             }
+         }},
+};
+
+// what LowerInstruction emits for an operation the tiles may cover
+[[nodiscard]] int lowering_cost(const qa_ir::Operation& op) {
+    if (const auto tree = tree_of(op)) {
+        // the left operand is copied into the result's register first
+        return 2 + (variable(tree->right) != nullptr ? 1 : 0) +
+               (variable(tree->dst) != nullptr ? 2 : 0);
+    }
+    if (const auto* deref = std::get_if<qa_ir::Deref>(&op)) {
+        return deref->depth + (variable(&deref->src) != nullptr ? 1 : 0);
+    }
+    return 1;
+}
+
+struct Cover {
+    const Tile* tile = nullptr;
+    Tree tree = {};
+    int cost = INT_MAX;
+};
+
+// the cheapest tile for tree and for the Add with its operands swapped
+void cheapest(const Tree& tree, Cover& best) {
+    for (const auto& candidate : {std::optional<Tree>(tree), commuted(tree)}) {
+        if (!candidate.has_value()) {
+            continue;
+        }
+        for (const auto& tile : tiles) {
+            const auto cost = tile.cost(candidate.value());
+            if (cost.has_value() && cost.value() < best.cost) {
+                best = Cover{&tile, candidate.value(), cost.value()};
+            }
+        }
+    }
+}
+
+// the cover of op by itself, with the cost of lowering it without a tile
+// when no tile is cheaper
+[[nodiscard]] Cover single_cover(const qa_ir::Operation& op) {
+    Cover best{.cost = lowering_cost(op)};
+    if (const auto tree = tree_of(op)) {
+        cheapest(tree.value(), best);
+    }
+    return best;
+}
+
+// whether value is a temp that only the next operation reads
+[[nodiscard]] bool single_use(const qa_ir::Value* value, const Ctx& ctx) {
+    const auto* t = temp(value);
+    return t != nullptr &&
+           static_cast<std::size_t>(t->id) < ctx.temp_reads.size() &&
+           ctx.temp_reads[t->id] == 1 && ctx.temp_writes[t->id] == 1;
+}
+
+// the cover of ops[i] as the subtree of ops[i + 1]
+[[nodiscard]] Cover pair_cover(const qa_ir::Operation& child,
+                               const qa_ir::Operation& root, const Ctx& ctx) {
+    Cover best;
+    // a result stored right away goes to the Variable directly
+    const auto* move = std::get_if<qa_ir::Mov>(&root);
+    const auto tree = tree_of(child);
+    if (move != nullptr && tree.has_value() && single_use(tree->dst, ctx) &&
+        same_temp(tree->dst, &move->src) && variable(&move->dst) != nullptr) {
+        cheapest(Tree{&move->dst, tree->left, tree->right, tree->add}, best);
+    }
+    // a Deref read once becomes a memory operand
+    const auto* deref = std::get_if<qa_ir::Deref>(&child);
+    const auto reader = tree_of(root);
+    if (deref != nullptr && reader.has_value() &&
+        single_use(&deref->dst, ctx)) {
+        for (const auto& candidate : {std::optional<Tree>(reader.value()),
+                                      commuted(reader.value())}) {
+            if (candidate.has_value() &&
+                same_temp(candidate->right, &deref->dst)) {
+                auto folded = candidate.value();
+                folded.deref = deref;
+                cheapest(folded, best);
+            }
+        }
+    }
+    return best;
+}
+}  // namespace
+
+void CountTempUses(const qa_ir::Frame& frame, Ctx& ctx) {
+    int count = 0;
+    auto grow = [&count](const qa_ir::Value& value) {
+        if (const auto* t = std::get_if<qa_ir::Temp>(&value)) {
+            count = std::max(count, t->id + 1);
+        }
+    };
+    for (const auto& op : frame.instructions) {
+        qa_ir::for_each_used_value(op, grow);
+        if (const auto* dst = qa_ir::defined_value(op)) {
+            grow(*dst);
+        }
+    }
+    ctx.temp_reads.assign(count, 0);
+    ctx.temp_writes.assign(count, 0);
+    for (const auto& op : frame.instructions) {
+        qa_ir::for_each_used_value(op, [&ctx](const qa_ir::Value& value) {
+            if (const auto* t = std::get_if<qa_ir::Temp>(&value)) {
+                ctx.temp_reads[t->id]++;
+            }
+        });
+        if (const auto* dst = qa_ir::defined_value(op)) {
+            if (const auto* t = std::get_if<qa_ir::Temp>(dst)) {
+                ctx.temp_writes[t->id]++;
+            }
+        }
+    }
+}
+
+std::size_t SelectTiles(const std::vector<qa_ir::Operation>& ops,
+                        std::size_t i, Ctx& ctx, Emitter& out) {
+    const auto alone = single_cover(ops[i]);
+    if (i + 1 < ops.size()) {
+        const auto pair = pair_cover(ops[i], ops[i + 1], ctx);
+        if (pair.tile != nullptr &&
+            pair.cost < alone.cost + single_cover(ops[i + 1]).cost) {
+            pair.tile->emit(pair.tree, ctx, out);
+            return 2;
+        }
+    }
+    if (alone.tile == nullptr) {
+        return 0;
+    }
+    alone.tile->emit(alone.tree, ctx, out);
+    return 1;
+}
+}  // namespace target
\ No newline at end of file
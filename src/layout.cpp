@@ -0,0 +1,226 @@
+#include "../include/layout.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+#include "../include/dce.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// branch probabilities in sixteenths
+constexpr std::int64_t certain = 16;
+constexpr std::int64_t likely = 14;
+constexpr std::int64_t unlikely = certain - likely;
+// how much more often a block runs per loop around it, up to the deepest
+// nesting that still counts
+constexpr std::int64_t trips = 8;
+constexpr int deepest = 5;
+
+struct Edge {
+    int from;
+    int to;
+    std::int64_t weight;
+};
+
+// blocks ending in a Ret, a branch is unlikely to take unless both ways do
+[[nodiscard]] std::vector<bool> returns(const Frame& frame,
+                                        const ControlFlowGraph& cfg) {
+    std::vector<bool> cold(cfg.blocks.size(), false);
+    for (std::size_t b = 0; b < cfg.blocks.size(); b++) {
+        const auto& terminator = frame.instructions[cfg.blocks[b].end - 1];
+        cold[b] = std::holds_alternative<Ret>(terminator);
+    }
+    return cold;
+}
+
+// whether b -> s goes back to the header of a loop around b
+[[nodiscard]] bool is_back_edge(const LoopForest& forest, int b, int s) {
+    for (auto l = forest.loopOf[b]; l >= 0; l = forest.parent[l]) {
+        if (forest.loops[l].header == s) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether b -> s leaves the innermost loop around b
+[[nodiscard]] bool is_exit(const LoopForest& forest, int b, int s) {
+    const auto l = forest.loopOf[b];
+    return l >= 0 && !forest.loops[l].contains(s);
+}
+
+// how likely b branches to s rather than to other
+[[nodiscard]] std::int64_t likelihood(const LoopForest& forest,
+                                      const std::vector<bool>& cold, int b,
+                                      int s, int other) {
+    auto prefer = [](bool taken) { return taken ? likely : unlikely; };
+    const auto back = is_back_edge(forest, b, s);
+    if (back != is_back_edge(forest, b, other)) {
+        return prefer(back);
+    }
+    const auto exit = is_exit(forest, b, s);
+    if (exit != is_exit(forest, b, other)) {
+        return prefer(!exit);
+    }
+    if (cold[s] != cold[other]) {
+        return prefer(!cold[s]);
+    }
+    return certain / 2;
+}
+
+[[nodiscard]] std::vector<std::vector<Edge>> weigh_edges(
+    const ControlFlowGraph& cfg, const LoopForest& forest,
+    const std::vector<bool>& cold) {
+    std::vector<std::vector<Edge>> edges(cfg.blocks.size());
+    for (std::size_t i = 0; i < cfg.blocks.size(); i++) {
+        const auto b = static_cast<int>(i);
+        const auto& successors = cfg.blocks[i].successors;
+        const auto frequency = [&] {
+            std::int64_t frequency = 1;
+            for (int d = 0; d < std::min(forest.depth[i], deepest); d++) {
+                frequency *= trips;
+            }
+            return frequency;
+        }();
+        for (const auto s : successors) {
+            auto probability = certain / static_cast<int>(successors.size());
+            if (successors.size() == 2) {
+                const auto other =
+                    s == successors[0] ? successors[1] : successors[0];
+                probability = likelihood(forest, cold, b, s, other);
+            }
+            edges[i].push_back(
+                Edge{.from = b, .to = s, .weight = frequency * probability});
+        }
+    }
+    return edges;
+}
+}  // namespace
+
+int PlaceBlocks(Frame& frame, FrameAnalyses& analyses,
+                const LayoutOptions& options) {
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    const auto& cfg = analyses.CFG();
+    const auto& forest = analyses.Loops();
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    const auto cold = returns(frame, cfg);
+    const auto out = weigh_edges(cfg, forest, cold);
+
+    // every block starts a chain of its own, an edge joins the chain ending
+    // in its source to the chain starting at its target, heaviest first
+    std::vector<std::vector<int>> chains(blocks);
+    std::vector<int> chainOf(blocks);
+    std::vector<Edge> edges;
+    for (int b = 0; b < blocks; b++) {
+        chains[b] = {b};
+        chainOf[b] = b;
+        edges.insert(edges.end(), out[b].begin(), out[b].end());
+    }
+    std::ranges::stable_sort(edges, std::greater{}, &Edge::weight);
+    for (const auto& edge : edges) {
+        const auto tail = chainOf[edge.from];
+        const auto head = chainOf[edge.to];
+        if (edge.to == 0 || tail == head || chains[tail].back() != edge.from ||
+            chains[head].front() != edge.to) {
+            continue;
+        }
+        for (const auto b : chains[head]) {
+            chainOf[b] = tail;
+        }
+        chains[tail].insert(chains[tail].end(), chains[head].begin(),
+                            chains[head].end());
+        chains[head].clear();
+    }
+
+    // after the entry's chain comes the one the placed blocks branch into
+    // the most, ties keep instruction order, chains of returns only last
+    std::vector<int> order;
+    std::vector<bool> placed(blocks, false);
+    std::vector<std::int64_t> attraction(blocks, 0);
+    auto place = [&](int c) {
+        placed[c] = true;
+        for (const auto b : chains[c]) {
+            order.push_back(b);
+            for (const auto& edge : out[b]) {
+                attraction[chainOf[edge.to]] += edge.weight;
+            }
+        }
+    };
+    auto isCold = [&](int c) {
+        return std::ranges::all_of(chains[c], [&](int b) { return cold[b]; });
+    };
+    place(chainOf[0]);
+    while (true) {
+        auto best = -1;
+        for (int c = 0; c < blocks; c++) {
+            if (chains[c].empty() || placed[c] || isCold(c)) {
+                continue;
+            }
+            if (best < 0 || attraction[c] > attraction[best]) {
+                best = c;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        place(best);
+    }
+    for (int c = 0; c < blocks; c++) {
+        if (!chains[c].empty() && !placed[c]) {
+            place(c);
+        }
+    }
+
+    // the loop is entered at its top on every trip but the first
+    std::vector<int> position(blocks);
+    for (int i = 0; i < blocks; i++) {
+        position[order[i]] = i;
+    }
+    std::vector<bool> aligned(blocks, false);
+    for (std::size_t l = 0; l < forest.loops.size(); l++) {
+        if (options.alignLoops && forest.children[l].empty()) {
+            const auto top =
+                std::ranges::min(forest.loops[l].blocks, {},
+                                 [&](int b) { return position[b]; });
+            aligned[top] = position[top] > 0;
+        }
+    }
+
+    const auto& ops = frame.instructions;
+    std::vector<Operation> laidOut;
+    laidOut.reserve(ops.size() + static_cast<std::size_t>(blocks));
+    // a block moved when another block than before comes right ahead of it
+    auto moved = 0;
+    for (int i = 0; i < blocks; i++) {
+        const auto b = order[i];
+        const auto& block = cfg.blocks[b];
+        moved += i > 0 && order[i - 1] != b - 1 ? 1 : 0;
+        const auto start = laidOut.size();
+        laidOut.insert(laidOut.end(), ops.begin() + block.begin,
+                       ops.begin() + block.end);
+        std::get<LabelDef>(laidOut[start]).align = aligned[b];
+        // a block that fell into the next one jumps there unless it follows
+        const auto fallsThrough =
+            !is_terminator(ops[block.end - 1]) && b + 1 < blocks;
+        if (fallsThrough && (i + 1 == blocks || order[i + 1] != b + 1)) {
+            laidOut.emplace_back(Jump{.label = Label{cfg.blocks[b + 1].label}});
+        }
+    }
+    frame.instructions = std::move(laidOut);
+    analyses.Invalidate(PreservedAnalyses::None());
+    // drops the jumps to the next block and labels only fallen into
+    SimplifyControlFlow(frame);
+    return moved;
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,357 @@
+#include "../include/licm.hpp"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+#include "../include/ssa.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// what the operations of a loop may do to memory
+struct MemoryEffects {
+    bool calls = false;
+    bool storesThroughPointers = false;
+    bool loadsThroughPointers = false;
+    std::set<std::string> storedVariables = {};
+    // variables whose address the loop takes, which must stay in memory
+    std::set<std::string> addressTaken = {};
+};
+
+// held by analyses, until the frame changes
+struct LoopView {
+    const ControlFlowGraph& cfg;
+    const DominatorTree& tree;
+    const Loop& loop;
+};
+
+[[nodiscard]] LoopView view_of(FrameAnalyses& analyses,
+                               const std::string& header) {
+    const auto& cfg = analyses.CFG();
+    const auto& loops = analyses.Loops().loops;
+    const auto loop = std::ranges::find_if(loops, [&](const Loop& loop) {
+        return cfg.blocks[loop.header].label == header;
+    });
+    return LoopView{
+        .cfg = cfg, .tree = analyses.Dominators(), .loop = *loop};
+}
+
+[[nodiscard]] MemoryEffects memory_effects(const Frame& frame,
+                                           const LoopView& view) {
+    MemoryEffects effects;
+    for (const auto b : view.loop.blocks) {
+        const auto& block = view.cfg.blocks[b];
+        for (int i = block.begin; i < block.end; i++) {
+            const auto& op = frame.instructions[i];
+            effects.calls |= std::holds_alternative<Call>(op);
+            effects.storesThroughPointers |=
+                std::holds_alternative<DerefStore>(op);
+            effects.loadsThroughPointers |= std::holds_alternative<Deref>(op);
+            if (const auto* addr = std::get_if<Addr>(&op)) {
+                effects.addressTaken.insert(
+                    std::get<Variable>(addr->src).name);
+            }
+            const auto* dst = defined_value(op);
+            if (const auto* variable =
+                    dst == nullptr ? nullptr : std::get_if<Variable>(dst)) {
+                effects.storedVariables.insert(variable->name);
+            }
+        }
+    }
+    return effects;
+}
+
+// Keeps the variables a loop stores to in temps while it runs. Only done
+// when nothing in the loop can reach memory through a pointer. Each one is
+// loaded in the preheader into a variable of its own that the loop uses
+// instead, and that is stored back on every edge leaving the loop.
+// PromoteVariables then renames it, so a phi in the header merges the load
+// and the values of the latches and the stores take what reaches the exits.
+int promote_variables(Frame& frame, FreshNames& names, const LoopView& view,
+                      const std::string& preheader,
+                      const MemoryEffects& effects) {
+    if (effects.calls || effects.storesThroughPointers ||
+        effects.loadsThroughPointers || effects.storedVariables.empty()) {
+        return 0;
+    }
+    auto& ops = frame.instructions;
+    const auto& cfg = view.cfg;
+    const auto& header = cfg.blocks[view.loop.header].label;
+    // a variable read or written at more than one size stays in memory, as
+    // does one whose address is taken
+    std::map<std::string, int> sizes;
+    std::set<std::string> pinned = effects.addressTaken;
+    auto see = [&](const Value& value) {
+        if (const auto* variable = std::get_if<Variable>(&value)) {
+            const auto [it, fresh] =
+                sizes.try_emplace(variable->name, variable->size);
+            if (!fresh && it->second != variable->size) {
+                pinned.insert(variable->name);
+            }
+        }
+    };
+    for (const auto b : view.loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            for_each_used_value(ops[i], see);
+            if (const auto* dst = defined_value(ops[i])) {
+                see(*dst);
+            }
+        }
+    }
+    // the variable in memory and the one the loop uses instead
+    std::map<std::string, std::pair<Variable, Variable>> promoted;
+    auto promote = [&](Value& value) {
+        const auto* variable = std::get_if<Variable>(&value);
+        if (variable == nullptr ||
+            !effects.storedVariables.contains(variable->name) ||
+            pinned.contains(variable->name)) {
+            return false;
+        }
+        auto it = promoted.find(variable->name);
+        if (it == promoted.end()) {
+            auto local = *variable;
+            local.name += "." + header;
+            it = promoted.emplace(variable->name, std::pair{*variable, local})
+                     .first;
+        }
+        value = it->second.second;
+        return true;
+    };
+    int sunk = 0;
+    for (const auto b : view.loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            for_each_used_value(ops[i], promote);
+            if (auto* dst = defined_value(ops[i]); dst != nullptr) {
+                sunk += promote(*dst) ? 1 : 0;
+            }
+        }
+    }
+    if (promoted.empty()) {
+        return 0;
+    }
+
+    // Reading a variable no path into the loop assigns is fine, lowering
+    // gives every variable its slot up front.
+    std::vector<Operation> loads;
+    std::vector<Operation> stores;
+    std::map<std::string, int> locals;
+    for (const auto& [variable, local] : promoted | std::views::values) {
+        loads.emplace_back(Mov{.dst = local, .src = variable});
+        stores.emplace_back(Mov{.dst = variable, .src = local});
+        locals.emplace(local.name, local.size);
+    }
+    // every edge leaving the loop gets a block storing the values back
+    std::map<int, std::vector<std::pair<int, Label>>> exits;
+    for (const auto b : view.loop.blocks) {
+        for (const auto s : cfg.blocks[b].successors) {
+            if (view.loop.contains(s)) {
+                continue;
+            }
+            const auto label = names.NewLabel();
+            exits[b].emplace_back(s, label);
+            const auto& successor = cfg.blocks[s];
+            for (int i = successor.begin + 1; i < successor.end; i++) {
+                auto* phi = std::get_if<Phi>(&ops[i]);
+                if (phi == nullptr) {
+                    break;
+                }
+                for (auto& incoming : phi->args) {
+                    if (incoming.predecessor.name == cfg.blocks[b].label) {
+                        incoming.predecessor = label;
+                    }
+                }
+            }
+        }
+    }
+
+    const auto& entry = cfg.blocks[cfg.blockOf.at(preheader)];
+    const auto loadAt = InsertionPoint(frame, entry);
+    std::vector<Operation> out;
+    out.reserve(ops.size() + loads.size());
+    for (int b = 0; b < static_cast<int>(cfg.blocks.size()); b++) {
+        const auto& block = cfg.blocks[b];
+        for (int i = block.begin; i < block.end; i++) {
+            if (i == loadAt) {
+                out.insert(out.end(), loads.begin(), loads.end());
+            }
+            out.push_back(std::move(ops[i]));
+        }
+        if (block.end == loadAt) {
+            out.insert(out.end(), loads.begin(), loads.end());
+        }
+        const auto it = exits.find(b);
+        if (it == exits.end()) {
+            continue;
+        }
+        // placed right after the exiting block, so a fallthrough still works
+        const auto jump = out.size() - 1;
+        for (const auto& [s, label] : it->second) {
+            retarget(out[jump], cfg.blocks[s].label, label);
+            out.emplace_back(LabelDef{.label = label});
+            out.insert(out.end(), stores.begin(), stores.end());
+            out.emplace_back(Jump{.label = Label{cfg.blocks[s].label}});
+        }
+    }
+    ops = std::move(out);
+
+    std::set<std::string> region;
+    for (const auto b : view.loop.blocks) {
+        region.insert(cfg.blocks[b].label);
+    }
+    PromoteVariables(frame, names, locals, region);
+    return sunk;
+}
+
+int hoist_invariants(Frame& frame, const LoopView& view,
+                     const std::string& preheader,
+                     const MemoryEffects& effects) {
+    auto& ops = frame.instructions;
+    const auto& cfg = view.cfg;
+    const auto& loop = view.loop;
+    std::map<int, int> definitions;
+    for (const auto& op : ops) {
+        if (const auto* dst = defined_value(op)) {
+            if (const auto* temp = std::get_if<Temp>(dst)) {
+                definitions[temp->id]++;
+            }
+        }
+    }
+    std::set<int> variant;
+    std::vector<int> exiting;
+    for (const auto b : loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            if (const auto* dst = defined_value(ops[i])) {
+                if (const auto* temp = std::get_if<Temp>(dst)) {
+                    variant.insert(temp->id);
+                }
+            }
+        }
+        if (std::ranges::any_of(cfg.blocks[b].successors, [&](int s) {
+                return !loop.contains(s);
+            })) {
+            exiting.push_back(b);
+        }
+    }
+    const auto storesToMemory = effects.calls ||
+                                effects.storesThroughPointers ||
+                                !effects.storedVariables.empty();
+    auto invariant = [&](const Value& value) {
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            return !variant.contains(temp->id);
+        }
+        if (const auto* variable = std::get_if<Variable>(&value)) {
+            return !effects.calls && !effects.storesThroughPointers &&
+                   !effects.storedVariables.contains(variable->name);
+        }
+        return std::holds_alternative<int>(value);
+    };
+    // a load through a pointer may only run where the loop would run it
+    auto runsEveryTrip = [&](int b) {
+        return std::ranges::all_of(
+            exiting, [&](int e) { return Dominates(view.tree, b, e); });
+    };
+    auto hoistable = [&](const Operation& op, int b) {
+        return std::visit(
+            [&](const auto& arg) {
+                using T = std::decay_t<decltype(arg)>;
+                if constexpr (std::is_same_v<T, Add> ||
+                              std::is_same_v<T, Sub> ||
+                              std::is_same_v<T, Equal> ||
+                              std::is_same_v<T, NotEqual> ||
+                              std::is_same_v<T, GreaterThan>) {
+                    return invariant(arg.left) && invariant(arg.right);
+                } else if constexpr (std::is_same_v<T, Addr>) {
+                    return true;
+                } else if constexpr (std::is_same_v<T, Mov>) {
+                    return invariant(arg.src);
+                } else if constexpr (std::is_same_v<T, Deref>) {
+                    return !storesToMemory && invariant(arg.src) &&
+                           runsEveryTrip(b);
+                }
+                return false;
+            },
+            op);
+    };
+
+    std::vector<int> hoisted;
+    std::vector<bool> moved(ops.size(), false);
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto b : view.tree.reversePostorder) {
+            if (!loop.contains(b)) {
+                continue;
+            }
+            for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                const auto* dst = defined_value(ops[i]);
+                const auto* temp =
+                    dst == nullptr ? nullptr : std::get_if<Temp>(dst);
+                if (moved[i] || temp == nullptr ||
+                    definitions[temp->id] != 1 || !hoistable(ops[i], b)) {
+                    continue;
+                }
+                moved[i] = true;
+                hoisted.push_back(i);
+                variant.erase(temp->id);
+                changed = true;
+            }
+        }
+    }
+    if (hoisted.empty()) {
+        return 0;
+    }
+
+    const auto at =
+        InsertionPoint(frame, cfg.blocks[cfg.blockOf.at(preheader)]);
+    std::vector<Operation> out;
+    out.reserve(ops.size());
+    for (int i = 0; i < static_cast<int>(ops.size()); i++) {
+        if (i == at) {
+            for (const auto h : hoisted) {
+                out.push_back(std::move(ops[h]));
+            }
+        }
+        if (!moved[i]) {
+            out.push_back(std::move(ops[i]));
+        }
+    }
+    ops = std::move(out);
+    return static_cast<int>(hoisted.size());
+}
+}  // namespace
+
+int HoistLoopInvariants(Frame& frame, FrameAnalyses& analyses) {
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    int moved = 0;
+    const auto visit = [&](int loop, const std::string& preheader) {
+        const auto b = analyses.Loops().loops[loop].header;
+        const auto header = analyses.CFG().blocks[b].label;
+        const auto before = moved;
+        auto effects = memory_effects(frame, view_of(analyses, header));
+        if (const auto sunk = promote_variables(
+                frame, names, view_of(analyses, header), preheader, effects)) {
+            moved += sunk;
+            analyses.Invalidate(PreservedAnalyses::None());
+            effects = memory_effects(frame, view_of(analyses, header));
+        }
+        moved += hoist_invariants(frame, view_of(analyses, header), preheader,
+                                  effects);
+        return moved != before;
+    };
+    ForEachLoop(frame, names, analyses, visit);
+    return moved;
+}
+}  // namespace qa_ir
\ No newline at end of file
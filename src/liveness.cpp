@@ -0,0 +1,207 @@
+#include "../include/liveness.hpp"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace target {
+
+int register_file_index(BaseRegister reg) {
+    const auto it = std::ranges::find(register_file, reg);
+    return static_cast<int>(std::distance(register_file.begin(), it));
+}
+
+int node_of(const Register& reg) {
+    if (const auto* hardcoded = std::get_if<HardcodedRegister>(&reg)) {
+        return register_file_index(hardcoded->reg);
+    }
+    return register_file_size + std::get<VirtualRegister>(reg).id;
+}
+
+[[nodiscard]] std::optional<Register> src_of(const Instruction& ins) {
+    return std::visit(
+        [](auto&& arg) -> std::optional<Register> {
+            if constexpr (HasRegisterSrc<decltype(arg)>) {
+                return arg.src;
+            }
+            return std::nullopt;
+        },
+        ins);
+}
+
+[[nodiscard]] std::optional<Register> dest_of(const Instruction& ins) {
+    return std::visit(
+        [](auto&& arg) -> std::optional<Register> {
+            if constexpr (HasRegisterDest<decltype(arg)>) {
+                return arg.dst;
+            }
+            return std::nullopt;
+        },
+        ins);
+}
+
+auto buildControlFlowGraph(const Frame& frame) -> ControlFlowGraph {
+    const auto n = static_cast<int>(frame.instructions.size());
+    ControlFlowGraph cfg{.blockStart = {},
+                         .blockOf = std::vector<int>(n, 0),
+                         .successors = {},
+                         .callArguments = std::vector<std::uint32_t>(n, 0),
+                         .loopDepth = std::vector<int>(n + 1, 0)};
+    std::map<std::string, int> labelBlock;
+    std::map<std::string, int> labelPosition;
+    for (auto [idx, ins] : frame.instructions | std::views::enumerate) {
+        const auto position = static_cast<int>(idx);
+        const auto* label = std::get_if<Label>(&ins);
+        if (position == 0 || label != nullptr ||
+            is_jump(frame.instructions[position - 1])) {
+            if (cfg.blockStart.empty() || cfg.blockStart.back() != position) {
+                cfg.blockStart.push_back(position);
+            }
+        }
+        cfg.blockOf[idx] = static_cast<int>(cfg.blockStart.size()) - 1;
+        if (label != nullptr) {
+            labelBlock[label->name] = cfg.blockOf[idx];
+            labelPosition[label->name] = position;
+        }
+    }
+    const auto blocks = static_cast<int>(cfg.blockStart.size());
+    cfg.blockStart.push_back(n);
+    cfg.successors.resize(blocks);
+    for (int b = 0; b < blocks; b++) {
+        const auto& last = frame.instructions[cfg.blockStart[b + 1] - 1];
+        const auto target = jump_label(last);
+        if (target.has_value()) {
+            // jumps to end leave the frame
+            if (auto it = labelBlock.find(target.value());
+                it != labelBlock.end()) {
+                cfg.successors[b].push_back(it->second);
+            }
+        }
+        if (!std::holds_alternative<Jump>(last) &&
+            !std::holds_alternative<TailCall>(last) && b + 1 < blocks) {
+            cfg.successors[b].push_back(b + 1);
+        }
+    }
+
+    std::uint32_t pending = 0;
+    for (auto [idx, ins] : frame.instructions | std::views::enumerate) {
+        if (std::holds_alternative<Label>(ins)) {
+            pending = 0;
+        }
+        if (std::holds_alternative<Call>(ins) ||
+            std::holds_alternative<TailCall>(ins)) {
+            cfg.callArguments[idx] = pending;
+            pending = 0;
+            continue;
+        }
+        const auto dest = dest_of(ins);
+        if (dest.has_value() && writes_dest(ins) &&
+            std::holds_alternative<HardcodedRegister>(dest.value())) {
+            const auto reg = std::get<HardcodedRegister>(dest.value()).reg;
+            if (std::ranges::find(param_regs, reg) != param_regs.end()) {
+                pending |= 1U << node_of(dest.value());
+            }
+        }
+        const auto target = jump_label(ins);
+        if (!target.has_value()) {
+            continue;
+        }
+        if (auto it = labelPosition.find(target.value());
+            it != labelPosition.end() && it->second < idx) {
+            cfg.loopDepth[it->second]++;
+            cfg.loopDepth[idx + 1]--;
+        }
+    }
+    for (int i = 1; i <= n; i++) {
+        cfg.loopDepth[i] += cfg.loopDepth[i - 1];
+    }
+    return cfg;
+}
+
+void collectOperands(const Instruction& ins, std::uint32_t callArguments,
+                     Operands& operands) {
+    operands.uses.clear();
+    operands.defs.clear();
+    operands.clobbers = 0;
+    if (const auto src = src_of(ins); src.has_value()) {
+        operands.uses.push_back(node_of(src.value()));
+    }
+    if (const auto dest = dest_of(ins); dest.has_value()) {
+        if (reads_dest(ins)) {
+            operands.uses.push_back(node_of(dest.value()));
+        }
+        if (writes_dest(ins)) {
+            operands.defs.push_back(node_of(dest.value()));
+        }
+    }
+    if (std::holds_alternative<Call>(ins) ||
+        std::holds_alternative<TailCall>(ins)) {
+        // callees restore callee_saved_regs before they return
+        operands.clobbers = caller_saved;
+        for (int p = 0; p < register_file_size; p++) {
+            if ((callArguments >> p) & 1U) {
+                operands.uses.push_back(p);
+            }
+        }
+    }
+    // setcc goes through al
+    if (std::holds_alternative<SetEAl>(ins) ||
+        std::holds_alternative<SetGAl>(ins) ||
+        std::holds_alternative<SetNeAl>(ins)) {
+        operands.clobbers = 1U << register_file_index(BaseRegister::AX);
+    }
+    // the return value stays in ax until the epilogue
+    if (const auto* jump = std::get_if<Jump>(&ins);
+        jump != nullptr && jump->label == "end") {
+        operands.uses.push_back(register_file_index(BaseRegister::AX));
+    }
+}
+
+auto computeLiveness(const Frame& frame, const ControlFlowGraph& cfg,
+                     int nodes) -> Liveness {
+    const auto blocks = cfg.blocks();
+    Liveness liveness{.liveIn = std::vector<BitSet>(blocks, BitSet(nodes)),
+                      .liveOut = std::vector<BitSet>(blocks, BitSet(nodes))};
+    // upward exposed uses and definitions of every block
+    std::vector<BitSet> gen(blocks, BitSet(nodes));
+    std::vector<BitSet> kill(blocks, BitSet(nodes));
+    Operands operands;
+    for (int b = 0; b < blocks; b++) {
+        for (int i = cfg.blockStart[b]; i < cfg.blockStart[b + 1]; i++) {
+            collectOperands(frame.instructions[i], cfg.callArguments[i],
+                            operands);
+            for (const auto u : operands.uses) {
+                if (!kill[b].test(u)) {
+                    gen[b].set(u);
+                }
+            }
+            for (const auto d : operands.defs) {
+                kill[b].set(d);
+            }
+            for (int p = 0; p < register_file_size; p++) {
+                if ((operands.clobbers >> p) & 1U) {
+                    kill[b].set(p);
+                }
+            }
+        }
+    }
+    // sets only grow, so sweeping the blocks backwards until nothing changes
+    // reaches the fixed point, in one or two sweeps for code without loops
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = blocks - 1; b >= 0; b--) {
+            for (const auto s : cfg.successors[b]) {
+                liveness.liveOut[b].unite(liveness.liveIn[s]);
+            }
+            changed |= liveness.liveIn[b].uniteTransfer(
+                gen[b], liveness.liveOut[b], kill[b]);
+        }
+    }
+    return liveness;
+}
+}  // namespace target
\ No newline at end of file
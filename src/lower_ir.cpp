@@ -1,113 +1,101 @@
 #include "../include/lower_ir.hpp"
 
+#include <algorithm>
 #include <concepts>
-#include <functional>
-#include <map>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include "../include/ast.hpp"
+#include "../include/isel.hpp"
+#include "../include/tailcall.hpp"
 
 namespace target {
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-parameter"
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(Register r_dst,
-                                                          int v_src, Ctx* ctx) {
-    return {LoadI{.dst = r_dst, .value = v_src}};
+void _Value_To_Location(Register r_dst, int v_src, Ctx* ctx, Emitter& out) {
+    out.emit(LoadI{.dst = r_dst, .value = v_src});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(StackLocation l_dest,
-                                                          int v_src, Ctx* ctx) {
-    return {StoreI{.dst = l_dest, .value = v_src}};
+void _Value_To_Location(StackLocation l_dest, int v_src, Ctx* ctx,
+                        Emitter& out) {
+    out.emit(StoreI{.dst = l_dest, .value = v_src});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(StackLocation l_dest,
-                                                          qa_ir::Temp t_src,
-                                                          Ctx* ctx) {
+void _Value_To_Location(StackLocation l_dest, const qa_ir::Temp& t_src,
+                        Ctx* ctx, Emitter& out) {
     const auto reg = ctx->AllocateNewForTemp(t_src);
-    return {Store{.dst = l_dest, .src = reg}};
+    out.emit(Store{.dst = l_dest, .src = reg});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(Register r,
-                                                          qa_ir::Temp t,
-                                                          Ctx* ctx) {
+void _Value_To_Location(Register r, const qa_ir::Temp& t, Ctx* ctx,
+                        Emitter& out) {
     const auto reg = ctx->AllocateNewForTemp(t);
-    return {Mov{.dst = r, .src = reg}};
+    out.emit(Mov{.dst = r, .src = reg});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(
-    Register r, target::HardcodedRegister t, Ctx* ctx) {
-    throw std::runtime_error(
-        "Cannot convert hardcoded register to register");  // just for now
+void _Value_To_Location(Register r, const target::HardcodedRegister& t,
+                        Ctx* ctx, Emitter& out) {
+    out.emit(Mov{.dst = r, .src = t});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(Register r_dst,
-                                                          qa_ir::Variable v_src,
-                                                          Ctx* ctx) {
+void _Value_To_Location(Register r_dst, const qa_ir::Variable& v_src,
+                        Ctx* ctx, Emitter& out) {
     const auto variableOffset = ctx->variable_offset.at(v_src.name);
-    return {Load{.dst = r_dst, .src = variableOffset}};
+    out.emit(Load{.dst = r_dst, .src = variableOffset});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(
-    StackLocation s_dst, target::HardcodedRegister r_src, Ctx* ctx) {
-    return {Store{.dst = s_dst, .src = r_src}};
+void _Value_To_Location(StackLocation s_dst,
+                        const target::HardcodedRegister& r_src, Ctx* ctx,
+                        Emitter& out) {
+    out.emit(Store{.dst = s_dst, .src = r_src});
 }
 
-[[nodiscard]] std::vector<Instruction> _Value_To_Location(StackLocation s_dst,
-                                                          qa_ir::Variable v_src,
-                                                          Ctx* ctx) {
+void _Value_To_Location(StackLocation s_dst, const qa_ir::Variable& v_src,
+                        Ctx* ctx, Emitter& out) {
     const auto reg = ctx->NewRegister(v_src.size);
-    auto result = std::vector<Instruction>{};
     // move variable to register
     const auto variableOffset = ctx->variable_offset.at(v_src.name);
-    result.push_back(Load{.dst = reg, .src = variableOffset});
+    out.emit(Load{.dst = reg, .src = variableOffset});
     // store register to stack
-    result.push_back(Store{.dst = s_dst, .src = reg});
-    return result;
-}
-
-[[nodiscard]] auto Register_To_Location(Location l, target::Register reg,
-                                        Ctx* ctx) -> Instruction {
-    if (auto stackLocation = std::get_if<StackLocation>(&l)) {
-        return Store{.dst = *stackLocation, .src = reg};
-    }
-    if (auto dest_register = std::get_if<Register>(&l)) {
-        return Mov{.dst = *dest_register, .src = reg};
-    }
-    throw std::runtime_error("Cannot convert register to location");
+    out.emit(Store{.dst = s_dst, .src = reg});
 }
 
-[[nodiscard]] auto Register_To_Location(Location l, target::Register reg,
-                                        Ctx& ctx) -> Instruction {
+void Register_To_Location(const Location& l, target::Register reg,
+                          Emitter& out) {
     if (auto stackLocation = std::get_if<StackLocation>(&l)) {
-        return Store{.dst = *stackLocation, .src = reg};
+        out.emit(Store{.dst = *stackLocation, .src = reg});
+        return;
     }
     if (auto dest_register = std::get_if<Register>(&l)) {
-        return Mov{.dst = *dest_register, .src = reg};
+        out.emit(Mov{.dst = *dest_register, .src = reg});
+        return;
     }
     throw std::runtime_error("Cannot convert register to location");
 }
 
 #pragma clang diagnostic pop
 
-Location Ctx::AllocateNew(qa_ir::Value v) {
+Location Ctx::AllocateNew(const qa_ir::Value& v) {
     if (auto tmp = std::get_if<qa_ir::Temp>(&v)) {
         return AllocateNewForTemp(*tmp);
     }
     if (auto variable = std::get_if<qa_ir::Variable>(&v)) {
-        const auto variableName = variable->name;
+        const auto& variableName = variable->name;
         if (auto it = variable_offset.find(variableName);
-            it == variable_offset.end()) {
-            stackOffset += variable->size;
-            variable_offset[variableName] =
-                StackLocation{.offset = stackOffset};
+            it != variable_offset.end()) {
+            return it->second;
         }
-        return variable_offset.at(variableName);
+        stackOffset += variable->size;
+        const auto location = StackLocation{.offset = stackOffset};
+        variable_offset.emplace(variableName, location);
+        return location;
     }
     if (auto hardcoded = std::get_if<target::HardcodedRegister>(&v)) {
         return *hardcoded;
@@ -137,310 +125,295 @@ void Ctx::define_stack_pushed_variable(const std::string& name) {
     stackPassedParameterOffset += 8;
 }
 
-std::vector<Instruction> Ctx::toLocation(Location l, qa_ir::Value v) {
-    return std::visit(
-        [this](auto&& arg1, auto&& arg2) {
-            return _Value_To_Location(arg1, arg2, this);
+void Ctx::toLocation(Location l, const qa_ir::Value& v, Emitter& out) {
+    std::visit(
+        [this, &out](auto&& arg1, auto&& arg2) {
+            _Value_To_Location(arg1, arg2, this, out);
         },
         l, v);
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(qa_ir::Mov move,
-                                                        Ctx& ctx) {
-    auto dest = move.dst;
-    auto src = move.src;
-    auto destLocation = ctx.AllocateNew(dest);
-    return ctx.toLocation(destLocation, src);
+void LowerInstruction(const qa_ir::Mov& move, Ctx& ctx, Emitter& out) {
+    auto destLocation = ctx.AllocateNew(move.dst);
+    ctx.toLocation(destLocation, move.src, out);
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(qa_ir::Ret ret,
-                                                        Ctx& ctx) {
-    const auto returnValue = ret.value;
+void LowerInstruction(const qa_ir::Ret& ret, Ctx& ctx, Emitter& out) {
+    const auto& returnValue = ret.value;
     const auto returnValueSize = qa_ir::SizeOf(returnValue);
     const auto returnRegister = HardcodedRegister{
         .reg = target::BaseRegister::AX, .size = returnValueSize};
-    auto result = ctx.toLocation(returnRegister, returnValue);
-    auto jumpInstruction = Jump{.label = "end"};
-    result.push_back(jumpInstruction);
-    return result;
-}
-
-std::vector<Instruction> Create_ArthBin_Instruction_Sequence(
-    ast::BinOpKind kind, std::optional<target::Location> dst, Register reg,
-    int value, Ctx& ctx) {
-    static const std::map<ast::BinOpKind,
-                          std::function<Instruction(Register, int)>>
-        ops = {
-            {ast::BinOpKind::Add,
-             [](Register reg, int value) -> Instruction {
-                 return AddI{.dst = reg, .value = value};
-             }},
-            {ast::BinOpKind::Sub, [](Register reg, int value) -> Instruction {
-                 return SubI{.dst = reg, .value = value};
-             }}};
-    auto op_it = ops.find(kind);
-    if (op_it == ops.end()) {
-        throw std::runtime_error("Unsupported operation kind");
-    }
-    std::vector<Instruction> result = {op_it->second(reg, value)};
+    ctx.toLocation(returnRegister, returnValue, out);
+    out.emit(Jump{.label = "end"});
+}
+
+template <ast::BinOpKind Kind>
+constexpr bool is_arithmetic_v =
+    Kind == ast::BinOpKind::Add || Kind == ast::BinOpKind::Sub;
+
+template <ast::BinOpKind Kind>
+constexpr bool is_comparison_v = Kind == ast::BinOpKind::Eq ||
+                                 Kind == ast::BinOpKind::Gt ||
+                                 Kind == ast::BinOpKind::Neq;
+
+template <ast::BinOpKind Kind>
+void Create_ArthBin_Instruction_Sequence(std::optional<target::Location> dst,
+                                         Register reg, int value,
+                                         Emitter& out) {
+    static_assert(is_arithmetic_v<Kind>, "Unsupported operation kind");
+    if constexpr (Kind == ast::BinOpKind::Add) {
+        out.emit(AddI{.dst = reg, .value = value});
+    } else {
+        out.emit(SubI{.dst = reg, .value = value});
+    }
     if (dst.has_value()) {
-        result.push_back(Register_To_Location(dst.value(), reg, ctx));
+        Register_To_Location(dst.value(), reg, out);
     }
-    return result;
 }
 
-std::vector<Instruction> Create_ArthBin_Instruction_Sequence(
-    ast::BinOpKind kind, std::optional<target::Location> dst,
-    Register result_reg, Register src_reg, Ctx& ctx) {
-    static const std::map<ast::BinOpKind,
-                          std::function<Instruction(Register, Register)>>
-        ops = {{ast::BinOpKind::Add,
-                [](Register dst, Register src) -> Instruction {
-                    return Add{.dst = dst, .src = src};
-                }},
-               {ast::BinOpKind::Sub,
-                [](Register dst, Register src) -> Instruction {
-                    return Sub{.dst = dst, .src = src};
-                }}};
-    auto op_it = ops.find(kind);
-    if (op_it == ops.end()) {
-        throw std::runtime_error("Unsupported operation kind");
-    }
-    std::vector<Instruction> result = {op_it->second(result_reg, src_reg)};
+template <ast::BinOpKind Kind>
+void Create_ArthBin_Instruction_Sequence(std::optional<target::Location> dst,
+                                         Register result_reg, Register src_reg,
+                                         Emitter& out) {
+    static_assert(is_arithmetic_v<Kind>, "Unsupported operation kind");
+    if constexpr (Kind == ast::BinOpKind::Add) {
+        out.emit(Add{.dst = result_reg, .src = src_reg});
+    } else {
+        out.emit(Sub{.dst = result_reg, .src = src_reg});
+    }
     if (dst.has_value()) {
-        result.push_back(Register_To_Location(dst.value(), result_reg, ctx));
+        Register_To_Location(dst.value(), result_reg, out);
     }
-    return result;
 }
 
-std::vector<Instruction> Create_Comparison_Instruction_Sequence(
-    ast::BinOpKind kind, std::optional<target::Location> dst, Register reg,
-    int value, Ctx& ctx) {
-    static const std::map<
-        ast::BinOpKind,
-        std::function<void(std::vector<Instruction>&, Register)>>
-        comparisonOps = {
-            {ast::BinOpKind::Eq,
-             [](std::vector<Instruction>& result, Register newReg) {
-                 result.push_back(SetEAl{.dst = newReg});
-             }},
-            {ast::BinOpKind::Gt,
-             [](std::vector<Instruction>& result, Register newReg) {
-                 result.push_back(SetGAl{.dst = newReg});
-             }}};
-    std::vector<Instruction> result = {CmpI{.dst = reg, .value = value}};
-    Register newReg = ctx.NewRegister(4);
-    auto op_it = comparisonOps.find(kind);
-    if (op_it != comparisonOps.end()) {
-        op_it->second(result, newReg);
+template <ast::BinOpKind Kind>
+[[nodiscard]] constexpr Instruction SetFlagInstruction(Register dst) {
+    static_assert(is_comparison_v<Kind>, "Unsupported comparison kind");
+    if constexpr (Kind == ast::BinOpKind::Eq) {
+        return SetEAl{.dst = dst};
+    } else if constexpr (Kind == ast::BinOpKind::Gt) {
+        return SetGAl{.dst = dst};
     } else {
-        throw std::runtime_error("Unsupported comparison kind");
+        return SetNeAl{.dst = dst};
     }
+}
+
+template <ast::BinOpKind Kind>
+void Create_Comparison_Instruction_Sequence(
+    std::optional<target::Location> dst, Register reg, int value, Ctx& ctx,
+    Emitter& out) {
+    out.emit(CmpI{.dst = reg, .value = value});
+    Register newReg = ctx.NewRegister(4);
+    out.emit(SetFlagInstruction<Kind>(newReg));
     if (dst.has_value()) {
-        result.push_back(Register_To_Location(dst.value(), newReg, ctx));
+        Register_To_Location(dst.value(), newReg, out);
     }
-    return result;
 }
 
-std::vector<Instruction> Create_Comparison_Instruction_Sequence(
-    ast::BinOpKind kind, std::optional<target::Location> dst, Register reg1,
-    Register reg2, Ctx& ctx) {
-    static const std::map<
-        ast::BinOpKind,
-        std::function<void(std::vector<Instruction>&, Register)>>
-        comparisonOps = {
-            {ast::BinOpKind::Eq,
-             [](std::vector<Instruction>& result, Register newReg) {
-                 result.push_back(SetEAl{.dst = newReg});
-             }},
-            {ast::BinOpKind::Gt,
-             [](std::vector<Instruction>& result, Register newReg) {
-                 result.push_back(SetGAl{.dst = newReg});
-             }},
-            {ast::BinOpKind::Neq,
-             [](std::vector<Instruction>& result, Register newReg) {
-                 result.push_back(SetNeAl{.dst = newReg});
-             }}};
-    std::vector<Instruction> result = {Cmp{.dst = reg1, .src = reg2}};
+template <ast::BinOpKind Kind>
+void Create_Comparison_Instruction_Sequence(
+    std::optional<target::Location> dst, Register reg1, Register reg2,
+    Ctx& ctx, Emitter& out) {
+    out.emit(Cmp{.dst = reg1, .src = reg2});
     Register newReg = ctx.NewRegister(4);
-    auto op_it = comparisonOps.find(kind);
-    if (op_it != comparisonOps.end()) {
-        op_it->second(result, newReg);
-    } else {
-        throw std::runtime_error("Unsupported comparison kind");
-    }
+    out.emit(SetFlagInstruction<Kind>(newReg));
     if (dst.has_value()) {
-        result.push_back(Register_To_Location(dst.value(), newReg, ctx));
+        Register_To_Location(dst.value(), newReg, out);
     }
-    return result;
 }
 
-template <typename T>
-[[nodiscard]] auto Create_Arth_Instruction(ast::BinOpKind kind,
-                                           std::optional<target::Location> dst,
-                                           Register result_reg, T rhs, Ctx& ctx)
-    -> std::vector<Instruction> {
-    std::vector<Instruction> result;
-    if (ast::is_arithmetic(kind)) {
-        return Create_ArthBin_Instruction_Sequence(kind, dst, result_reg, rhs,
-                                                   ctx);
-    }
-    if (ast::is_comparison(kind)) {
-        return Create_Comparison_Instruction_Sequence(kind, dst, result_reg,
-                                                      rhs, ctx);
+template <ast::BinOpKind Kind, typename T>
+void Create_Arth_Instruction(std::optional<target::Location> dst,
+                             Register result_reg, T rhs, Ctx& ctx,
+                             Emitter& out) {
+    if constexpr (is_arithmetic_v<Kind>) {
+        Create_ArthBin_Instruction_Sequence<Kind>(dst, result_reg, rhs, out);
+    } else {
+        Create_Comparison_Instruction_Sequence<Kind>(dst, result_reg, rhs, ctx,
+                                                     out);
     }
-    throw std::runtime_error("Unsupported operation kind");
 }
 
 template <typename T>
-std::pair<Register, std::vector<Instruction>> ensureRegister(T operand,
-                                                             Ctx& ctx) {
+[[nodiscard]] Register ensureRegister(const T& operand, Ctx& ctx,
+                                      Emitter& out) {
     if constexpr (qa_ir::IsIRLocation<T>) {
         Register reg = ctx.NewRegister(SizeOf(operand));
-        std::vector<Instruction> instructions = ctx.toLocation(reg, operand);
-        return {reg, instructions};
+        ctx.toLocation(reg, operand, out);
+        return reg;
     } else {
         static_assert(qa_ir::IsRegister<T>,
                       "Operand must be a Register or IRLocation");
-        return {operand, {}};
+        return operand;
+    }
+}
+
+// Add and Sub can build their result in dst's own register, saving the copy
+// out of a scratch one, unless the right operand is read from there
+template <ast::BinOpKind Kind>
+[[nodiscard]] std::optional<Register> resultInPlace(
+    const std::optional<Location>& dst, int size,
+    const std::optional<Register>& right = std::nullopt) {
+    if (!is_arithmetic_v<Kind> || !dst.has_value()) {
+        return std::nullopt;
+    }
+    const auto* reg = std::get_if<Register>(&dst.value());
+    const auto* virt =
+        reg == nullptr ? nullptr : std::get_if<VirtualRegister>(reg);
+    if (virt == nullptr || virt->size != size) {
+        return std::nullopt;
+    }
+    const auto* read = right.has_value()
+                           ? std::get_if<VirtualRegister>(&right.value())
+                           : nullptr;
+    if (read != nullptr && read->id == virt->id) {
+        return std::nullopt;
     }
+    return *reg;
 }
 
-template <typename T, typename U>
+// the right operand is only read, so a temp's own register will do
+template <typename T>
+[[nodiscard]] Register readRegister(const T& operand, Ctx& ctx, Emitter& out) {
+    if constexpr (std::is_same_v<T, qa_ir::Temp>) {
+        return ctx.AllocateNewForTemp(operand);
+    } else {
+        return ensureRegister(operand, ctx, out);
+    }
+}
+
+template <ast::BinOpKind Kind, typename T, typename U>
     requires(qa_ir::IsIRLocation<T> || qa_ir::IsRegister<T>) &&
             (qa_ir::IsIRLocation<U> || qa_ir::IsRegister<U>)
-std::vector<Instruction> InstructionForArth(ast::BinOpKind kind,
-                                            std::optional<target::Location> dst,
-                                            T left, U right, Ctx& ctx) {
-    std::vector<Instruction> result;
-    auto [result_reg, left_instructions] = ensureRegister(left, ctx);
-    std::ranges::copy(left_instructions, std::back_inserter(result));
-    auto [right_reg, right_instructions] = ensureRegister(right, ctx);
-    std::ranges::copy(right_instructions, std::back_inserter(result));
-    const auto arth_instructions =
-        Create_Arth_Instruction(kind, dst, result_reg, right_reg, ctx);
-    std::ranges::copy(arth_instructions, std::back_inserter(result));
-    return result;
+void InstructionForArth(std::optional<target::Location> dst, const T& left,
+                        const U& right, Ctx& ctx, Emitter& out) {
+    const auto right_reg = readRegister(right, ctx, out);
+    if (const auto in_place =
+            resultInPlace<Kind>(dst, qa_ir::SizeOf(left), right_reg)) {
+        ctx.toLocation(in_place.value(), left, out);
+        Create_Arth_Instruction<Kind>(std::nullopt, in_place.value(),
+                                      right_reg, ctx, out);
+        return;
+    }
+    const auto result_reg = ensureRegister(left, ctx, out);
+    Create_Arth_Instruction<Kind>(dst, result_reg, right_reg, ctx, out);
 }
 
-template <typename T>
+template <ast::BinOpKind Kind, typename T>
     requires qa_ir::IsRegister<T>
-std::vector<Instruction> InstructionForArth(ast::BinOpKind kind,
-                                            std::optional<target::Location> dst,
-                                            T result_reg, int value, Ctx& ctx) {
-    return Create_Arth_Instruction(kind, dst, result_reg, value, ctx);
+void InstructionForArth(std::optional<target::Location> dst,
+                        const T& result_reg, int value, Ctx& ctx,
+                        Emitter& out) {
+    Create_Arth_Instruction<Kind>(dst, result_reg, value, ctx, out);
 }
 
-template <typename LeftType>
+template <ast::BinOpKind Kind, typename LeftType>
     requires qa_ir::IsIRLocation<LeftType>
-std::vector<Instruction> InstructionForArth(ast::BinOpKind kind,
-                                            std::optional<target::Location> dst,
-                                            LeftType left, int value,
-                                            Ctx& ctx) {
-    auto [result_reg, result] = ensureRegister(left, ctx);
-    const auto rest_instructions =
-        Create_Arth_Instruction(kind, dst, result_reg, value, ctx);
-    std::ranges::copy(rest_instructions, std::back_inserter(result));
-    return result;
+void InstructionForArth(std::optional<target::Location> dst,
+                        const LeftType& left, int value, Ctx& ctx,
+                        Emitter& out) {
+    if (const auto in_place = resultInPlace<Kind>(dst, qa_ir::SizeOf(left))) {
+        ctx.toLocation(in_place.value(), left, out);
+        Create_Arth_Instruction<Kind>(std::nullopt, in_place.value(), value,
+                                      ctx, out);
+        return;
+    }
+    const auto result_reg = ensureRegister(left, ctx, out);
+    Create_Arth_Instruction<Kind>(dst, result_reg, value, ctx, out);
 }
 
-template <typename RightType>
+template <ast::BinOpKind Kind, typename RightType>
     requires(qa_ir::IsIRLocation<RightType> || qa_ir::IsRegister<RightType>)
-std::vector<Instruction> InstructionForArth(ast::BinOpKind kind,
-                                            std::optional<target::Location> dst,
-                                            int value, RightType right,
-                                            Ctx& ctx) {
+void InstructionForArth(std::optional<target::Location> dst, int value,
+                        const RightType& right, Ctx& ctx, Emitter& out) {
+    const auto rhs_reg = readRegister(right, ctx, out);
+    if (const auto in_place = resultInPlace<Kind>(dst, 4, rhs_reg)) {
+        out.emit(LoadI{.dst = in_place.value(), .value = value});
+        Create_Arth_Instruction<Kind>(std::nullopt, in_place.value(), rhs_reg,
+                                      ctx, out);
+        return;
+    }
     const target::Register result_reg = ctx.NewRegister(4);
-    std::vector<Instruction> result = {
-        LoadI{.dst = result_reg, .value = value}};
-    auto [rhs_reg, move_to_rhs_instructions] = ensureRegister(right, ctx);
-    std::ranges::copy(move_to_rhs_instructions, std::back_inserter(result));
-    const auto rest_instructions =
-        Create_Arth_Instruction(kind, dst, result_reg, rhs_reg, ctx);
-    std::ranges::copy(rest_instructions, std::back_inserter(result));
-    return result;
+    out.emit(LoadI{.dst = result_reg, .value = value});
+    Create_Arth_Instruction<Kind>(dst, result_reg, rhs_reg, ctx, out);
 }
 
-template <qa_ir::Integral T, qa_ir::Integral U>
-std::vector<Instruction> InstructionForArth(ast::BinOpKind kind,
-                                            std::optional<target::Location> dst,
-                                            T left, U right, Ctx& ctx) {
-    auto result_reg = ctx.NewRegister(4);
-    auto src_reg = ctx.NewRegister(4);
-    std::vector<Instruction> result = {LoadI{.dst = result_reg, .value = left},
-                                       LoadI{.dst = src_reg, .value = right}};
-    const auto rest_instructions =
-        InstructionForArth(kind, dst, result_reg, src_reg, ctx);
-    std::ranges::copy(rest_instructions, std::back_inserter(result));
-    return result;
+template <ast::BinOpKind Kind, qa_ir::Integral T, qa_ir::Integral U>
+void InstructionForArth(std::optional<target::Location> dst, T left, U right,
+                        Ctx& ctx, Emitter& out) {
+    const target::Register result_reg = ctx.NewRegister(4);
+    const target::Register src_reg = ctx.NewRegister(4);
+    out.emit(LoadI{.dst = result_reg, .value = left});
+    out.emit(LoadI{.dst = src_reg, .value = right});
+    Create_Arth_Instruction<Kind>(dst, result_reg, src_reg, ctx, out);
 }
 
-[[nodiscard]] std::vector<Instruction> LowerArth(
-    ast::BinOpKind kind, std::optional<qa_ir::Value> dst, qa_ir::Value left,
-    qa_ir::Value right, Ctx& ctx) {
+template <ast::BinOpKind Kind>
+void LowerArth(const std::optional<qa_ir::Value>& dst,
+               const qa_ir::Value& left, const qa_ir::Value& right, Ctx& ctx,
+               Emitter& out) {
     std::optional<target::Location> dest_location = std::nullopt;
     if (dst.has_value()) {
         dest_location = ctx.AllocateNew(dst.value());
     }
-    auto visitor = [&](auto&& left, auto&& right) -> std::vector<Instruction> {
-        return InstructionForArth(kind, dest_location, left, right, ctx);
+    auto visitor = [&](const auto& left, const auto& right) {
+        InstructionForArth<Kind>(dest_location, left, right, ctx, out);
     };
-    return std::visit(visitor, left, right);
+    std::visit(visitor, left, right);
 }
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-parameter"
 
-auto LowerInstruction(qa_ir::LabelDef label, Ctx& ctx)
-    -> std::vector<Instruction> {
-    return {Label{.name = label.label.name}};
+void LowerInstruction(const qa_ir::LabelDef& label, Ctx& ctx, Emitter& out) {
+    out.emit(Label{.name = label.label.name, .align = label.align});
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(
-    qa_ir::ConditionalJumpEqual cj, Ctx& ctx) {
-    std::vector<Instruction> result;
-    result.push_back(JumpEq{.label = cj.trueLabel.name});
-    result.push_back(Jump{.label = cj.falseLabel.name});
-    return result;
+void LowerInstruction(const qa_ir::ConditionalJumpEqual& cj, Ctx& ctx,
+                      Emitter& out) {
+    out.emit(JumpEq{.label = cj.trueLabel.name});
+    out.emit(Jump{.label = cj.falseLabel.name});
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(
-    qa_ir::ConditionalJumpGreater cj, Ctx& ctx) {
-    std::vector<Instruction> result;
-    result.push_back(JumpGreater{.label = cj.trueLabel.name});
-    result.push_back(Jump{.label = cj.falseLabel.name});
-    return result;
+void LowerInstruction(const qa_ir::ConditionalJumpGreater& cj, Ctx& ctx,
+                      Emitter& out) {
+    out.emit(JumpGreater{.label = cj.trueLabel.name});
+    out.emit(Jump{.label = cj.falseLabel.name});
 }
 
-auto LowerInstruction(qa_ir::ConditionalJumpLess cj, Ctx& ctx)
-    -> std::vector<Instruction> {
-    std::vector<Instruction> result;
-    result.push_back(JumpLess{.label = cj.trueLabel.name});
-    result.push_back(Jump{.label = cj.falseLabel.name});
-    return result;
+void LowerInstruction(const qa_ir::ConditionalJumpLess& cj, Ctx& ctx,
+                      Emitter& out) {
+    out.emit(JumpLess{.label = cj.trueLabel.name});
+    out.emit(Jump{.label = cj.falseLabel.name});
 }
 
 #pragma clang diagnostic pop
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(qa_ir::Call call,
-                                                        Ctx& ctx) {
+void LowerInstruction(const qa_ir::Call& call, Ctx& ctx, Emitter& out) {
     auto dest = ctx.AllocateNew(call.dst);
-    std::vector<Instruction> result;
     for (auto it = call.args.rbegin(); it != call.args.rend(); ++it) {
-        auto dist = std::distance(call.args.rbegin(), it);
-        std::size_t index = static_cast<std::size_t>(dist);
+        // arguments past the sixth are pushed last to first
+        const auto dist = std::distance(call.args.rbegin(), it);
+        const auto index =
+            call.args.size() - 1 - static_cast<std::size_t>(dist);
         if (index >= 6) {
             if (std::holds_alternative<int>(*it)) {
-                result.push_back(PushI{.src = std::get<int>(*it)});
+                out.emit(PushI{.src = std::get<int>(*it)});
                 continue;
             }
             if (std::holds_alternative<qa_ir::Variable>(*it)) {
                 const auto reg = ctx.NewRegister(SizeOf(*it));
-                const auto variable = std::get<qa_ir::Variable>(*it);
+                const auto& variable = std::get<qa_ir::Variable>(*it);
                 const auto variableOffset =
                     ctx.variable_offset.at(variable.name);
-                result.push_back(Load{.dst = reg, .src = variableOffset});
-                result.push_back(Push{.src = reg});
+                out.emit(Load{.dst = reg, .src = variableOffset});
+                out.emit(Push{.src = reg});
+                continue;
+            }
+            if (std::holds_alternative<qa_ir::Temp>(*it)) {
+                const auto reg =
+                    ctx.AllocateNewForTemp(std::get<qa_ir::Temp>(*it));
+                out.emit(Push{.src = reg});
                 continue;
             }
             throw std::runtime_error("can't handle non-hardcoded int for >= 6");
@@ -449,137 +422,406 @@ auto LowerInstruction(qa_ir::ConditionalJumpLess cj, Ctx& ctx)
         const auto argsize = SizeOf(*it);
         const auto argreg =
             target::HardcodedRegister{.reg = argbase, .size = argsize};
-        auto argToParamRegInstructions = ctx.toLocation(argreg, *it);
-        result.insert(result.end(), argToParamRegInstructions.begin(),
-                      argToParamRegInstructions.end());
+        ctx.toLocation(argreg, *it, out);
     }
     const auto returnValueSize = SizeOf(call.dst);
     const auto returnRegister = HardcodedRegister{
         .reg = target::BaseRegister::AX, .size = returnValueSize};
-    result.push_back(Call{.name = call.name, .dst = returnRegister});
-    const auto move_dest_instructions =
-        Register_To_Location(dest, returnRegister, &ctx);
-    result.emplace_back(move_dest_instructions);
-    return result;
+    out.emit(Call{.name = call.name, .dst = returnRegister});
+    Register_To_Location(dest, returnRegister, out);
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(qa_ir::MovR move,
-                                                        Ctx& ctx) {
+void LowerInstruction(const qa_ir::MovR& move, Ctx& ctx, Emitter& out) {
     const auto dst = ctx.AllocateNew(move.dst);
-    return ctx.toLocation(dst, move.src);
+    ctx.toLocation(dst, move.src, out);
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(qa_ir::Addr addr,
-                                                        Ctx& ctx) {
-    std::vector<Instruction> result;
-    const auto temp = std::get<qa_ir::Temp>(addr.dst);
-    const auto variable = std::get<qa_ir::Variable>(addr.src);
+void LowerInstruction(const qa_ir::Addr& addr, Ctx& ctx, Emitter& out) {
+    const auto& temp = std::get<qa_ir::Temp>(addr.dst);
+    const auto& variable = std::get<qa_ir::Variable>(addr.src);
     const auto variableOffset = ctx.variable_offset.at(variable.name);
     const auto reg = ctx.AllocateNewForTemp(temp);
-    result.push_back(Lea{.dst = reg, .src = variableOffset});
-    return result;
+    out.emit(Lea{.dst = reg, .src = variableOffset});
 }
 
-[[nodiscard]] std::vector<Instruction> LowerInstruction(qa_ir::Deref deref,
-                                                        Ctx& ctx) {
-    std::vector<Instruction> result;
-    const auto temp = std::get<qa_ir::Temp>(deref.dst);
-    const auto variable = std::get<qa_ir::Variable>(deref.src);
-    const auto variableOffset = ctx.variable_offset.at(variable.name);
+void LowerInstruction(const qa_ir::Deref& deref, Ctx& ctx, Emitter& out) {
+    const auto& temp = std::get<qa_ir::Temp>(deref.dst);
     const auto depth = deref.depth;
-    auto reg = ctx.NewRegister(8);
-    result.push_back(Load{.dst = reg, .src = variableOffset});
+    // the pointer is either a promoted temp or still in its stack slot
+    auto pointer = [&]() -> Register {
+        if (const auto* promoted = std::get_if<qa_ir::Temp>(&deref.src)) {
+            return ctx.AllocateNewForTemp(*promoted);
+        }
+        const auto& variable = std::get<qa_ir::Variable>(deref.src);
+        const auto variableOffset = ctx.variable_offset.at(variable.name);
+        const auto reg = ctx.NewRegister(8);
+        out.emit(Load{.dst = reg, .src = variableOffset});
+        return reg;
+    };
+    auto reg = pointer();
     for (int i = 1; i < depth; i++) {
         const auto tempreg = ctx.NewRegister(8);
-        result.push_back(IndirectLoad{.dst = tempreg, .src = reg});
+        out.emit(IndirectLoad{.dst = tempreg, .src = reg});
         reg = tempreg;
     }
     // indirect mem access
     const auto finalDest = ctx.AllocateNewForTemp(temp);
-    result.push_back(IndirectLoad{.dst = finalDest, .src = reg});
-    return result;
+    out.emit(IndirectLoad{.dst = finalDest, .src = reg});
 }
 
-[[nodiscard]] auto LowerInstruction(qa_ir::DerefStore deref, Ctx& ctx) {
-    std::vector<Instruction> result;
+void LowerInstruction(const qa_ir::DerefStore& deref, Ctx& ctx, Emitter& out) {
     // variable_dest holds the address of the variable
-    const auto variable_dest = deref.dst;
+    const auto& variable_dest = deref.dst;
     // move the variable to a register
     const auto tempregister = ctx.NewRegister(8);
-    auto moveInstructions = ctx.toLocation(tempregister, variable_dest);
-    result.insert(result.end(), moveInstructions.begin(),
-                  moveInstructions.end());
+    ctx.toLocation(tempregister, variable_dest, out);
     // load the value at the address
-    const auto src = deref.src;
+    const auto& src = deref.src;
     const auto srcSize = SizeOf(src);
     const auto srcReg = ctx.NewRegister(srcSize);
-    auto srcInstructions = ctx.toLocation(srcReg, src);
-    result.insert(result.end(), srcInstructions.begin(), srcInstructions.end());
+    ctx.toLocation(srcReg, src, out);
     // store the value at the address using indirect store instructions
-    result.push_back(IndirectStore{.dst = tempregister, .src = srcReg});
-    return result;
+    out.emit(IndirectStore{.dst = tempregister, .src = srcReg});
 }
 
-auto LowerInstruction(qa_ir::Add arg, Ctx& ctx) -> std::vector<Instruction> {
-    return LowerArth(ast::BinOpKind::Add, arg.dst, arg.left, arg.right, ctx);
+void LowerInstruction(const qa_ir::Add& arg, Ctx& ctx, Emitter& out) {
+    LowerArth<ast::BinOpKind::Add>(arg.dst, arg.left, arg.right, ctx, out);
 }
 
-auto LowerInstruction(qa_ir::Sub arg, Ctx& ctx) -> std::vector<Instruction> {
-    return LowerArth(ast::BinOpKind::Sub, arg.dst, arg.left, arg.right, ctx);
+void LowerInstruction(const qa_ir::Sub& arg, Ctx& ctx, Emitter& out) {
+    LowerArth<ast::BinOpKind::Sub>(arg.dst, arg.left, arg.right, ctx, out);
 }
 
-auto LowerInstruction(qa_ir::Equal arg, Ctx& ctx) -> std::vector<Instruction> {
-    return LowerArth(ast::BinOpKind::Eq, arg.dst, arg.left, arg.right, ctx);
+void LowerInstruction(const qa_ir::Equal& arg, Ctx& ctx, Emitter& out) {
+    LowerArth<ast::BinOpKind::Eq>(arg.dst, arg.left, arg.right, ctx, out);
 }
 
-auto LowerInstruction(qa_ir::NotEqual arg, Ctx& ctx)
-    -> std::vector<Instruction> {
-    return LowerArth(ast::BinOpKind::Neq, arg.dst, arg.left, arg.right, ctx);
+void LowerInstruction(const qa_ir::NotEqual& arg, Ctx& ctx, Emitter& out) {
+    LowerArth<ast::BinOpKind::Neq>(arg.dst, arg.left, arg.right, ctx, out);
 }
 
-auto LowerInstruction(qa_ir::GreaterThan arg, Ctx& ctx)
-    -> std::vector<Instruction> {
-    return LowerArth(ast::BinOpKind::Gt, arg.dst, arg.left, arg.right, ctx);
+void LowerInstruction(const qa_ir::GreaterThan& arg, Ctx& ctx, Emitter& out) {
+    LowerArth<ast::BinOpKind::Gt>(arg.dst, arg.left, arg.right, ctx, out);
 }
 
-auto LowerInstruction(qa_ir::Compare arg, Ctx& ctx)
-    -> std::vector<Instruction> {
-    return LowerArth(ast::BinOpKind::Eq, std::nullopt, arg.left, arg.right,
-                     ctx);
+// conditions a conditional jump tests the flags of a Compare for
+enum class Condition {
+    Equal,
+    NotEqual,
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual
+};
+
+[[nodiscard]] constexpr Condition negate(Condition condition) {
+    switch (condition) {
+        case Condition::Equal:
+            return Condition::NotEqual;
+        case Condition::NotEqual:
+            return Condition::Equal;
+        case Condition::Greater:
+            return Condition::LessEqual;
+        case Condition::GreaterEqual:
+            return Condition::Less;
+        case Condition::Less:
+            return Condition::GreaterEqual;
+        case Condition::LessEqual:
+            return Condition::Greater;
+    }
+    return condition;
+}
+
+// the condition on right and left that holds when condition holds on left
+// and right
+[[nodiscard]] constexpr Condition swap_operands(Condition condition) {
+    switch (condition) {
+        case Condition::Greater:
+            return Condition::Less;
+        case Condition::GreaterEqual:
+            return Condition::LessEqual;
+        case Condition::Less:
+            return Condition::Greater;
+        case Condition::LessEqual:
+            return Condition::GreaterEqual;
+        default:
+            return condition;
+    }
+}
+
+void EmitConditionalJump(Condition condition, const std::string& label,
+                         Emitter& out) {
+    switch (condition) {
+        case Condition::Equal:
+            out.emit(JumpEq{.label = label});
+            break;
+        case Condition::NotEqual:
+            out.emit(JumpNotEq{.label = label});
+            break;
+        case Condition::Greater:
+            out.emit(JumpGreater{.label = label});
+            break;
+        case Condition::GreaterEqual:
+            out.emit(JumpGreaterEq{.label = label});
+            break;
+        case Condition::Less:
+            out.emit(JumpLess{.label = label});
+            break;
+        case Condition::LessEqual:
+            out.emit(JumpLessEq{.label = label});
+            break;
+    }
+}
+
+// a compared value in a register, a temp's own one if it has one
+[[nodiscard]] Register comparedRegister(const qa_ir::Value& value, Ctx& ctx,
+                                        Emitter& out) {
+    return std::visit(
+        [&ctx, &out](const auto& operand) -> Register {
+            if constexpr (qa_ir::Integral<std::decay_t<decltype(operand)>>) {
+                const auto reg = ctx.NewRegister(4);
+                out.emit(LoadI{.dst = reg, .value = operand});
+                return reg;
+            } else {
+                return readRegister(operand, ctx, out);
+            }
+        },
+        value);
+}
+
+// Sets the flags of left - right. x86 only takes an immediate or a stack
+// slot as the right operand, so when swappable the operands are swapped to
+// get one there, and the return value tells whether they were.
+[[nodiscard]] bool LowerCompare(const qa_ir::Value& left,
+                                const qa_ir::Value& right, bool swappable,
+                                Ctx& ctx, Emitter& out) {
+    const auto in_memory = [](const qa_ir::Value& value) {
+        return std::holds_alternative<qa_ir::Variable>(value);
+    };
+    const auto immediate = [](const qa_ir::Value& value) {
+        return std::holds_alternative<int>(value);
+    };
+    const auto swapped =
+        swappable && !immediate(right) &&
+        (immediate(left) || (in_memory(left) && !in_memory(right)));
+    const auto& lhs = swapped ? right : left;
+    const auto& rhs = swapped ? left : right;
+    if (const auto* value = std::get_if<int>(&rhs)) {
+        if (const auto* variable = std::get_if<qa_ir::Variable>(&lhs)) {
+            out.emit(CmpMI{.dst = ctx.variable_offset.at(variable->name),
+                           .size = variable->size,
+                           .value = *value});
+            return swapped;
+        }
+        const auto reg = comparedRegister(lhs, ctx, out);
+        if (*value == 0) {
+            out.emit(Test{.dst = reg});
+        } else {
+            out.emit(CmpI{.dst = reg, .value = *value});
+        }
+        return swapped;
+    }
+    const auto reg = comparedRegister(lhs, ctx, out);
+    if (const auto* variable = std::get_if<qa_ir::Variable>(&rhs);
+        variable != nullptr &&
+        variable->size ==
+            std::visit([](const auto& r) { return r.size; }, reg)) {
+        out.emit(
+            CmpM{.dst = reg, .src = ctx.variable_offset.at(variable->name)});
+        return swapped;
+    }
+    out.emit(Cmp{.dst = reg, .src = comparedRegister(rhs, ctx, out)});
+    return swapped;
+}
+
+void LowerInstruction(const qa_ir::Compare& arg, Ctx& ctx, Emitter& out) {
+    // the jump reading the flags isn't known here
+    static_cast<void>(LowerCompare(arg.left, arg.right, false, ctx, out));
+}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+
+// the slot was assigned before the frame was lowered
+void LowerInstruction(const qa_ir::DefineStackPushed& arg, Ctx& ctx,
+                      Emitter& out) {}
+
+void LowerInstruction(const qa_ir::Jump& arg, Ctx& ctx, Emitter& out) {
+    out.emit(Jump{.label = arg.label.name});
+}
+
+void LowerInstruction(const qa_ir::Phi& arg, Ctx& ctx, Emitter& out) {
+    throw std::runtime_error("Phi must be removed by DestructSSA");
+}
+
+#pragma clang diagnostic pop
+
+// A call whose result is returned right away can leave the frame first
+// when the callee's stack arguments fit in the slots the frame's own came
+// in, and nothing may point into the frame.
+[[nodiscard]] bool can_tail_call(const qa_ir::Frame& frame, std::size_t i) {
+    if (!qa_ir::IsTailCall(frame, i)) {
+        return false;
+    }
+    const auto& call = std::get<qa_ir::Call>(frame.instructions[i]);
+    const auto incoming =
+        std::ranges::count_if(frame.instructions, [](const auto& op) {
+            return std::holds_alternative<qa_ir::DefineStackPushed>(op);
+        });
+    const auto stacked = static_cast<long>(call.args.size()) -
+                         static_cast<long>(param_regs.size());
+    return stacked <= incoming &&
+           std::ranges::none_of(frame.instructions, [](const auto& op) {
+               return std::holds_alternative<qa_ir::Addr>(op);
+           });
+}
+
+// Every argument is read before any of the incoming slots is overwritten,
+// since the arguments may be the frame's own stack parameters.
+void LowerTailCall(const qa_ir::Call& call, Ctx& ctx, Emitter& out) {
+    std::vector<Register> stacked;
+    for (std::size_t k = param_regs.size(); k < call.args.size(); k++) {
+        const auto reg = ctx.NewRegister(SizeOf(call.args[k]));
+        ctx.toLocation(reg, call.args[k], out);
+        stacked.push_back(reg);
+    }
+    for (std::size_t k = 0; k < call.args.size() && k < param_regs.size();
+         k++) {
+        const auto argreg = HardcodedRegister{.reg = param_regs.at(k),
+                                              .size = SizeOf(call.args[k])};
+        ctx.toLocation(argreg, call.args[k], out);
+    }
+    for (std::size_t k = 0; k < stacked.size(); k++) {
+        const auto offset = 16 + 8 * static_cast<int>(k);
+        out.emit(Store{.dst = StackLocation{.offset = -offset},
+                       .src = stacked[k]});
+    }
+    out.emit(TailCall{.name = call.name});
 }
 
-auto LowerInstruction(qa_ir::DefineStackPushed arg, Ctx& ctx)
-    -> std::vector<Instruction> {
-    auto name = arg.name;
-    ctx.define_stack_pushed_variable(name);
-    return {};
+// what a conditional jump tests and where it goes
+struct Branch {
+    Condition condition;
+    const qa_ir::Label* trueLabel;
+    const qa_ir::Label* falseLabel;
+};
+
+template <typename T>
+[[nodiscard]] std::optional<Branch> branch_of(const T& op) {
+    if constexpr (std::is_same_v<T, qa_ir::ConditionalJumpEqual>) {
+        return Branch{Condition::Equal, &op.trueLabel, &op.falseLabel};
+    } else if constexpr (std::is_same_v<T, qa_ir::ConditionalJumpGreater>) {
+        return Branch{Condition::Greater, &op.trueLabel, &op.falseLabel};
+    } else if constexpr (std::is_same_v<T, qa_ir::ConditionalJumpLess>) {
+        return Branch{Condition::Less, &op.trueLabel, &op.falseLabel};
+    } else {
+        return std::nullopt;
+    }
 }
 
-auto LowerInstruction(qa_ir::Jump arg, Ctx& ctx) -> std::vector<Instruction> {
-    return {Jump{.label = arg.label.name}};
+// Lowers the Compare at ops[i] and the conditional jump after it to a cmp
+// and a jcc on the flags, with no boolean in between. The jump goes to the
+// label that doesn't follow, negated if that is the false one, so only a
+// branch away from both labels needs a jmp as well. Returns false when
+// ops[i] doesn't start such a pair.
+[[nodiscard]] bool LowerBranch(const std::vector<qa_ir::Operation>& ops,
+                               std::size_t i, Ctx& ctx, Emitter& out) {
+    const auto* compare = std::get_if<qa_ir::Compare>(&ops[i]);
+    if (compare == nullptr || i + 1 == ops.size()) {
+        return false;
+    }
+    const auto branch = std::visit(
+        [](const auto& op) { return branch_of(op); }, ops[i + 1]);
+    if (!branch.has_value()) {
+        return false;
+    }
+    auto condition = branch->condition;
+    if (LowerCompare(compare->left, compare->right, true, ctx, out)) {
+        condition = swap_operands(condition);
+    }
+    const auto& trueLabel = branch->trueLabel->name;
+    const auto& falseLabel = branch->falseLabel->name;
+    const auto* next = i + 2 < ops.size()
+                           ? std::get_if<qa_ir::LabelDef>(&ops[i + 2])
+                           : nullptr;
+    if (next != nullptr && next->label.name == falseLabel) {
+        EmitConditionalJump(condition, trueLabel, out);
+    } else if (next != nullptr && next->label.name == trueLabel) {
+        EmitConditionalJump(negate(condition), falseLabel, out);
+    } else {
+        EmitConditionalJump(condition, trueLabel, out);
+        out.emit(Jump{.label = falseLabel});
+    }
+    return true;
+}
+
+// Gives every variable of the frame its stack slot, in the order the
+// variables first appear. Optimizations may move a read of a variable, or
+// its address, ahead of the assignment that would otherwise be the first to
+// need its slot.
+void assign_stack_slots(const qa_ir::Frame& frame, Ctx& ctx) {
+    for (const auto& op : frame.instructions) {
+        const auto* pushed = std::get_if<qa_ir::DefineStackPushed>(&op);
+        if (pushed != nullptr && !ctx.variable_offset.contains(pushed->name)) {
+            ctx.define_stack_pushed_variable(pushed->name);
+        }
+    }
+    auto assign = [&ctx](const qa_ir::Value& value) {
+        if (std::holds_alternative<qa_ir::Variable>(value)) {
+            (void)ctx.AllocateNew(value);
+        }
+    };
+    for (const auto& op : frame.instructions) {
+        if (const auto* dst = qa_ir::defined_value(op)) {
+            assign(*dst);
+        }
+        qa_ir::for_each_used_value(op, assign);
+    }
 }
 
-[[nodiscard]] std::vector<Instruction> GenerateInstructionsForOperation(
-    const qa_ir::Operation& op, Ctx& ctx) {
-    return std::visit([&ctx](auto&& arg) { return LowerInstruction(arg, ctx); },
-                      op);
+void LowerFrame(const qa_ir::Frame& frame, Ctx& ctx, Emitter& out) {
+    const auto& ops = frame.instructions;
+    assign_stack_slots(frame, ctx);
+    CountTempUses(frame, ctx);
+    for (std::size_t i = 0; i < ops.size(); i++) {
+        if (const auto covered = SelectTiles(ops, i, ctx, out); covered > 0) {
+            i += covered - 1;
+            continue;
+        }
+        if (LowerBranch(ops, i, ctx, out)) {
+            // the conditional jump
+            i++;
+            continue;
+        }
+        if (can_tail_call(frame, i)) {
+            LowerTailCall(std::get<qa_ir::Call>(ops[i]), ctx, out);
+            // the Ret of the result
+            i++;
+            continue;
+        }
+        std::visit(
+            [&ctx, &out](const auto& arg) { LowerInstruction(arg, ctx, out); },
+            ops[i]);
+    }
 }
 
+// most operations lower to one to three target instructions
+constexpr std::size_t expected_instructions_per_operation = 3;
+
 [[nodiscard]] std::vector<Frame> LowerIR(
     const std::vector<qa_ir::Frame>& frames) {
     std::vector<Frame> result;
+    result.reserve(frames.size());
     for (const auto& f : frames) {
         std::vector<Instruction> instructions;
+        instructions.reserve(f.instructions.size() *
+                             expected_instructions_per_operation);
         Ctx ctx = Ctx{};
-        for (const auto& op : f.instructions) {
-            auto ins = GenerateInstructionsForOperation(op, ctx);
-            if (ins.empty()) {
-                continue;
-            }
-            instructions.insert(instructions.end(), ins.begin(), ins.end());
-        }
-        auto new_frame = Frame{f.name, instructions, ctx.get_stack_offset()};
-        result.push_back(new_frame);
+        Emitter out{instructions};
+        LowerFrame(f, ctx, out);
+        result.push_back(Frame{.name = f.name,
+                               .instructions = std::move(instructions),
+                               .size = ctx.get_stack_offset()});
     }
     return result;
 }
@@ -2,10 +2,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <ranges>
 #include <string>
+#include <string_view>
 
 #include "../include/driver.hpp"
 
+enum LongOption {
+    Stats = 256,
+    RegAlloc,
+    UnrollLoops,
+    UnrollCount,
+    InlineLimit,
+    OmitFramePointer,
+    O0,
+    O1,
+    O2,
+    Os,
+    Passes,
+    PrintAfter,
+    TimePasses
+};
+
 int main(int argc, char* argv[]) {
     if (argc <= 1) {
         fprintf(stderr, "Usage: %s -o <outputfile> <inputfile>\n", argv[0]);
@@ -14,12 +32,103 @@ int main(int argc, char* argv[]) {
 
     int opt;
     std::string outfile = "test.asm";
+    Options options;
+
+    // long options are accepted with a single dash, e.g. -stats
+    const option long_options[] = {
+        {"stats", no_argument, nullptr, LongOption::Stats},
+        {"regalloc", required_argument, nullptr, LongOption::RegAlloc},
+        {"funroll-loops", no_argument, nullptr, LongOption::UnrollLoops},
+        {"unroll-count", required_argument, nullptr, LongOption::UnrollCount},
+        {"finline-limit", required_argument, nullptr, LongOption::InlineLimit},
+        {"fomit-frame-pointer", no_argument, nullptr,
+         LongOption::OmitFramePointer},
+        {"O0", no_argument, nullptr, LongOption::O0},
+        {"O1", no_argument, nullptr, LongOption::O1},
+        {"O2", no_argument, nullptr, LongOption::O2},
+        {"Os", no_argument, nullptr, LongOption::Os},
+        {"passes", required_argument, nullptr, LongOption::Passes},
+        {"print-after", required_argument, nullptr, LongOption::PrintAfter},
+        {"time-passes", no_argument, nullptr, LongOption::TimePasses},
+        {nullptr, 0, nullptr, 0},
+    };
 
-    while ((opt = getopt(argc, argv, "o:")) != -1) {
+    while ((opt = getopt_long_only(argc, argv, "o:", long_options, nullptr)) !=
+           -1) {
         switch (opt) {
             case 'o':
                 outfile = optarg;
                 break;
+            case LongOption::Stats:
+                options.stats = true;
+                break;
+            case LongOption::RegAlloc:
+                if (std::string_view(optarg) == "graph") {
+                    options.allocator = target::RegisterAllocator::Graph;
+                } else if (std::string_view(optarg) == "linear") {
+                    options.allocator = target::RegisterAllocator::LinearScan;
+                } else {
+                    fprintf(stderr, "Unknown register allocator %s\n",
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case LongOption::UnrollLoops:
+                options.unroll.runtime = true;
+                break;
+            case LongOption::UnrollCount: {
+                char* end = nullptr;
+                const auto count = strtol(optarg, &end, 10);
+                if (*end != '\0' || count < 1 || count > 64) {
+                    fprintf(stderr, "Invalid unroll count %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                options.unroll.runtime = true;
+                options.unroll.count = static_cast<int>(count);
+                break;
+            }
+            case LongOption::InlineLimit: {
+                char* end = nullptr;
+                const auto limit = strtol(optarg, &end, 10);
+                if (*end != '\0' || limit < 0 || limit > 10000) {
+                    fprintf(stderr, "Invalid inline limit %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                options.inlining.limit = static_cast<int>(limit);
+                break;
+            }
+            case LongOption::OmitFramePointer:
+                options.omitFramePointer = true;
+                break;
+            case LongOption::O0:
+                options.level = passes::OptLevel::O0;
+                break;
+            case LongOption::O1:
+                options.level = passes::OptLevel::O1;
+                break;
+            case LongOption::O2:
+                options.level = passes::OptLevel::O2;
+                break;
+            case LongOption::Os:
+                options.level = passes::OptLevel::Os;
+                break;
+            case LongOption::Passes: {
+                // names are checked when the pass manager is built
+                auto& names = options.pipeline.emplace();
+                for (const auto name :
+                     std::string_view(optarg) | std::views::split(',')) {
+                    if (!name.empty()) {
+                        names.emplace_back(name.begin(), name.end());
+                    }
+                }
+                break;
+            }
+            case LongOption::PrintAfter:
+                options.printAfter.emplace_back(optarg);
+                break;
+            case LongOption::TimePasses:
+                options.timePasses = true;
+                break;
             default:
                 fprintf(stderr, "Usage: %s -o <outputfile> <inputfile>\n",
                         argv[0]);
@@ -33,5 +142,5 @@ int main(int argc, char* argv[]) {
     }
 
     char* sourcefile = argv[optind];
-    return runfile(sourcefile, outfile);
+    return runfile(sourcefile, outfile, options);
 }
@@ -0,0 +1,398 @@
+#include "../include/pass_manager.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include "../include/copies.hpp"
+#include "../include/dce.hpp"
+#include "../include/gvn.hpp"
+#include "../include/induction.hpp"
+#include "../include/layout.hpp"
+#include "../include/licm.hpp"
+#include "../include/sccp.hpp"
+#include "../include/scev.hpp"
+#include "../include/simplify.hpp"
+#include "../include/ssa.hpp"
+#include "../include/tailcall.hpp"
+
+namespace passes {
+
+namespace {
+
+using qa_ir::PreservedAnalyses;
+using Clock = std::chrono::steady_clock;
+
+// the names the manager records its own conversions under
+constexpr std::string_view construct_ssa = "ssa";
+constexpr std::string_view destruct_ssa = "out-of-ssa";
+// the stages the driver records between the passes
+constexpr auto stages = std::array<std::string_view, 3>{
+    "lower", "regalloc", "codegen"};
+
+[[nodiscard]] Pass frame_pass(std::string_view name, std::string_view stat,
+                              Form form, FramePass run,
+                              PreservedAnalyses preserved,
+                              bool reassignsTemps = false) {
+    return Pass{.name = name,
+                .stat = stat,
+                .form = form,
+                .run = run,
+                .preserved = preserved,
+                .reassignsTemps = reassignsTemps};
+}
+
+[[nodiscard]] const Pass* find(std::string_view name) {
+    const auto& registry = Registry();
+    const auto it = std::ranges::find(registry, name, &Pass::name);
+    return it == registry.end() ? nullptr : &*it;
+}
+
+[[nodiscard]] bool is_stage(std::string_view name) {
+    return name == construct_ssa || name == destruct_ssa ||
+           std::ranges::find(stages, name) != stages.end();
+}
+}  // namespace
+
+const std::vector<Pass>& Registry() {
+    const auto none = PreservedAnalyses::None();
+    // passes that only add or remove operations inside the blocks
+    const auto blocks = PreservedAnalyses::Blocks();
+    static const auto registry = std::vector<Pass>{
+        frame_pass("tailrec", "recursive calls turned into loops",
+                   Form::Plain,
+                   [](qa_ir::Frame& frame, PassContext&) {
+                       // a frame without recursion is left for the inliner
+                       return qa_ir::EliminateTailRecursion(frame);
+                   },
+                   none),
+        Pass{.name = "inline",
+             .stat = "calls inlined",
+             .form = Form::Plain,
+             .run = ProgramPass{[](std::vector<qa_ir::Frame>& frames,
+                                   const PassOptions& options) {
+                 return qa_ir::InlineCalls(frames, options.inlining);
+             }},
+             .preserved = none},
+        frame_pass("sccp", "IR operations removed", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::PropagateConstants(frame, *ctx.analyses);
+                   },
+                   none),
+        frame_pass("simplify", "IR operations removed", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext&) {
+                       return qa_ir::Simplify(frame);
+                   },
+                   none),
+        // replaced operations become moves in place, so blocks stay put
+        frame_pass("gvn", "IR operations replaced", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::NumberValues(frame, *ctx.analyses);
+                   },
+                   PreservedAnalyses::All()),
+        frame_pass("copyprop", "IR operations removed", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext&) {
+                       return qa_ir::PropagateCopies(frame);
+                   },
+                   blocks),
+        frame_pass("scev", "loops replaced by their values", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::EvaluateLoopExitValues(frame,
+                                                            *ctx.analyses);
+                   },
+                   none),
+        frame_pass("unroll", "loops unrolled", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::UnrollLoops(frame, *ctx.analyses,
+                                                 ctx.options.unroll);
+                   },
+                   none),
+        frame_pass("iv", "induction variables reduced or removed", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::ReduceInductionVariables(frame,
+                                                              *ctx.analyses);
+                   },
+                   none),
+        frame_pass("dce", "IR operations removed", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::EliminateDeadCode(frame, *ctx.analyses);
+                   },
+                   blocks),
+        frame_pass("licm", "IR operations moved out of loops", Form::SSA,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::HoistLoopInvariants(frame, *ctx.analyses);
+                   },
+                   none),
+        // merges the temps DestructSSA copies phis through
+        frame_pass("coalesce", "IR moves removed", Form::Plain,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::CoalesceCopies(frame, *ctx.analyses);
+                   },
+                   blocks, true),
+        frame_pass("cleanup", "IR operations removed", Form::Plain,
+                   [](qa_ir::Frame& frame, PassContext&) {
+                       return qa_ir::SimplifyControlFlow(frame);
+                   },
+                   none),
+        frame_pass("layout", "blocks moved", Form::Plain,
+                   [](qa_ir::Frame& frame, PassContext& ctx) {
+                       return qa_ir::PlaceBlocks(frame, *ctx.analyses,
+                                                 ctx.options.layout);
+                   },
+                   none),
+        Pass{.name = "peephole",
+             .stat = "windows rewritten",
+             .form = Form::Machine,
+             .run = MachinePass{[](target::Frame& frame, PassContext& ctx) {
+                 return target::Peephole(frame, ctx.peephole);
+             }},
+             .preserved = none},
+    };
+    return registry;
+}
+
+std::vector<std::string> Preset(OptLevel level) {
+    switch (level) {
+        case OptLevel::O0:
+            return {};
+        case OptLevel::O1:
+            return {"tailrec",  "inline",  "sccp",   "simplify", "copyprop",
+                    "dce",      "coalesce", "cleanup", "layout", "peephole"};
+        case OptLevel::O2:
+            // the copies of a loop body start out with constant counters,
+            // and the test of a deleted loop is left for constants to decide
+            return {"tailrec",  "inline", "sccp",     "simplify", "gvn",
+                    "copyprop", "scev",   "unroll",   "sccp",     "simplify",
+                    "copyprop", "iv",     "dce",      "licm",     "coalesce",
+                    "cleanup",  "layout", "peephole"};
+        case OptLevel::Os:
+            // everything but unrolling, which trades size for speed
+            return {"tailrec",  "inline", "sccp",     "simplify", "gvn",
+                    "copyprop", "scev",   "sccp",     "simplify", "copyprop",
+                    "iv",       "dce",    "licm",     "coalesce", "cleanup",
+                    "layout",   "peephole"};
+    }
+    return {};
+}
+
+long SizeOf(const std::vector<qa_ir::Frame>& frames) {
+    long size = 0;
+    for (const auto& frame : frames) {
+        size += static_cast<long>(frame.instructions.size());
+    }
+    return size;
+}
+
+long SizeOf(const std::vector<target::Frame>& frames) {
+    long size = 0;
+    for (const auto& frame : frames) {
+        size += static_cast<long>(frame.instructions.size());
+    }
+    return size;
+}
+
+PassManager::PassManager(const std::vector<std::string>& names,
+                         PassOptions options,
+                         std::set<std::string, std::less<>> printAfter)
+    : options(options), printAfter(std::move(printAfter)) {
+    // SSA form is entered once, and left for good by DestructSSA, whose
+    // copies assign the temps of phis more than once. The machine passes
+    // come last.
+    auto form = Form::Plain;
+    auto leftSSA = false;
+    const Pass* reassigned = nullptr;
+    for (const auto& name : names) {
+        const auto* pass = find(name);
+        if (pass == nullptr) {
+            throw std::invalid_argument("unknown pass " + name);
+        }
+        if (pass->form == Form::SSA && leftSSA) {
+            throw std::invalid_argument("pass " + name +
+                                        " needs SSA form, which was left");
+        }
+        if (pass->form == Form::SSA && reassigned != nullptr) {
+            throw std::invalid_argument(
+                "pass " + name + " needs temps assigned once, which " +
+                std::string(reassigned->name) + " may reassign");
+        }
+        if (pass->form != Form::Machine && form == Form::Machine) {
+            throw std::invalid_argument("IR pass " + name +
+                                        " after a machine pass");
+        }
+        leftSSA = leftSSA || (form == Form::SSA && pass->form != Form::SSA);
+        if (pass->reassignsTemps) {
+            reassigned = pass;
+        }
+        form = pass->form;
+        pipeline.push_back(pass);
+    }
+    for (const auto& name : this->printAfter) {
+        if (find(name) == nullptr && !is_stage(name)) {
+            throw std::invalid_argument("unknown pass " + name +
+                                        " to print after");
+        }
+    }
+}
+
+PassRecord& PassManager::record(std::string_view name) {
+    auto it = std::ranges::find(records, name, &PassRecord::name);
+    if (it == records.end()) {
+        records.push_back(PassRecord{.name = std::string(name)});
+        return records.back();
+    }
+    return *it;
+}
+
+void PassManager::Record(std::string_view name, long sizeBefore,
+                         long sizeAfter, std::chrono::nanoseconds time) {
+    auto& entry = record(name);
+    entry.runs++;
+    entry.time += time;
+    entry.sizeBefore += sizeBefore;
+    entry.sizeAfter += sizeAfter;
+}
+
+void PassManager::convert(std::vector<qa_ir::Frame>& frames, Form to) {
+    const auto before = SizeOf(frames);
+    const auto start = Clock::now();
+    for (auto& frame : frames) {
+        if (to == Form::SSA) {
+            qa_ir::ConstructSSA(frame);
+        } else {
+            qa_ir::DestructSSA(frame);
+        }
+    }
+    const auto name = to == Form::SSA ? construct_ssa : destruct_ssa;
+    Record(name, before, SizeOf(frames), Clock::now() - start);
+    PrintAfter(name, frames);
+}
+
+void PassManager::RunIR(std::vector<qa_ir::Frame>& frames) {
+    auto form = Form::Plain;
+    auto analyses = std::vector<qa_ir::FrameAnalyses>{};
+    const auto reset = [&] {
+        analyses.clear();
+        for (const auto& frame : frames) {
+            analyses.emplace_back(frame);
+        }
+    };
+    reset();
+    for (const auto* pass : pipeline) {
+        if (pass->form == Form::Machine) {
+            break;
+        }
+        if (pass->form != form) {
+            convert(frames, pass->form);
+            form = pass->form;
+            // both conversions rebuild the blocks of every frame
+            reset();
+        }
+        const auto before = SizeOf(frames);
+        const auto start = Clock::now();
+        auto changed = 0;
+        if (const auto* program = std::get_if<ProgramPass>(&pass->run)) {
+            changed = (*program)(frames, options);
+            // frames may be gone or moved
+            reset();
+        } else {
+            const auto run = std::get<FramePass>(pass->run);
+            for (std::size_t i = 0; i < frames.size(); i++) {
+                auto ctx = PassContext{.options = options,
+                                       .analyses = &analyses[i],
+                                       .peephole = peephole};
+                changed += run(frames[i], ctx);
+                analyses[i].Invalidate(pass->preserved);
+            }
+        }
+        Record(pass->name, before, SizeOf(frames), Clock::now() - start);
+        record(pass->name).changed += changed;
+        PrintAfter(pass->name, frames);
+    }
+    if (form == Form::SSA) {
+        convert(frames, Form::Plain);
+    }
+}
+
+void PassManager::RunMachine(std::vector<target::Frame>& frames) {
+    for (const auto* pass : pipeline) {
+        if (pass->form != Form::Machine) {
+            continue;
+        }
+        const auto before = SizeOf(frames);
+        const auto start = Clock::now();
+        auto changed = 0;
+        const auto run = std::get<MachinePass>(pass->run);
+        for (auto& frame : frames) {
+            auto ctx = PassContext{
+                .options = options, .analyses = nullptr, .peephole = peephole};
+            changed += run(frame, ctx);
+        }
+        Record(pass->name, before, SizeOf(frames), Clock::now() - start);
+        record(pass->name).changed += changed;
+        PrintAfter(pass->name, frames);
+    }
+}
+
+void PassManager::PrintAfter(std::string_view name,
+                             const std::vector<qa_ir::Frame>& frames) const {
+    if (!printAfter.contains(name)) {
+        return;
+    }
+    std::cout << "; IR after " << name << std::endl;
+    for (const auto& frame : frames) {
+        std::cout << frame.name << ":" << std::endl;
+        for (const auto& ins : frame.instructions) {
+            std::cout << ins << std::endl;
+        }
+    }
+}
+
+void PassManager::PrintAfter(std::string_view name,
+                             const std::vector<target::Frame>& frames) const {
+    if (!printAfter.contains(name)) {
+        return;
+    }
+    std::cout << "; machine code after " << name << std::endl;
+    for (const auto& frame : frames) {
+        std::cout << frame.name << ":" << std::endl;
+        for (const auto& ins : frame.instructions) {
+            std::cout << ins << std::endl;
+        }
+    }
+}
+
+void PassManager::PrintAfter(std::string_view name,
+                             const std::string& code) const {
+    if (!printAfter.contains(name)) {
+        return;
+    }
+    std::cout << "; assembly after " << name << std::endl << code;
+}
+
+void PassManager::PrintStats(std::ostream& os) const {
+    for (const auto& entry : records) {
+        const auto* pass = find(entry.name);
+        if (pass == nullptr || pass->form == Form::Machine) {
+            continue;
+        }
+        os << entry.name << ": " << entry.changed << " " << pass->stat
+           << std::endl;
+    }
+}
+
+void PassManager::PrintTimings(std::ostream& os) const {
+    for (const auto& entry : records) {
+        const auto micros =
+            std::chrono::duration_cast<std::chrono::microseconds>(entry.time);
+        const auto delta = entry.sizeAfter - entry.sizeBefore;
+        os << "time: " << std::left << std::setw(12) << entry.name
+           << std::right << std::setw(3) << entry.runs << " runs "
+           << std::setw(8) << micros.count() << "us " << std::setw(6)
+           << entry.sizeBefore << " -> " << std::setw(6) << entry.sizeAfter
+           << " (" << (delta > 0 ? "+" : "") << delta << ")" << std::endl;
+    }
+}
+}  // namespace passes
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "../include/peephole.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace target {
+
+namespace {
+
+using Window = std::span<const Instruction>;
+// what a window is replaced by, nullopt when the rule does not apply
+using Rewrite = std::optional<std::vector<Instruction>>;
+
+struct Rule {
+    std::string_view name;
+    std::size_t size;
+    Rewrite (*apply)(Window window);
+};
+
+// Instruction in a pattern matches any instruction
+template <typename T>
+[[nodiscard]] bool matches(const Instruction& ins) {
+    if constexpr (std::is_same_v<T, Instruction>) {
+        return true;
+    } else {
+        return std::holds_alternative<T>(ins);
+    }
+}
+
+template <typename T>
+[[nodiscard]] const T& as(const Instruction& ins) {
+    if constexpr (std::is_same_v<T, Instruction>) {
+        return ins;
+    } else {
+        return *std::get_if<T>(&ins);
+    }
+}
+
+// The window matches when its instructions have the types Ts, only then F
+// is called with them. F is a lambda without captures.
+template <typename F, typename... Ts>
+[[nodiscard]] Rewrite apply_pattern(Window window) {
+    return [&]<std::size_t... I>(std::index_sequence<I...>) -> Rewrite {
+        if (!(matches<Ts>(window[I]) && ...)) {
+            return std::nullopt;
+        }
+        return F{}(as<Ts>(window[I])...);
+    }(std::index_sequence_for<Ts...>{});
+}
+
+template <typename... Ts, typename F>
+[[nodiscard]] constexpr Rule rule(std::string_view name, F) {
+    return Rule{name, sizeof...(Ts), &apply_pattern<F, Ts...>};
+}
+
+[[nodiscard]] bool same(const Register& lhs, const Register& rhs) {
+    const auto* left = std::get_if<HardcodedRegister>(&lhs);
+    const auto* right = std::get_if<HardcodedRegister>(&rhs);
+    return left != nullptr && right != nullptr && *left == *right;
+}
+
+[[nodiscard]] int size_of(const Register& reg) {
+    return std::visit([](const auto& r) { return r.size; }, reg);
+}
+
+[[nodiscard]] Rewrite replace(std::vector<Instruction> instructions) {
+    return instructions;
+}
+
+constexpr auto rules = std::array{
+    rule<Jump, Label>("jump-to-next",
+                      [](const Jump& jump, const Label& label) -> Rewrite {
+                          if (jump.label != label.name) {
+                              return std::nullopt;
+                          }
+                          return replace({label});
+                      }),
+    rule<Jump, Instruction>(
+        "unreachable",
+        [](const Jump& jump, const Instruction& next) -> Rewrite {
+            if (std::holds_alternative<Label>(next)) {
+                return std::nullopt;
+            }
+            return replace({jump});
+        }),
+    rule<TailCall, Instruction>(
+        "unreachable",
+        [](const TailCall& tail, const Instruction& next) -> Rewrite {
+            if (std::holds_alternative<Label>(next)) {
+                return std::nullopt;
+            }
+            return replace({tail});
+        }),
+    rule<Mov>("self-move",
+              [](const Mov& mov) -> Rewrite {
+                  if (!same(mov.dst, mov.src) ||
+                      size_of(mov.dst) != size_of(mov.src)) {
+                      return std::nullopt;
+                  }
+                  return replace({});
+              }),
+    rule<Mov, Mov>("move-back",
+                   [](const Mov& first, const Mov& second) -> Rewrite {
+                       if (!same(first.dst, second.src) ||
+                           !same(first.src, second.dst)) {
+                           return std::nullopt;
+                       }
+                       return replace({first});
+                   }),
+    // the loaded register gets a copy of what was stored instead
+    rule<Store, Load>(
+        "store-load",
+        [](const Store& store, const Load& load) -> Rewrite {
+            if (store.dst.offset != load.src.offset ||
+                size_of(store.src) != size_of(load.dst)) {
+                return std::nullopt;
+            }
+            if (same(store.src, load.dst)) {
+                return replace({store});
+            }
+            return replace({store, Mov{.dst = load.dst, .src = store.src}});
+        }),
+    rule<Load, Store>("load-store",
+                      [](const Load& load, const Store& store) -> Rewrite {
+                          if (store.dst.offset != load.src.offset ||
+                              size_of(load.dst) != size_of(store.src) ||
+                              !same(load.dst, store.src)) {
+                              return std::nullopt;
+                          }
+                          return replace({load});
+                      }),
+    rule<Store, Store>("dead-store",
+                       [](const Store& first, const Store& second) -> Rewrite {
+                           if (first.dst.offset != second.dst.offset ||
+                               size_of(first.src) != size_of(second.src)) {
+                               return std::nullopt;
+                           }
+                           return replace({second});
+                       }),
+    rule<AddI>("add-zero",
+               [](const AddI& add) -> Rewrite {
+                   if (add.value != 0) {
+                       return std::nullopt;
+                   }
+                   return replace({});
+               }),
+    rule<SubI>("sub-zero",
+               [](const SubI& sub) -> Rewrite {
+                   if (sub.value != 0) {
+                       return std::nullopt;
+                   }
+                   return replace({});
+               }),
+};
+
+constexpr auto widest = std::ranges::max(
+    rules, {}, [](const Rule& rule) { return rule.size; }).size;
+}  // namespace
+
+int Peephole(Frame& frame, PeepholeStats& stats) {
+    auto& code = frame.instructions;
+    // codegen puts the epilogue's label after the last instruction
+    code.emplace_back(Label{.name = "end"});
+    // code[0, kept) is final so far, code[i, end) is still to be read, no
+    // rule grows its window so a rewrite fits into the window it replaces
+    const auto at = [&](std::size_t index) {
+        return code.begin() + static_cast<std::ptrdiff_t>(index);
+    };
+    int rewritten = 0;
+    std::size_t kept = 0;
+    std::size_t i = 0;
+    while (i < code.size()) {
+        Rewrite replacement;
+        const auto fired = std::ranges::find_if(rules, [&](const Rule& rule) {
+            if (i + rule.size > code.size()) {
+                return false;
+            }
+            replacement = rule.apply(Window(code).subspan(i, rule.size));
+            return replacement.has_value();
+        });
+        if (fired == rules.end()) {
+            if (kept != i) {
+                code[kept] = std::move(code[i]);
+            }
+            kept++;
+            i++;
+            continue;
+        }
+        assert(replacement->size() <= fired->size);
+        i += fired->size - replacement->size();
+        std::ranges::move(*replacement, at(i));
+        stats.fired[std::string(fired->name)]++;
+        rewritten++;
+        // windows that start before the rewrite may match now, so the tail
+        // of what was kept is read again
+        const auto back = std::min(kept, widest - 1);
+        if (kept != i) {
+            std::move_backward(at(kept - back), at(kept), at(i));
+        }
+        kept -= back;
+        i -= back;
+    }
+    code.resize(kept);
+    // no rule removes a label
+    code.pop_back();
+    return rewritten;
+}
+}  // namespace target
\ No newline at end of file
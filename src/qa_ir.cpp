@@ -43,7 +43,7 @@ std::ostream& operator<<(std::ostream& os, const Operation& ins) {
         os << "cj " << cj.trueLabel << ", " << cj.falseLabel;
     } else if (std::holds_alternative<LabelDef>(ins)) {
         const auto& label = std::get<LabelDef>(ins);
-        os << label.label << ":";
+        os << (label.align ? "align " : "") << label.label << ":";
     } else if (std::holds_alternative<Compare>(ins)) {
         const auto& cmp = std::get<Compare>(ins);
         os << "cmp " << cmp.left << ", " << cmp.right;
@@ -81,6 +81,13 @@ std::ostream& operator<<(std::ostream& os, const Operation& ins) {
     } else if (std::holds_alternative<NotEqual>(ins)) {
         const auto& neq = std::get<NotEqual>(ins);
         os << "neq " << neq.dst << ", " << neq.left << ", " << neq.right;
+    } else if (std::holds_alternative<Phi>(ins)) {
+        const auto& phi = std::get<Phi>(ins);
+        os << "phi " << phi.dst;
+        for (const auto& incoming : phi.args) {
+            os << ", [" << incoming.predecessor << ": " << incoming.value
+               << "]";
+        }
     } else {
         throw std::runtime_error("Unknown instruction type " +
                                  std::to_string(ins.index()));
@@ -109,6 +116,69 @@ Label get_false_label(const CondJ& condj) {
     }
 }
 
+Value* defined_value(Operation& op) {
+    return std::visit(
+        [](auto& arg) -> Value* {
+            using T = std::decay_t<decltype(arg)>;
+            // a DerefStore writes through dst, it does not write dst itself
+            if constexpr (requires { arg.dst; } &&
+                          !std::is_same_v<T, DerefStore>) {
+                return &arg.dst;
+            }
+            return nullptr;
+        },
+        op);
+}
+
+const Value* defined_value(const Operation& op) {
+    return defined_value(const_cast<Operation&>(op));
+}
+
+bool is_terminator(const Operation& op) {
+    return std::holds_alternative<Jump>(op) ||
+           std::holds_alternative<Ret>(op) ||
+           std::holds_alternative<ConditionalJumpEqual>(op) ||
+           std::holds_alternative<ConditionalJumpGreater>(op) ||
+           std::holds_alternative<ConditionalJumpLess>(op);
+}
+
+std::vector<Label> successor_labels(const Operation& op) {
+    return std::visit(
+        [](const auto& arg) -> std::vector<Label> {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, Jump>) {
+                return {arg.label};
+            } else if constexpr (std::is_same_v<T, ConditionalJumpEqual> ||
+                                 std::is_same_v<T, ConditionalJumpGreater> ||
+                                 std::is_same_v<T, ConditionalJumpLess>) {
+                return {arg.trueLabel, arg.falseLabel};
+            }
+            return {};
+        },
+        op);
+}
+
+void retarget(Operation& op, const std::string& from, const Label& to) {
+    auto follow = [&](Label& label) {
+        if (label.name == from) {
+            label = to;
+        }
+    };
+    std::visit(
+        [&follow](auto& arg) {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, Jump>) {
+                follow(arg.label);
+            } else if constexpr (std::is_same_v<T, ConditionalJumpEqual> ||
+                                 std::is_same_v<T, ConditionalJumpGreater> ||
+                                 std::is_same_v<T, ConditionalJumpLess>) {
+                follow(arg.trueLabel);
+                follow(arg.falseLabel);
+            }
+        },
+        op);
+}
+
 bool operator<(const Temp& lhs, const Temp& rhs) { return lhs.id < rhs.id; }
 
 std::ostream& operator<<(std::ostream& os, const Temp& temp) {
@@ -1,5 +1,7 @@
 #include "../include/qa_x86.hpp"
 
+#include <algorithm>
+
 namespace target {
 [[nodiscard]] std::string to_asm(const Mov& mov) {
     auto dst = std::get<HardcodedRegister>(mov.dst);
@@ -51,6 +53,9 @@ std::ostream& operator<<(std::ostream& os, BaseRegister reg) {
         case BaseRegister::R15:
             os << "r15";
             break;
+        case BaseRegister::BP:
+            os << "bp";
+            break;
     }
     return os;
 }
@@ -85,6 +90,8 @@ std::ostream& operator<<(std::ostream& os, BaseRegister reg) {
             return size == 4 ? "r14d" : "r14";
         case BaseRegister::R15:
             return size == 4 ? "r15d" : "r15";
+        case BaseRegister::BP:
+            return size == 4 ? "ebp" : "rbp";
         default:
             throw std::runtime_error("to_asm not implemented");
     }
@@ -149,7 +156,7 @@ std::ostream& operator<<(std::ostream& os, const Instruction& ins) {
         os << "cmp " << cmp.dst << " -> " << cmp.src;
     } else if (std::holds_alternative<Label>(ins)) {
         const auto label = std::get<Label>(ins);
-        os << label.name << ":";
+        os << (label.align ? "align " : "") << label.name << ":";
     } else if (std::holds_alternative<JumpEq>(ins)) {
         const auto jumpEq = std::get<JumpEq>(ins);
         os << "je " << jumpEq.label;
@@ -189,6 +196,52 @@ std::ostream& operator<<(std::ostream& os, const Instruction& ins) {
     } else if (std::holds_alternative<SetNeAl>(ins)) {
         const auto setAl = std::get<SetNeAl>(ins);
         os << "SetNeAl " << setAl.dst;
+    } else if (std::holds_alternative<TailCall>(ins)) {
+        const auto tail = std::get<TailCall>(ins);
+        os << "tailcall " << tail.name;
+    } else if (std::holds_alternative<JumpNotEq>(ins)) {
+        os << "jne " << std::get<JumpNotEq>(ins).label;
+    } else if (std::holds_alternative<JumpGreaterEq>(ins)) {
+        os << "jge " << std::get<JumpGreaterEq>(ins).label;
+    } else if (std::holds_alternative<JumpLessEq>(ins)) {
+        os << "jle " << std::get<JumpLessEq>(ins).label;
+    } else if (std::holds_alternative<Test>(ins)) {
+        os << "test " << std::get<Test>(ins).dst;
+    } else if (std::holds_alternative<CmpM>(ins)) {
+        const auto cmpM = std::get<CmpM>(ins);
+        os << "cmpM " << cmpM.src << " to -> " << cmpM.dst;
+    } else if (std::holds_alternative<CmpMI>(ins)) {
+        const auto cmpMI = std::get<CmpMI>(ins);
+        os << "cmpMI " << cmpMI.value << " to -> " << cmpMI.dst;
+    } else if (std::holds_alternative<Inc>(ins)) {
+        os << "inc " << std::get<Inc>(ins).dst;
+    } else if (std::holds_alternative<Dec>(ins)) {
+        os << "dec " << std::get<Dec>(ins).dst;
+    } else if (std::holds_alternative<IncM>(ins)) {
+        os << "incM " << std::get<IncM>(ins).dst;
+    } else if (std::holds_alternative<DecM>(ins)) {
+        os << "decM " << std::get<DecM>(ins).dst;
+    } else if (std::holds_alternative<AddM>(ins)) {
+        const auto addM = std::get<AddM>(ins);
+        os << "addM " << addM.src << " -> " << addM.dst;
+    } else if (std::holds_alternative<SubM>(ins)) {
+        const auto subM = std::get<SubM>(ins);
+        os << "subM " << subM.src << " -> " << subM.dst;
+    } else if (std::holds_alternative<AddRM>(ins)) {
+        const auto addRM = std::get<AddRM>(ins);
+        os << "addRM " << addRM.src << " -> " << addRM.dst;
+    } else if (std::holds_alternative<SubRM>(ins)) {
+        const auto subRM = std::get<SubRM>(ins);
+        os << "subRM " << subRM.src << " -> " << subRM.dst;
+    } else if (std::holds_alternative<AddIndirect>(ins)) {
+        const auto add = std::get<AddIndirect>(ins);
+        os << "add [" << add.src << "] -> " << add.dst;
+    } else if (std::holds_alternative<SubIndirect>(ins)) {
+        const auto sub = std::get<SubIndirect>(ins);
+        os << "sub [" << sub.src << "] -> " << sub.dst;
+    } else if (std::holds_alternative<LeaOffset>(ins)) {
+        const auto lea = std::get<LeaOffset>(ins);
+        os << "lea " << lea.src << " + " << lea.offset << " -> " << lea.dst;
     } else {
         throw std::runtime_error("Unsupported instruction type");
     }
@@ -279,4 +332,75 @@ void set_dest_register(Instruction& ins, Register reg) {
         ins);
 }
 
+bool reads_dest(const Instruction& ins) {
+    return std::holds_alternative<Add>(ins) ||
+           std::holds_alternative<Sub>(ins) ||
+           std::holds_alternative<AddI>(ins) ||
+           std::holds_alternative<SubI>(ins) ||
+           std::holds_alternative<Inc>(ins) ||
+           std::holds_alternative<Dec>(ins) ||
+           std::holds_alternative<AddRM>(ins) ||
+           std::holds_alternative<SubRM>(ins) ||
+           std::holds_alternative<AddIndirect>(ins) ||
+           std::holds_alternative<SubIndirect>(ins) ||
+           std::holds_alternative<Cmp>(ins) ||
+           std::holds_alternative<CmpI>(ins) ||
+           std::holds_alternative<CmpM>(ins) ||
+           std::holds_alternative<Test>(ins) ||
+           std::holds_alternative<IndirectStore>(ins);
+}
+
+bool writes_dest(const Instruction& ins) {
+    if (std::holds_alternative<Cmp>(ins) || std::holds_alternative<CmpI>(ins) ||
+        std::holds_alternative<CmpM>(ins) ||
+        std::holds_alternative<Test>(ins) ||
+        std::holds_alternative<IndirectStore>(ins)) {
+        return false;
+    }
+    return std::visit(
+        [](auto&& arg) { return HasRegisterDest<decltype(arg)>; }, ins);
+}
+
+bool is_jump(const Instruction& ins) {
+    return std::holds_alternative<Jump>(ins) ||
+           std::holds_alternative<JumpEq>(ins) ||
+           std::holds_alternative<JumpGreater>(ins) ||
+           std::holds_alternative<JumpLess>(ins) ||
+           std::holds_alternative<JumpNotEq>(ins) ||
+           std::holds_alternative<JumpGreaterEq>(ins) ||
+           std::holds_alternative<JumpLessEq>(ins) ||
+           std::holds_alternative<TailCall>(ins);
+}
+
+bool pushes_arguments(const Frame& frame) {
+    return std::ranges::any_of(frame.instructions, [](const auto& ins) {
+        return std::holds_alternative<Push>(ins) ||
+               std::holds_alternative<PushI>(ins);
+    });
+}
+
+bool makes_calls(const Frame& frame) {
+    return std::ranges::any_of(frame.instructions, [](const auto& ins) {
+        return std::holds_alternative<Call>(ins);
+    });
+}
+
+std::optional<std::string> jump_label(const Instruction& ins) {
+    return std::visit(
+        [](auto&& arg) -> std::optional<std::string> {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, Jump> ||
+                          std::is_same_v<T, JumpEq> ||
+                          std::is_same_v<T, JumpGreater> ||
+                          std::is_same_v<T, JumpLess> ||
+                          std::is_same_v<T, JumpNotEq> ||
+                          std::is_same_v<T, JumpGreaterEq> ||
+                          std::is_same_v<T, JumpLessEq>) {
+                return arg.label;
+            }
+            return std::nullopt;
+        },
+        ins);
+}
+
 }  // namespace target
\ No newline at end of file
@@ -0,0 +1,358 @@
+#include "../include/sccp.hpp"
+
+#include <algorithm>
+#include <ranges>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+#include "../include/simplify.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// Top: no definition has been seen to run yet, Bottom: varies at run time
+struct Lattice {
+    enum class State { Top, Constant, Bottom };
+    State state = State::Top;
+    int value = 0;
+
+    bool operator==(const Lattice&) const = default;
+};
+
+constexpr Lattice bottom{.state = Lattice::State::Bottom, .value = 0};
+
+[[nodiscard]] Lattice constant(int value) {
+    return Lattice{.state = Lattice::State::Constant, .value = value};
+}
+
+[[nodiscard]] Lattice meet(const Lattice& a, const Lattice& b) {
+    if (a.state == Lattice::State::Top) {
+        return b;
+    }
+    if (b.state == Lattice::State::Top) {
+        return a;
+    }
+    if (a.state == Lattice::State::Constant &&
+        b.state == Lattice::State::Constant && a.value == b.value) {
+        return a;
+    }
+    return bottom;
+}
+
+[[nodiscard]] int temp_count(const Frame& frame) {
+    int count = 0;
+    auto see = [&count](const Value& value) {
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            count = std::max(count, temp->id + 1);
+        }
+    };
+    for (const auto& op : frame.instructions) {
+        if (const auto* dst = defined_value(op)) {
+            see(*dst);
+        }
+        for_each_used_value(op, see);
+    }
+    return count;
+}
+
+[[nodiscard]] bool is_conditional_jump(const Operation& op) {
+    return successor_labels(op).size() == 2;
+}
+
+struct ConstantPropagation {
+    const Frame& frame;
+    const ControlFlowGraph& cfg;
+    // block of every operation
+    std::vector<int> blockOf = {};
+    std::vector<Lattice> values = {};
+    // operations reading each temp
+    std::vector<std::vector<int>> uses = {};
+    std::set<std::pair<int, int>> executableEdges = {};
+    std::vector<bool> executableBlocks = {};
+    std::vector<std::pair<int, int>> flowWorklist = {};
+    std::vector<int> ssaWorklist = {};
+
+    ConstantPropagation(const Frame& frame, const ControlFlowGraph& cfg)
+        : frame(frame),
+          cfg(cfg),
+          blockOf(frame.instructions.size(), 0),
+          values(temp_count(frame)),
+          uses(values.size()),
+          executableBlocks(cfg.blocks.size(), false) {
+        for (const auto& [b, block] : cfg.blocks | std::views::enumerate) {
+            for (int i = block.begin; i < block.end; i++) {
+                blockOf[i] = static_cast<int>(b);
+                for_each_used_value(
+                    frame.instructions[i], [&](const Value& value) {
+                        if (const auto* temp = std::get_if<Temp>(&value)) {
+                            uses[temp->id].push_back(i);
+                        }
+                    });
+            }
+        }
+    }
+
+    [[nodiscard]] bool executable(int from, int to) const {
+        return executableEdges.contains({from, to});
+    }
+
+    [[nodiscard]] Lattice valueOf(const Value& value) const {
+        if (const auto* literal = std::get_if<int>(&value)) {
+            return constant(*literal);
+        }
+        if (const auto* temp = std::get_if<Temp>(&value)) {
+            return values[temp->id];
+        }
+        // variables left in memory and hardcoded registers
+        return bottom;
+    }
+
+    [[nodiscard]] Lattice evaluate(int i) const {
+        const auto& op = frame.instructions[i];
+        return std::visit(
+            [&](const auto& arg) -> Lattice {
+                using T = std::decay_t<decltype(arg)>;
+                if constexpr (std::is_same_v<T, Mov>) {
+                    return valueOf(arg.src);
+                } else if constexpr (std::is_same_v<T, Add> ||
+                                     std::is_same_v<T, Sub> ||
+                                     std::is_same_v<T, Equal> ||
+                                     std::is_same_v<T, NotEqual> ||
+                                     std::is_same_v<T, GreaterThan>) {
+                    const auto left = valueOf(arg.left);
+                    const auto right = valueOf(arg.right);
+                    if (left == bottom || right == bottom) {
+                        return bottom;
+                    }
+                    if (left.state == Lattice::State::Top ||
+                        right.state == Lattice::State::Top) {
+                        return Lattice{};
+                    }
+                    return constant(
+                        EvaluateBinary(op, left.value, right.value).value());
+                } else if constexpr (std::is_same_v<T, Phi>) {
+                    const auto to = blockOf[i];
+                    auto result = Lattice{};
+                    for (const auto& incoming : arg.args) {
+                        const auto from =
+                            cfg.blockOf.at(incoming.predecessor.name);
+                        if (executable(from, to)) {
+                            result = meet(result, valueOf(incoming.value));
+                        }
+                    }
+                    return result;
+                }
+                // loads, calls and parameters
+                return bottom;
+            },
+            op);
+    }
+
+    void markEdge(int from, int to) {
+        if (!executable(from, to)) {
+            flowWorklist.emplace_back(from, to);
+        }
+    }
+
+    // the successors a conditional jump can continue at given the Compare
+    // right before it
+    void visitBranch(int jump) {
+        const auto& op = frame.instructions[jump];
+        const auto b = blockOf[jump];
+        const auto labels = successor_labels(op);
+        const auto* compare =
+            jump > cfg.blocks[b].begin
+                ? std::get_if<Compare>(&frame.instructions[jump - 1])
+                : nullptr;
+        auto left = bottom;
+        auto right = bottom;
+        if (compare != nullptr) {
+            left = valueOf(compare->left);
+            right = valueOf(compare->right);
+        }
+        if (left.state == Lattice::State::Top ||
+            right.state == Lattice::State::Top) {
+            return;
+        }
+        if (left.state == Lattice::State::Constant &&
+            right.state == Lattice::State::Constant) {
+            const auto taken = EvaluateBranch(op, left.value, right.value);
+            markEdge(b, cfg.blockOf.at(labels.at(taken ? 0 : 1).name));
+            return;
+        }
+        for (const auto& label : labels) {
+            markEdge(b, cfg.blockOf.at(label.name));
+        }
+    }
+
+    void visit(int i) {
+        const auto& op = frame.instructions[i];
+        if (std::holds_alternative<Compare>(op)) {
+            if (i + 1 < cfg.blocks[blockOf[i]].end &&
+                is_conditional_jump(frame.instructions[i + 1])) {
+                visitBranch(i + 1);
+            }
+            return;
+        }
+        if (is_conditional_jump(op)) {
+            visitBranch(i);
+            return;
+        }
+        if (const auto* jump = std::get_if<Jump>(&op)) {
+            markEdge(blockOf[i], cfg.blockOf.at(jump->label.name));
+            return;
+        }
+        const auto* dst = defined_value(op);
+        const auto* temp = dst == nullptr ? nullptr : std::get_if<Temp>(dst);
+        if (temp == nullptr) {
+            return;
+        }
+        const auto value = evaluate(i);
+        if (value != values[temp->id]) {
+            values[temp->id] = value;
+            ssaWorklist.insert(ssaWorklist.end(), uses[temp->id].begin(),
+                               uses[temp->id].end());
+        }
+    }
+
+    void solve() {
+        const auto blocks = static_cast<int>(cfg.blocks.size());
+        if (blocks == 0) {
+            return;
+        }
+        flowWorklist.emplace_back(-1, 0);
+        while (!flowWorklist.empty() || !ssaWorklist.empty()) {
+            while (!flowWorklist.empty()) {
+                const auto [from, to] = flowWorklist.back();
+                flowWorklist.pop_back();
+                if (from >= 0 && !executableEdges.emplace(from, to).second) {
+                    continue;
+                }
+                const auto& block = cfg.blocks[to];
+                if (executableBlocks[to]) {
+                    // only the phis can see the new edge
+                    for (int i = block.begin + 1; i < block.end; i++) {
+                        if (!std::holds_alternative<Phi>(
+                                frame.instructions[i])) {
+                            break;
+                        }
+                        visit(i);
+                    }
+                    continue;
+                }
+                executableBlocks[to] = true;
+                for (int i = block.begin; i < block.end; i++) {
+                    visit(i);
+                }
+                if (!is_terminator(frame.instructions[block.end - 1]) &&
+                    to + 1 < blocks) {
+                    markEdge(to, to + 1);
+                }
+            }
+            while (!ssaWorklist.empty()) {
+                const auto i = ssaWorklist.back();
+                ssaWorklist.pop_back();
+                if (executableBlocks[blockOf[i]]) {
+                    visit(i);
+                }
+            }
+        }
+    }
+};
+}  // namespace
+
+int PropagateConstants(Frame& frame, FrameAnalyses& analyses) {
+    const auto& cfg = analyses.CFG();
+    ConstantPropagation solver(frame, cfg);
+    solver.solve();
+
+    auto& ops = frame.instructions;
+    const auto before = ops.size();
+    auto isConstant = [&solver](const Value& value) {
+        const auto* temp = std::get_if<Temp>(&value);
+        return temp != nullptr && solver.values[temp->id].state ==
+                                      Lattice::State::Constant;
+    };
+    std::vector<bool> dead(ops.size(), false);
+    for (const auto& [b, block] : cfg.blocks | std::views::enumerate) {
+        if (!solver.executableBlocks[b]) {
+            std::fill(dead.begin() + block.begin, dead.begin() + block.end,
+                      true);
+            continue;
+        }
+        for (int i = block.begin; i < block.end; i++) {
+            auto& op = ops[i];
+            for_each_immediate_operand(op, [&](Value& value) {
+                if (isConstant(value)) {
+                    value = solver.values[std::get<Temp>(value).id].value;
+                }
+            });
+            if (auto* phi = std::get_if<Phi>(&op)) {
+                std::erase_if(phi->args, [&](const PhiArgument& incoming) {
+                    const auto from =
+                        cfg.blockOf.at(incoming.predecessor.name);
+                    return !solver.executable(from, static_cast<int>(b));
+                });
+                if (phi->args.size() == 1) {
+                    op = Mov{.dst = phi->dst, .src = phi->args.front().value};
+                }
+            }
+        }
+        // a conditional jump with one executable successor
+        const auto last = block.end - 1;
+        const auto labels = successor_labels(ops[last]);
+        if (labels.size() != 2) {
+            continue;
+        }
+        std::vector<Label> taken;
+        for (const auto& label : labels) {
+            if (solver.executable(static_cast<int>(b),
+                                  cfg.blockOf.at(label.name))) {
+                taken.push_back(label);
+            }
+        }
+        if (taken.size() == 1) {
+            ops[last] = Jump{.label = taken.front()};
+            if (last > block.begin &&
+                std::holds_alternative<Compare>(ops[last - 1])) {
+                dead[last - 1] = true;
+            }
+        }
+    }
+
+    // the definitions of constants nothing reads any more
+    std::vector<bool> read(solver.values.size(), false);
+    for (const auto& [i, op] : ops | std::views::enumerate) {
+        if (dead[i]) {
+            continue;
+        }
+        for_each_used_value(op, [&read](const Value& value) {
+            if (const auto* temp = std::get_if<Temp>(&value)) {
+                read[temp->id] = true;
+            }
+        });
+    }
+    for (const auto& [i, op] : ops | std::views::enumerate) {
+        const auto* dst = defined_value(op);
+        if (dst != nullptr && isConstant(*dst) &&
+            !read[std::get<Temp>(*dst).id]) {
+            dead[i] = true;
+        }
+    }
+
+    std::vector<Operation> kept;
+    kept.reserve(ops.size());
+    for (auto&& [i, op] : ops | std::views::enumerate) {
+        if (!dead[i]) {
+            kept.push_back(std::move(op));
+        }
+    }
+    ops = std::move(kept);
+    return static_cast<int>(before - ops.size());
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,407 @@
+#include "../include/scev.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace qa_ir {
+
+namespace {
+
+// the most coefficients past the first a recurrence may have
+constexpr int kMaxDegree = 3;
+
+[[nodiscard]] bool is_zero(const Invariant& value) {
+    return value.constant == 0 && value.terms.empty();
+}
+
+// self * (the phi being solved) + the recurrence of the rest
+struct Evolution {
+    int self = 0;
+    std::vector<Invariant> coefficients = {};
+};
+
+[[nodiscard]] Evolution combine(Evolution a, const Evolution& b, int sign) {
+    a.self += sign * b.self;
+    a.coefficients.resize(
+        std::max(a.coefficients.size(), b.coefficients.size()));
+    for (std::size_t k = 0; k < b.coefficients.size(); k++) {
+        a.coefficients[k] =
+            AddInvariants(a.coefficients[k], b.coefficients[k], sign);
+    }
+    while (!a.coefficients.empty() && is_zero(a.coefficients.back())) {
+        a.coefficients.pop_back();
+    }
+    return a;
+}
+
+class Evolutions {
+   public:
+    Evolutions(const Frame& frame, const ControlFlowGraph& cfg,
+               const Loop& loop, const CountedLoop& counted)
+        : ops_(frame.instructions), counted_(counted) {
+        for (const auto b : loop.blocks) {
+            for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                if (const auto* dst = defined_value(ops_[i])) {
+                    if (const auto* temp = std::get_if<Temp>(dst)) {
+                        definitions_[temp->id] = i;
+                    }
+                }
+            }
+        }
+    }
+
+    // how value changes from trip to trip while self is being solved
+    [[nodiscard]] std::optional<Evolution> of(const Value& value, int self) {
+        if (const auto* literal = std::get_if<int>(&value)) {
+            return Evolution{.self = 0,
+                             .coefficients = {{.constant = *literal}}};
+        }
+        const auto* temp = std::get_if<Temp>(&value);
+        // only ints wrap around the way the recurrences do
+        if (temp == nullptr || temp->size != 4) {
+            return std::nullopt;
+        }
+        if (temp->id == self) {
+            return Evolution{.self = 1};
+        }
+        const auto it = definitions_.find(temp->id);
+        if (it == definitions_.end()) {
+            return Evolution{
+                .self = 0,
+                .coefficients = {{.constant = 0, .terms = {{1, *temp}}}}};
+        }
+        const auto key = std::pair{temp->id, self};
+        if (const auto known = memo_.find(key); known != memo_.end()) {
+            return known->second;
+        }
+        auto evolution = defined_by(ops_[it->second], self);
+        memo_.emplace(key, evolution);
+        return evolution;
+    }
+
+   private:
+    [[nodiscard]] std::optional<Evolution> defined_by(const Operation& op,
+                                                      int self) {
+        if (const auto* add = std::get_if<Add>(&op)) {
+            const auto left = of(add->left, self);
+            const auto right = of(add->right, self);
+            return left && right ? std::optional{combine(*left, *right, 1)}
+                                 : std::nullopt;
+        }
+        if (const auto* sub = std::get_if<Sub>(&op)) {
+            const auto left = of(sub->left, self);
+            const auto right = of(sub->right, self);
+            return left && right ? std::optional{combine(*left, *right, -1)}
+                                 : std::nullopt;
+        }
+        if (const auto* mov = std::get_if<Mov>(&op)) {
+            return of(mov->src, self);
+        }
+        if (const auto* phi = std::get_if<Phi>(&op)) {
+            return solve(std::get<Temp>(phi->dst));
+        }
+        return std::nullopt;
+    }
+
+    // a header phi grows by the evolution of what the latch hands back
+    // minus itself
+    [[nodiscard]] std::optional<Evolution> solve(const Temp& phi) {
+        const auto values = std::ranges::find_if(
+            counted_.phis,
+            [&](const HeaderPhi& values) { return values.phi.id == phi.id; });
+        if (values == counted_.phis.end() || solving_.contains(phi.id)) {
+            return std::nullopt;
+        }
+        const auto init = of(values->entry, -1);
+        solving_.insert(phi.id);
+        const auto step = of(values->next, phi.id);
+        solving_.erase(phi.id);
+        if (!init.has_value() || init->coefficients.size() > 1 ||
+            !step.has_value() || step->self != 1 ||
+            static_cast<int>(step->coefficients.size()) > kMaxDegree) {
+            return std::nullopt;
+        }
+        Evolution evolution{.self = 0, .coefficients = init->coefficients};
+        evolution.coefficients.resize(1);
+        evolution.coefficients.insert(evolution.coefficients.end(),
+                                      step->coefficients.begin(),
+                                      step->coefficients.end());
+        return combine(evolution, {}, 1);
+    }
+
+    const std::vector<Operation>& ops_;
+    const CountedLoop& counted_;
+    // temps defined in the loop and the operation defining them
+    std::map<int, int> definitions_ = {};
+    std::map<std::pair<int, int>, std::optional<Evolution>> memo_ = {};
+    std::set<int> solving_ = {};
+};
+
+// C(n, k) wrapped to an int, for k up to kMaxDegree
+[[nodiscard]] int binomial(long long n, int k) {
+    std::vector<long long> factors;
+    for (int j = 0; j < k; j++) {
+        factors.push_back(n - j);
+    }
+    // k consecutive integers hold a multiple of each d up to k, and one of
+    // them is still even after taking out the 3
+    for (int d = k; d > 1; d--) {
+        *std::ranges::find_if(factors, [d](long long f) {
+            return f % d == 0;
+        }) /= d;
+    }
+    unsigned long long product = 1;
+    for (const auto f : factors) {
+        product *= static_cast<unsigned long long>(f);
+    }
+    return static_cast<int>(static_cast<unsigned>(product));
+}
+
+[[nodiscard]] bool has_effects(const Operation& op) {
+    const auto* dst = defined_value(op);
+    return std::holds_alternative<Call>(op) ||
+           std::holds_alternative<DerefStore>(op) ||
+           std::holds_alternative<Ret>(op) ||
+           std::holds_alternative<MovR>(op) ||
+           std::holds_alternative<DefineStackPushed>(op) ||
+           (dst != nullptr && !std::holds_alternative<Temp>(*dst));
+}
+
+// the trips the loop makes, valid once it has entered the body
+[[nodiscard]] std::optional<Invariant> trips_of(const Frame& frame,
+                                                const std::set<int>& defined,
+                                                const CountedLoop& counted) {
+    if (const auto trips = ConstantTripCount(frame, counted)) {
+        return Invariant{.constant = *trips};
+    }
+    const auto& compare = std::get<Compare>(frame.instructions[counted.test]);
+    const auto& jump = frame.instructions[counted.test + 1];
+    const auto& bound = counted.side == 0 ? compare.right : compare.left;
+    const auto& counter = counted.counter;
+    const auto* temp = std::get_if<Temp>(&bound);
+    if (temp == nullptr || temp->size != 4 || defined.contains(temp->id) ||
+        counter.phi.size != 4 || !counter.step.terms.empty() ||
+        successor_labels(jump)[0].name != counted.body ||
+        std::holds_alternative<ConditionalJumpEqual>(jump)) {
+        return std::nullopt;
+    }
+    // counting one at a time up to or down to the bound, the counter meets it
+    const auto increasing = std::holds_alternative<ConditionalJumpLess>(jump) ==
+                            (counted.side == 0);
+    if (counter.step.constant != (increasing ? 1 : -1)) {
+        return std::nullopt;
+    }
+    const Invariant limit{.constant = 0, .terms = {{1, *temp}}};
+    return increasing ? AddInvariants(limit, counter.init, -1)
+                      : AddInvariants(counter.init, limit, -1);
+}
+
+// Sends the header to a block computing the values the loop would leave
+// behind instead of to the body, which nothing reaches anymore.
+bool evaluate_exit_values(Frame& frame, FreshNames& names,
+                          const ControlFlowGraph& cfg,
+                          const DominatorTree& tree, const Loop& loop,
+                          const std::string& preheader) {
+    auto& ops = frame.instructions;
+    const auto counted = FindCountedLoop(frame, cfg, tree, loop, preheader);
+    if (!counted.has_value()) {
+        return false;
+    }
+    std::set<int> defined;
+    for (const auto b : loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            if (has_effects(ops[i])) {
+                return false;
+            }
+            if (const auto* dst = defined_value(ops[i])) {
+                defined.insert(std::get<Temp>(*dst).id);
+            }
+        }
+    }
+    const auto trips = trips_of(frame, defined, *counted);
+    if (!trips.has_value()) {
+        return false;
+    }
+    // the temps of the loop read after it
+    std::map<int, Temp> escaping;
+    for (int b = 0; b < static_cast<int>(cfg.blocks.size()); b++) {
+        if (loop.contains(b)) {
+            continue;
+        }
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            for_each_used_value(ops[i], [&](const Value& value) {
+                const auto* temp = std::get_if<Temp>(&value);
+                if (temp != nullptr && defined.contains(temp->id)) {
+                    escaping.emplace(temp->id, *temp);
+                }
+            });
+        }
+    }
+    const auto& headerLabel = cfg.blocks[loop.header].label;
+    const auto& exit = cfg.blocks[cfg.blockOf.at(counted->exit)];
+    if (!escaping.empty() && exit.predecessors != std::vector{loop.header}) {
+        return false;
+    }
+
+    const auto recurrences =
+        AnalyzeScalarEvolution(frame, cfg, loop, *counted);
+    const auto done = names.NewLabel();
+    std::vector<Operation> code = {LabelDef{.label = done}};
+    std::map<int, Value> finals;
+    for (const auto& [id, temp] : escaping) {
+        const auto it = recurrences.find(id);
+        if (it == recurrences.end()) {
+            return false;
+        }
+        const auto value = EvaluateAt(it->second, *trips);
+        const auto result =
+            value.has_value()
+                ? MaterializeInvariant(*value, temp.size, names, code)
+                : std::nullopt;
+        if (!result.has_value()) {
+            return false;
+        }
+        finals.emplace(id, *result);
+    }
+    code.emplace_back(Jump{.label = {exit.label}});
+
+    // past the exit the values come from the header or from the new block
+    std::map<int, Temp> merged;
+    std::vector<Operation> phis;
+    for (const auto& [id, temp] : escaping) {
+        merged.emplace(id, names.NewTemp(temp.size));
+        phis.emplace_back(Phi{
+            .dst = merged.at(id),
+            .args = {{.predecessor = {headerLabel}, .value = temp},
+                     {.predecessor = done, .value = finals.at(id)}}});
+    }
+    for (int b = 0; b < static_cast<int>(cfg.blocks.size()); b++) {
+        if (loop.contains(b)) {
+            continue;
+        }
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            auto* phi = b == cfg.blockOf.at(exit.label)
+                            ? std::get_if<Phi>(&ops[i])
+                            : nullptr;
+            if (phi == nullptr) {
+                for_each_used_value(ops[i], [&](Value& value) {
+                    const auto* temp = std::get_if<Temp>(&value);
+                    if (temp != nullptr && merged.contains(temp->id)) {
+                        value = merged.at(temp->id);
+                    }
+                });
+                continue;
+            }
+            const auto from = std::ranges::find_if(
+                phi->args, [&](const PhiArgument& incoming) {
+                    return incoming.predecessor.name == headerLabel;
+                });
+            auto value = from->value;
+            if (const auto* temp = std::get_if<Temp>(&value);
+                temp != nullptr && finals.contains(temp->id)) {
+                value = finals.at(temp->id);
+            }
+            phi->args.push_back({.predecessor = done, .value = value});
+        }
+    }
+    retarget(ops[counted->test + 1], counted->body, done);
+
+    const auto& header = cfg.blocks[loop.header];
+    std::vector<Operation> out;
+    out.reserve(ops.size() + code.size() + phis.size());
+    for (int i = 0; i < static_cast<int>(ops.size()); i++) {
+        out.push_back(std::move(ops[i]));
+        if (i + 1 == header.end) {
+            std::ranges::move(code, std::back_inserter(out));
+        } else if (i == exit.begin) {
+            std::ranges::move(phis, std::back_inserter(out));
+        }
+    }
+    ops = std::move(out);
+    return true;
+}
+}  // namespace
+
+std::map<int, AddRecurrence> AnalyzeScalarEvolution(
+    const Frame& frame, const ControlFlowGraph& cfg, const Loop& loop,
+    const CountedLoop& counted) {
+    Evolutions evolutions(frame, cfg, loop, counted);
+    std::map<int, AddRecurrence> found;
+    for (const auto b : loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            const auto* dst = defined_value(frame.instructions[i]);
+            const auto* temp =
+                dst == nullptr ? nullptr : std::get_if<Temp>(dst);
+            if (temp == nullptr) {
+                continue;
+            }
+            const auto evolution = evolutions.of(*temp, -1);
+            if (evolution.has_value() && evolution->self == 0) {
+                found.emplace(
+                    temp->id,
+                    AddRecurrence{.coefficients = evolution->coefficients});
+            }
+        }
+    }
+    return found;
+}
+
+std::optional<Invariant> EvaluateAt(const AddRecurrence& recurrence,
+                                    const Invariant& trips) {
+    const auto& coefficients = recurrence.coefficients;
+    Invariant value;
+    if (trips.terms.empty()) {
+        for (int k = 0; k < static_cast<int>(coefficients.size()); k++) {
+            value = AddInvariants(
+                value,
+                ScaleInvariant(coefficients[k], binomial(trips.constant, k)));
+        }
+        return value;
+    }
+    // without a multiplication only a constant step times trips is an
+    // Invariant
+    if (coefficients.size() > 2 ||
+        (coefficients.size() == 2 && !coefficients[1].terms.empty())) {
+        return std::nullopt;
+    }
+    if (!coefficients.empty()) {
+        value = coefficients[0];
+    }
+    if (coefficients.size() == 2) {
+        value = AddInvariants(value,
+                              ScaleInvariant(trips, coefficients[1].constant));
+    }
+    return value;
+}
+
+int EvaluateLoopExitValues(Frame& frame, FrameAnalyses& analyses) {
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    int deleted = 0;
+    const auto visit = [&](int index, const std::string& preheader) {
+        const auto& forest = analyses.Loops();
+        // an inner loop may never finish, so loops go from the inside out
+        if (!forest.children[index].empty() ||
+            !evaluate_exit_values(frame, names, analyses.CFG(),
+                                  analyses.Dominators(), forest.loops[index],
+                                  preheader)) {
+            return false;
+        }
+        // drops the body, which nothing reaches anymore
+        NormalizeBlocks(frame, names);
+        deleted++;
+        return true;
+    };
+    ForEachLoop(frame, names, analyses, visit);
+    return deleted;
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "../include/simplify.hpp"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace qa_ir {
+
+namespace {
+
+// C int arithmetic wraps around in every implementation we target
+[[nodiscard]] int wrap(std::int64_t value) {
+    return static_cast<int>(static_cast<std::uint32_t>(value));
+}
+
+[[nodiscard]] bool same_value(const Value& a, const Value& b) {
+    return std::visit(
+        [](const auto& left, const auto& right) {
+            using L = std::decay_t<decltype(left)>;
+            using R = std::decay_t<decltype(right)>;
+            if constexpr (!std::is_same_v<L, R>) {
+                return false;
+            } else if constexpr (std::is_same_v<L, Temp>) {
+                return left.id == right.id;
+            } else if constexpr (std::is_same_v<L, Variable>) {
+                return left.name == right.name;
+            } else if constexpr (std::is_same_v<L, target::HardcodedRegister>) {
+                return left.reg == right.reg;
+            } else {
+                return left == right;
+            }
+        },
+        a, b);
+}
+
+[[nodiscard]] std::optional<int> literal(const Value& value) {
+    if (const auto* constant = std::get_if<int>(&value)) {
+        return *constant;
+    }
+    return std::nullopt;
+}
+
+// the simpler operation an arithmetic or comparison with at most one literal
+// operand computes, if any
+template <typename T>
+[[nodiscard]] std::optional<Operation> simplify(T& op) {
+    const auto left = literal(op.left);
+    const auto right = literal(op.right);
+    auto move = [&op](Value src) -> Operation {
+        return Mov{.dst = op.dst, .src = std::move(src)};
+    };
+    if constexpr (std::is_same_v<T, Add>) {
+        if (right == 0) {
+            return move(op.left);
+        }
+        if (left == 0) {
+            return move(op.right);
+        }
+    } else if constexpr (std::is_same_v<T, Sub>) {
+        if (right == 0) {
+            return move(op.left);
+        }
+        if (same_value(op.left, op.right)) {
+            return move(0);
+        }
+    } else if constexpr (std::is_same_v<T, Equal>) {
+        if (same_value(op.left, op.right)) {
+            return move(1);
+        }
+    } else if constexpr (std::is_same_v<T, NotEqual>) {
+        if (same_value(op.left, op.right)) {
+            return move(0);
+        }
+    } else if constexpr (std::is_same_v<T, GreaterThan>) {
+        if (same_value(op.left, op.right)) {
+            return move(0);
+        }
+    }
+    return std::nullopt;
+}
+
+// Where the conditional jump after a Compare goes when its outcome is known.
+// Literals move to the right, mirroring the jump's condition.
+[[nodiscard]] std::optional<Label> fold_branch(Compare& compare,
+                                               Operation& jump) {
+    if (literal(compare.left) && !literal(compare.right)) {
+        std::swap(compare.left, compare.right);
+        if (auto* less = std::get_if<ConditionalJumpLess>(&jump)) {
+            jump = ConditionalJumpGreater{.trueLabel = less->trueLabel,
+                                          .falseLabel = less->falseLabel};
+        } else if (auto* greater = std::get_if<ConditionalJumpGreater>(&jump)) {
+            jump = ConditionalJumpLess{.trueLabel = greater->trueLabel,
+                                       .falseLabel = greater->falseLabel};
+        }
+    }
+    const auto left = literal(compare.left);
+    const auto right = literal(compare.right);
+    const auto same = same_value(compare.left, compare.right);
+    if (!(left && right) && !same) {
+        return std::nullopt;
+    }
+    const auto taken = same ? EvaluateBranch(jump, 0, 0)
+                            : EvaluateBranch(jump, *left, *right);
+    return successor_labels(jump).at(taken ? 0 : 1);
+}
+
+}  // namespace
+
+std::optional<int> EvaluateBinary(const Operation& op, int left, int right) {
+    const auto wide = std::int64_t{left};
+    return std::visit(
+        [&](const auto& arg) -> std::optional<int> {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, Add>) {
+                return wrap(wide + right);
+            } else if constexpr (std::is_same_v<T, Sub>) {
+                return wrap(wide - right);
+            } else if constexpr (std::is_same_v<T, Equal>) {
+                return left == right ? 1 : 0;
+            } else if constexpr (std::is_same_v<T, NotEqual>) {
+                return left != right ? 1 : 0;
+            } else if constexpr (std::is_same_v<T, GreaterThan>) {
+                return left > right ? 1 : 0;
+            }
+            return std::nullopt;
+        },
+        op);
+}
+
+bool EvaluateBranch(const Operation& jump, int left, int right) {
+    if (std::holds_alternative<ConditionalJumpLess>(jump)) {
+        return left < right;
+    }
+    if (std::holds_alternative<ConditionalJumpGreater>(jump)) {
+        return left > right;
+    }
+    return left == right;
+}
+
+int Simplify(Frame& frame) {
+    auto& ops = frame.instructions;
+    const auto before = ops.size();
+    std::map<int, int> constants;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (std::size_t i = 0; i < ops.size(); i++) {
+            for_each_immediate_operand(ops[i], [&](Value& value) {
+                const auto* temp = std::get_if<Temp>(&value);
+                if (temp == nullptr) {
+                    return;
+                }
+                if (const auto it = constants.find(temp->id);
+                    it != constants.end()) {
+                    value = it->second;
+                    changed = true;
+                }
+            });
+            auto replacement = std::visit(
+                [&op = ops[i]](auto& arg) -> std::optional<Operation> {
+                    using T = std::decay_t<decltype(arg)>;
+                    if constexpr (std::is_same_v<T, Add> ||
+                                  std::is_same_v<T, Sub> ||
+                                  std::is_same_v<T, Equal> ||
+                                  std::is_same_v<T, NotEqual> ||
+                                  std::is_same_v<T, GreaterThan>) {
+                        if constexpr (std::is_same_v<T, Add> ||
+                                      std::is_same_v<T, Equal> ||
+                                      std::is_same_v<T, NotEqual>) {
+                            // commutative, keep literals on the right
+                            if (literal(arg.left) && !literal(arg.right)) {
+                                std::swap(arg.left, arg.right);
+                            }
+                        }
+                        const auto left = literal(arg.left);
+                        const auto right = literal(arg.right);
+                        if (left && right) {
+                            const auto value =
+                                EvaluateBinary(op, *left, *right);
+                            return Mov{.dst = arg.dst, .src = value.value()};
+                        }
+                        return simplify(arg);
+                    }
+                    return std::nullopt;
+                },
+                ops[i]);
+            if (replacement.has_value()) {
+                ops[i] = std::move(replacement.value());
+                changed = true;
+            }
+            if (const auto* move = std::get_if<Mov>(&ops[i])) {
+                const auto* temp = std::get_if<Temp>(&move->dst);
+                const auto constant = literal(move->src);
+                if (temp != nullptr && constant.has_value()) {
+                    constants[temp->id] = constant.value();
+                }
+            }
+            auto* compare = std::get_if<Compare>(&ops[i]);
+            if (compare == nullptr || i + 1 == ops.size()) {
+                continue;
+            }
+            if (const auto target = fold_branch(*compare, ops[i + 1])) {
+                ops[i + 1] = Jump{.label = target.value()};
+                ops.erase(ops.begin() + static_cast<std::ptrdiff_t>(i));
+                changed = true;
+            }
+        }
+    }
+
+    // the folded constants now live in their readers
+    std::vector<bool> read;
+    for (const auto& op : ops) {
+        for_each_used_value(op, [&read](const Value& value) {
+            if (const auto* temp = std::get_if<Temp>(&value)) {
+                if (temp->id >= static_cast<int>(read.size())) {
+                    read.resize(temp->id + 1, false);
+                }
+                read[temp->id] = true;
+            }
+        });
+    }
+    std::erase_if(ops, [&](const Operation& op) {
+        const auto* move = std::get_if<Mov>(&op);
+        if (move == nullptr || !std::holds_alternative<int>(move->src)) {
+            return false;
+        }
+        const auto* temp = std::get_if<Temp>(&move->dst);
+        return temp != nullptr &&
+               (temp->id >= static_cast<int>(read.size()) || !read[temp->id]);
+    });
+    return static_cast<int>(before - ops.size());
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "../include/ssa.hpp"
+
+#include <algorithm>
+#include <map>
+#include <ranges>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// locals that mem2reg may rename, with their sizes. A variable read or
+// written at more than one size stays in memory, since its temps would mix
+// register widths.
+[[nodiscard]] std::map<std::string, int> promotable_variables(
+    const Frame& frame) {
+    std::map<std::string, int> sizes;
+    std::set<std::string> pinned;
+    auto see = [&sizes, &pinned](const Value& value) {
+        if (const auto* variable = std::get_if<Variable>(&value)) {
+            const auto [it, fresh] =
+                sizes.try_emplace(variable->name, variable->size);
+            if (!fresh && it->second != variable->size) {
+                pinned.insert(variable->name);
+            }
+        }
+    };
+    for (const auto& op : frame.instructions) {
+        if (const auto* addr = std::get_if<Addr>(&op)) {
+            pinned.insert(std::get<Variable>(addr->src).name);
+        }
+        if (const auto* pushed = std::get_if<DefineStackPushed>(&op)) {
+            pinned.insert(pushed->name);
+        }
+        if (const auto* dst = defined_value(op)) {
+            see(*dst);
+        }
+        for_each_used_value(op, see);
+    }
+    for (const auto& name : pinned) {
+        sizes.erase(name);
+    }
+    return sizes;
+}
+
+// Semi-pruned SSA: a variable only needs phis if some block reads it before
+// assigning it. Returns the blocks assigning each of those variables.
+[[nodiscard]] std::map<std::string, std::vector<int>> live_across_blocks(
+    const Frame& frame, const ControlFlowGraph& cfg,
+    const std::map<std::string, int>& promotable) {
+    std::set<std::string> global;
+    std::map<std::string, std::vector<int>> definedIn;
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    for (int b = 0; b < blocks; b++) {
+        std::set<std::string> defined;
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            const auto& op = frame.instructions[i];
+            for_each_used_value(op, [&](const Value& value) {
+                const auto* variable = std::get_if<Variable>(&value);
+                if (variable != nullptr &&
+                    promotable.contains(variable->name) &&
+                    !defined.contains(variable->name)) {
+                    global.insert(variable->name);
+                }
+            });
+            const auto* dst = defined_value(op);
+            const auto* variable =
+                dst == nullptr ? nullptr : std::get_if<Variable>(dst);
+            if (variable != nullptr && promotable.contains(variable->name) &&
+                defined.insert(variable->name).second) {
+                definedIn[variable->name].push_back(b);
+            }
+        }
+    }
+    std::erase_if(definedIn, [&global](const auto& entry) {
+        return !global.contains(entry.first);
+    });
+    return definedIn;
+}
+
+// the variables each block needs a phi for, placed on the iterated dominance
+// frontier of their assignments, only in the blocks of region if there is one
+[[nodiscard]] std::vector<std::vector<std::string>> place_phis(
+    const ControlFlowGraph& cfg, const DominatorTree& tree,
+    const std::map<std::string, std::vector<int>>& definedIn,
+    const std::set<std::string>* region) {
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    const auto frontiers = DominanceFrontiers(cfg, tree);
+    std::vector<std::vector<std::string>> phis(blocks);
+    for (const auto& [name, defining] : definedIn) {
+        std::vector<bool> hasPhi(blocks, false);
+        std::vector<bool> queued(blocks, false);
+        std::vector<int> worklist = defining;
+        for (const auto b : defining) {
+            queued[b] = true;
+        }
+        while (!worklist.empty()) {
+            const auto b = worklist.back();
+            worklist.pop_back();
+            for (const auto d : frontiers[b]) {
+                if (hasPhi[d] ||
+                    (region != nullptr &&
+                     !region->contains(cfg.blocks[d].label))) {
+                    continue;
+                }
+                hasPhi[d] = true;
+                phis[d].push_back(name);
+                if (!queued[d]) {
+                    queued[d] = true;
+                    worklist.push_back(d);
+                }
+            }
+        }
+    }
+    return phis;
+}
+
+void promote(Frame& frame, FreshNames& names,
+             const std::map<std::string, int>& promotable,
+             const std::set<std::string>* region) {
+    auto cfg = BuildCFG(frame);
+    const auto tree = ComputeDominators(cfg);
+    const auto phis = place_phis(
+        cfg, tree, live_across_blocks(frame, cfg, promotable), region);
+
+    // phis go right after the LabelDef opening their block. Blocks keep their
+    // order, so the dominator tree stays valid for the new instructions.
+    std::vector<Operation> withPhis;
+    withPhis.reserve(frame.instructions.size());
+    for (const auto& [b, block] : cfg.blocks | std::views::enumerate) {
+        withPhis.push_back(std::move(frame.instructions[block.begin]));
+        for (const auto& name : phis[b]) {
+            withPhis.emplace_back(
+                Phi{.dst = Variable{name, 0, promotable.at(name)}, .args = {}});
+        }
+        for (int i = block.begin + 1; i < block.end; i++) {
+            withPhis.push_back(std::move(frame.instructions[i]));
+        }
+    }
+    frame.instructions = std::move(withPhis);
+    cfg = BuildCFG(frame);
+
+    // rename in a preorder walk of the dominator tree, keeping the reaching
+    // definition of every variable on a stack
+    std::map<std::string, std::vector<Value>> reaching;
+    auto current = [&reaching](const std::string& name) -> Value {
+        const auto& stack = reaching[name];
+        // reading a variable that was never assigned is undefined behaviour
+        return stack.empty() ? Value{0} : stack.back();
+    };
+    auto promoted = [&promotable](const Value& value) -> const Variable* {
+        const auto* variable = std::get_if<Variable>(&value);
+        return variable != nullptr && promotable.contains(variable->name)
+                   ? variable
+                   : nullptr;
+    };
+    std::vector<std::vector<std::string>> pushed(cfg.blocks.size());
+    std::vector<std::pair<int, bool>> walk = {{0, false}};
+    while (!walk.empty()) {
+        const auto [b, leaving] = walk.back();
+        walk.pop_back();
+        if (leaving) {
+            for (const auto& name : pushed[b]) {
+                reaching[name].pop_back();
+            }
+            continue;
+        }
+        walk.emplace_back(b, true);
+        const auto& block = cfg.blocks[b];
+        for (int i = block.begin; i < block.end; i++) {
+            auto& op = frame.instructions[i];
+            if (!std::holds_alternative<Phi>(op)) {
+                for_each_used_value(op, [&](Value& value) {
+                    if (const auto* variable = promoted(value)) {
+                        value = current(variable->name);
+                    }
+                });
+            }
+            auto* dst = defined_value(op);
+            const auto* variable = dst == nullptr ? nullptr : promoted(*dst);
+            if (variable != nullptr) {
+                const auto name = variable->name;
+                *dst = names.NewTemp(variable->size);
+                reaching[name].push_back(*dst);
+                pushed[b].push_back(name);
+            }
+        }
+        for (const auto s : block.successors) {
+            const auto& successor = cfg.blocks[s];
+            for (const auto& [j, name] : phis[s] | std::views::enumerate) {
+                auto& phi = std::get<Phi>(frame.instructions[successor.begin +
+                                                             1 + j]);
+                phi.args.push_back(PhiArgument{
+                    .predecessor = Label{block.label}, .value = current(name)});
+            }
+        }
+        for (auto it = tree.children[b].rbegin();
+             it != tree.children[b].rend(); ++it) {
+            walk.emplace_back(*it, false);
+        }
+    }
+}
+}  // namespace
+
+void ConstructSSA(Frame& frame) {
+    FreshNames names(frame);
+    NormalizeBlocks(frame, names);
+    const auto promotable = promotable_variables(frame);
+    if (promotable.empty()) {
+        return;
+    }
+    promote(frame, names, promotable, nullptr);
+}
+
+void PromoteVariables(Frame& frame, FreshNames& names,
+                      const std::map<std::string, int>& variables,
+                      const std::set<std::string>& region) {
+    promote(frame, names, variables, &region);
+}
+
+void DestructSSA(Frame& frame) {
+    FreshNames names(frame);
+    const auto cfg = BuildCFG(frame);
+    const auto blocks = static_cast<int>(cfg.blocks.size());
+    // Every phi gets a fresh temp that its predecessors copy into and that
+    // the phi's block copies out of, so phis of one block can't clobber each
+    // other's inputs.
+    std::vector<std::vector<Operation>> copiesIn(blocks);
+    std::vector<std::vector<Operation>> copiesOut(blocks);
+    // edges from a conditional jump get a block of their own
+    std::map<std::pair<int, int>, std::vector<Operation>> splitEdges;
+    for (int b = 0; b < blocks; b++) {
+        for (int i = cfg.blocks[b].begin + 1; i < cfg.blocks[b].end; i++) {
+            const auto* phi = std::get_if<Phi>(&frame.instructions[i]);
+            if (phi == nullptr) {
+                break;
+            }
+            const auto temp = names.NewTemp(SizeOf(phi->dst));
+            copiesIn[b].emplace_back(Mov{.dst = phi->dst, .src = temp});
+            for (const auto& incoming : phi->args) {
+                const auto p = cfg.blockOf.at(incoming.predecessor.name);
+                auto copy = Mov{.dst = temp, .src = incoming.value};
+                if (cfg.blocks[p].successors.size() > 1) {
+                    splitEdges[{p, b}].emplace_back(std::move(copy));
+                } else {
+                    copiesOut[p].emplace_back(std::move(copy));
+                }
+            }
+        }
+    }
+    auto none = [](const auto& copies) { return copies.empty(); };
+    if (std::ranges::all_of(copiesIn, none)) {
+        return;
+    }
+
+    std::vector<Operation> out;
+    out.reserve(frame.instructions.size());
+    for (const auto& [b, block] : cfg.blocks | std::views::enumerate) {
+        out.push_back(std::move(frame.instructions[block.begin]));
+        for (auto& copy : copiesIn[b]) {
+            out.push_back(std::move(copy));
+        }
+        for (int i = block.begin + 1; i < block.end; i++) {
+            auto& op = frame.instructions[i];
+            if (std::holds_alternative<Phi>(op)) {
+                continue;
+            }
+            if (i + 1 == block.end && is_terminator(op)) {
+                for (auto& copy : copiesOut[b]) {
+                    out.push_back(std::move(copy));
+                }
+                copiesOut[b].clear();
+            }
+            out.push_back(std::move(op));
+        }
+        for (auto& copy : copiesOut[b]) {
+            out.push_back(std::move(copy));
+        }
+        // the block ends in a conditional jump, which names both of its
+        // targets, so its split edges can follow it directly
+        const auto jump = out.size() - 1;
+        for (const auto s : block.successors) {
+            const auto it = splitEdges.find({static_cast<int>(b), s});
+            if (it == splitEdges.end()) {
+                continue;
+            }
+            const auto& target = cfg.blocks[s].label;
+            const auto label = names.NewLabel();
+            std::visit(
+                [&](auto& arg) {
+                    using T = std::decay_t<decltype(arg)>;
+                    if constexpr (std::is_same_v<T, ConditionalJumpEqual> ||
+                                  std::is_same_v<T, ConditionalJumpGreater> ||
+                                  std::is_same_v<T, ConditionalJumpLess>) {
+                        for (auto* edge : {&arg.trueLabel, &arg.falseLabel}) {
+                            if (edge->name == target) {
+                                *edge = label;
+                            }
+                        }
+                    }
+                },
+                out[jump]);
+            out.emplace_back(LabelDef{.label = label});
+            for (auto& copy : it->second) {
+                out.push_back(std::move(copy));
+            }
+            out.emplace_back(Jump{.label = Label{target}});
+        }
+    }
+    frame.instructions = std::move(out);
+}
+}  // namespace qa_ir
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "../include/tailcall.hpp"
+
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+
+namespace qa_ir {
+
+bool IsTailCall(const Frame& frame, std::size_t i) {
+    const auto& ops = frame.instructions;
+    if (i + 1 >= ops.size()) {
+        return false;
+    }
+    const auto* call = std::get_if<Call>(&ops[i]);
+    const auto* ret = std::get_if<Ret>(&ops[i + 1]);
+    if (call == nullptr || ret == nullptr) {
+        return false;
+    }
+    const auto* result = std::get_if<Temp>(&call->dst);
+    const auto* returned = std::get_if<Temp>(&ret->value);
+    return result != nullptr && returned != nullptr &&
+           result->id == returned->id;
+}
+
+int EliminateTailRecursion(Frame& frame) {
+    auto& ops = frame.instructions;
+    const auto parameters = FrameParameters(frame);
+    auto recursive = [&](std::size_t i) {
+        return IsTailCall(frame, i) &&
+               std::get<Call>(ops[i]).name == frame.name &&
+               std::get<Call>(ops[i]).args.size() == parameters.size();
+    };
+    bool any = false;
+    for (std::size_t i = 0; i < ops.size() && !any; i++) {
+        any = recursive(i);
+    }
+    if (!any) {
+        return 0;
+    }
+
+    FreshNames names(frame);
+    const auto start = names.NewLabel();
+    std::vector<Operation> out;
+    out.reserve(ops.size() + 2);
+    int replaced = 0;
+    for (std::size_t i = 0; i < ops.size(); i++) {
+        if (i == parameters.size()) {
+            // the entry block keeps the parameters, so the loop's header is
+            // not the entry
+            out.emplace_back(Jump{.label = start});
+            out.emplace_back(LabelDef{.label = start});
+        }
+        if (!recursive(i)) {
+            out.push_back(std::move(ops[i]));
+            continue;
+        }
+        // every argument is read before any parameter changes
+        const auto& call = std::get<Call>(ops[i]);
+        std::vector<Temp> arguments;
+        for (std::size_t k = 0; k < parameters.size(); k++) {
+            arguments.push_back(names.NewTemp(parameters[k].size));
+            out.emplace_back(Mov{.dst = arguments[k], .src = call.args[k]});
+        }
+        for (std::size_t k = 0; k < parameters.size(); k++) {
+            out.emplace_back(Mov{.dst = parameters[k], .src = arguments[k]});
+        }
+        out.emplace_back(Jump{.label = start});
+        // the Ret of the result
+        i++;
+        replaced++;
+    }
+    ops = std::move(out);
+    return replaced;
+}
+}  // namespace qa_ir
\ No newline at end of file
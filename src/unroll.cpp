@@ -0,0 +1,385 @@
+#include "../include/unroll.hpp"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "../include/cfg.hpp"
+#include "../include/induction.hpp"
+
+namespace qa_ir {
+
+namespace {
+
+// the most operations the copies of a fully unrolled loop may add up to
+constexpr int kFullBudget = 64;
+// the most operations one trip of a partially unrolled loop may take
+constexpr int kPartialBudget = 64;
+// the most copies of the body a trip gets when the options don't say
+constexpr int kDefaultCount = 4;
+
+// operations one trip through the loop runs, leaving out labels and jumps
+[[nodiscard]] int trip_size(const Frame& frame, const ControlFlowGraph& cfg,
+                            const Loop& loop, const CountedLoop& header) {
+    auto size = header.test - header.first;
+    for (const auto b : loop.blocks) {
+        if (b == loop.header) {
+            continue;
+        }
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            const auto& op = frame.instructions[i];
+            if (!std::holds_alternative<LabelDef>(op) &&
+                !std::holds_alternative<Jump>(op)) {
+                size++;
+            }
+        }
+    }
+    return size;
+}
+
+[[nodiscard]] Value renamed(const Value& value,
+                            const std::map<int, Temp>& temps) {
+    if (const auto* temp = std::get_if<Temp>(&value)) {
+        if (const auto it = temps.find(temp->id); it != temps.end()) {
+            return it->second;
+        }
+    }
+    return value;
+}
+
+struct Trip {
+    std::vector<Operation> code = {};
+    // the values the phis get for the next trip
+    std::vector<Value> next = {};
+    // the copy of the latch
+    std::string latch = {};
+};
+
+// One trip through the loop under fresh names, opening with entry: the
+// phis take incoming, then come the header without its test and the other
+// blocks of the loop. Branching back to the header goes to next instead.
+[[nodiscard]] Trip clone_trip(const Frame& frame, const ControlFlowGraph& cfg,
+                              const Loop& loop, const CountedLoop& header,
+                              FreshNames& names, const std::string& entry,
+                              const std::vector<Value>& incoming,
+                              const std::string& next) {
+    const auto& ops = frame.instructions;
+    const auto& headerLabel = cfg.blocks[loop.header].label;
+    std::map<int, Temp> temps;
+    std::map<std::string, std::string> labels = {{headerLabel, next}};
+    // a block the header branches to is entered from this trip's header
+    std::map<std::string, std::string> predecessors = {{headerLabel, entry}};
+    auto define = [&](int i) {
+        if (const auto* dst = defined_value(ops[i])) {
+            if (const auto* temp = std::get_if<Temp>(dst)) {
+                temps.emplace(temp->id, names.NewTemp(temp->size));
+            }
+        }
+    };
+    for (const auto& values : header.phis) {
+        temps.emplace(values.phi.id, names.NewTemp(values.phi.size));
+    }
+    for (int i = header.first; i < header.test; i++) {
+        define(i);
+    }
+    for (const auto b : loop.blocks) {
+        if (b == loop.header) {
+            continue;
+        }
+        const auto label = names.NewLabel().name;
+        labels[cfg.blocks[b].label] = label;
+        predecessors[cfg.blocks[b].label] = label;
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            define(i);
+        }
+    }
+
+    Trip trip;
+    auto copy = [&](int i) {
+        auto op = ops[i];
+        for_each_used_value(op, [&](Value& value) {
+            value = renamed(value, temps);
+        });
+        if (auto* dst = defined_value(op)) {
+            *dst = renamed(*dst, temps);
+        }
+        if (auto* label = std::get_if<LabelDef>(&op)) {
+            label->label.name = labels.at(label->label.name);
+        } else if (auto* phi = std::get_if<Phi>(&op)) {
+            for (auto& incoming : phi->args) {
+                incoming.predecessor.name =
+                    predecessors.at(incoming.predecessor.name);
+            }
+        }
+        for (const auto& target : successor_labels(ops[i])) {
+            retarget(op, target.name, Label{labels.at(target.name)});
+        }
+        trip.code.push_back(std::move(op));
+    };
+    trip.code.emplace_back(LabelDef{.label = {entry}});
+    for (std::size_t j = 0; j < header.phis.size(); j++) {
+        trip.code.emplace_back(
+            Mov{.dst = temps.at(header.phis[j].phi.id), .src = incoming[j]});
+    }
+    for (int i = header.first; i < header.test; i++) {
+        copy(i);
+    }
+    trip.code.emplace_back(Jump{.label = {labels.at(header.body)}});
+    for (const auto b : loop.blocks) {
+        if (b == loop.header) {
+            continue;
+        }
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            copy(i);
+        }
+        // the other blocks keep their order, only the header is left out
+        if (!is_terminator(ops[cfg.blocks[b].end - 1]) &&
+            b + 1 == loop.header) {
+            trip.code.emplace_back(Jump{.label = {next}});
+        }
+    }
+    for (const auto& values : header.phis) {
+        trip.next.push_back(renamed(values.next, temps));
+    }
+    trip.latch = predecessors.at(header.latch);
+    return trip;
+}
+
+// Lays the frame out again with code in place of the loop. The preheader
+// branches to entry instead of the header.
+void replace_loop(Frame& frame, const ControlFlowGraph& cfg, const Loop& loop,
+                  const std::string& preheader, const std::string& entry,
+                  std::vector<Operation> code) {
+    auto& ops = frame.instructions;
+    const auto& headerLabel = cfg.blocks[loop.header].label;
+    std::vector<Operation> out;
+    out.reserve(ops.size() + code.size());
+    for (int b = 0; b < static_cast<int>(cfg.blocks.size()); b++) {
+        const auto& block = cfg.blocks[b];
+        if (loop.contains(b)) {
+            if (b == loop.blocks.front()) {
+                std::ranges::move(code, std::back_inserter(out));
+            }
+            continue;
+        }
+        for (int i = block.begin; i < block.end; i++) {
+            out.push_back(std::move(ops[i]));
+        }
+        if (block.label == preheader) {
+            if (is_terminator(out.back())) {
+                retarget(out.back(), headerLabel, Label{entry});
+            } else {
+                out.emplace_back(Jump{.label = {entry}});
+            }
+        }
+    }
+    ops = std::move(out);
+}
+
+void unroll_fully(Frame& frame, FreshNames& names,
+                  const ControlFlowGraph& cfg, const Loop& loop,
+                  const CountedLoop& header, const std::string& preheader,
+                  int trips) {
+    const auto& ops = frame.instructions;
+    const auto& headerLabel = cfg.blocks[loop.header].label;
+    std::vector<Value> incoming;
+    for (const auto& values : header.phis) {
+        incoming.push_back(values.entry);
+    }
+    const auto first = trips > 0 ? names.NewLabel().name : headerLabel;
+    std::vector<Operation> code;
+    auto entry = first;
+    for (int k = 0; k < trips; k++) {
+        const auto next = k + 1 < trips ? names.NewLabel().name : headerLabel;
+        auto trip = clone_trip(frame, cfg, loop, header, names, entry,
+                               incoming, next);
+        std::ranges::move(trip.code, std::back_inserter(code));
+        incoming = std::move(trip.next);
+        entry = next;
+    }
+    // the header runs once more to find the loop done, under its own names
+    // for the uses after the loop
+    code.emplace_back(LabelDef{.label = {headerLabel}});
+    for (std::size_t j = 0; j < header.phis.size(); j++) {
+        code.emplace_back(Mov{.dst = header.phis[j].phi, .src = incoming[j]});
+    }
+    for (int i = header.first; i < header.test; i++) {
+        code.push_back(ops[i]);
+    }
+    code.emplace_back(Jump{.label = {header.exit}});
+    replace_loop(frame, cfg, loop, preheader, first, std::move(code));
+}
+
+// Puts a loop running count trips per test in front of the loop, which
+// keeps running the trips that are left. Returns whether it could.
+bool unroll_partially(
+    Frame& frame, FreshNames& names, const ControlFlowGraph& cfg,
+    const Loop& loop, const CountedLoop& header, const std::string& preheader,
+    int count) {
+    auto& ops = frame.instructions;
+    const auto& basic = header.counter;
+    const auto side = header.side;
+    const auto& compare = std::get<Compare>(ops[header.test]);
+    const auto& jump = ops[header.test + 1];
+    const auto& bound = side == 0 ? compare.right : compare.left;
+    const auto* boundTemp = std::get_if<Temp>(&bound);
+    if (!basic.step.terms.empty() ||
+        successor_labels(jump)[0].name != header.body ||
+        std::holds_alternative<ConditionalJumpEqual>(jump) ||
+        (boundTemp == nullptr && !std::holds_alternative<int>(bound))) {
+        return false;
+    }
+    for (const auto b : loop.blocks) {
+        for (int i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            const auto* dst = defined_value(ops[i]);
+            if (boundTemp != nullptr && dst != nullptr &&
+                std::holds_alternative<Temp>(*dst) &&
+                std::get<Temp>(*dst).id == boundTemp->id) {
+                return false;
+            }
+        }
+    }
+    // only a test that stays true until the counter passes the bound tells
+    // whether count more trips are left
+    const auto increasing =
+        std::holds_alternative<ConditionalJumpLess>(jump) == (side == 0);
+    if (increasing ? basic.step.constant <= 0 : basic.step.constant >= 0) {
+        return false;
+    }
+
+    const auto& headerLabel = cfg.blocks[loop.header].label;
+    const auto unrolled = names.NewLabel().name;
+    std::vector<Label> entries;
+    for (int k = 0; k < count; k++) {
+        entries.push_back(names.NewLabel());
+    }
+    std::vector<Value> incoming;
+    std::vector<Temp> phis;
+    for (const auto& values : header.phis) {
+        phis.push_back(names.NewTemp(values.phi.size));
+        incoming.push_back(phis.back());
+    }
+    std::vector<Operation> trips;
+    std::string latch;
+    for (int k = 0; k < count; k++) {
+        const auto next = k + 1 < count ? entries[k + 1].name : unrolled;
+        auto trip = clone_trip(frame, cfg, loop, header, names,
+                               entries[k].name, incoming, next);
+        std::ranges::move(trip.code, std::back_inserter(trips));
+        incoming = std::move(trip.next);
+        latch = trip.latch;
+    }
+
+    std::vector<Operation> code;
+    const auto& headerBlock = cfg.blocks[loop.header];
+    // a loop block falling into the header has to jump over the new loop
+    if (loop.contains(loop.header - 1) &&
+        !is_terminator(ops[headerBlock.begin - 1])) {
+        code.emplace_back(Jump{.label = {headerLabel}});
+    }
+    code.emplace_back(LabelDef{.label = {unrolled}});
+    for (std::size_t j = 0; j < phis.size(); j++) {
+        code.emplace_back(Phi{
+            .dst = phis[j],
+            .args = {{.predecessor = {preheader},
+                      .value = header.phis[j].entry},
+                     {.predecessor = {latch}, .value = incoming[j]}}});
+    }
+    // count more trips are left while the last of them still passes
+    const auto last = names.NewTemp(basic.phi.size);
+    const auto position = std::ranges::find_if(header.phis, [&](const auto& v) {
+        return v.phi.id == basic.phi.id;
+    });
+    code.emplace_back(
+        Add{.dst = last,
+            .left = phis[position - header.phis.begin()],
+            .right = (count - 1) * basic.step.constant});
+    auto guard = compare;
+    (side == 0 ? guard.left : guard.right) = last;
+    code.emplace_back(guard);
+    auto branch = jump;
+    retarget(branch, header.body, entries[0]);
+    retarget(branch, header.exit, Label{headerLabel});
+    code.push_back(branch);
+    std::ranges::move(trips, std::back_inserter(code));
+
+    // the original loop now starts from where the unrolled one left off
+    for (int i = headerBlock.begin + 1; i < header.first; i++) {
+        for (auto& arg : std::get<Phi>(ops[i]).args) {
+            if (arg.predecessor.name == preheader) {
+                arg = PhiArgument{.predecessor = {unrolled},
+                                  .value = phis[i - headerBlock.begin - 1]};
+            }
+        }
+    }
+    std::vector<Operation> out;
+    out.reserve(ops.size() + code.size() + 1);
+    for (int b = 0; b < static_cast<int>(cfg.blocks.size()); b++) {
+        const auto& block = cfg.blocks[b];
+        if (b == loop.header) {
+            std::ranges::move(code, std::back_inserter(out));
+        }
+        for (int i = block.begin; i < block.end; i++) {
+            out.push_back(std::move(ops[i]));
+        }
+        if (block.label == preheader) {
+            if (is_terminator(out.back())) {
+                retarget(out.back(), headerLabel, Label{unrolled});
+            } else {
+                out.emplace_back(Jump{.label = {unrolled}});
+            }
+        }
+    }
+    ops = std::move(out);
+    return true;
+}
+}  // namespace
+
+int UnrollLoops(Frame& frame, FrameAnalyses& analyses,
+                const UnrollOptions& options) {
+    FreshNames names(frame);
+    if (NormalizeBlocks(frame, names)) {
+        analyses.Invalidate(PreservedAnalyses::None());
+    }
+    int unrolled = 0;
+    const auto visit = [&](int index, const std::string& preheader) {
+        const auto& forest = analyses.Loops();
+        // only innermost loops, copies of a loop would be unrolled again
+        if (!forest.children[index].empty()) {
+            return false;
+        }
+        const auto& cfg = analyses.CFG();
+        const auto& loop = forest.loops[index];
+        const auto header = FindCountedLoop(frame, cfg, analyses.Dominators(),
+                                            loop, preheader);
+        if (!header.has_value()) {
+            return false;
+        }
+        const auto size = std::max(1, trip_size(frame, cfg, loop, *header));
+        if (const auto trips = ConstantTripCount(frame, *header);
+            trips.has_value() && *trips <= kFullBudget / size) {
+            unroll_fully(frame, names, cfg, loop, *header, preheader, *trips);
+            unrolled++;
+            return true;
+        }
+        const auto count = options.count > 0
+                               ? options.count
+                               : std::min(kDefaultCount, kPartialBudget / size);
+        if (!options.runtime || count < 2) {
+            return false;
+        }
+        if (!unroll_partially(frame, names, cfg, loop, *header, preheader,
+                              count)) {
+            return false;
+        }
+        unrolled++;
+        return true;
+    };
+    ForEachLoop(frame, names, analyses, visit);
+    return unrolled;
+}
+}  // namespace qa_ir
\ No newline at end of file
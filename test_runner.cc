@@ -1,11 +1,43 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstdlib>
 #include <expected>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <system_error>
+#include <tuple>
+#include <vector>
+
+#include "include/allocator.hpp"
+#include "include/analysis.hpp"
+#include "include/assem.hpp"
+#include "include/cfg.hpp"
+#include "include/codegen.hpp"
+#include "include/copies.hpp"
+#include "include/dce.hpp"
+#include "include/gvn.hpp"
+#include "include/induction.hpp"
+#include "include/inline.hpp"
+#include "include/layout.hpp"
+#include "include/licm.hpp"
+#include "include/liveness.hpp"
+#include "include/lower_ir.hpp"
+#include "include/pass_manager.hpp"
+#include "include/peephole.hpp"
+#include "include/sccp.hpp"
+#include "include/scev.hpp"
+#include "include/simplify.hpp"
+#include "include/ssa.hpp"
+#include "include/tailcall.hpp"
+#include "include/unroll.hpp"
 
 constexpr std::string compiler_path = "./build/bin/qac";
 constexpr std::string temp_dir = "./tmp/";
@@ -15,10 +47,11 @@ const std::string compiler_gen_asm_path = temp_dir + asm_path;
 const std::string compiler_gen_object_path = temp_dir + "test.o";
 const std::string compiler_gen_binary_path = temp_dir + "test.out";
 
-[[nodiscard]] auto invoke_qac(const std::string& sourcePath)
+[[nodiscard]] auto invoke_qac(const std::string& sourcePath,
+                              const std::string& flags)
     -> std::expected<int, std::string> {
     const auto command = compiler_path.data() + std::string(" ") + sourcePath +
-                         " -o " + compiler_gen_asm_path;
+                         " -o " + compiler_gen_asm_path + " " + flags;
     const auto result = system(command.c_str());
     if (result != 0) {
         return std::unexpected("Failed to compile the source file");
@@ -49,9 +82,10 @@ const std::string compiler_gen_binary_path = temp_dir + "test.out";
     return result;
 }
 
-[[nodiscard]] auto compile(const std::string& sourcePath)
+[[nodiscard]] auto compile(const std::string& sourcePath,
+                           const std::string& flags)
     -> std::expected<int, std::string> {
-    const auto compileResult = invoke_qac(sourcePath);
+    const auto compileResult = invoke_qac(sourcePath, flags);
     if (!compileResult) {
         return std::unexpected(compileResult.error());
     }
@@ -87,7 +121,8 @@ const std::string compiler_gen_binary_path = temp_dir + "test.out";
     return std::unexpected("Expected return value not found");
 }
 
-[[nodiscard]] auto run_test_for_status_code(const std::string& sourcePath)
+[[nodiscard]] auto run_test_for_status_code(const std::string& sourcePath,
+                                            const std::string& flags = "")
     -> std::expected<bool, std::string> {
     const auto expectedReturn = parse_expected_return_from_source(sourcePath);
 
@@ -96,7 +131,7 @@ const std::string compiler_gen_binary_path = temp_dir + "test.out";
     }
     const auto expected_return_code = expectedReturn.value();
 
-    const auto compileResult = compile(sourcePath);
+    const auto compileResult = compile(sourcePath, flags);
     if (!compileResult) {
         return std::unexpected(compileResult.error());
     }
@@ -116,10 +151,10 @@ const std::string compiler_gen_binary_path = temp_dir + "test.out";
     return true;
 }
 
-#define RUN_TEST_CASE(NAME, PATH)                                           \
+#define RUN_TEST_CASE_WITH_FLAGS(NAME, PATH, FLAGS)                         \
     TEST(CompilerIntegrationTest, NAME) {                                   \
-        auto result =                                                       \
-            run_test_for_status_code("tests/sources/" + std::string(PATH)); \
+        auto result = run_test_for_status_code(                             \
+            "tests/sources/" + std::string(PATH), FLAGS);                   \
         if (!result) {                                                      \
             std::cerr << result.error() << std::endl;                       \
             FAIL();                                                         \
@@ -127,6 +162,8 @@ const std::string compiler_gen_binary_path = temp_dir + "test.out";
         SUCCEED();                                                          \
     }
 
+#define RUN_TEST_CASE(NAME, PATH) RUN_TEST_CASE_WITH_FLAGS(NAME, PATH, "")
+
 /** Basic **/
 RUN_TEST_CASE(IntReturnValue, "int_return.c");
 RUN_TEST_CASE(IntAssignment, "int_assignment.c");
@@ -159,6 +196,1732 @@ RUN_TEST_CASE(PassVariablesOnStack, "pass_vars_on_stack.c");
 RUN_TEST_CASE(PassVariablesOnStackMoreInvolved,
               "pass_vars_on_stack_more_involved.c");
 
+/** Register pressure  **/
+RUN_TEST_CASE(RegisterPressureNestedSum, "register_pressure_nested_sum.c");
+RUN_TEST_CASE(RegisterPressureCallArgs, "register_pressure_call_args.c");
+RUN_TEST_CASE(RegisterPressureAcrossCalls,
+              "register_pressure_across_calls.c");
+
+/** Graph coloring register allocator  **/
+RUN_TEST_CASE_WITH_FLAGS(GraphForLoopIncrement, "for_loop_increment.c",
+                         "-regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(GraphIntSwap, "int_swap.c", "-regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(GraphPassVariablesOnStackMoreInvolved,
+                         "pass_vars_on_stack_more_involved.c",
+                         "-regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(GraphRegisterPressureNestedSum,
+                         "register_pressure_nested_sum.c", "-regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(GraphRegisterPressureCallArgs,
+                         "register_pressure_call_args.c", "-regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(GraphRegisterPressureAcrossCalls,
+                         "register_pressure_across_calls.c",
+                         "-regalloc=graph");
+
+/** SSA  **/
+RUN_TEST_CASE(SSALoopCarriedSwap, "ssa_loop_carried_swap.c");
+RUN_TEST_CASE_WITH_FLAGS(GraphSSALoopCarriedSwap, "ssa_loop_carried_swap.c",
+                         "-regalloc=graph");
+RUN_TEST_CASE(SSAMixedSizes, "ssa_mixed_sizes.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineSSAMixedSizes, "ssa_mixed_sizes.c",
+                         "-finline-limit=0");
+RUN_TEST_CASE(SCCPConstantBranches, "sccp_constant_branches.c");
+RUN_TEST_CASE(GVNRepeatedLoads, "gvn_repeated_loads.c");
+RUN_TEST_CASE(LICMInvariantLoop, "licm_invariant_loop.c");
+RUN_TEST_CASE(LICMAddressTaken, "licm_address_taken.c");
+RUN_TEST_CASE(IVStrengthReduction, "iv_strength_reduction.c");
+RUN_TEST_CASE(UnrollRuntimeTripCount, "unroll_runtime_trip_count.c");
+RUN_TEST_CASE_WITH_FLAGS(UnrollRuntimeTripCountByThree,
+                         "unroll_runtime_trip_count.c", "-unroll-count=3");
+RUN_TEST_CASE(SCEVLoopExitValues, "scev_loop_exit_values.c");
+
+/** Inlining **/
+RUN_TEST_CASE(InlineSmallHelpers, "inline_small_helpers.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineSmallHelpers, "inline_small_helpers.c",
+                         "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineIntSwap, "int_swap.c", "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(NoInlinePassVariablesOnStackMoreInvolved,
+                         "pass_vars_on_stack_more_involved.c",
+                         "-finline-limit=0");
+
+/** Tail calls **/
+RUN_TEST_CASE(TailCalls, "tail_calls.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineTailCalls, "tail_calls.c", "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(GraphNoInlineTailCalls, "tail_calls.c",
+                         "-finline-limit=0 -regalloc=graph");
+
+/** Instruction selection **/
+RUN_TEST_CASE(IselMemoryOperands, "isel_memory_operands.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineIselMemoryOperands, "isel_memory_operands.c",
+                         "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(GraphNoInlineIselMemoryOperands,
+                         "isel_memory_operands.c",
+                         "-finline-limit=0 -regalloc=graph");
+
+/** Compare and branch **/
+RUN_TEST_CASE(FusedCompareBranch, "fused_compare_branch.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineFusedCompareBranch, "fused_compare_branch.c",
+                         "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(GraphNoInlineFusedCompareBranch,
+                         "fused_compare_branch.c",
+                         "-finline-limit=0 -regalloc=graph");
+
+/** Callee-saved registers **/
+RUN_TEST_CASE(CalleeSavedRegisters, "callee_saved_registers.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineCalleeSavedRegisters,
+                         "callee_saved_registers.c", "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(GraphNoInlineCalleeSavedRegisters,
+                         "callee_saved_registers.c",
+                         "-finline-limit=0 -regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(OmitFramePointerCalleeSavedRegisters,
+                         "callee_saved_registers.c",
+                         "-finline-limit=0 -fomit-frame-pointer");
+
+/** Frame pointer omission **/
+RUN_TEST_CASE_WITH_FLAGS(OmitFramePointerRegisterPressureNestedSum,
+                         "register_pressure_nested_sum.c",
+                         "-fomit-frame-pointer");
+RUN_TEST_CASE_WITH_FLAGS(GraphOmitFramePointerRegisterPressureNestedSum,
+                         "register_pressure_nested_sum.c",
+                         "-fomit-frame-pointer -regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(OmitFramePointerAcrossCalls,
+                         "register_pressure_across_calls.c",
+                         "-fomit-frame-pointer -finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(OmitFramePointerPassVariablesOnStackMoreInvolved,
+                         "pass_vars_on_stack_more_involved.c",
+                         "-fomit-frame-pointer -finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(OmitFramePointerIselMemoryOperands,
+                         "isel_memory_operands.c",
+                         "-fomit-frame-pointer -finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(GraphOmitFramePointerTailCalls, "tail_calls.c",
+                         "-fomit-frame-pointer -finline-limit=0 "
+                         "-regalloc=graph");
+
+/** Optimization levels **/
+RUN_TEST_CASE_WITH_FLAGS(O0SSALoopCarriedSwap, "ssa_loop_carried_swap.c",
+                         "-O0");
+RUN_TEST_CASE_WITH_FLAGS(O0TailCalls, "tail_calls.c", "-O0");
+RUN_TEST_CASE_WITH_FLAGS(GraphO0CalleeSavedRegisters,
+                         "callee_saved_registers.c", "-O0 -regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(O1IVStrengthReduction, "iv_strength_reduction.c",
+                         "-O1");
+RUN_TEST_CASE_WITH_FLAGS(OsUnrollRuntimeTripCount,
+                         "unroll_runtime_trip_count.c", "-Os -funroll-loops");
+RUN_TEST_CASE_WITH_FLAGS(PassesLICMInvariantLoop, "licm_invariant_loop.c",
+                         "-passes=licm,dce,cleanup");
+RUN_TEST_CASE_WITH_FLAGS(OsLICMAddressTaken, "licm_address_taken.c", "-Os");
+RUN_TEST_CASE_WITH_FLAGS(PassesLICMAddressTaken, "licm_address_taken.c",
+                         "-passes=licm");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineLICMAddressTaken, "licm_address_taken.c",
+                         "-finline-limit=0");
+RUN_TEST_CASE(LICMPromotedLoopValue, "licm_promoted_loop_value.c");
+RUN_TEST_CASE_WITH_FLAGS(PassesSimplifyAfterLICMPromotedLoopValue,
+                         "licm_promoted_loop_value.c",
+                         "-passes=licm,simplify");
+RUN_TEST_CASE_WITH_FLAGS(PassesSCCPAfterLICMPromotedLoopValue,
+                         "licm_promoted_loop_value.c", "-passes=licm,sccp");
+
+/** Block layout **/
+RUN_TEST_CASE(BlockLayout, "block_layout.c");
+RUN_TEST_CASE_WITH_FLAGS(NoInlineBlockLayout, "block_layout.c",
+                         "-finline-limit=0");
+RUN_TEST_CASE_WITH_FLAGS(GraphNoInlineBlockLayout, "block_layout.c",
+                         "-finline-limit=0 -regalloc=graph");
+RUN_TEST_CASE_WITH_FLAGS(O0BlockLayout, "block_layout.c", "-O0");
+RUN_TEST_CASE(BlockLayoutInlinedLocals, "block_layout_inlined_locals.c");
+RUN_TEST_CASE_WITH_FLAGS(OsBlockLayoutInlinedLocals,
+                         "block_layout_inlined_locals.c", "-Os");
+
+/** Lowering **/
+
+// The replacements below count the heap allocations made while a test sets
+// counting_allocations. The nothrow forms the library provides forward to
+// them.
+static bool counting_allocations = false;
+static std::size_t allocation_count = 0;
+
+[[nodiscard]] static void* counted_allocation(std::size_t size,
+                                              std::size_t alignment) noexcept {
+    if (counting_allocations) {
+        ++allocation_count;
+    }
+    size = std::max<std::size_t>(size, 1);
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+    return std::aligned_alloc(alignment,
+                              (size + alignment - 1) / alignment * alignment);
+}
+
+void* operator new(std::size_t size) {
+    if (void* ptr = counted_allocation(size, 0)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* ptr =
+            counted_allocation(size, static_cast<std::size_t>(alignment))) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+// kept out of line, or GCC sees free() meet the `new` of a test fixture
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept { ::operator delete(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    ::operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    ::operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    ::operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    ::operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    ::operator delete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    ::operator delete(ptr);
+}
+
+TEST(LowerIR, SteadyStateLoweringDoesNotAllocate) {
+    const auto a = qa_ir::Variable{.name = "a", .version = 0, .size = 4};
+    const auto b = qa_ir::Variable{.name = "b", .version = 0, .size = 4};
+    // the labels copied into the jumps have to fit std::string's small
+    // buffer, longer ones would allocate on every lowering
+    const auto top = qa_ir::Label{.name = "L0"};
+    const auto exit = qa_ir::Label{.name = "L1"};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    frame.instructions.emplace_back(qa_ir::Mov{.dst = a, .src = 1});
+    frame.instructions.emplace_back(qa_ir::Mov{.dst = b, .src = 2});
+    frame.instructions.emplace_back(qa_ir::LabelDef{.label = top});
+    for (int i = 0; i < 256; i++) {
+        const auto t = qa_ir::Temp{.id = i, .size = 4};
+        frame.instructions.emplace_back(
+            qa_ir::Add{.dst = t, .left = a, .right = b});
+        frame.instructions.emplace_back(
+            qa_ir::Sub{.dst = a, .left = t, .right = 1});
+        frame.instructions.emplace_back(
+            qa_ir::GreaterThan{.dst = b, .left = t, .right = a});
+    }
+    frame.instructions.emplace_back(qa_ir::Compare{.left = a, .right = 0});
+    frame.instructions.emplace_back(
+        qa_ir::ConditionalJumpLess{.trueLabel = top, .falseLabel = exit});
+    frame.instructions.emplace_back(qa_ir::LabelDef{.label = exit});
+    frame.instructions.emplace_back(qa_ir::Ret{.value = a});
+
+    std::vector<target::Instruction> buffer;
+    auto ctx = target::Ctx{};
+    auto out = target::Emitter{buffer};
+    // the first pass assigns stack slots and temp registers and grows the
+    // buffer, after that lowering only appends
+    target::LowerFrame(frame, ctx, out);
+    const auto lowered = buffer.size();
+    buffer.clear();
+
+    allocation_count = 0;
+    counting_allocations = true;
+    target::LowerFrame(frame, ctx, out);
+    counting_allocations = false;
+
+    EXPECT_EQ(buffer.size(), lowered);
+    EXPECT_EQ(allocation_count, 0);
+}
+
+TEST(LowerIR, CompareAndBranchLowerToOneJcc) {
+    const auto n = qa_ir::Temp{.id = 0, .size = 4};
+    const auto body = qa_ir::Label{.name = "L0"};
+    const auto exit = qa_ir::Label{.name = "L1"};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    frame.instructions.emplace_back(qa_ir::Mov{.dst = n, .src = 7});
+    // 3 > n, with the false label next
+    frame.instructions.emplace_back(qa_ir::Compare{.left = 3, .right = n});
+    frame.instructions.emplace_back(
+        qa_ir::ConditionalJumpGreater{.trueLabel = body, .falseLabel = exit});
+    frame.instructions.emplace_back(qa_ir::LabelDef{.label = exit});
+    frame.instructions.emplace_back(qa_ir::Compare{.left = n, .right = 0});
+    frame.instructions.emplace_back(
+        qa_ir::ConditionalJumpEqual{.trueLabel = body, .falseLabel = exit});
+    frame.instructions.emplace_back(qa_ir::LabelDef{.label = body});
+    frame.instructions.emplace_back(qa_ir::Ret{.value = n});
+
+    const auto lowered = target::LowerIR({frame}).front().instructions;
+    std::vector<std::string> kinds;
+    for (const auto& ins : lowered) {
+        std::ostringstream printed;
+        printed << ins;
+        kinds.push_back(printed.str().substr(0, printed.str().find(' ')));
+    }
+    // n < 3 jumps to the body, n != 0 falls through to it
+    EXPECT_EQ(kinds, (std::vector<std::string>{"loadI", "cmpI", "jl", "L1:",
+                                               "test", "jne", "L0:", "mov",
+                                               "jump"}));
+}
+
+TEST(LowerIR, TilesUseIncLeaAndMemoryOperands) {
+    const auto t = [](int id) { return qa_ir::Temp{.id = id, .size = 4}; };
+    const auto x = qa_ir::Variable{.name = "x", .version = 0, .size = 4};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::Mov{.dst = t(0), .src = 5});
+    ops.emplace_back(qa_ir::Add{.dst = t(1), .left = t(0), .right = 7});
+    ops.emplace_back(qa_ir::Sub{.dst = t(1), .left = t(1), .right = -1});
+    ops.emplace_back(qa_ir::Mov{.dst = x, .src = 0});
+    // x = x + t1 and t5 = t1 + *(&x), t1 and t0 living on
+    ops.emplace_back(qa_ir::Add{.dst = t(2), .left = x, .right = t(1)});
+    ops.emplace_back(qa_ir::Mov{.dst = x, .src = t(2)});
+    ops.emplace_back(qa_ir::Addr{.dst = qa_ir::Temp{3, 8}, .src = x});
+    ops.emplace_back(qa_ir::Deref{.dst = t(4), .src = qa_ir::Temp{3, 8}});
+    ops.emplace_back(qa_ir::Add{.dst = t(5), .left = t(4), .right = t(1)});
+    ops.emplace_back(qa_ir::Add{.dst = t(5), .left = t(5), .right = t(0)});
+    ops.emplace_back(qa_ir::Ret{.value = t(5)});
+
+    const auto lowered = target::LowerIR({frame});
+    std::vector<std::string> printed;
+    for (const auto& ins : lowered.front().instructions) {
+        std::ostringstream os;
+        os << ins;
+        printed.push_back(os.str().substr(0, os.str().find(' ')));
+    }
+    EXPECT_EQ(printed, (std::vector<std::string>{"loadI", "lea", "inc",
+                                                 "storeI", "addM", "lea",
+                                                 "mov", "add", "add", "mov",
+                                                 "jump"}));
+}
+
+TEST(LowerIR, ReadsMayComeBeforeTheFirstAssignment) {
+    const auto x = qa_ir::Variable{.name = "x", .version = 0, .size = 4};
+    const auto t = qa_ir::Temp{.id = 0, .size = 4};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Jump{.label = {"L2"}});
+    // laid out ahead of the block assigning x, which always runs first
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Mov{.dst = t, .src = x});
+    ops.emplace_back(qa_ir::Ret{.value = t});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Mov{.dst = x, .src = 3});
+    ops.emplace_back(qa_ir::Jump{.label = {"L1"}});
+
+    const auto lowered = target::LowerIR({frame});
+    EXPECT_EQ(lowered.front().size, 4);
+}
+
+/** Register allocation **/
+
+TEST(Allocator, BenchmarkFrameWithManyVirtualRegisters) {
+    constexpr int expressions = 100000;
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 4};
+    frame.instructions.reserve(expressions * 4);
+    for (int i = 0; i < expressions; i++) {
+        const auto lhs = target::VirtualRegister{.id = 2 * i, .size = 4};
+        const auto rhs = target::VirtualRegister{.id = 2 * i + 1, .size = 4};
+        frame.instructions.emplace_back(target::LoadI{.dst = lhs, .value = i});
+        frame.instructions.emplace_back(target::LoadI{.dst = rhs, .value = 1});
+        frame.instructions.emplace_back(target::Add{.dst = lhs, .src = rhs});
+        frame.instructions.emplace_back(target::Store{
+            .dst = target::StackLocation{.offset = 4}, .src = lhs});
+    }
+    std::vector<target::Frame> frames;
+    frames.push_back(std::move(frame));
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto rewritten = target::rewrite(std::move(frames));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const auto elapsed_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    std::cout << "rewrite of " << 2 * expressions << " virtual registers took "
+              << elapsed_ms << "ms" << std::endl;
+    RecordProperty("rewrite_ms", std::to_string(elapsed_ms));
+
+    ASSERT_EQ(rewritten.size(), 1);
+    for (const auto& ins : rewritten.front().instructions) {
+        EXPECT_FALSE(target::get_src_register(ins).has_value());
+        EXPECT_FALSE(target::get_dest_register(ins).has_value());
+    }
+}
+
+TEST(Allocator, SpillsWhenMoreValuesAreLiveThanRegisters) {
+    // every constant and every load stays live until the final sum, so the
+    // frame needs more registers than register_file has
+    constexpr int values = 8;
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 4};
+    std::vector<target::VirtualRegister> regs;
+    for (int i = 0; i < 2 * values; i++) {
+        regs.push_back(target::VirtualRegister{.id = i, .size = 4});
+    }
+    for (int i = 0; i < values; i++) {
+        frame.instructions.emplace_back(
+            target::LoadI{.dst = regs[2 * i], .value = i});
+        frame.instructions.emplace_back(target::Load{
+            .dst = regs[2 * i + 1], .src = target::StackLocation{.offset = 4}});
+    }
+    for (int i = 1; i < 2 * values; i++) {
+        frame.instructions.emplace_back(
+            target::Add{.dst = regs[0], .src = regs[i]});
+    }
+    frame.instructions.emplace_back(target::Store{
+        .dst = target::StackLocation{.offset = 4}, .src = regs[0]});
+    std::vector<target::Frame> frames;
+    frames.push_back(std::move(frame));
+
+    auto stats = target::AllocationStats{};
+    const auto rewritten = target::rewrite(std::move(frames), stats);
+
+    ASSERT_EQ(rewritten.size(), 1);
+    EXPECT_GT(stats.spilled, 0);
+    EXPECT_GT(stats.reloads, 0);
+    EXPECT_GT(stats.rematerialized, 0);
+    EXPECT_GT(rewritten.front().size, 4);
+    for (const auto& ins : rewritten.front().instructions) {
+        EXPECT_FALSE(target::get_src_register(ins).has_value());
+        EXPECT_FALSE(target::get_dest_register(ins).has_value());
+    }
+}
+
+TEST(Allocator, SpillsRegistersTheFrontendGaveNoSize) {
+    // as SpillsWhenMoreValuesAreLiveThanRegisters, but the load read last,
+    // which is spilled first, never has a size
+    constexpr int values = 8;
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 4};
+    std::vector<target::VirtualRegister> regs;
+    for (int i = 0; i < 2 * values; i++) {
+        regs.push_back(target::VirtualRegister{
+            .id = i, .size = i + 1 < 2 * values ? 4 : 0});
+    }
+    for (int i = 0; i < values; i++) {
+        frame.instructions.emplace_back(
+            target::LoadI{.dst = regs[2 * i], .value = i});
+        frame.instructions.emplace_back(target::Load{
+            .dst = regs[2 * i + 1], .src = target::StackLocation{.offset = 4}});
+    }
+    for (int i = 1; i < 2 * values; i++) {
+        frame.instructions.emplace_back(
+            target::Add{.dst = regs[0], .src = regs[i]});
+    }
+    std::vector<target::Frame> frames;
+    frames.push_back(std::move(frame));
+
+    auto stats = target::AllocationStats{};
+    const auto rewritten = target::rewrite(std::move(frames), stats);
+
+    ASSERT_EQ(rewritten.size(), 1);
+    EXPECT_GT(stats.spilled, 0);
+    EXPECT_GT(stats.reloads, 0);
+    // a full slot after the 4 bytes the frame had
+    EXPECT_GE(rewritten.front().size, 16);
+}
+
+TEST(Allocator, FramesWithoutFramePointerAllocateRbp) {
+    // one loaded value more than register_file has without rbp
+    constexpr int values = 15;
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 4};
+    for (int i = 0; i < values; i++) {
+        frame.instructions.emplace_back(target::Load{
+            .dst = target::VirtualRegister{.id = i, .size = 4},
+            .src = target::StackLocation{.offset = 4}});
+    }
+    const auto sum = target::VirtualRegister{.id = 0, .size = 4};
+    for (int i = 1; i < values; i++) {
+        frame.instructions.emplace_back(target::Add{
+            .dst = sum, .src = target::VirtualRegister{.id = i, .size = 4}});
+    }
+    frame.instructions.emplace_back(target::Store{
+        .dst = target::StackLocation{.offset = 4}, .src = sum});
+
+    auto framed = target::AllocationStats{};
+    std::ignore = target::rewrite({frame}, framed);
+    EXPECT_GT(framed.spilled, 0);
+
+    auto omitted = target::AllocationStats{};
+    const auto rewritten = target::rewrite(
+        {frame}, omitted, target::RegisterAllocator::LinearScan, true);
+    EXPECT_EQ(omitted.spilled, 0);
+    // the frame saves the caller's rbp around its own use of it
+    const auto code = codegen::Generate(
+        rewritten, codegen::FrameOptions{.omitFramePointer = true});
+    EXPECT_NE(code.find("ebp"), std::string::npos);
+    EXPECT_NE(code.find("push rbp"), std::string::npos);
+    EXPECT_NE(code.find("pop rbp"), std::string::npos);
+    EXPECT_EQ(code.find("mov rbp, rsp"), std::string::npos);
+}
+
+TEST(Allocator, ValuesLiveAcrossCallsTakeCalleeSavedRegisters) {
+    const auto eax = target::HardcodedRegister{target::BaseRegister::AX, 4};
+    const auto across = target::VirtualRegister{.id = 0, .size = 4};
+    const auto after = target::VirtualRegister{.id = 1, .size = 4};
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 0};
+    frame.instructions.emplace_back(target::LoadI{.dst = across, .value = 1});
+    frame.instructions.emplace_back(target::Call{.name = "f", .dst = eax});
+    frame.instructions.emplace_back(target::Mov{.dst = after, .src = eax});
+    frame.instructions.emplace_back(target::Add{.dst = after, .src = across});
+    frame.instructions.emplace_back(target::Mov{.dst = eax, .src = after});
+    frame.instructions.emplace_back(target::Jump{.label = "end"});
+
+    auto is_callee_saved = [](const target::Register& reg) {
+        const auto base = std::get<target::HardcodedRegister>(reg).reg;
+        return std::ranges::find(target::callee_saved_regs, base) !=
+               target::callee_saved_regs.end();
+    };
+    for (const auto allocator : {target::RegisterAllocator::LinearScan,
+                                 target::RegisterAllocator::Graph}) {
+        auto stats = target::AllocationStats{};
+        const auto rewritten = target::rewrite({frame}, stats, allocator);
+        ASSERT_EQ(rewritten.size(), 1);
+        const auto& code = rewritten.front().instructions;
+        const auto* constant = std::get_if<target::LoadI>(&code[0]);
+        ASSERT_NE(constant, nullptr);
+        EXPECT_TRUE(is_callee_saved(constant->dst));
+        // the sum is only live between two instructions without a call
+        for (const auto& ins : code) {
+            if (const auto* add = std::get_if<target::Add>(&ins)) {
+                EXPECT_FALSE(is_callee_saved(add->dst));
+            }
+        }
+        // only the register the frame used is saved
+        const auto asm_code = codegen::Generate(rewritten);
+        EXPECT_NE(asm_code.find("push rbx"), std::string::npos);
+        EXPECT_NE(asm_code.find("pop rbx"), std::string::npos);
+        EXPECT_EQ(asm_code.find("push r12"), std::string::npos);
+    }
+}
+
+// loops that each keep ten loaded values live at once and return their sum
+// through ax
+[[nodiscard]] auto make_loop_frame(int loops) -> target::Frame {
+    constexpr int values = 10;
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 8};
+    int next = 0;
+    for (int l = 0; l < loops; l++) {
+        const auto label = "L" + std::to_string(l);
+        frame.instructions.emplace_back(target::Label{.name = label});
+        const auto first = next;
+        for (int i = 0; i < values; i++) {
+            frame.instructions.emplace_back(target::Load{
+                .dst = target::VirtualRegister{.id = next++, .size = 4},
+                .src = target::StackLocation{.offset = 4}});
+        }
+        const auto sum = target::VirtualRegister{.id = first, .size = 4};
+        for (int i = values - 1; i > 0; i--) {
+            frame.instructions.emplace_back(target::Add{
+                .dst = sum,
+                .src = target::VirtualRegister{.id = first + i, .size = 4}});
+        }
+        frame.instructions.emplace_back(target::Mov{
+            .dst = target::HardcodedRegister{.reg = target::BaseRegister::AX,
+                                             .size = 4},
+            .src = sum});
+        frame.instructions.emplace_back(target::Store{
+            .dst = target::StackLocation{.offset = 8},
+            .src = target::HardcodedRegister{.reg = target::BaseRegister::AX,
+                                             .size = 4}});
+        frame.instructions.emplace_back(target::CmpI{.dst = sum, .value = 0});
+        frame.instructions.emplace_back(target::JumpLess{.label = label});
+    }
+    return frame;
+}
+
+TEST(Allocator, BenchmarkGraphColoringAgainstLinearScan) {
+    constexpr int loops = 2000;
+    for (const auto allocator : {target::RegisterAllocator::LinearScan,
+                                 target::RegisterAllocator::Graph}) {
+        std::vector<target::Frame> frames;
+        frames.push_back(make_loop_frame(loops));
+        auto stats = target::AllocationStats{};
+        const auto start = std::chrono::steady_clock::now();
+        const auto rewritten =
+            target::rewrite(std::move(frames), stats, allocator);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const auto elapsed_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                .count();
+        const auto name = allocator == target::RegisterAllocator::Graph
+                              ? std::string("graph")
+                              : std::string("linear");
+        std::cout << name << ": " << elapsed_ms << "ms, "
+                  << rewritten.front().instructions.size()
+                  << " instructions, " << stats.reloads << " reloads, "
+                  << stats.stores << " stores, " << stats.coalesced
+                  << " moves coalesced" << std::endl;
+        RecordProperty(name + "_ms", std::to_string(elapsed_ms));
+        RecordProperty(name + "_instructions",
+                       std::to_string(rewritten.front().instructions.size()));
+
+        if (allocator == target::RegisterAllocator::Graph) {
+            // ten values fit the larger palette, and every sum is computed
+            // straight into ax
+            EXPECT_EQ(stats.spilled, 0);
+            EXPECT_EQ(stats.coalesced, loops);
+        }
+        for (const auto& ins : rewritten.front().instructions) {
+            EXPECT_FALSE(target::get_src_register(ins).has_value());
+            EXPECT_FALSE(target::get_dest_register(ins).has_value());
+        }
+    }
+}
+
+/** Liveness **/
+
+// for (...) { sum = sum + step; } with step defined before the loop and the
+// condition block placed after the body, the way for loops are lowered
+[[nodiscard]] auto make_for_loop_frame() -> target::Frame {
+    const auto step = target::VirtualRegister{.id = 0, .size = 4};
+    const auto sum = target::VirtualRegister{.id = 1, .size = 4};
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 0};
+    frame.instructions.emplace_back(target::LoadI{.dst = step, .value = 3});
+    frame.instructions.emplace_back(target::LoadI{.dst = sum, .value = 0});
+    frame.instructions.emplace_back(target::Jump{.label = "L0"});
+    frame.instructions.emplace_back(target::Label{.name = "L1"});
+    frame.instructions.emplace_back(target::Add{.dst = sum, .src = step});
+    frame.instructions.emplace_back(target::Label{.name = "L0"});
+    // the condition needs enough registers to reuse step's if it were free
+    const auto bound = target::VirtualRegister{.id = 2, .size = 4};
+    frame.instructions.emplace_back(target::LoadI{.dst = bound, .value = 0});
+    for (int i = 3; i < 10; i++) {
+        const auto part = target::VirtualRegister{.id = i, .size = 4};
+        frame.instructions.emplace_back(target::LoadI{.dst = part, .value = 4});
+        frame.instructions.emplace_back(
+            target::Add{.dst = bound, .src = part});
+    }
+    frame.instructions.emplace_back(target::Cmp{.dst = sum, .src = bound});
+    frame.instructions.emplace_back(target::JumpLess{.label = "L1"});
+    frame.instructions.emplace_back(target::Mov{
+        .dst = target::HardcodedRegister{.reg = target::BaseRegister::AX,
+                                         .size = 4},
+        .src = sum});
+    frame.instructions.emplace_back(target::Jump{.label = "end"});
+    return frame;
+}
+
+TEST(Liveness, ValueUsedInLoopBodyIsLiveAcrossBackEdge) {
+    const auto frame = make_for_loop_frame();
+    const auto cfg = target::buildControlFlowGraph(frame);
+    const auto nodes = target::register_file_size + 10;
+    const auto liveness = target::computeLiveness(frame, cfg, nodes);
+    const auto step = target::register_file_size + 0;
+    const auto bound = target::register_file_size + 2;
+    const auto condition = cfg.blockOf[5];
+
+    EXPECT_TRUE(liveness.liveIn[condition].test(step));
+    EXPECT_TRUE(liveness.liveOut[condition].test(step));
+    EXPECT_FALSE(liveness.liveIn[condition].test(bound));
+
+    // the JumpLess back to the body, followed by the return
+    const auto backEdge = static_cast<int>(frame.instructions.size()) - 3;
+    const auto intervals = target::computeLiveIntervals(frame);
+    EXPECT_EQ(intervals.start[0], 0);
+    EXPECT_EQ(intervals.end[0], backEdge);
+}
+
+TEST(Liveness, LinearScanKeepsLoopCarriedValueInItsRegister) {
+    std::vector<target::Frame> frames;
+    frames.push_back(make_for_loop_frame());
+    const auto rewritten = target::rewrite(std::move(frames));
+    const auto& instructions = rewritten.front().instructions;
+
+    const auto step = std::get<target::HardcodedRegister>(
+        std::get<target::LoadI>(instructions.front()).dst);
+    const auto condition = std::ranges::find_if(
+        instructions, [](const target::Instruction& ins) {
+            const auto* label = std::get_if<target::Label>(&ins);
+            return label != nullptr && label->name == "L0";
+        });
+    const auto backEdge =
+        std::ranges::find_if(instructions, [](const target::Instruction& ins) {
+            return std::holds_alternative<target::JumpLess>(ins);
+        });
+    ASSERT_LT(condition, backEdge);
+    for (auto it = condition; it != backEdge; ++it) {
+        if (!target::writes_dest(*it)) {
+            continue;
+        }
+        std::visit(
+            [&step](auto&& arg) {
+                if constexpr (target::HasRegisterDest<decltype(arg)>) {
+                    EXPECT_NE(std::get<target::HardcodedRegister>(arg.dst).reg,
+                              step.reg);
+                }
+            },
+            *it);
+    }
+}
+
+/** SSA **/
+
+// int sum = 0; for (int i = 0; i < 5; i = i + 1) { sum = sum + i; }
+// return sum; as Produce_IR lowers it
+[[nodiscard]] auto make_sum_loop_frame() -> qa_ir::Frame {
+    const auto sum = qa_ir::Variable{.name = "sum", .version = 1, .size = 4};
+    const auto i = qa_ir::Variable{.name = "i", .version = 1, .size = 4};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::Mov{.dst = sum, .src = 0});
+    ops.emplace_back(qa_ir::Mov{.dst = i, .src = 0});
+    ops.emplace_back(qa_ir::Jump{.label = {"L0"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(
+        qa_ir::Add{.dst = qa_ir::Temp{0, 4}, .left = sum, .right = i});
+    ops.emplace_back(qa_ir::Mov{.dst = sum, .src = qa_ir::Temp{0, 4}});
+    ops.emplace_back(
+        qa_ir::Add{.dst = qa_ir::Temp{1, 4}, .left = i, .right = 1});
+    ops.emplace_back(qa_ir::Mov{.dst = i, .src = qa_ir::Temp{1, 4}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Compare{.left = i, .right = 5});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"L1"},
+                                                .falseLabel = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Ret{.value = sum});
+    return frame;
+}
+
+TEST(SSA, DominatorsAndFrontiersOfForLoop) {
+    auto frame = make_sum_loop_frame();
+    qa_ir::FreshNames names(frame);
+    qa_ir::NormalizeBlocks(frame, names);
+    const auto cfg = qa_ir::BuildCFG(frame);
+    ASSERT_EQ(cfg.blocks.size(), 4);
+    const auto entry = cfg.blocks.front().label;
+    const auto body = cfg.blockOf.at("L1");
+    const auto condition = cfg.blockOf.at("L0");
+    const auto exit = cfg.blockOf.at("L2");
+    EXPECT_NE(entry, "L1");
+
+    const auto tree = qa_ir::ComputeDominators(cfg);
+    EXPECT_EQ(tree.idom[condition], 0);
+    EXPECT_EQ(tree.idom[body], condition);
+    EXPECT_EQ(tree.idom[exit], condition);
+
+    const auto frontiers = qa_ir::DominanceFrontiers(cfg, tree);
+    EXPECT_EQ(frontiers[body], std::vector<int>{condition});
+    EXPECT_EQ(frontiers[condition], std::vector<int>{condition});
+    EXPECT_TRUE(frontiers[exit].empty());
+}
+
+// an outer loop around groups of loops whose body is a diamond, four
+// blocks per group
+[[nodiscard]] auto make_nested_loops_frame(int groups) -> qa_ir::Frame {
+    const auto x = qa_ir::Variable{.name = "x", .version = 1, .size = 4};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    auto label = [](const std::string& kind, int g) {
+        return qa_ir::Label{kind + std::to_string(g)};
+    };
+    ops.emplace_back(qa_ir::LabelDef{.label = {"entry"}});
+    ops.emplace_back(qa_ir::Mov{.dst = x, .src = 0});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"outer"}});
+    for (int g = 0; g < groups; g++) {
+        const auto next =
+            g + 1 < groups ? label("H", g + 1) : qa_ir::Label{"latch"};
+        ops.emplace_back(qa_ir::LabelDef{.label = label("H", g)});
+        ops.emplace_back(qa_ir::Compare{.left = x, .right = g});
+        ops.emplace_back(qa_ir::ConditionalJumpLess{
+            .trueLabel = label("A", g), .falseLabel = label("B", g)});
+        ops.emplace_back(qa_ir::LabelDef{.label = label("A", g)});
+        ops.emplace_back(qa_ir::Mov{.dst = x, .src = 1});
+        ops.emplace_back(qa_ir::Jump{.label = label("J", g)});
+        ops.emplace_back(qa_ir::LabelDef{.label = label("B", g)});
+        ops.emplace_back(qa_ir::Mov{.dst = x, .src = 2});
+        ops.emplace_back(qa_ir::LabelDef{.label = label("J", g)});
+        ops.emplace_back(qa_ir::Compare{.left = x, .right = 0});
+        ops.emplace_back(qa_ir::ConditionalJumpLess{
+            .trueLabel = label("H", g), .falseLabel = next});
+    }
+    ops.emplace_back(qa_ir::LabelDef{.label = {"latch"}});
+    ops.emplace_back(qa_ir::Compare{.left = x, .right = 1});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"outer"},
+                                                .falseLabel = {"done"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"done"}});
+    ops.emplace_back(qa_ir::Ret{.value = x});
+    return frame;
+}
+
+TEST(Analysis, PostDominatorsAndLoopNesting) {
+    const auto frame = make_nested_loops_frame(3);
+    qa_ir::FrameAnalyses analyses(frame);
+    const auto& cfg = analyses.CFG();
+    auto block = [&cfg](const std::string& name) {
+        return cfg.blockOf.at(name);
+    };
+    const auto& tree = analyses.Dominators();
+    EXPECT_TRUE(qa_ir::Dominates(tree, block("H1"), block("J1")));
+    EXPECT_FALSE(qa_ir::Dominates(tree, block("A1"), block("J1")));
+    EXPECT_TRUE(qa_ir::Dominates(tree, block("outer"), block("done")));
+    EXPECT_EQ(analyses.Frontiers()[block("A1")],
+              std::vector<int>{block("J1")});
+
+    const auto& post = analyses.PostDominators();
+    const auto exit = static_cast<int>(cfg.blocks.size());
+    EXPECT_EQ(post.idom[block("H1")], block("J1"));
+    EXPECT_EQ(post.idom[block("J1")], block("H2"));
+    EXPECT_EQ(post.idom[block("done")], exit);
+    EXPECT_TRUE(qa_ir::Dominates(post, block("latch"), block("entry")));
+    EXPECT_FALSE(qa_ir::Dominates(post, block("A0"), block("H0")));
+
+    const auto& forest = analyses.Loops();
+    ASSERT_EQ(forest.loops.size(), 4);
+    const auto outer = forest.loopOf[block("outer")];
+    EXPECT_EQ(forest.parent[outer], -1);
+    EXPECT_EQ(forest.children[outer].size(), 3);
+    const auto inner = forest.loopOf[block("A2")];
+    EXPECT_EQ(forest.loops[inner].header, block("H2"));
+    EXPECT_EQ(forest.parent[inner], outer);
+    EXPECT_EQ(forest.depth[block("B0")], 2);
+    EXPECT_EQ(forest.depth[block("latch")], 1);
+    EXPECT_EQ(forest.depth[block("entry")], 0);
+}
+
+TEST(Analysis, CachedUntilInvalidated) {
+    const auto frame = make_nested_loops_frame(2);
+    qa_ir::FrameAnalyses analyses(frame);
+    std::ignore = analyses.Loops();
+    EXPECT_EQ(analyses.Computations(), 3);
+    std::ignore = analyses.Loops();
+    std::ignore = analyses.Dominators();
+    EXPECT_EQ(analyses.Computations(), 3);
+
+    // the dominator tree goes, so do the loops derived from it
+    analyses.Invalidate(
+        qa_ir::PreservedAnalyses::None().Preserve(qa_ir::Analysis::CFG));
+    std::ignore = analyses.Loops();
+    EXPECT_EQ(analyses.Computations(), 5);
+
+    analyses.Invalidate(qa_ir::PreservedAnalyses::All());
+    std::ignore = analyses.Loops();
+    EXPECT_EQ(analyses.Computations(), 5);
+
+    // the dominator tree only names blocks, so it outlives the CFG
+    analyses.Invalidate(qa_ir::PreservedAnalyses::None().Preserve(
+        qa_ir::Analysis::Dominators));
+    std::ignore = analyses.Dominators();
+    EXPECT_EQ(analyses.Computations(), 5);
+    std::ignore = analyses.Loops();
+    EXPECT_EQ(analyses.Computations(), 7);
+}
+
+TEST(Analysis, KeptByPassesThatKeepTheBlocks) {
+    auto frame = make_nested_loops_frame(2);
+    // dead, so removing it moves every block after A0
+    auto& ops = frame.instructions;
+    const auto a0 = std::ranges::find_if(ops, [](const auto& op) {
+        const auto* label = std::get_if<qa_ir::LabelDef>(&op);
+        return label != nullptr && label->label.name == "A0";
+    });
+    ops.insert(a0 + 1, qa_ir::Add{.dst = qa_ir::Temp{0, 4},
+                                  .left = qa_ir::Temp{1, 4},
+                                  .right = 1});
+    qa_ir::FrameAnalyses analyses(frame);
+    const auto& forest = analyses.Loops();
+    EXPECT_EQ(analyses.Computations(), 3);
+
+    const auto& registry = passes::Registry();
+    const auto dce = std::ranges::find(registry, "dce", &passes::Pass::name);
+    ASSERT_NE(dce, registry.end());
+    const auto options = passes::PassOptions{};
+    auto stats = target::PeepholeStats{};
+    auto ctx = passes::PassContext{
+        .options = options, .analyses = &analyses, .peephole = stats};
+    EXPECT_EQ(std::get<passes::FramePass>(dce->run)(frame, ctx), 1);
+    analyses.Invalidate(dce->preserved);
+
+    // the loops are still cached, only the CFG is built again
+    EXPECT_EQ(&analyses.Loops(), &forest);
+    EXPECT_EQ(analyses.Computations(), 3);
+    std::ignore = analyses.CFG();
+    EXPECT_EQ(analyses.Computations(), 4);
+    qa_ir::FrameAnalyses fresh(frame);
+    EXPECT_EQ(fresh.Loops().loopOf, forest.loopOf);
+    EXPECT_EQ(fresh.Loops().parent, forest.parent);
+}
+
+TEST(Analysis, BenchmarkLinearOnLargeFrames) {
+    // best of a few runs over every analysis of a fresh cache
+    auto time_us = [](const qa_ir::Frame& frame) {
+        auto best = std::chrono::microseconds::max();
+        for (int run = 0; run < 3; run++) {
+            const auto start = std::chrono::steady_clock::now();
+            qa_ir::FrameAnalyses analyses(frame);
+            std::ignore = analyses.Frontiers();
+            std::ignore = analyses.PostDominators();
+            std::ignore = analyses.Loops();
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(
+                best,
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+        }
+        return best.count();
+    };
+    constexpr int groups = 2000;
+    const auto small = time_us(make_nested_loops_frame(groups));
+    const auto large = time_us(make_nested_loops_frame(8 * groups));
+    std::cout << "analyses of " << 4 * groups << " and " << 32 * groups
+              << " blocks took " << small << "us and " << large << "us"
+              << std::endl;
+    RecordProperty("analyses_small_us", std::to_string(small));
+    RecordProperty("analyses_large_us", std::to_string(large));
+    // eight times the blocks, well below the 64 times of a quadratic pass
+    EXPECT_LT(large, 24 * std::max<long long>(small, 100));
+}
+
+TEST(SSA, PromotesLoopVariablesThroughPhis) {
+    auto frame = make_sum_loop_frame();
+    qa_ir::ConstructSSA(frame);
+
+    int phis = 0;
+    for (const auto& op : frame.instructions) {
+        if (const auto* dst = qa_ir::defined_value(op)) {
+            EXPECT_FALSE(std::holds_alternative<qa_ir::Variable>(*dst));
+        }
+        qa_ir::for_each_used_value(op, [](const qa_ir::Value& value) {
+            EXPECT_FALSE(std::holds_alternative<qa_ir::Variable>(value));
+        });
+        if (const auto* phi = std::get_if<qa_ir::Phi>(&op)) {
+            phis++;
+            EXPECT_EQ(phi->args.size(), 2);
+        }
+    }
+    // sum and i meet at the loop condition
+    EXPECT_EQ(phis, 2);
+
+    qa_ir::DestructSSA(frame);
+    for (const auto& op : frame.instructions) {
+        EXPECT_FALSE(std::holds_alternative<qa_ir::Phi>(op));
+    }
+    std::vector<qa_ir::Frame> frames;
+    frames.push_back(std::move(frame));
+    const auto lowered = target::LowerIR(frames);
+    // no stack slots are left for the promoted variables
+    EXPECT_EQ(lowered.front().size, 0);
+}
+
+TEST(SSA, KeepsVariablesOfMixedSizesInMemory) {
+    const auto narrow = qa_ir::Variable{.name = "x", .version = 0, .size = 4};
+    const auto wide = qa_ir::Variable{.name = "x", .version = 0, .size = 8};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Mov{.dst = narrow, .src = 1});
+    ops.emplace_back(qa_ir::Mov{.dst = qa_ir::Temp{0, 8}, .src = wide});
+    ops.emplace_back(qa_ir::Ret{.value = qa_ir::Temp{0, 8}});
+
+    // renaming x would put a 4 byte temp where an 8 byte one is read
+    qa_ir::ConstructSSA(frame);
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Variable>(
+        std::get<qa_ir::Mov>(ops[1]).dst));
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Variable>(
+        std::get<qa_ir::Mov>(ops[2]).src));
+}
+
+/** Simplify **/
+
+TEST(Simplify, FoldsConstantsAndKnownBranches) {
+    const auto x = qa_ir::Variable{.name = "x", .version = 1, .size = 4};
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::Add{.dst = t(0), .left = 2, .right = 3});
+    ops.emplace_back(
+        qa_ir::Add{.dst = t(1), .left = 2147483647, .right = t(0)});
+    ops.emplace_back(qa_ir::Add{.dst = t(2), .left = 1, .right = x});
+    ops.emplace_back(qa_ir::Sub{.dst = t(3), .left = x, .right = x});
+    ops.emplace_back(qa_ir::Compare{.left = 5, .right = t(0)});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"L1"},
+                                                .falseLabel = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Ret{.value = t(1)});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Add{.dst = t(4), .left = t(2), .right = t(3)});
+    ops.emplace_back(qa_ir::Ret{.value = t(4)});
+
+    // t0, t1, t3 and the Compare
+    EXPECT_EQ(qa_ir::Simplify(frame), 4);
+    ASSERT_EQ(ops.size(), 7);
+    // 2147483647 + 5 wraps around
+    EXPECT_EQ(std::get<int>(std::get<qa_ir::Ret>(ops[3]).value), -2147483644);
+    const auto& canonical = std::get<qa_ir::Add>(ops[0]);
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Variable>(canonical.left));
+    EXPECT_EQ(std::get<int>(canonical.right), 1);
+    // 5 < 5 never holds
+    EXPECT_EQ(std::get<qa_ir::Jump>(ops[1]).label.name, "L2");
+    // t2 - 0
+    const auto& sum = std::get<qa_ir::Mov>(ops[5]);
+    EXPECT_EQ(std::get<qa_ir::Temp>(sum.src).id, 2);
+}
+
+/** SCCP **/
+
+TEST(SCCP, ConstantGuardedBranchIsRemoved) {
+    const auto flag = qa_ir::Variable{.name = "flag", .version = 1, .size = 4};
+    const auto y = qa_ir::Variable{.name = "y", .version = 1, .size = 4};
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::Mov{.dst = flag, .src = 0});
+    ops.emplace_back(qa_ir::Mov{.dst = y, .src = 5});
+    ops.emplace_back(qa_ir::Compare{.left = flag, .right = 1});
+    ops.emplace_back(qa_ir::ConditionalJumpEqual{.trueLabel = {"L1"},
+                                                 .falseLabel = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Mov{.dst = y, .src = 7});
+    ops.emplace_back(qa_ir::Jump{.label = {"L3"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Jump{.label = {"L3"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L3"}});
+    ops.emplace_back(qa_ir::Ret{.value = y});
+
+    qa_ir::ConstructSSA(frame);
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_GT(qa_ir::PropagateConstants(frame, analyses), 0);
+
+    for (const auto& op : ops) {
+        EXPECT_FALSE(std::holds_alternative<qa_ir::Compare>(op));
+        EXPECT_FALSE(std::holds_alternative<qa_ir::Phi>(op));
+        if (const auto* label = std::get_if<qa_ir::LabelDef>(&op)) {
+            EXPECT_NE(label->label.name, "L1");
+        }
+    }
+    EXPECT_EQ(std::get<int>(std::get<qa_ir::Ret>(ops.back()).value), 5);
+}
+
+/** GVN **/
+
+TEST(GVN, ReusesValuesUntilMemoryChanges) {
+    const auto p = qa_ir::Temp{0, 8};
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Add{.dst = t(1), .left = t(9), .right = 1});
+    ops.emplace_back(qa_ir::Add{.dst = t(2), .left = 1, .right = t(9)});
+    ops.emplace_back(qa_ir::Deref{.dst = t(3), .src = p});
+    ops.emplace_back(qa_ir::Call{.name = "f", .args = {}, .dst = t(4)});
+    ops.emplace_back(qa_ir::Deref{.dst = t(5), .src = p});
+    ops.emplace_back(qa_ir::Deref{.dst = t(6), .src = p});
+    ops.emplace_back(qa_ir::Ret{.value = t(6)});
+
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_EQ(qa_ir::NumberValues(frame, analyses), 2);
+    // Add is commutative
+    EXPECT_EQ(std::get<qa_ir::Temp>(std::get<qa_ir::Mov>(ops[2]).src).id, 1);
+    // the call may have stored through p
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Deref>(ops[5]));
+    EXPECT_EQ(std::get<qa_ir::Temp>(std::get<qa_ir::Mov>(ops[6]).src).id, 5);
+}
+
+/** Copies **/
+
+TEST(Copies, PropagatesChainsOfMoves) {
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Add{.dst = t(1), .left = t(0), .right = 1});
+    ops.emplace_back(qa_ir::Mov{.dst = t(2), .src = t(1)});
+    ops.emplace_back(qa_ir::Mov{.dst = t(3), .src = t(2)});
+    ops.emplace_back(qa_ir::Ret{.value = t(3)});
+
+    EXPECT_EQ(qa_ir::PropagateCopies(frame), 2);
+    ASSERT_EQ(ops.size(), 3);
+    EXPECT_EQ(std::get<qa_ir::Temp>(std::get<qa_ir::Ret>(ops[2]).value).id, 1);
+}
+
+TEST(Copies, CoalescesOnlyWhenLiveRangesDoNotOverlap) {
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Add{.dst = t(1), .left = t(0), .right = 1});
+    ops.emplace_back(qa_ir::Mov{.dst = t(2), .src = t(1)});
+    // t2 still holds the old value while t3 is given a new one
+    ops.emplace_back(qa_ir::Mov{.dst = t(3), .src = t(2)});
+    ops.emplace_back(qa_ir::Add{.dst = t(3), .left = t(3), .right = 1});
+    ops.emplace_back(qa_ir::Add{.dst = t(4), .left = t(2), .right = t(3)});
+    ops.emplace_back(qa_ir::Ret{.value = t(4)});
+
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_EQ(qa_ir::CoalesceCopies(frame, analyses), 1);
+    ASSERT_EQ(ops.size(), 6);
+    const auto& sum = std::get<qa_ir::Add>(ops[4]);
+    EXPECT_EQ(std::get<qa_ir::Temp>(std::get<qa_ir::Add>(ops[1]).dst).id,
+              std::get<qa_ir::Temp>(sum.left).id);
+    EXPECT_NE(std::get<qa_ir::Temp>(sum.left).id,
+              std::get<qa_ir::Temp>(sum.right).id);
+}
+
+/** Dead code **/
+
+TEST(DCE, RemovesUnusedValuesButKeepsCalls) {
+    const auto x = qa_ir::Variable{.name = "x", .version = 1, .size = 4};
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Add{.dst = t(0), .left = 1, .right = 2});
+    ops.emplace_back(qa_ir::Add{.dst = t(1), .left = t(0), .right = 3});
+    ops.emplace_back(qa_ir::Mov{.dst = x, .src = t(1)});
+    ops.emplace_back(qa_ir::Call{.name = "f", .args = {}, .dst = t(2)});
+    ops.emplace_back(qa_ir::Ret{.value = 0});
+    ops.emplace_back(qa_ir::Add{.dst = t(3), .left = 4, .right = 5});
+    ops.emplace_back(qa_ir::Ret{.value = t(3)});
+
+    // the store to x, the Adds feeding it and everything after the first Ret
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_EQ(qa_ir::EliminateDeadCode(frame, analyses), 5);
+    ASSERT_EQ(ops.size(), 3);
+    EXPECT_TRUE(std::holds_alternative<qa_ir::LabelDef>(ops[0]));
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Call>(ops[1]));
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Ret>(ops[2]));
+}
+
+TEST(DCE, BranchesSkipBlocksThatOnlyJump) {
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Compare{.left = qa_ir::Temp{0, 4}, .right = 1});
+    ops.emplace_back(qa_ir::ConditionalJumpEqual{.trueLabel = {"L1"},
+                                                 .falseLabel = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Jump{.label = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Jump{.label = {"L3"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L3"}});
+    ops.emplace_back(qa_ir::Ret{.value = 0});
+
+    // both targets end up at L3, so the branch and its Compare go as well
+    EXPECT_EQ(qa_ir::SimplifyControlFlow(frame), 7);
+    ASSERT_EQ(ops.size(), 2);
+    EXPECT_TRUE(std::holds_alternative<qa_ir::LabelDef>(ops[0]));
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Ret>(ops[1]));
+}
+
+/** Loops **/
+
+TEST(LICM, HoistsInvariantArithmeticIntoPreheader) {
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Mov{.dst = t(1), .src = 0});
+    ops.emplace_back(qa_ir::Jump{.label = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Add{.dst = t(3), .left = t(8), .right = t(9)});
+    ops.emplace_back(qa_ir::Add{.dst = t(4), .left = t(2), .right = t(3)});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Phi{
+        .dst = t(2),
+        .args = {{.predecessor = {"L0"}, .value = t(1)},
+                 {.predecessor = {"L1"}, .value = t(4)}}});
+    ops.emplace_back(qa_ir::Compare{.left = t(2), .right = 100});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"L1"},
+                                                .falseLabel = {"L3"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L3"}});
+    ops.emplace_back(qa_ir::Ret{.value = t(2)});
+
+    const auto cfg = qa_ir::BuildCFG(frame);
+    const auto loops =
+        qa_ir::FindNaturalLoops(cfg, qa_ir::ComputeDominators(cfg));
+    ASSERT_EQ(loops.size(), 1);
+    EXPECT_EQ(loops[0].header, cfg.blockOf.at("L2"));
+    EXPECT_EQ(loops[0].latches, std::vector<int>{cfg.blockOf.at("L1")});
+
+    // only t8 + t9 is the same on every trip; L0 already is a preheader
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_EQ(qa_ir::HoistLoopInvariants(frame, analyses), 1);
+    ASSERT_EQ(ops.size(), 12);
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Add>(ops[2]));
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Jump>(ops[3]));
+    EXPECT_EQ(std::get<qa_ir::Temp>(std::get<qa_ir::Add>(ops[5]).dst).id, 4);
+}
+
+TEST(LICM, KeepsAddressTakenVariablesInMemory) {
+    const auto v = qa_ir::Variable{.name = "v", .version = 0, .size = 4};
+    const auto w = qa_ir::Variable{.name = "w", .version = 0, .size = 4};
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Mov{.dst = t(1), .src = 0});
+    ops.emplace_back(qa_ir::Jump{.label = {"L2"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Mov{.dst = v, .src = t(2)});
+    ops.emplace_back(qa_ir::Addr{.dst = qa_ir::Temp{3, 8}, .src = v});
+    ops.emplace_back(qa_ir::Mov{.dst = w, .src = t(2)});
+    ops.emplace_back(qa_ir::Add{.dst = t(4), .left = t(2), .right = 1});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Phi{
+        .dst = t(2),
+        .args = {{.predecessor = {"L0"}, .value = t(1)},
+                 {.predecessor = {"L1"}, .value = t(4)}}});
+    ops.emplace_back(qa_ir::Compare{.left = t(2), .right = 5});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"L1"},
+                                                .falseLabel = {"L3"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L3"}});
+    ops.emplace_back(qa_ir::Ret{.value = t(2)});
+
+    // only w moves into temps and is loaded in the preheader. The address
+    // of v is the same on every trip and is hoisted.
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_EQ(qa_ir::HoistLoopInvariants(frame, analyses), 2);
+    const auto preheaderEnd = std::ranges::find_if(ops, [](const auto& op) {
+        return std::holds_alternative<qa_ir::Jump>(op);
+    });
+    ASSERT_EQ(std::distance(ops.begin(), preheaderEnd), 4);
+    const auto& load = std::get<qa_ir::Mov>(ops[2]);
+    EXPECT_EQ(std::get<qa_ir::Variable>(load.src).name, "w");
+    EXPECT_TRUE(std::holds_alternative<qa_ir::Addr>(ops[3]));
+    int storesToV = 0;
+    int storesToW = 0;
+    for (const auto& op : ops) {
+        const auto* dst = qa_ir::defined_value(op);
+        const auto* variable =
+            dst == nullptr ? nullptr : std::get_if<qa_ir::Variable>(dst);
+        storesToV += variable != nullptr && variable->name == "v" ? 1 : 0;
+        storesToW += variable != nullptr && variable->name == "w" ? 1 : 0;
+    }
+    // v is still stored on every trip, w once on the way out
+    EXPECT_EQ(storesToV, 1);
+    EXPECT_EQ(storesToW, 1);
+}
+
+TEST(LICM, PromotedVariablesStayInSSAForm) {
+    const auto v = qa_ir::Variable{.name = "v", .version = 0, .size = 4};
+    auto t = [](int id) { return qa_ir::Temp{id, 4}; };
+    auto frame = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L0"}});
+    ops.emplace_back(qa_ir::Mov{.dst = v, .src = 1});
+    ops.emplace_back(qa_ir::Addr{.dst = qa_ir::Temp{9, 8}, .src = v});
+    ops.emplace_back(qa_ir::Mov{.dst = t(1), .src = 0});
+    ops.emplace_back(qa_ir::Jump{.label = {"L2"}});
+    // s = s + v; v = 5;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L1"}});
+    ops.emplace_back(qa_ir::Mov{.dst = t(5), .src = v});
+    ops.emplace_back(qa_ir::Add{.dst = t(6), .left = t(3), .right = t(5)});
+    ops.emplace_back(qa_ir::Mov{.dst = v, .src = 5});
+    ops.emplace_back(qa_ir::Add{.dst = t(4), .left = t(2), .right = 1});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L2"}});
+    ops.emplace_back(qa_ir::Phi{
+        .dst = t(2),
+        .args = {{.predecessor = {"L0"}, .value = t(1)},
+                 {.predecessor = {"L1"}, .value = t(4)}}});
+    ops.emplace_back(qa_ir::Phi{
+        .dst = t(3),
+        .args = {{.predecessor = {"L0"}, .value = t(1)},
+                 {.predecessor = {"L1"}, .value = t(6)}}});
+    ops.emplace_back(qa_ir::Compare{.left = t(2), .right = 3});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"L1"},
+                                                .falseLabel = {"L3"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"L3"}});
+    ops.emplace_back(qa_ir::Deref{.dst = t(7), .src = qa_ir::Temp{9, 8}});
+    ops.emplace_back(qa_ir::Add{.dst = t(8), .left = t(3), .right = t(7)});
+    ops.emplace_back(qa_ir::Ret{.value = t(8)});
+
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_GT(qa_ir::HoistLoopInvariants(frame, analyses), 0);
+    std::map<int, int> assignments;
+    for (const auto& op : ops) {
+        const auto* dst = qa_ir::defined_value(op);
+        if (const auto* temp =
+                dst == nullptr ? nullptr : std::get_if<qa_ir::Temp>(dst)) {
+            EXPECT_EQ(++assignments[temp->id], 1) << "t" << temp->id;
+        }
+    }
+    // the first trip reads the v loaded in the preheader, later ones 5
+    const auto cfg = qa_ir::BuildCFG(frame);
+    const auto& header = cfg.blocks[cfg.blockOf.at("L2")];
+    const auto merged = std::ranges::count_if(
+        ops.begin() + header.begin, ops.begin() + header.end,
+        [](const auto& op) { return std::holds_alternative<qa_ir::Phi>(op); });
+    EXPECT_EQ(merged, 3);
+}
+
+TEST(Induction, FindsTheCounterOfForLoop) {
+    auto frame = make_sum_loop_frame();
+    qa_ir::ConstructSSA(frame);
+    qa_ir::PropagateCopies(frame);
+    qa_ir::FreshNames names(frame);
+    const auto cfg = qa_ir::BuildCFG(frame);
+    const auto tree = qa_ir::ComputeDominators(cfg);
+    const auto loops = qa_ir::FindNaturalLoops(cfg, tree);
+    ASSERT_EQ(loops.size(), 1);
+    const auto preheader =
+        qa_ir::EnsurePreheader(frame, names, cfg, loops[0]);
+    EXPECT_EQ(preheader, cfg.blocks.front().label);
+
+    const auto found =
+        qa_ir::FindInductionVariables(frame, cfg, tree, loops[0], preheader);
+    ASSERT_EQ(found.basics.size(), 1);
+    EXPECT_EQ(found.basics[0].init.constant, 0);
+    EXPECT_EQ(found.basics[0].step.constant, 1);
+    EXPECT_TRUE(found.basics[0].step.terms.empty());
+    // sum grows by i, which is no loop invariant
+    ASSERT_EQ(found.derived.size(), 1);
+    EXPECT_EQ(found.derived[0].value.id, found.basics[0].next.id);
+    EXPECT_EQ(found.derived[0].scale, 1);
+    EXPECT_EQ(found.derived[0].offset.constant, 1);
+}
+
+TEST(Unroll, ConstantTripCountLeavesNoLoop) {
+    auto frame = make_sum_loop_frame();
+    qa_ir::ConstructSSA(frame);
+    qa_ir::FrameAnalyses analyses(frame);
+    qa_ir::PropagateConstants(frame, analyses);
+    analyses.Invalidate(qa_ir::PreservedAnalyses::None());
+    qa_ir::PropagateCopies(frame);
+
+    EXPECT_EQ(qa_ir::UnrollLoops(frame, analyses, {}), 1);
+    analyses.Invalidate(qa_ir::PreservedAnalyses::None());
+    qa_ir::PropagateConstants(frame, analyses);
+    // 0 + 1 + 2 + 3 + 4 with the branches gone
+    const auto ret = std::ranges::find_if(frame.instructions, [](auto& op) {
+        return std::holds_alternative<qa_ir::Ret>(op);
+    });
+    ASSERT_NE(ret, frame.instructions.end());
+    EXPECT_EQ(std::get<int>(std::get<qa_ir::Ret>(*ret).value), 10);
+    const auto cfg = qa_ir::BuildCFG(frame);
+    EXPECT_TRUE(
+        qa_ir::FindNaturalLoops(cfg, qa_ir::ComputeDominators(cfg)).empty());
+}
+
+TEST(SCEV, SumOfCounterIsQuadraticAndEvaluatedAtExit) {
+    auto frame = make_sum_loop_frame();
+    // too many trips to unroll
+    std::get<qa_ir::Compare>(frame.instructions[9]).right = 1000;
+    qa_ir::ConstructSSA(frame);
+    qa_ir::FrameAnalyses analyses(frame);
+    qa_ir::PropagateConstants(frame, analyses);
+    analyses.Invalidate(qa_ir::PreservedAnalyses::None());
+    qa_ir::PropagateCopies(frame);
+
+    qa_ir::FreshNames names(frame);
+    qa_ir::NormalizeBlocks(frame, names);
+    const auto cfg = qa_ir::BuildCFG(frame);
+    const auto tree = qa_ir::ComputeDominators(cfg);
+    const auto loops = qa_ir::FindNaturalLoops(cfg, tree);
+    ASSERT_EQ(loops.size(), 1);
+    const auto preheader = cfg.blocks[0].label;
+    const auto counted =
+        qa_ir::FindCountedLoop(frame, cfg, tree, loops[0], preheader);
+    ASSERT_TRUE(counted.has_value());
+    EXPECT_EQ(qa_ir::ConstantTripCount(frame, *counted), 1000);
+    const auto recurrences =
+        qa_ir::AnalyzeScalarEvolution(frame, cfg, loops[0], *counted);
+    // sum is {0, +, 0, +, 1} next to i = {0, +, 1}
+    std::vector<int> degrees;
+    for (const auto& values : counted->phis) {
+        ASSERT_TRUE(recurrences.contains(values.phi.id));
+        degrees.push_back(static_cast<int>(
+            recurrences.at(values.phi.id).coefficients.size()));
+    }
+    std::ranges::sort(degrees);
+    EXPECT_EQ(degrees, (std::vector<int>{2, 3}));
+
+    EXPECT_EQ(qa_ir::EvaluateLoopExitValues(frame, analyses), 1);
+    analyses.Invalidate(qa_ir::PreservedAnalyses::None());
+    qa_ir::PropagateConstants(frame, analyses);
+    const auto ret = std::ranges::find_if(frame.instructions, [](auto& op) {
+        return std::holds_alternative<qa_ir::Ret>(op);
+    });
+    ASSERT_NE(ret, frame.instructions.end());
+    EXPECT_EQ(std::get<int>(std::get<qa_ir::Ret>(*ret).value), 499500);
+    const auto after = qa_ir::BuildCFG(frame);
+    EXPECT_TRUE(
+        qa_ir::FindNaturalLoops(after, qa_ir::ComputeDominators(after))
+            .empty());
+}
+
+/** Inlining **/
+
+// int twice(int x) { return x + x; } as Produce_IR lowers it
+[[nodiscard]] auto make_twice_frame() -> qa_ir::Frame {
+    const auto x = qa_ir::Variable{.name = "x", .version = 1, .size = 4};
+    auto frame = qa_ir::Frame{.name = "twice", .instructions = {}, .size = 0};
+    frame.instructions.emplace_back(qa_ir::MovR{
+        .dst = x,
+        .src = target::HardcodedRegister{.reg = target::param_regs[0],
+                                         .size = 4}});
+    frame.instructions.emplace_back(
+        qa_ir::Add{.dst = qa_ir::Temp{0, 4}, .left = x, .right = x});
+    frame.instructions.emplace_back(qa_ir::Ret{.value = qa_ir::Temp{0, 4}});
+    return frame;
+}
+
+TEST(Inline, SmallCalleeIsInlinedAndDropped) {
+    auto caller = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    caller.instructions.emplace_back(qa_ir::Call{
+        .name = "twice", .args = {21}, .dst = qa_ir::Temp{0, 4}});
+    caller.instructions.emplace_back(qa_ir::Ret{.value = qa_ir::Temp{0, 4}});
+    std::vector<qa_ir::Frame> frames;
+    frames.push_back(make_twice_frame());
+    frames.push_back(std::move(caller));
+
+    EXPECT_EQ(qa_ir::InlineCalls(frames, {}), 1);
+    ASSERT_EQ(frames.size(), 1);
+    auto& frame = frames.front();
+    EXPECT_EQ(frame.name, "main");
+    EXPECT_TRUE(std::ranges::none_of(frame.instructions, [](auto& op) {
+        return std::holds_alternative<qa_ir::Call>(op);
+    }));
+
+    qa_ir::ConstructSSA(frame);
+    qa_ir::FrameAnalyses analyses(frame);
+    qa_ir::PropagateConstants(frame, analyses);
+    const auto ret = std::ranges::find_if(frame.instructions, [](auto& op) {
+        return std::holds_alternative<qa_ir::Ret>(op);
+    });
+    ASSERT_NE(ret, frame.instructions.end());
+    EXPECT_EQ(std::get<int>(std::get<qa_ir::Ret>(*ret).value), 42);
+}
+
+TEST(Inline, RecursiveCallsAndTheLimitAreRespected) {
+    auto recursive = make_twice_frame();
+    recursive.instructions.insert(
+        recursive.instructions.begin() + 1,
+        qa_ir::Call{.name = "twice",
+                    .args = {qa_ir::Variable{"x", 1, 4}},
+                    .dst = qa_ir::Temp{1, 4}});
+    auto caller = qa_ir::Frame{.name = "main", .instructions = {}, .size = 0};
+    for (int i = 0; i < 2; i++) {
+        caller.instructions.emplace_back(qa_ir::Call{
+            .name = "twice", .args = {i}, .dst = qa_ir::Temp{i, 4}});
+    }
+    caller.instructions.emplace_back(qa_ir::Ret{.value = qa_ir::Temp{1, 4}});
+    std::vector<qa_ir::Frame> frames;
+    frames.push_back(std::move(recursive));
+    frames.push_back(caller);
+
+    EXPECT_EQ(qa_ir::InlineCalls(frames, {}), 0);
+    EXPECT_EQ(frames.size(), 2);
+
+    frames.clear();
+    frames.push_back(make_twice_frame());
+    frames.push_back(caller);
+    EXPECT_EQ(qa_ir::InlineCalls(frames, {.limit = 1}), 0);
+    EXPECT_EQ(qa_ir::InlineCalls(frames, {.limit = 2}), 2);
+    EXPECT_EQ(frames.size(), 1);
+}
+
+/** Tail calls **/
+
+// int f(int n) { return g(n); } with g the frame itself or another one
+[[nodiscard]] auto make_forwarding_frame(const std::string& callee)
+    -> qa_ir::Frame {
+    const auto n = qa_ir::Variable{.name = "n", .version = 1, .size = 4};
+    auto frame = qa_ir::Frame{.name = "f", .instructions = {}, .size = 0};
+    frame.instructions.emplace_back(qa_ir::MovR{
+        .dst = n,
+        .src = target::HardcodedRegister{.reg = target::param_regs[0],
+                                         .size = 4}});
+    frame.instructions.emplace_back(qa_ir::Call{
+        .name = callee, .args = {n}, .dst = qa_ir::Temp{0, 4}});
+    frame.instructions.emplace_back(qa_ir::Ret{.value = qa_ir::Temp{0, 4}});
+    return frame;
+}
+
+TEST(TailCall, SelfRecursionBecomesALoop) {
+    auto frame = make_forwarding_frame("f");
+    ASSERT_TRUE(qa_ir::IsTailCall(frame, 1));
+    EXPECT_EQ(qa_ir::EliminateTailRecursion(frame), 1);
+    EXPECT_TRUE(std::ranges::none_of(frame.instructions, [](auto& op) {
+        return std::holds_alternative<qa_ir::Call>(op);
+    }));
+    const auto cfg = qa_ir::BuildCFG(frame);
+    EXPECT_EQ(
+        qa_ir::FindNaturalLoops(cfg, qa_ir::ComputeDominators(cfg)).size(), 1);
+}
+
+TEST(TailCall, SiblingCallLeavesTheFrameUnlessItsAddressEscapes) {
+    auto is_tail_call = [](const target::Instruction& ins) {
+        return std::holds_alternative<target::TailCall>(ins);
+    };
+    std::vector<qa_ir::Frame> frames;
+    frames.push_back(make_forwarding_frame("g"));
+    auto lowered = target::LowerIR(frames);
+    EXPECT_EQ(std::ranges::count_if(lowered.front().instructions,
+                                    is_tail_call),
+              1);
+
+    // g(&n) would read a slot of the frame after it is gone
+    auto& ops = frames.front().instructions;
+    ops.insert(ops.begin() + 1,
+               qa_ir::Addr{.dst = qa_ir::Temp{1, 8},
+                           .src = qa_ir::Variable{"n", 1, 4}});
+    std::get<qa_ir::Call>(ops[2]).args = {qa_ir::Temp{1, 8}};
+    lowered = target::LowerIR(frames);
+    EXPECT_TRUE(
+        std::ranges::none_of(lowered.front().instructions, is_tail_call));
+}
+
+/** Peephole **/
+
+TEST(Peephole, RulesRunToAFixedPoint) {
+    const auto eax = target::HardcodedRegister{target::BaseRegister::AX, 4};
+    const auto ebx = target::HardcodedRegister{target::BaseRegister::BX, 4};
+    const auto ecx = target::HardcodedRegister{target::BaseRegister::CX, 4};
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 8};
+    auto& code = frame.instructions;
+    code.emplace_back(target::Store{.dst = {4}, .src = eax});
+    code.emplace_back(target::Load{.dst = eax, .src = {4}});
+    code.emplace_back(target::AddI{.dst = eax, .value = 0});
+    code.emplace_back(target::Mov{.dst = ebx, .src = ebx});
+    code.emplace_back(target::Jump{.label = "L1"});
+    code.emplace_back(target::LoadI{.dst = ecx, .value = 7});
+    code.emplace_back(target::Label{.name = "L1"});
+    code.emplace_back(target::Store{.dst = {8}, .src = ebx});
+    code.emplace_back(target::Load{.dst = ecx, .src = {8}});
+    code.emplace_back(target::Jump{.label = "end"});
+
+    auto stats = target::PeepholeStats{};
+    EXPECT_EQ(target::Peephole(frame, stats), 7);
+    ASSERT_EQ(code.size(), 4);
+    EXPECT_TRUE(std::holds_alternative<target::Store>(code[0]));
+    EXPECT_TRUE(std::holds_alternative<target::Label>(code[1]));
+    const auto* copy = std::get_if<target::Mov>(&code[3]);
+    ASSERT_NE(copy, nullptr);
+    EXPECT_TRUE(std::get<target::HardcodedRegister>(copy->dst) == ecx);
+    EXPECT_TRUE(std::get<target::HardcodedRegister>(copy->src) == ebx);
+
+    // the jump over dead code only meets its label once the code is gone
+    EXPECT_EQ(stats.fired["unreachable"], 1);
+    EXPECT_EQ(stats.fired["jump-to-next"], 2);
+    EXPECT_EQ(stats.fired["store-load"], 2);
+    EXPECT_EQ(stats.fired["add-zero"], 1);
+    EXPECT_EQ(stats.fired["self-move"], 1);
+}
+
+TEST(Peephole, RewritesInPlaceWithoutLosingKeptInstructions) {
+    const auto eax = target::HardcodedRegister{target::BaseRegister::AX, 4};
+    const auto ecx = target::HardcodedRegister{target::BaseRegister::CX, 4};
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 4};
+    auto& code = frame.instructions;
+    // store-load keeps both instructions while nothing before it was removed
+    code.emplace_back(target::Label{.name = "L1"});
+    code.emplace_back(target::Store{.dst = {4}, .src = eax});
+    code.emplace_back(target::Load{.dst = ecx, .src = {4}});
+    for (int i = 0; i < 10000; i++) {
+        code.emplace_back(target::AddI{.dst = ecx, .value = 0});
+    }
+    code.emplace_back(target::Label{.name = "L2"});
+
+    auto stats = target::PeepholeStats{};
+    EXPECT_EQ(target::Peephole(frame, stats), 10001);
+    ASSERT_EQ(code.size(), 4);
+    const auto* first = std::get_if<target::Label>(&code[0]);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first->name, "L1");
+    EXPECT_TRUE(std::holds_alternative<target::Store>(code[1]));
+    EXPECT_TRUE(std::holds_alternative<target::Mov>(code[2]));
+    const auto* last = std::get_if<target::Label>(&code[3]);
+    ASSERT_NE(last, nullptr);
+    EXPECT_EQ(last->name, "L2");
+}
+
+TEST(Peephole, KeepsMovesAndStoresOfAnotherSize) {
+    const auto eax = target::HardcodedRegister{target::BaseRegister::AX, 4};
+    const auto rax = target::HardcodedRegister{target::BaseRegister::AX, 8};
+    auto frame = target::Frame{.name = "main", .instructions = {}, .size = 8};
+    auto& code = frame.instructions;
+    // the store writes all 8 bytes of the slot the load read 4 of
+    code.emplace_back(target::Load{.dst = eax, .src = {8}});
+    code.emplace_back(target::Store{.dst = {8}, .src = rax});
+    // zero extends rax
+    code.emplace_back(target::Mov{.dst = rax, .src = eax});
+
+    auto stats = target::PeepholeStats{};
+    EXPECT_EQ(target::Peephole(frame, stats), 0);
+    EXPECT_EQ(code.size(), 3);
+}
+
+TEST(Codegen, LeafSlotsUseTheRedZoneAndRspAddressesWithoutFramePointer) {
+    const auto eax = target::HardcodedRegister{target::BaseRegister::AX, 4};
+    auto leafFrame =
+        target::Frame{.name = "leaf", .instructions = {}, .size = 4};
+    leafFrame.instructions.emplace_back(target::Store{.dst = {4}, .src = eax});
+    leafFrame.instructions.emplace_back(target::Load{.dst = eax, .src = {4}});
+    auto mainFrame =
+        target::Frame{.name = "main", .instructions = {}, .size = 4};
+    mainFrame.instructions.emplace_back(target::Store{.dst = {4}, .src = eax});
+    mainFrame.instructions.emplace_back(
+        target::Call{.name = "leaf", .dst = eax});
+    const std::vector<target::Frame> frames = {leafFrame, mainFrame};
+
+    const auto framed = codegen::Generate(frames);
+    const auto leaf = framed.substr(0, framed.find("main:"));
+    EXPECT_EQ(leaf.find("sub rsp"), std::string::npos);
+    EXPECT_NE(leaf.find("mov dword [rbp - 4], eax"), std::string::npos);
+    EXPECT_NE(leaf.find("pop rbp"), std::string::npos);
+    EXPECT_NE(framed.find("sub rsp, 16"), std::string::npos);
+
+    const auto omitted = codegen::Generate(
+        frames, codegen::FrameOptions{.omitFramePointer = true});
+    EXPECT_EQ(omitted.find("rbp"), std::string::npos);
+    // the leaf's slots lie below its return address, the caller moves rsp
+    // by 8 so that the call sees it 16 byte aligned
+    EXPECT_NE(omitted.find("mov dword [rsp - 4], eax"), std::string::npos);
+    EXPECT_NE(omitted.find("sub rsp, 8"), std::string::npos);
+    EXPECT_NE(omitted.find("mov dword [rsp + 4], eax"), std::string::npos);
+    EXPECT_NE(omitted.find("add rsp, 8"), std::string::npos);
+}
+
+/** Pass manager **/
+
+TEST(PassManager, PresetsAndCustomPipelines) {
+    EXPECT_TRUE(passes::Preset(passes::OptLevel::O0).empty());
+    const auto o2 = passes::Preset(passes::OptLevel::O2);
+    const auto os = passes::Preset(passes::OptLevel::Os);
+    EXPECT_NE(std::ranges::find(o2, "unroll"), o2.end());
+    EXPECT_EQ(std::ranges::find(os, "unroll"), os.end());
+    for (const auto level : {passes::OptLevel::O0, passes::OptLevel::O1,
+                             passes::OptLevel::O2, passes::OptLevel::Os}) {
+        EXPECT_NO_THROW(passes::PassManager(passes::Preset(level), {}));
+    }
+
+    using Names = std::vector<std::string>;
+    EXPECT_THROW(passes::PassManager(Names{"sccp", "bogus"}, {}),
+                 std::invalid_argument);
+    // out of SSA form after coalescing, it is not built a second time
+    EXPECT_THROW(passes::PassManager(Names{"sccp", "coalesce", "dce"}, {}),
+                 std::invalid_argument);
+    // coalescing may give a temp several assignments, which ConstructSSA
+    // does not rename
+    EXPECT_THROW(passes::PassManager(Names{"coalesce", "sccp"}, {}),
+                 std::invalid_argument);
+    EXPECT_THROW(passes::PassManager(Names{"peephole", "dce"}, {}),
+                 std::invalid_argument);
+    EXPECT_THROW(passes::PassManager(Names{"dce"}, {}, {"lowering"}),
+                 std::invalid_argument);
+    // LICM keeps the frame in SSA form for the passes after it
+    EXPECT_NO_THROW(passes::PassManager(Names{"licm", "simplify", "sccp"}, {}));
+    EXPECT_NO_THROW(passes::PassManager(Names{"tailrec", "sccp"}, {},
+                                        {"ssa", "lower", "sccp"}));
+}
+
+TEST(PassManager, EntersSSAFormForThePassesThatNeedIt) {
+    auto frames = std::vector<qa_ir::Frame>{make_sum_loop_frame()};
+    auto manager =
+        passes::PassManager({"tailrec", "sccp", "dce", "coalesce"}, {});
+    manager.RunIR(frames);
+
+    const auto& records = manager.Records();
+    auto names = std::vector<std::string>{};
+    for (const auto& record : records) {
+        names.push_back(record.name);
+        EXPECT_EQ(record.runs, 1);
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{"tailrec", "ssa", "sccp",
+                                               "dce", "out-of-ssa",
+                                               "coalesce"}));
+    // a label for the entry block, the phis of sum and i at the loop header
+    EXPECT_EQ(records[1].sizeAfter - records[1].sizeBefore, 3);
+    EXPECT_EQ(records[2].sizeBefore, records[1].sizeAfter);
+    for (const auto& op : frames[0].instructions) {
+        EXPECT_FALSE(std::holds_alternative<qa_ir::Phi>(op));
+    }
+
+    std::ostringstream stats;
+    manager.PrintStats(stats);
+    EXPECT_NE(stats.str().find("dce: "), std::string::npos);
+    EXPECT_EQ(stats.str().find("ssa"), std::string::npos);
+}
+
+TEST(PassManager, PrintsTheAssemblyAfterCodegen) {
+    const auto manager =
+        passes::PassManager(std::vector<std::string>{}, {}, {"codegen"});
+    testing::internal::CaptureStdout();
+    manager.PrintAfter("codegen", "main:\n    ret\n");
+    manager.PrintAfter("lower", "not asked for\n");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "; assembly after codegen\nmain:\n    ret\n");
+}
+
+/** Block layout **/
+
+// if (n == 0) return 0; i = 0; while (i < n) i = i + 1; return i; with the
+// loop's exit between its test and its body
+[[nodiscard]] auto make_early_return_loop_frame() -> qa_ir::Frame {
+    const auto n = qa_ir::Variable{.name = "n", .version = 1, .size = 4};
+    const auto i = qa_ir::Variable{.name = "i", .version = 1, .size = 4};
+    auto frame = qa_ir::Frame{.name = "f", .instructions = {}, .size = 0};
+    auto& ops = frame.instructions;
+    ops.emplace_back(qa_ir::LabelDef{.label = {"entry"}});
+    ops.emplace_back(qa_ir::Compare{.left = n, .right = 0});
+    ops.emplace_back(qa_ir::ConditionalJumpEqual{.trueLabel = {"early"},
+                                                 .falseLabel = {"init"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"early"}});
+    ops.emplace_back(qa_ir::Ret{.value = 0});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"init"}});
+    ops.emplace_back(qa_ir::Mov{.dst = i, .src = 0});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"test"}});
+    ops.emplace_back(qa_ir::Compare{.left = i, .right = n});
+    ops.emplace_back(qa_ir::ConditionalJumpLess{.trueLabel = {"body"},
+                                                .falseLabel = {"exit"}});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"exit"}});
+    ops.emplace_back(qa_ir::Ret{.value = i});
+    ops.emplace_back(qa_ir::LabelDef{.label = {"body"}});
+    ops.emplace_back(
+        qa_ir::Add{.dst = qa_ir::Temp{0, 4}, .left = i, .right = 1});
+    ops.emplace_back(qa_ir::Mov{.dst = i, .src = qa_ir::Temp{0, 4}});
+    ops.emplace_back(qa_ir::Jump{.label = {"test"}});
+    return frame;
+}
+
+TEST(Layout, LoopsFallIntoTheirTestAndEarlyReturnsGoLast) {
+    auto frame = make_early_return_loop_frame();
+    qa_ir::FrameAnalyses analyses(frame);
+    // init, body, test and early follow other blocks than before
+    EXPECT_EQ(qa_ir::PlaceBlocks(frame, analyses, {}), 4);
+
+    auto labels = std::vector<std::string>{};
+    auto aligned = std::vector<std::string>{};
+    auto jumps = 0;
+    for (const auto& op : frame.instructions) {
+        if (const auto* label = std::get_if<qa_ir::LabelDef>(&op)) {
+            labels.push_back(label->label.name);
+            if (label->align) {
+                aligned.push_back(label->label.name);
+            }
+        }
+        jumps += std::holds_alternative<qa_ir::Jump>(op) ? 1 : 0;
+    }
+    // the body falls into the test, which falls out of the loop, and init
+    // only reaches the test by a jump
+    EXPECT_EQ(labels, (std::vector<std::string>{"entry", "init", "body",
+                                                "test", "exit", "early"}));
+    EXPECT_EQ(aligned, std::vector<std::string>{"body"});
+    EXPECT_EQ(jumps, 1);
+
+    // laid out once, nothing moves any more
+    EXPECT_EQ(qa_ir::PlaceBlocks(frame, analyses, {}), 0);
+}
+
+TEST(Layout, LoopTopsStayUnalignedWhenAskedTo) {
+    auto frame = make_early_return_loop_frame();
+    qa_ir::FrameAnalyses analyses(frame);
+    EXPECT_EQ(qa_ir::PlaceBlocks(frame, analyses, {.alignLoops = false}), 4);
+    for (const auto& op : frame.instructions) {
+        if (const auto* label = std::get_if<qa_ir::LabelDef>(&op)) {
+            EXPECT_FALSE(label->align);
+        }
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
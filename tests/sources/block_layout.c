@@ -0,0 +1,33 @@
+// EXPECTED_RETURN: 114
+
+int find(int* values, int n, int wanted) {
+    if (n == 0) {
+        return 100;
+    }
+    for (int i = 0; i < n; i = i + 1) {
+        if (*values == wanted) {
+            return i;
+        }
+    }
+    return n;
+}
+
+int grid(int rows, int cols) {
+    int total = 0;
+    for (int r = 0; r < rows; r = r + 1) {
+        for (int c = 0; c < cols; c = c + 1) {
+            if (c > r) {
+                total = total + 1;
+            } else {
+                total = total + 2;
+            }
+        }
+    }
+    return total;
+}
+
+int main() {
+    int v = 7;
+    int* p = &v;
+    return find(p, 0, 7) + find(p, 4, 7) + find(p, 3, 1) + grid(3, 2);
+}
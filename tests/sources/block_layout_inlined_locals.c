@@ -0,0 +1,17 @@
+// EXPECTED_RETURN: 8
+
+int pick(int a) {
+    int* p = &a;
+    if (*p > 1) {
+        return a;
+    }
+    return a + 1;
+}
+
+int main() {
+    int s = 0;
+    for (int i = 0; i < 4; i = i + 1) {
+        s = s + pick(i);
+    }
+    return s;
+}
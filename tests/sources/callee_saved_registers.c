@@ -0,0 +1,19 @@
+// EXPECTED_RETURN: 98
+
+int twice(int x) {
+    return x + x;
+}
+
+int chain(int x) {
+    int a = twice(x);
+    int b = twice(a);
+    int c = twice(b);
+    return a + b + c;
+}
+
+int main() {
+    int p = chain(1);
+    int q = chain(2);
+    int r = chain(3);
+    return p + q + r - (p - q);
+}
@@ -0,0 +1,39 @@
+// EXPECTED_RETURN: 42
+
+int pick(int a, int b) {
+    int r = 0;
+    if (a > b) {
+        r = r + 1;
+    }
+    if (3 > a) {
+        r = r + 2;
+    }
+    if (a == 0) {
+        r = r + 4;
+    }
+    if (b == a) {
+        r = r + 8;
+    }
+    return r;
+}
+
+int address_taken(int n) {
+    int k = n;
+    int* p = &k;
+    int total = 0;
+    for (int i = 0; i < k; i = i + 1) {
+        total = total + 2;
+    }
+    if (k == 5) {
+        total = total + *p;
+    }
+    return total;
+}
+
+int main() {
+    int down = 0;
+    for (int j = 10; j > 0; j = j - 1) {
+        down = down + 1;
+    }
+    return pick(5, 3) + pick(0, 0) + pick(2, 7) + address_taken(5) + down;
+}
@@ -0,0 +1,16 @@
+// EXPECTED_RETURN: 22
+
+int sum(int** pp) {
+    int a = **pp + **pp;
+    **pp = 1;
+    int b = **pp + **pp;
+    return a + b;
+}
+
+int main() {
+    int x = 4;
+    int* p = &x;
+    int** pp = &p;
+    int s = sum(pp);
+    return s + x + (x + s);
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+// EXPECTED_RETURN: 42
+
+int max(int a, int b) {
+    if (a > b) {
+        return a;
+    }
+    return b;
+}
+
+int countdown(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return countdown(n - 1) + 1;
+}
+
+int sum_below(int* p, int bias) {
+    int n = *p;
+    int total = bias;
+    for (int i = 0; i < n; i = i + 1) {
+        total = total + i;
+        total = total - i;
+        total = total + 1;
+    }
+    int floor = max(total, bias);
+    return floor - bias;
+}
+
+int main() {
+    int x = max(3, 9);
+    int y = max(x, 4);
+    int n = 4;
+    return x + y + countdown(20) + sum_below(&n, 7);
+}
@@ -0,0 +1,18 @@
+// EXPECTED_RETURN: 42
+
+int accumulate(int* p, int n) {
+    int total = 0;
+    int* t = &total;
+    for (int i = 0; i < n; i = i + 1) {
+        total = total + *p;
+        total = total - 1;
+    }
+    int base = n + 3;
+    int more = base - *p;
+    return *t + more + base;
+}
+
+int main() {
+    int v = 4;
+    return accumulate(&v, 5) + 15;
+}
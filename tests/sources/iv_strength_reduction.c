@@ -0,0 +1,11 @@
+// EXPECTED_RETURN: 165
+
+int main() {
+    int total = 0;
+    int k = 3;
+    for (int i = 0; i < 10; i = i + 1) {
+        int j = i + i + i + k;
+        total = total + j;
+    }
+    return total;
+}
\ No newline at end of file
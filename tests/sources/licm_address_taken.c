@@ -0,0 +1,30 @@
+// EXPECTED_RETURN: 108
+
+int count(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i = i + 1) {
+        int v = s + i;
+        int* p = &v;
+        s = s + 1;
+    }
+    return s;
+}
+
+int keep(int a) {
+    int* p = &a;
+    return a + 2;
+}
+
+int main() {
+    int s = 0;
+    for (int i = 0; i < 5; i = i + 1) {
+        int v = s + i;
+        int* p = &v;
+        s = s + 1;
+    }
+    int total = 0;
+    for (int j = 0; j < 20; j = j + 1) {
+        total = total + keep(j);
+    }
+    return s + count(3) + (total - 130);
+}
@@ -0,0 +1,21 @@
+// EXPECTED_RETURN: 86
+
+int scale(int* p) {
+    int a = *p + 7;
+    int b = *p;
+    int total = 0;
+    int* t = &total;
+    for (int i = 0; i < 5; i = i + 1) {
+        total = total + (a + b);
+    }
+    int count = 0;
+    for (int j = 0; j < *p; j = j + 1) {
+        count = count + (a - b);
+    }
+    return *t + count;
+}
+
+int main() {
+    int n = 3;
+    return scale(&n);
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+// EXPECTED_RETURN: 16
+
+int main() {
+    int v = 1;
+    int* p = &v;
+    int s = 0;
+    for (int i = 0; i < 3; i = i + 1) {
+        s = s + v;
+        v = 5;
+    }
+    return s + *p;
+}
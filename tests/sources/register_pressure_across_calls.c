@@ -0,0 +1,9 @@
+// EXPECTED_RETURN: 10
+
+int id(int x) {
+    return x;
+}
+
+int main() {
+    return (id(1) + id(2)) + ((id(1) + id(2)) + (id(2) + id(2)));
+}
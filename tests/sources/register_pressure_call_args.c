@@ -0,0 +1,10 @@
+// EXPECTED_RETURN: 65
+
+int sum10(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j) {
+    return a + b + c + d + e + f + g + h + i + j;
+}
+
+int main() {
+    int x = 1;
+    return sum10(x + 1, x + 2, x + 3, x + 4, x + 5, x + 6, x + 7, x + 8, x + 9, x + 10);
+}
@@ -0,0 +1,18 @@
+// EXPECTED_RETURN: 130
+
+int main() {
+    int a = 1;
+    int b = 2;
+    int c = 3;
+    int d = 4;
+    int e = 5;
+    int f = 6;
+    int g = 7;
+    int h = 8;
+    int i = 9;
+    int j = 10;
+    int k = 11;
+    int l = 12;
+    return (a + b) + ((c + d) + ((e + f) + ((g + h) + ((i + j) + ((k + l) +
+           ((a + l) + ((b + k) + ((c + j) + (d + i)))))))));
+}
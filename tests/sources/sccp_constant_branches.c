@@ -0,0 +1,15 @@
+// EXPECTED_RETURN: 12
+
+int main() {
+    int debug = 0;
+    int result = 2;
+    if (debug == 1) {
+        result = 100;
+    } else {
+        result = result + 10;
+    }
+    for (int i = 0; i < debug; i = i + 1) {
+        result = result + 50;
+    }
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+// EXPECTED_RETURN: 226
+
+int steps(int* p) {
+    int n = *p;
+    int s = 3;
+    int c = 0;
+    for (int i = 0; i < n; i = i + 1) {
+        s = s + 2;
+        c = c + 1;
+    }
+    return s + c;
+}
+
+int main() {
+    int sum = 0;
+    int squares = 0;
+    for (int i = 0; i < 100; i = i + 1) {
+        sum = sum + i;
+        squares = squares + sum;
+    }
+    int n = 30;
+    int z = 0;
+    return squares - 166500 + sum - 4950 + steps(&n) + steps(&z) - 20;
+}
\ No newline at end of file
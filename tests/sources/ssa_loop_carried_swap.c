@@ -0,0 +1,12 @@
+// EXPECTED_RETURN: 55
+
+int main() {
+    int a = 0;
+    int b = 1;
+    for (int i = 0; i < 10; i = i + 1) {
+        int t = a;
+        a = b;
+        b = t + b;
+    }
+    return a;
+}
\ No newline at end of file
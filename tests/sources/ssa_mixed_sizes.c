@@ -0,0 +1,17 @@
+// EXPECTED_RETURN: 20
+
+int f1(int a0, int a1, int a2) {
+    int* p1 = &a0;
+    for (int i3 = -1; i3 < a0; i3 = i3 + 2) {
+        int v4 = a2;
+        if (a2 > 3) {
+            a2 = 20;
+        }
+        *p1 = v4;
+    }
+    return a2;
+}
+
+int main() {
+    return f1(30, 4, 14);
+}
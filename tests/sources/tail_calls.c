@@ -0,0 +1,36 @@
+// EXPECTED_RETURN: 42
+
+int count_down(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return count_down(n - 1, acc + 1);
+}
+
+int is_odd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return is_even(n - 1);
+}
+
+int is_even(int n) {
+    if (n == 0) {
+        return 1;
+    }
+    return is_odd(n - 1);
+}
+
+int weigh(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return a + b + c + d + e + f + g - h;
+}
+
+int rotate(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return weigh(h, a, b, c, d, e, f, g);
+}
+
+int main() {
+    int deep = count_down(1000000, 0) - 1000000;
+    int even = is_even(1000000) + is_odd(999999);
+    return deep + even + rotate(1, 2, 3, 4, 5, 6, 7, 8) + 18;
+}
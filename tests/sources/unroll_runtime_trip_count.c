@@ -0,0 +1,18 @@
+// EXPECTED_RETURN: 53
+
+int count(int* p) {
+    int total = 0;
+    int n = *p;
+    for (int i = 0; i < n; i = i + 1) {
+        total = total + i;
+        if (total > 100) {
+            total = total - 50;
+        }
+    }
+    return total;
+}
+
+int main() {
+    int n = 23;
+    return count(&n);
+}
\ No newline at end of file